@@ -18,8 +18,18 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #ifndef _SPINLOCK_H
 #define _SPINLOCK_H
 
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+Ticket lock. The low 32 bits are the ticket currently being served, the high
+32 bits are the next ticket to hand out. Waiters spin on their own ticket, so
+the lock is granted in FIFO order.
+*/
+
 #define SPINLOCK_DEFAULT_VALUE 0
-#define SPINLOCK_LOCKED_VALUE 1
+#define SPINLOCK_LOCKED_VALUE (1UL << 32)
 
 #ifdef __cplusplus
 extern "C" {
@@ -31,7 +41,29 @@ typedef unsigned long spinlock_t;
 #define spinlock_new(name) spinlock_t name = SPINLOCK_DEFAULT_VALUE
 
 void spinlock_acquire(spinlock_t* lock);
-void spinlock_release(spinlock_t* lock);
+bool spinlock_try_acquire(spinlock_t* lock);
+void spinlock_release(spinlock_t* lock); // no-op if the lock is not held
+
+#if _FROSTYOS_ENABLE_SPINLOCK_STATS
+
+#define SPINLOCK_STATS_TABLE_SIZE 1024
+
+struct spinlock_stats {
+    spinlock_t* lock;
+    void* firstCaller;
+    uint64_t acquireCount;
+    uint64_t contendedCount;
+    uint64_t totalSpinCycles;
+    uint64_t maxSpinCycles;
+};
+
+// Called from spinlock_acquire, must not take any locks itself
+void spinlock_stats_record(spinlock_t* lock, uint64_t spinCycles, void* caller);
+
+#endif
+
+void spinlock_stats_reset();
+void spinlock_stats_dump(fd_t fd); // prints a notice if stats are not enabled
 
 #ifdef __cplusplus
 }
@@ -94,6 +94,18 @@ void* memmove(void* dst, const void* src, const size_t n);
 int memcmp(const void* s1, const void* s2, const size_t n);
 bool memcmp_b(const void* s, uint8_t c, const size_t n);
 
+#ifdef __x86_64__
+
+#define X86_64_MEM_ERMS 1 // rep movsb/stosb beat a qword loop from a few hundred bytes
+#define X86_64_MEM_FSRM 2 // rep movsb is also fast for short copies
+
+#define X86_64_MEM_NT_THRESHOLD MiB(1) // copies this big or bigger bypass the cache
+
+// Selects the mem* variants, the generic ones without non-temporal stores are used until this is called
+void x86_64_SetMemFeatures(uint32_t features, size_t ntThreshold);
+
+#endif /* __x86_64__ */
+
 #define FLAG_SET(x, flag) x |= (flag)
 #define FLAG_UNSET(x, flag) x &= ~(flag)
 
@@ -15,28 +15,96 @@
 
 [bits 64]
 
+%ifdef _FROSTYOS_ENABLE_SPINLOCK_STATS
+extern spinlock_stats_record
+%endif
+
+; Ticket lock, see spinlock.h for the layout
+
 global spinlock_acquire
 spinlock_acquire:
     push rbp
     mov rbp, rsp
-.check:
-    lock bts QWORD [rdi], 0
-    jc .spin_with_pause
+    mov rax, 1 << 32
+    lock xadd QWORD [rdi], rax
+    mov rdx, rax
+    shr rdx, 32 ; our ticket
+    cmp eax, edx
+    jne .contended
+%ifdef _FROSTYOS_ENABLE_SPINLOCK_STATS
+    xor esi, esi
+    mov rdx, QWORD [rbp + 8]
+    call spinlock_stats_record
+%endif
     mov rsp, rbp
     pop rbp
     ret
 
+.contended:
+    mov r8d, edx
+%ifdef _FROSTYOS_ENABLE_SPINLOCK_STATS
+    rdtsc
+    shl rdx, 32
+    or rax, rdx
+    mov r9, rax
+%endif
 .spin_with_pause:
     pause
-    test QWORD [rdi], 1
-    jnz .spin_with_pause
-    jmp .check
+    cmp DWORD [rdi], r8d
+    jne .spin_with_pause
+%ifdef _FROSTYOS_ENABLE_SPINLOCK_STATS
+    rdtsc
+    shl rdx, 32
+    or rax, rdx
+    sub rax, r9
+    mov rsi, rax
+    mov rdx, QWORD [rbp + 8]
+    call spinlock_stats_record
+%endif
+    mov rsp, rbp
+    pop rbp
+    ret
+
+global spinlock_try_acquire
+spinlock_try_acquire:
+    push rbp
+    mov rbp, rsp
+    mov rax, QWORD [rdi]
+    mov rdx, rax
+    shr rdx, 32
+    cmp eax, edx
+    jne .fail ; already held
+    mov rdx, 1 << 32
+    add rdx, rax
+    lock cmpxchg QWORD [rdi], rdx
+    jne .fail
+%ifdef _FROSTYOS_ENABLE_SPINLOCK_STATS
+    xor esi, esi
+    mov rdx, QWORD [rbp + 8]
+    call spinlock_stats_record
+%endif
+    mov al, 1
+    mov rsp, rbp
+    pop rbp
+    ret
+.fail:
+    xor al, al
+    mov rsp, rbp
+    pop rbp
+    ret
 
 global spinlock_release
 spinlock_release:
     push rbp
     mov rbp, rsp
-    mov QWORD [rdi], 0
+    mov rax, QWORD [rdi]
+    mov rdx, rax
+    shr rdx, 32
+    cmp eax, edx
+    je .end ; not held
+    ; only the holder ever writes the low half, so this doesn't need to be locked
+    inc DWORD [rdi]
+.end:
     mov rsp, rbp
     pop rbp
-    ret
\ No newline at end of file
+    ret
@@ -15,34 +15,374 @@
 
 [bits 64]
 
+; must match util.h
+MEM_ERMS equ 1
+MEM_FSRM equ 2
+
+; Sizes up to 64 bytes are done with overlapping loads and stores of the first and last bytes, so there is no loop.
+; Above that it's rep movsb/stosb when the CPU says they're fast, otherwise a qword loop. Copies of memNTThreshold
+; or more use non-temporal stores. Only general purpose registers are used, the kernel doesn't save SIMD state.
+
+section .data
+
+memFeatures:
+    dd 0
+
+memNTThreshold:
+    dq -1
+
+section .text
+
+global x86_64_SetMemFeatures
+x86_64_SetMemFeatures:
+    mov DWORD [rel memFeatures], edi
+    mov QWORD [rel memNTThreshold], rsi
+    ret
+
 global memset
 memset:
-    push rbp
-    mov rbp, rsp
+    mov rax, rdi
+    movzx ecx, sil
+    mov r8, 0x0101010101010101
+    imul rcx, r8 ; value in every byte
+
+    cmp rdx, 16
+    ja .above16
+    cmp edx, 8
+    jae .8to16
+    cmp edx, 4
+    jae .4to7
+    test edx, edx
+    jz .done
+    mov r9, rdx
+    shr r9, 1
+    mov BYTE [rdi], cl
+    mov BYTE [rdi+r9], cl
+    mov BYTE [rdi+rdx-1], cl
+.done:
+    ret
+
+.4to7:
+    mov DWORD [rdi], ecx
+    mov DWORD [rdi+rdx-4], ecx
+    ret
 
-    push rdi
+.8to16:
+    mov QWORD [rdi], rcx
+    mov QWORD [rdi+rdx-8], rcx
+    ret
 
-    mov al, sil
+.above16:
+    cmp rdx, 64
+    ja .above64
+    mov QWORD [rdi], rcx
+    mov QWORD [rdi+8], rcx
+    mov QWORD [rdi+rdx-16], rcx
+    mov QWORD [rdi+rdx-8], rcx
+    cmp edx, 32
+    jbe .done
+    mov QWORD [rdi+16], rcx
+    mov QWORD [rdi+24], rcx
+    mov QWORD [rdi+rdx-32], rcx
+    mov QWORD [rdi+rdx-24], rcx
+    ret
+
+.above64:
+    cmp rdx, 256
+    jb .loop32
+    test DWORD [rel memFeatures], MEM_ERMS
+    jz .stosq
+    mov r9, rdi
+    mov eax, ecx
     mov rcx, rdx
     rep stosb
+    mov rax, r9
+    ret
 
-    pop rax
+.stosq:
+    mov QWORD [rdi+rdx-8], rcx
+    mov r9, rdi
+    mov rax, rcx
+    mov rcx, rdx
+    shr rcx, 3
+    rep stosq
+    mov rax, r9
+    ret
 
-    mov rsp, rbp
-    pop rbp
+.loop32:
+    mov QWORD [rdi+rdx-32], rcx
+    mov QWORD [rdi+rdx-24], rcx
+    mov QWORD [rdi+rdx-16], rcx
+    mov QWORD [rdi+rdx-8], rcx
+    mov r8, rdi
+    lea r9, [rdi+rdx-32]
+.l32:
+    mov QWORD [r8], rcx
+    mov QWORD [r8+8], rcx
+    mov QWORD [r8+16], rcx
+    mov QWORD [r8+24], rcx
+    add r8, 32
+    cmp r8, r9
+    jb .l32
     ret
 
 global memcpy
 memcpy:
-    push rbp
-    mov rbp, rsp
-
     mov rax, rdi
+    cmp rdx, 16
+    ja .above16
+    cmp edx, 8
+    jae .8to16
+    cmp edx, 4
+    jae .4to7
+    test edx, edx
+    jz .done
+    mov r9, rdx
+    shr r9, 1
+    movzx ecx, BYTE [rsi]
+    movzx r8d, BYTE [rsi+r9]
+    movzx r10d, BYTE [rsi+rdx-1]
+    mov BYTE [rdi], cl
+    mov BYTE [rdi+r9], r8b
+    mov BYTE [rdi+rdx-1], r10b
+.done:
+    ret
+
+.4to7:
+    mov ecx, DWORD [rsi]
+    mov r8d, DWORD [rsi+rdx-4]
+    mov DWORD [rdi], ecx
+    mov DWORD [rdi+rdx-4], r8d
+    ret
+
+.8to16:
+    mov rcx, QWORD [rsi]
+    mov r8, QWORD [rsi+rdx-8]
+    mov QWORD [rdi], rcx
+    mov QWORD [rdi+rdx-8], r8
+    ret
+
+.above16:
+    cmp rdx, 64
+    ja .above64
+    mov rcx, QWORD [rsi]
+    mov r8, QWORD [rsi+8]
+    mov r9, QWORD [rsi+rdx-16]
+    mov r10, QWORD [rsi+rdx-8]
+    mov QWORD [rdi], rcx
+    mov QWORD [rdi+8], r8
+    mov QWORD [rdi+rdx-16], r9
+    mov QWORD [rdi+rdx-8], r10
+    cmp edx, 32
+    jbe .done
+    mov rcx, QWORD [rsi+16]
+    mov r8, QWORD [rsi+24]
+    mov r9, QWORD [rsi+rdx-32]
+    mov r10, QWORD [rsi+rdx-24]
+    mov QWORD [rdi+16], rcx
+    mov QWORD [rdi+24], r8
+    mov QWORD [rdi+rdx-32], r9
+    mov QWORD [rdi+rdx-24], r10
+    ret
+
+.above64:
+    cmp rdx, QWORD [rel memNTThreshold]
+    jae .nt
+    mov ecx, DWORD [rel memFeatures]
+    cmp rdx, 256
+    jae .long
+    test ecx, MEM_FSRM
+    jz copy_forward
+.movsb:
     mov rcx, rdx
     rep movsb
+    ret
 
-    mov rsp, rbp
-    pop rbp
+.long:
+    test ecx, MEM_ERMS
+    jnz .movsb
+    mov r8, QWORD [rsi+rdx-8]
+    lea r9, [rdi+rdx-8]
+    mov rcx, rdx
+    shr rcx, 3
+    rep movsq
+    mov QWORD [r9], r8
+    ret
+
+.nt:
+    ; the buffers don't overlap, so the order of the stores doesn't matter
+    mov r8, QWORD [rsi]
+    mov r9, QWORD [rsi+rdx-8]
+    mov QWORD [rdi], r8
+    mov QWORD [rdi+rdx-8], r9
+    mov rcx, rdi
+    neg rcx
+    and ecx, 7
+    add rdi, rcx
+    add rsi, rcx
+    sub rdx, rcx
+    mov rcx, rdx
+    shr rcx, 6
+    jz .ntrest
+.nt64:
+    mov r8, QWORD [rsi]
+    mov r9, QWORD [rsi+8]
+    mov r10, QWORD [rsi+16]
+    mov r11, QWORD [rsi+24]
+    movnti QWORD [rdi], r8
+    movnti QWORD [rdi+8], r9
+    movnti QWORD [rdi+16], r10
+    movnti QWORD [rdi+24], r11
+    mov r8, QWORD [rsi+32]
+    mov r9, QWORD [rsi+40]
+    mov r10, QWORD [rsi+48]
+    mov r11, QWORD [rsi+56]
+    movnti QWORD [rdi+32], r8
+    movnti QWORD [rdi+40], r9
+    movnti QWORD [rdi+48], r10
+    movnti QWORD [rdi+56], r11
+    add rsi, 64
+    add rdi, 64
+    dec rcx
+    jnz .nt64
+.ntrest:
+    and edx, 63
+    shr edx, 3
+    jz .ntend
+.nt8:
+    mov r8, QWORD [rsi]
+    movnti QWORD [rdi], r8
+    add rsi, 8
+    add rdi, 8
+    dec edx
+    jnz .nt8
+.ntend:
+    sfence
+    ret
+
+; Forward copy for n >= 16 that is safe when dst < src, rax must already be set.
+; The tail is loaded before anything is stored.
+copy_forward:
+    mov r10, QWORD [rsi+rdx-16]
+    mov r11, QWORD [rsi+rdx-8]
+    lea r9, [rdi+rdx-16]
+    mov rcx, rdx
+    shr rcx, 4
+.l16:
+    mov r8, QWORD [rsi]
+    mov QWORD [rdi], r8
+    mov r8, QWORD [rsi+8]
+    mov QWORD [rdi+8], r8
+    add rsi, 16
+    add rdi, 16
+    dec rcx
+    jnz .l16
+    mov QWORD [r9], r10
+    mov QWORD [r9+8], r11
+    ret
+
+global memmove
+memmove:
+    mov rax, rdi
+    mov rcx, rdi
+    sub rcx, rsi
+    cmp rcx, rdx
+    jb .backward ; src <= dst < src + n
+    mov rcx, rsi
+    sub rcx, rdi
+    cmp rcx, rdx
+    jae memcpy ; no overlap
+    cmp rdx, 16
+    jae copy_forward
+.fbytes:
+    movzx ecx, BYTE [rsi]
+    mov BYTE [rdi], cl
+    inc rsi
+    inc rdi
+    dec rdx
+    jnz .fbytes
+    ret
+
+.backward:
+    test rcx, rcx
+    jz .done
+    cmp rdx, 8
+    jb .bbytes
+    ; qwords from the end down, the head is loaded first and stored last
+    mov r8, QWORD [rsi]
+    lea rsi, [rsi+rdx-8]
+    lea r9, [rdi+rdx-8]
+    mov rcx, rdx
+    shr rcx, 3
+.b8:
+    mov r10, QWORD [rsi]
+    mov QWORD [r9], r10
+    sub rsi, 8
+    sub r9, 8
+    dec rcx
+    jnz .b8
+    mov QWORD [rdi], r8
+    ret
+
+.bbytes:
+    movzx ecx, BYTE [rsi+rdx-1]
+    mov BYTE [rdi+rdx-1], cl
+    dec rdx
+    jnz .bbytes
+.done:
+    ret
+
+global memcmp
+memcmp:
+    xor eax, eax
+    cmp rdx, 8
+    jb .bytes
+.q:
+    mov rcx, QWORD [rdi]
+    mov r8, QWORD [rsi]
+    cmp rcx, r8
+    jne .diff
+    add rdi, 8
+    add rsi, 8
+    sub rdx, 8
+    cmp rdx, 8
+    jae .q
+    test edx, edx
+    jz .done
+    ; the last qword overlaps bytes already known to be equal
+    mov rcx, QWORD [rdi+rdx-8]
+    mov r8, QWORD [rsi+rdx-8]
+    cmp rcx, r8
+    jne .diff
+.done:
+    ret
+
+.diff:
+    ; the first differing byte is the most significant one after swapping
+    bswap rcx
+    bswap r8
+    cmp rcx, r8
+    sbb eax, eax
+    or eax, 1
+    ret
+
+.bytes:
+    test edx, edx
+    jz .done
+.b:
+    movzx ecx, BYTE [rdi]
+    movzx r8d, BYTE [rsi]
+    cmp ecx, r8d
+    jne .bdiff
+    inc rdi
+    inc rsi
+    dec edx
+    jnz .b
+    ret
+
+.bdiff:
+    sbb eax, eax
+    or eax, 1
     ret
 
 global memcmp_b
@@ -0,0 +1,102 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <spinlock.h>
+#include <stdio.h>
+
+#if _FROSTYOS_ENABLE_SPINLOCK_STATS
+
+struct spinlock_stats g_spinlockStats[SPINLOCK_STATS_TABLE_SIZE];
+uint64_t g_spinlockStatsDropped = 0;
+
+// Open addressing keyed on the lock address, slots are claimed with a CAS so no lock is needed
+static struct spinlock_stats* spinlock_stats_find(spinlock_t* lock, bool create) {
+    uint64_t hash = ((uint64_t)lock >> 3) * 0x9E3779B97F4A7C15UL;
+    for (uint64_t i = 0; i < SPINLOCK_STATS_TABLE_SIZE; i++) {
+        struct spinlock_stats* stats = &g_spinlockStats[(hash + i) % SPINLOCK_STATS_TABLE_SIZE];
+        spinlock_t* current = __atomic_load_n(&stats->lock, __ATOMIC_ACQUIRE);
+        if (current == lock)
+            return stats;
+        if (current != NULL)
+            continue;
+        if (!create)
+            return NULL;
+        spinlock_t* expected = NULL;
+        if (__atomic_compare_exchange_n(&stats->lock, &expected, lock, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) || expected == lock)
+            return stats;
+    }
+    return NULL;
+}
+
+void spinlock_stats_record(spinlock_t* lock, uint64_t spinCycles, void* caller) {
+    struct spinlock_stats* stats = spinlock_stats_find(lock, true);
+    if (stats == NULL) {
+        __atomic_add_fetch(&g_spinlockStatsDropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    void* expected = NULL;
+    __atomic_compare_exchange_n(&stats->firstCaller, &expected, caller, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stats->acquireCount, 1, __ATOMIC_RELAXED);
+    if (spinCycles == 0)
+        return;
+
+    __atomic_add_fetch(&stats->contendedCount, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stats->totalSpinCycles, spinCycles, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&stats->maxSpinCycles, __ATOMIC_RELAXED);
+    while (spinCycles > max && !__atomic_compare_exchange_n(&stats->maxSpinCycles, &max, spinCycles, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+void spinlock_stats_reset() {
+    for (uint64_t i = 0; i < SPINLOCK_STATS_TABLE_SIZE; i++) {
+        struct spinlock_stats* stats = &g_spinlockStats[i];
+        __atomic_store_n(&stats->acquireCount, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&stats->contendedCount, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&stats->totalSpinCycles, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&stats->maxSpinCycles, 0, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&g_spinlockStatsDropped, 0, __ATOMIC_RELAXED);
+}
+
+void spinlock_stats_dump(fd_t fd) {
+    // Only contended locks are interesting, and the table is far too big to print whole
+    fprintf(fd, "Spinlocks with contention (lock, first caller, acquires, contended, average spin, max spin):\n");
+    for (uint64_t i = 0; i < SPINLOCK_STATS_TABLE_SIZE; i++) {
+        struct spinlock_stats* stats = &g_spinlockStats[i];
+        spinlock_t* lock = __atomic_load_n(&stats->lock, __ATOMIC_ACQUIRE);
+        uint64_t contended = __atomic_load_n(&stats->contendedCount, __ATOMIC_RELAXED);
+        if (lock == NULL || contended == 0)
+            continue;
+        uint64_t acquires = __atomic_load_n(&stats->acquireCount, __ATOMIC_RELAXED);
+        uint64_t total = __atomic_load_n(&stats->totalSpinCycles, __ATOMIC_RELAXED);
+        fprintf(fd, "\t%p %p: %lu, %lu (%lu%%), %lu cycles, %lu cycles\n", lock, stats->firstCaller, acquires, contended, acquires > 0 ? contended * 100 / acquires : 0, total / contended, __atomic_load_n(&stats->maxSpinCycles, __ATOMIC_RELAXED));
+    }
+    uint64_t dropped = __atomic_load_n(&g_spinlockStatsDropped, __ATOMIC_RELAXED);
+    if (dropped > 0)
+        fprintf(fd, "Spinlock stats table full, %lu acquires not recorded\n", dropped);
+}
+
+#else
+
+void spinlock_stats_reset() {
+
+}
+
+void spinlock_stats_dump(fd_t fd) {
+    fprintf(fd, "Spinlock stats are not enabled, rebuild with FROSTYOS_ENABLE_SPINLOCK_STATS\n");
+}
+
+#endif /* _FROSTYOS_ENABLE_SPINLOCK_STATS */
@@ -15,31 +15,49 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <stdint.h>
 #include <string.h>
 #include <errno.h>
 
-size_t strlen(const char* str) {
-    size_t len = 0;
+// Word at a time helpers. An aligned word never crosses a page boundary, so reading past the terminator is safe.
+typedef size_t __attribute__((may_alias)) word_t;
+typedef size_t __attribute__((may_alias, aligned(1))) unaligned_word_t;
 
-    char c = str[len];
+#define WORD_ONES ((size_t)-1 / 0xFF)
+#define WORD_HIGHS (WORD_ONES * 0x80)
+#define WORD_HAS_ZERO(x) (((x) - WORD_ONES) & ~(x) & WORD_HIGHS)
+#define WORD_PAGE_SIZE 4096
 
-    while (c != 0) {
-        len++;
-        c = str[len];
+__attribute__((no_sanitize("address","kernel-address"))) size_t strlen(const char* str) {
+    const char* s = str;
+    for (; ((uintptr_t)s % sizeof(word_t)) != 0; s++) {
+        if (*s == 0)
+            return s - str;
     }
 
-    return len;
+    const word_t* w = (const word_t*)s;
+    while (!WORD_HAS_ZERO(*w))
+        w++;
+
+    s = (const char*)w;
+    while (*s != 0)
+        s++;
+
+    return s - str;
 }
 
-size_t strnlen(const char* str, size_t maxlen) {
+__attribute__((no_sanitize("address","kernel-address"))) size_t strnlen(const char* str, size_t maxlen) {
     size_t len = 0;
+    for (; len < maxlen && ((uintptr_t)&str[len] % sizeof(word_t)) != 0; len++) {
+        if (str[len] == 0)
+            return len;
+    }
 
-    char c = str[len];
+    while (maxlen - len >= sizeof(word_t) && !WORD_HAS_ZERO(*(const word_t*)&str[len]))
+        len += sizeof(word_t);
 
-    while (c != 0 && len < maxlen) {
+    while (len < maxlen && str[len] != 0)
         len++;
-        c = str[len];
-    }
 
     return len;
 }
@@ -68,9 +86,17 @@ char* strncpy(char* dst, const char* src, size_t n) {
     return dst;
 }
 
-int strcmp(const char* str1, const char* str2) {
+__attribute__((no_sanitize("address","kernel-address"))) int strcmp(const char* str1, const char* str2) {
     size_t i = 0;
     while (1) {
+        // str1 is read aligned, str2 only when the word doesn't cross into the next page
+        if (((uintptr_t)&str1[i] % sizeof(word_t)) == 0 && ((uintptr_t)&str2[i] % WORD_PAGE_SIZE) <= WORD_PAGE_SIZE - sizeof(word_t)) {
+            size_t a = *(const word_t*)&str1[i];
+            if (a == *(const unaligned_word_t*)&str2[i] && !WORD_HAS_ZERO(a)) {
+                i += sizeof(word_t);
+                continue;
+            }
+        }
         if (str1[i] != str2[i]) {
             return str1[i] > str2[i] ? 1 : -1;
         }
@@ -18,7 +18,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <stddef.h>
 #include <util.h>
 
-// Faster assembly alternatives for memset, memcpy and memcmp_b are used on x86_64 when KASAN is off
+// Faster assembly alternatives for memset, memcpy, memmove and memcmp are used on x86_64 when KASAN is off, memcmp_b always
 #if !(defined(__x86_64__)) || _FROSTYOS_ENABLE_KASAN
 
 void* memset(void* dst, const uint8_t value, const size_t n) {
@@ -44,6 +44,35 @@ void* memcpy(void* dst, const void* src, const size_t n) {
     return dst;
 }
 
+void* memmove(void* dst, const void* src, const size_t n) {
+    // OK, since we know that memcpy copies forwards
+    if (dst < src) {
+        return memcpy(dst, src, n);
+    }
+
+    uint8_t *d = (uint8_t*) dst;
+    const uint8_t *s = (const uint8_t*) src;
+
+    for (size_t i = n; i > 0; i--) {
+        d[i - 1] = s[i - 1];
+    }
+
+    return dst;
+}
+
+int memcmp(const void* s1, const void* s2, const size_t n) {
+    const uint8_t* src1 = (const uint8_t*)s1;
+    const uint8_t* src2 = (const uint8_t*)s2;
+
+    for (size_t i = 0; i < n; i++) {
+        if (src1[i] != src2[i]) {
+            return src1[i] > src2[i] ? 1 : -1;
+        }
+    }
+
+    return 0;
+}
+
 #endif /* !(defined(__x86_64__)) || _FROSTYOS_ENABLE_KASAN */
 
 #ifndef __x86_64__
@@ -62,22 +91,6 @@ __attribute__((no_sanitize("address","kernel-address"))) bool memcmp_b(const voi
 
 #endif /* __x86_64__ */
 
-void* memmove(void* dst, const void* src, const size_t n) {
-    // OK, since we know that memcpy copies forwards
-    if (dst < src) {
-        return memcpy(dst, src, n);
-    }
-
-    uint8_t *d = (uint8_t*) dst;
-    const uint8_t *s = (const uint8_t*) src;
-
-    for (size_t i = n; i > 0; i--) {
-        d[i - 1] = s[i - 1];
-    }
-
-    return dst;
-}
-
 /*
 Uses 64-bit operations to quick fill a buffer.
 dst is where you write to
@@ -130,16 +143,3 @@ void* fast_memmove(void* dst, const void* src, const size_t n) {
 
     return dst;
 }
-
-int memcmp(const void* s1, const void* s2, const size_t n) {
-    const uint8_t* src1 = (const uint8_t*)s1;
-    const uint8_t* src2 = (const uint8_t*)s2;
-
-    for (size_t i = 0; i < n; i++) {
-        if (src1[i] != src2[i]) {
-            return src1[i] > src2[i] ? 1 : -1;
-        }
-    }
-
-    return 0;
-}
@@ -16,6 +16,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include "ELF.hpp"
+#include "VDSO.hpp"
 
 #include <errno.h>
 #include <stdint.h>
@@ -27,6 +28,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <DataStructures/LinkedList.hpp>
 
 #include <Memory/PageMapper.hpp>
+#include <Memory/UserAccess.hpp>
 #include <Memory/VMM.hpp>
 
 #include <Scheduling/Process.hpp>
@@ -212,7 +214,9 @@ int LoadELFFile(const char* path, void* base, Process* proc, void** entry, auxv6
                     return -ENOMEM;
                 }
 
+                UserAccessBegin();
                 rc = ReadExact(vnode, (void*)phdr.p_vaddr, lastPageCount, phdr.p_offset, cred);
+                UserAccessEnd();
                 if (rc < 0) {
                     vnode->Unlock();
                     FS::VFS_Close(vnode, cred);
@@ -314,7 +318,8 @@ void* PrepareELFStack(void* stackTop, auxv64list_t* auxv64, char** argv, char**
     auxv64->execfn.a_type = AT_EXECFN;
     auxv64->execfn.a_val = (uint64_t)pathDataStart;
     
-    // TODO: user access begin?
+    UserAccessBegin();
+
     memcpy(pathDataStart, path, pathSize);
 
     memcpy(auxvStart, auxv64, sizeof(auxv64list_t));
@@ -335,7 +340,7 @@ void* PrepareELFStack(void* stackTop, auxv64list_t* auxv64, char** argv, char**
     envStart[envc] = nullptr;
     *argcPoint = argc;
 
-    // TODO: user access end?
+    UserAccessEnd();
     return argcPoint;
 }
 
@@ -390,6 +395,11 @@ int CreateELFProcess(const char* path, Process* parent, char** argv, char** env,
         delete interp;
     }
 
+    // a process without the vDSO just uses the system calls
+    void* vdso = VDSO_Map(vmm);
+    auxv64.vdsoData.a_type = vdso == nullptr ? AT_IGNORE : AT_VDSO_DATA;
+    auxv64.vdsoData.a_val = (uint64_t)vdso;
+
     if (!proc->CreateMainThread({(void (*)(void*))entry, nullptr})) {
         g_KPageMapper->SwapToThis();
         proc->Delete();
@@ -94,6 +94,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #define AT_EGID 14
 #define AT_SECURE 23
 #define AT_EXECFN 31
+#define AT_VDSO_DATA 0x1000 // FrostyOS specific, address of the read-only VDSOData page
 
 
 struct Elf64_Ehdr {
@@ -137,6 +138,7 @@ struct auxv64list_t {
     auxv64_t execfn;
     auxv64_t secure;
     auxv64_t pagesz;
+    auxv64_t vdsoData;
     auxv64_t null;
 };
 
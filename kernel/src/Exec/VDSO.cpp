@@ -0,0 +1,159 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "VDSO.hpp"
+#include "VDSOData.h"
+
+#include <errno.h>
+#include <spinlock.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <util.h>
+
+#include <HAL/Time.hpp>
+
+#include <Memory/Pager.hpp>
+#include <Memory/PagingUtil.hpp>
+#include <Memory/PMM.hpp>
+#include <Memory/VMM.hpp>
+
+#ifdef __x86_64__
+#include <arch/x86_64/TSC.hpp>
+#endif
+
+VMM::MemoryObject* g_VDSOObject = nullptr;
+VDSOData* g_VDSOData = nullptr;
+spinlock_new(g_VDSOWriteLock);
+
+static void VDSO_BeginUpdate() {
+    spinlock_acquire(&g_VDSOWriteLock);
+    __atomic_store_n(&g_VDSOData->sequence, g_VDSOData->sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void VDSO_EndUpdate() {
+    __atomic_store_n(&g_VDSOData->sequence, g_VDSOData->sequence + 1, __ATOMIC_RELEASE);
+    spinlock_release(&g_VDSOWriteLock);
+}
+
+void VDSO_Init() {
+    void* phys = g_PMM->AllocatePage();
+    if (phys == nullptr)
+        return;
+    memset(to_HHDM(phys), 0, PAGE_SIZE);
+
+    VMM::MemoryObject* obj = static_cast<VMM::MemoryObject*>(kcalloc_vmm(1, sizeof(VMM::MemoryObject)));
+    VMM::Page* page = static_cast<VMM::Page*>(kcalloc_vmm(1, sizeof(VMM::Page)));
+    if (obj == nullptr || page == nullptr) {
+        kfree_vmm(obj);
+        kfree_vmm(page);
+        g_PMM->FreePage(phys);
+        return;
+    }
+    page->physAddr = (uint64_t)phys;
+    page->protection = VMM::Protection::READ;
+    page->isWired = true;
+    obj->pages.Insert(0, page);
+    obj->size = 1;
+    obj->refCount = 1; // never dropped, so the page is never freed
+    obj->pager = &VMM::g_wiredPager;
+
+    g_VDSOData = static_cast<VDSOData*>(to_HHDM(phys));
+    g_VDSOObject = obj;
+
+#ifdef __x86_64__
+    // same conversion as the kernel, so user and kernel time always agree
+    if (HAL_IsTSCClock()) {
+        const x86_64_TSCClock* clock = x86_64_GetTSCClock();
+        VDSO_SetClock(VDSO_CLOCK_MODE_TSC, clock->tscBase, clock->nsBase, clock->mult, clock->shift);
+    }
+#endif
+
+    int64_t epoch = HAL_GetUnixEpochTime();
+    if (epoch != INT64_MAX)
+        VDSO_SetRealTime(epoch * 1'000'000'000);
+}
+
+void VDSO_SetClock(uint32_t mode, uint64_t tscBase, uint64_t nsBase, uint64_t mult, uint32_t shift) {
+    if (g_VDSOData == nullptr)
+        return;
+    VDSO_BeginUpdate();
+    g_VDSOData->clockMode = mode;
+    g_VDSOData->tscBase = tscBase;
+    g_VDSOData->nsBase = nsBase;
+    g_VDSOData->mult = mult;
+    g_VDSOData->shift = shift;
+    VDSO_EndUpdate();
+}
+
+void VDSO_SetRealTime(int64_t epochNs) {
+    if (g_VDSOData == nullptr)
+        return;
+    timespec now;
+    uint64_t monotonic;
+    if (VDSO_ClockGet(g_VDSOData, CLOCK_MONOTONIC, &now) == 0)
+        monotonic = now.tv_sec * 1'000'000'000UL + now.tv_nsec;
+    else
+        monotonic = HAL_GetNSTicks();
+    VDSO_BeginUpdate();
+    g_VDSOData->bootEpochNs = epochNs - (int64_t)monotonic;
+    g_VDSOData->realtimeValid = 1;
+    VDSO_EndUpdate();
+}
+
+int VDSO_KernelClockGet(int clock, timespec* ts) {
+    if (g_VDSOData != nullptr && VDSO_ClockGet(g_VDSOData, clock, ts) == 0)
+        return ESUCCESS;
+
+    int64_t ns;
+    switch (clock) {
+    case CLOCK_REALTIME:
+        if (g_VDSOData != nullptr && __atomic_load_n(&g_VDSOData->realtimeValid, __ATOMIC_ACQUIRE))
+            ns = g_VDSOData->bootEpochNs + HAL_GetNSTicks();
+        else {
+            int64_t epoch = HAL_GetUnixEpochTime();
+            if (epoch == INT64_MAX)
+                return -ENOSYS;
+            ns = epoch * 1'000'000'000;
+        }
+        break;
+    case CLOCK_MONOTONIC:
+    case CLOCK_BOOTTIME:
+        ns = HAL_GetNSTicks();
+        break;
+    default:
+        return -EINVAL;
+    }
+
+    ts->tv_sec = ns / 1'000'000'000;
+    ts->tv_nsec = ns % 1'000'000'000;
+    return ESUCCESS;
+}
+
+void* VDSO_Map(VMM::VMM* vmm) {
+    if (g_VDSOObject == nullptr || vmm == nullptr)
+        return nullptr;
+
+    VMM::AllocFlags flags = VMM::DEFAULT_ALLOC_FLAGS;
+    flags.protection = VMM::Protection::READ;
+    flags.isPrivate = false;
+    flags.zero = false;
+    flags.allocPhys = true;
+    return vmm->AllocateBackedPages(1, g_VDSOObject, 0, nullptr, flags);
+}
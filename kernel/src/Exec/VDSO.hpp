@@ -0,0 +1,40 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _VDSO_HPP
+#define _VDSO_HPP
+
+#include <stdint.h>
+#include <time.h>
+
+#include "VDSOData.h"
+
+namespace VMM {
+    class VMM;
+}
+
+void VDSO_Init(); // after time keeping is up
+
+// Both are published under the sequence lock
+void VDSO_SetClock(uint32_t mode, uint64_t tscBase, uint64_t nsBase, uint64_t mult, uint32_t shift);
+void VDSO_SetRealTime(int64_t epochNs); // the current real time, in ns since the unix epoch
+
+int VDSO_KernelClockGet(int clock, timespec* ts); // same clock as user mode sees, falling back to HAL time without the TSC
+
+void* VDSO_Map(VMM::VMM* vmm); // maps the data page read-only into vmm, nullptr on failure
+
+#endif /* _VDSO_HPP */
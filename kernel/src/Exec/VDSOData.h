@@ -0,0 +1,80 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _VDSO_DATA_H
+#define _VDSO_DATA_H
+
+// Layout of the read-only page mapped into every process, found through the AT_VDSO_DATA auxv entry.
+// This is ABI: only ever append fields. Plain C so libc can include it as is.
+
+#include <stdint.h>
+#include <time.h>
+
+#define VDSO_CLOCK_MODE_NONE 0 // no usable user mode clock, use the clockget system call
+#define VDSO_CLOCK_MODE_TSC 1
+
+struct VDSOData {
+    uint32_t sequence; // odd while the kernel is updating the fields below
+    uint32_t clockMode;
+    uint64_t tscBase; // monotonic ns = nsBase + (((tsc - tscBase) * mult) >> shift), with a 128-bit product
+    uint64_t nsBase;
+    uint64_t mult;
+    uint32_t shift;
+    uint32_t realtimeValid;
+    int64_t bootEpochNs; // realtime ns at monotonic 0
+};
+
+#ifdef __x86_64__
+__extension__ typedef unsigned __int128 VDSO_uint128_t;
+
+static inline uint64_t VDSO_ReadTSC(void) {
+    uint32_t low, high;
+    __asm__ volatile("lfence; rdtsc" : "=a"(low), "=d"(high) :: "memory");
+    return ((uint64_t)high << 32) | low;
+}
+#endif
+
+// Returns 0 on success, or -1 if the caller has to make the system call instead
+static inline int VDSO_ClockGet(const volatile struct VDSOData* data, int clock, struct timespec* ts) {
+    if (clock != CLOCK_REALTIME && clock != CLOCK_MONOTONIC && clock != CLOCK_BOOTTIME)
+        return -1;
+
+    uint32_t seq;
+    uint64_t ns;
+    int realtime = clock == CLOCK_REALTIME;
+    do {
+        seq = __atomic_load_n(&data->sequence, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+            continue;
+#ifdef __x86_64__
+        if (data->clockMode != VDSO_CLOCK_MODE_TSC || (realtime && !data->realtimeValid))
+            return -1;
+        ns = data->nsBase + (uint64_t)(((VDSO_uint128_t)(VDSO_ReadTSC() - data->tscBase) * data->mult) >> data->shift);
+        if (realtime)
+            ns += data->bootEpochNs;
+#else
+        return -1;
+#endif
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || __atomic_load_n(&data->sequence, __ATOMIC_RELAXED) != seq);
+
+    ts->tv_sec = ns / 1000000000;
+    ts->tv_nsec = ns % 1000000000;
+    return 0;
+}
+
+#endif /* _VDSO_DATA_H */
@@ -41,6 +41,7 @@ public:
 
     virtual void Halt(bool wait = true) = 0;
     virtual void Yield(bool forceSwitch = false) = 0;
+    virtual void SendReschedule() = 0; // asynchronous, makes this processor re-run the scheduler soon
 
     virtual inline bool isBSP() const { return m_BSP; }
 
@@ -55,6 +56,7 @@ public:
     
     static int DisableInterrupts(); // return value is an arch-specific state
     static void EnableInterrupts(int prevState = -1);
+    static bool AreInterruptsEnabled();
 
     static void SwapStack(void (*func)(void*), void* data, void* stack); // Should only return on error
     static void SwapStackWithReturn(void (*func)(uint64_t, void*), uint64_t a, void* b, void* stack);
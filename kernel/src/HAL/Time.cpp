@@ -21,28 +21,85 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "drivers/HPET.hpp"
 
 #include <stdint.h>
+#include <stdio.h>
 #include <util.h>
 
+#include <Exec/VDSO.hpp>
+
 #include <Scheduling/Scheduler.hpp>
 
 #ifdef __x86_64__
 #include <arch/x86_64/CMOS.hpp>
 #include <arch/x86_64/Processor.hpp>
+#include <arch/x86_64/TSC.hpp>
 
 #include <arch/x86_64/interrupts/APIC/LocalAPIC.hpp>
 #endif
 
+#define HAL_WATCHDOG_INTERVAL 1'000'000'000 // ns
+#define HAL_WATCHDOG_MAX_DRIFT_SHIFT 8 // the TSC may drift from the HPET by up to 1/256 per interval
+
+enum class HAL_ClockSource {
+    TICKS,
+    HPET,
+    TSC
+};
+
 uint64_t g_HALTimerTicks = 0; // in ms
 bool g_HALTimeReady = false;
+HAL_ClockSource g_HALClockSource = HAL_ClockSource::TICKS;
+int64_t g_HALClockOffset = 0; // added to the HPET or tick time after switching away from the TSC
+
+uint64_t g_HALWatchdogHPET = 0;
+uint64_t g_HALWatchdogTSC = 0;
 
 void HAL_InitTime() {
+    if (g_HPET != nullptr)
+        g_HALClockSource = HAL_ClockSource::HPET; // the LAPIC timer is calibrated against it
     g_BSP->InitTime();
+#ifdef __x86_64__
+    if (x86_64_TSCClockInit(HAL_GetNSTicks())) {
+        if (g_HPET != nullptr) {
+            g_HALWatchdogHPET = g_HPET->GetNSTicks();
+            g_HALWatchdogTSC = x86_64_ReadTSCFence();
+        }
+        __atomic_store_n(&g_HALClockSource, HAL_ClockSource::TSC, __ATOMIC_RELEASE);
+        printf("Using the TSC as the clock source, %lu kHz\n", x86_64_GetTSCFrequency() / 1000);
+    }
+#endif
     g_HALTimeReady = true;
 }
 
+// Checks the TSC against the HPET, as the TSC can still stop or change speed on broken hardware
+static void HAL_ClockWatchdog() {
+#ifdef __x86_64__
+    if (g_HPET == nullptr || __atomic_load_n(&g_HALClockSource, __ATOMIC_ACQUIRE) != HAL_ClockSource::TSC)
+        return;
+
+    uint64_t hpetNow = g_HPET->GetNSTicks();
+    uint64_t hpetDelta = hpetNow - g_HALWatchdogHPET;
+    if (hpetDelta < HAL_WATCHDOG_INTERVAL)
+        return;
+
+    uint64_t tscNow = x86_64_ReadTSCFence();
+    const x86_64_TSCClock* clock = x86_64_GetTSCClock();
+    uint64_t tscDelta = x86_64_TSCToNS(clock, tscNow) - x86_64_TSCToNS(clock, g_HALWatchdogTSC);
+    g_HALWatchdogHPET = hpetNow;
+    g_HALWatchdogTSC = tscNow;
+
+    uint64_t drift = tscDelta > hpetDelta ? tscDelta - hpetDelta : hpetDelta - tscDelta;
+    if (drift > (hpetDelta >> HAL_WATCHDOG_MAX_DRIFT_SHIFT)) {
+        printf("TSC drifted by %lu ns over %lu ns\n", drift, hpetDelta);
+        HAL_DisableTSCClock("TSC is unstable");
+    }
+#endif
+}
+
 void HAL_TimerTick(Processor* proc, uint64_t ticks, void *data) {
-    if (proc->isBSP())
+    if (proc->isBSP()) {
         g_HALTimerTicks += ticks;
+        HAL_ClockWatchdog();
+    }
     Scheduler_PrepForTimerTick(ticks, data);
 }
 
@@ -60,29 +117,74 @@ void HAL_EndTimerTick() {
 #endif
 }
 
+bool HAL_IsTickless() {
+#ifdef __x86_64__
+    return g_BSP_LAPIC != nullptr && g_BSP_LAPIC->IsOneShot();
+#endif
+}
+
+void HAL_SetTimerDeadline(uint64_t deadline) {
+#ifdef __x86_64__
+    x86_64_Processor* proc = static_cast<x86_64_Processor*>(GetCurrentProcessor());
+    if (proc == nullptr)
+        return;
+
+    x86_64_LAPIC* lapic = proc->GetLAPIC();
+    if (lapic != nullptr && lapic->IsOneShot())
+        lapic->SetDeadline(deadline);
+#endif
+}
+
 uint64_t HAL_GetTicks() {
+    if (HAL_IsTickless())
+        return HAL_GetNSTicks() / 1'000'000;
     return g_HALTimerTicks;
 }
 
 uint64_t HAL_GetNSTicks() {
-    if (g_HPET != nullptr)
-        return g_HPET->GetNSTicks();
-    return g_HALTimerTicks * 1'000'000;
+    switch (__atomic_load_n(&g_HALClockSource, __ATOMIC_ACQUIRE)) {
+#ifdef __x86_64__
+    case HAL_ClockSource::TSC:
+        return x86_64_TSCToNS(x86_64_GetTSCClock(), x86_64_ReadTSCFence());
+#endif
+    case HAL_ClockSource::HPET:
+        return g_HPET->GetNSTicks() + g_HALClockOffset;
+    default:
+        return g_HALTimerTicks * 1'000'000 + g_HALClockOffset;
+    }
+}
+
+bool HAL_IsTSCClock() {
+    return __atomic_load_n(&g_HALClockSource, __ATOMIC_ACQUIRE) == HAL_ClockSource::TSC;
+}
+
+void HAL_DisableTSCClock(const char* reason) {
+    if (!HAL_IsTSCClock())
+        return;
+
+    uint64_t now = HAL_GetNSTicks();
+    HAL_ClockSource source = g_HPET != nullptr ? HAL_ClockSource::HPET : HAL_ClockSource::TICKS;
+    uint64_t raw = source == HAL_ClockSource::HPET ? g_HPET->GetNSTicks() : g_HALTimerTicks * 1'000'000;
+    g_HALClockOffset = (int64_t)(now - raw);
+    __atomic_store_n(&g_HALClockSource, source, __ATOMIC_RELEASE);
+
+    VDSO_SetClock(VDSO_CLOCK_MODE_NONE, 0, 0, 0, 0);
+    printf("Warning: %s, falling back to the %s clock\n", reason, source == HAL_ClockSource::HPET ? "HPET" : "timer tick");
 }
 
 void HAL_Sleep(uint64_t ms) {
     if (Scheduler::isRunning())
         Scheduler::SleepCurrentThread(ms);
     else
-        HAL_SleepNS(ms * 1'000'00);
+        HAL_SleepNS(ms * 1'000'000);
 }
 
 void HAL_SleepNS(uint64_t ns) {
     if (!g_HALTimeReady)
         return;
-    if (g_HPET != nullptr) {
-        uint64_t end = g_HPET->GetNSTicks() + ns;
-        while (g_HPET->GetNSTicks() < end)
+    if (g_HALClockSource != HAL_ClockSource::TICKS) {
+        uint64_t end = HAL_GetNSTicks() + ns;
+        while (HAL_GetNSTicks() < end)
             PAUSE();
     } else {
         uint64_t end = g_HALTimerTicks + DIV_ROUNDUP(ns, 1'000'000);
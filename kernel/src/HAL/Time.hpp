@@ -35,9 +35,15 @@ void HAL_InitTime();
 void HAL_TimerTick(Processor* proc, uint64_t ticks, void* data);
 void HAL_EndTimerTick();
 
+bool HAL_IsTickless(); // true if the timer only fires for programmed deadlines
+void HAL_SetTimerDeadline(uint64_t deadline); // in HAL_GetNSTicks() time, 0 for none. No-op when not tickless
+
 uint64_t HAL_GetTicks();
 uint64_t HAL_GetNSTicks();
 
+bool HAL_IsTSCClock(); // true while HAL_GetNSTicks() is derived from the TSC
+void HAL_DisableTSCClock(const char* reason); // switches to the HPET, or the timer ticks, without time going backwards
+
 void HAL_Sleep(uint64_t ms);
 void HAL_SleepNS(uint64_t ns);
 
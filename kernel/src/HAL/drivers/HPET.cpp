@@ -28,7 +28,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 HPET* g_HPET = nullptr;
 
-HPET::HPET(uint64_t address) : m_address(to_HHDM(address)), m_period(0), m_nsperiod(0), m_freq(0) {
+HPET::HPET(uint64_t address) : m_address(to_HHDM(address)), m_period(0), m_nsMult(0), m_freq(0) {
 
 }
 
@@ -43,8 +43,8 @@ bool HPET::Init() {
     uint64_t data = volatile_addr_read64(m_address + static_cast<uint64_t>(HPET_Register::CAP_ID));
     HPET_GeneralCapID* CAPID = reinterpret_cast<HPET_GeneralCapID*>(&data);
     m_period = CAPID->COUNTER_CLK_PERIOD;
-    m_nsperiod = m_period / 1'000'000;
-    assert(m_nsperiod > 0);
+    assert(m_period >= 1'000'000); // at least 1ns
+    m_nsMult = ((uint64_t)m_period << 32) / 1'000'000;
     m_freq = 1'000'000'000'000'000UL / m_period;
 
     data = volatile_addr_read64(m_address + static_cast<uint64_t>(HPET_Register::CONFIG));
@@ -56,7 +56,12 @@ bool HPET::Init() {
 }
 
 uint64_t HPET::GetNSTicks() {
-    return m_nsperiod * volatile_addr_read64(m_address + static_cast<uint64_t>(HPET_Register::MAIN_COUNTER));
+    __extension__ typedef unsigned __int128 uint128_t;
+    return ((uint128_t)GetCounter() * m_nsMult) >> 32;
+}
+
+uint64_t HPET::GetCounter() {
+    return volatile_addr_read64(m_address + static_cast<uint64_t>(HPET_Register::MAIN_COUNTER));
 }
 
 uint64_t* HPET::GetMainCounterPointer() {
@@ -49,6 +49,7 @@ public:
     bool Init();
 
     uint64_t GetNSTicks(); // Get ticks in nanoseconds
+    uint64_t GetCounter(); // raw main counter
 
     uint64_t* GetMainCounterPointer();
     uint64_t GetPeriod(); // In femtoseconds (10^-15)
@@ -59,7 +60,7 @@ public:
 private:
     uint64_t m_address;
     uint32_t m_period;
-    uint32_t m_nsperiod;
+    uint64_t m_nsMult; // ns = (counter * m_nsMult) >> 32, keeps the fractional part of the period
     uint64_t m_freq;
     mutable spinlock_t m_lock;
 };
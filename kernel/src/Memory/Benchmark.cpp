@@ -0,0 +1,89 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "Benchmark.hpp"
+#include "VMM.hpp"
+
+#include <stdio.h>
+#include <util.h>
+
+#include <HAL/Time.hpp>
+
+#include <Scheduling/Benchmark.hpp>
+
+namespace VMM {
+
+    struct FaultBenchmarkData {
+        uint8_t** regions; // one per thread, or a single region split into per-thread slices
+        bool perThreadRegions;
+        uint64_t pagesPerThread;
+        uint64_t nextSlice;
+    };
+
+    void FaultBenchmarkThread(void* arg) {
+        FaultBenchmarkData* data = static_cast<FaultBenchmarkData*>(arg);
+        uint64_t slice = __atomic_fetch_add(&data->nextSlice, 1, __ATOMIC_RELAXED);
+        volatile uint8_t* pages;
+        if (data->perThreadRegions)
+            pages = data->regions[slice];
+        else
+            pages = data->regions[0] + slice * data->pagesPerThread * PAGE_SIZE;
+        for (uint64_t i = 0; i < data->pagesPerThread; i++)
+            pages[i * PAGE_SIZE] = 1;
+    }
+
+    static void FreeFaultBenchmarkRegions(uint8_t** regions, uint64_t count) {
+        for (uint64_t i = 0; i < count; i++)
+            g_KVMM->FreePages(regions[i]);
+        delete[] regions;
+    }
+
+    uint64_t RunPageFaultBenchmark(uint64_t pagesPerThread, uint64_t threads, bool perThreadRegions) {
+        uint64_t regionCount = perThreadRegions ? threads : 1;
+        uint64_t regionPages = perThreadRegions ? pagesPerThread : pagesPerThread * threads;
+        uint8_t** regions = new uint8_t*[regionCount];
+        if (regions == nullptr) {
+            printf("VMM: failed to allocate page fault benchmark region\n");
+            return 0;
+        }
+        // allocPhys = false so every first touch is a fault
+        for (uint64_t i = 0; i < regionCount; i++) {
+            regions[i] = static_cast<uint8_t*>(g_KVMM->AllocateAnonPages(regionPages, {Protection::READ_WRITE, CacheType::DEFAULT, false, true, true, false, false, false}));
+            if (regions[i] == nullptr) {
+                printf("VMM: failed to allocate page fault benchmark region\n");
+                FreeFaultBenchmarkRegions(regions, i);
+                return 0;
+            }
+        }
+        FaultBenchmarkData data = {regions, perThreadRegions, pagesPerThread, 0};
+
+        uint64_t start = HAL_GetNSTicks();
+        bool ran = Scheduler::RunBenchmarkThreads(FaultBenchmarkThread, &data, threads);
+        uint64_t elapsed = HAL_GetNSTicks() - start;
+
+        FreeFaultBenchmarkRegions(regions, regionCount);
+        if (!ran) {
+            printf("VMM: failed to create page fault benchmark threads\n");
+            return 0;
+        }
+
+        uint64_t faults = threads * pagesPerThread;
+        uint64_t rate = elapsed > 0 ? faults * 1'000'000'000 / elapsed : 0;
+        printf("VMM: %lu threads took %lu page faults in %lu us (%s), %lu faults/s\n", threads, faults, elapsed / 1000, perThreadRegions ? "a region each" : "one shared region", rate);
+        return rate;
+    }
+
+} // namespace VMM
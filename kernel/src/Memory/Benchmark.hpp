@@ -0,0 +1,29 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef _VMM_BENCHMARK_HPP
+#define _VMM_BENCHMARK_HPP
+
+#include <stdint.h>
+
+namespace VMM {
+
+    // `threads` kernel threads each write-fault `pagesPerThread` pages, either of their own demand-paged region or of their own slice of one shared region. Blocks until all finish, prints and returns page faults per second.
+    uint64_t RunPageFaultBenchmark(uint64_t pagesPerThread, uint64_t threads, bool perThreadRegions);
+
+} // namespace VMM
+
+#endif /* _VMM_BENCHMARK_HPP */
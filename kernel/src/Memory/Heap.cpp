@@ -18,6 +18,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "Heap.hpp"
 #include "PagingUtil.hpp"
 #include "PMM.hpp"
+#include "Slab.hpp"
 #include "VMM.hpp"
 
 #include <assert.h>
@@ -271,6 +272,15 @@ size_t HeapAllocator::GetSize(void* ptr) const {
     return block->size;
 }
 
+void HeapAllocator::GetStats(HeapStats* stats) {
+    m_lock.Lock();
+    stats->usedMemory = m_UsedMemory;
+    stats->freeMemory = m_FreeMemory;
+    stats->metadataMemory = m_MetadataMemory;
+    stats->totalMemory = m_TotalMemory;
+    m_lock.Unlock();
+}
+
 void HeapAllocator::Verify() {
     assert(m_UsedMemory + m_FreeMemory + m_MetadataMemory == m_TotalMemory);
     assert(static_cast<int64_t>(m_UsedMemory) >= 0);
@@ -297,8 +307,17 @@ HeapSectionAllocator g_KHeapSectionAllocator = {[](size_t size) -> void* {
 HeapAllocator g_VMMHeapAllocator(&g_VMMHeapSectionAllocator);
 HeapAllocator g_KHeapAllocator(&g_KHeapSectionAllocator);
 
+void Heap_DumpStats(fd_t fd) {
+    HeapStats stats;
+    g_VMMHeapAllocator.GetStats(&stats);
+    fprintf(fd, "VMM heap: used = %lu, free = %lu, metadata = %lu, total = %lu\n", stats.usedMemory, stats.freeMemory, stats.metadataMemory, stats.totalMemory);
+    g_KHeapAllocator.GetStats(&stats);
+    fprintf(fd, "Kernel heap: used = %lu, free = %lu, metadata = %lu, total = %lu\n", stats.usedMemory, stats.freeMemory, stats.metadataMemory, stats.totalMemory);
+    g_SlabAllocator.DumpStats(fd);
+}
+
 extern "C" void* kcalloc_vmm(size_t num, size_t size) {
-    void* ptr = g_VMMHeapAllocator.Allocate(num * size);
+    void* ptr = kmalloc_vmm(num * size);
     if (ptr == nullptr)
         return nullptr;
     memset(ptr, 0, num * size);
@@ -306,10 +325,18 @@ extern "C" void* kcalloc_vmm(size_t num, size_t size) {
 }
 
 extern "C" void kfree_vmm(void* ptr) {
-    g_VMMHeapAllocator.Free(ptr);
+    if (g_SlabAllocator.Owns(ptr))
+        g_SlabAllocator.Free(ptr);
+    else
+        g_VMMHeapAllocator.Free(ptr);
 }
 
 extern "C" void* kmalloc_vmm(size_t size) {
+    if (size <= SLAB_MAX_OBJECT_SIZE) {
+        void* ptr = g_SlabAllocator.Allocate(size);
+        if (ptr != nullptr)
+            return ptr;
+    }
     return g_VMMHeapAllocator.Allocate(size);
 }
 
@@ -319,7 +346,7 @@ extern "C" void* krealloc_vmm(void* ptr, size_t size) {
 }
 
 extern "C" void* kcalloc(size_t num, size_t size) {
-    void* ptr = g_KHeapAllocator.Allocate(num * size);
+    void* ptr = kmalloc(num * size);
     if (ptr == nullptr)
         return nullptr;
     memset(ptr, 0, num * size);
@@ -327,34 +354,42 @@ extern "C" void* kcalloc(size_t num, size_t size) {
 }
 
 extern "C" void kfree(void* ptr) {
-    g_KHeapAllocator.Free(ptr);
+    if (g_SlabAllocator.Owns(ptr))
+        g_SlabAllocator.Free(ptr);
+    else
+        g_KHeapAllocator.Free(ptr);
 }
 
 extern "C" void* kmalloc(size_t size) {
+    if (size <= SLAB_MAX_OBJECT_SIZE) {
+        void* ptr = g_SlabAllocator.Allocate(size);
+        if (ptr != nullptr)
+            return ptr;
+    }
     return g_KHeapAllocator.Allocate(size);
 }
 
 extern "C" void* krealloc(void* ptr, size_t size) {
     if (ptr == nullptr)
-        return g_KHeapAllocator.Allocate(size);
+        return kmalloc(size);
     if (size == 0) {
-        g_KHeapAllocator.Free(ptr);
+        kfree(ptr);
         return nullptr;
     }
 
-    size_t oldSize = g_KHeapAllocator.GetSize(ptr);
+    size_t oldSize = g_SlabAllocator.Owns(ptr) ? g_SlabAllocator.GetSize(ptr) : g_KHeapAllocator.GetSize(ptr);
     if (oldSize == 0)
         return nullptr;
 
     if (oldSize >= size)
         return ptr;
 
-    void* newBuf = g_KHeapAllocator.Allocate(size);
+    void* newBuf = kmalloc(size);
     if (newBuf == nullptr)
         return nullptr;
 
     memcpy(newBuf, ptr, oldSize);
 
-    g_KHeapAllocator.Free(ptr);
+    kfree(ptr);
     return newBuf;
 }
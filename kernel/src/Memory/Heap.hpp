@@ -19,12 +19,20 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #define _KERNEL_HEAP_HPP
 
 #include <stddef.h>
+#include <stdio.h>
 #include <spinlock.h>
 
 #include <Scheduling/Mutex.hpp>
 
 #define HEAP_MIN_BLOCK_SIZE 16
 
+struct HeapStats {
+    size_t usedMemory;
+    size_t freeMemory;
+    size_t metadataMemory;
+    size_t totalMemory;
+};
+
 struct HeapSectionAllocator {
     void* (*Allocate)(size_t size);
     void (*Free)(void* ptr, size_t size);
@@ -44,6 +52,8 @@ public:
 
     size_t GetSize(void* ptr) const;
 
+    void GetStats(HeapStats* stats);
+
 private:
     void Verify();
 
@@ -70,4 +80,10 @@ private:
     size_t m_TotalMemory;
 };
 
+// Small allocations are served by the slab allocator, these sit behind it for larger sizes
+extern HeapAllocator g_VMMHeapAllocator;
+extern HeapAllocator g_KHeapAllocator;
+
+void Heap_DumpStats(fd_t fd);
+
 #endif /* _KERNEL_HEAP_HPP */
\ No newline at end of file
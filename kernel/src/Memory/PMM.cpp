@@ -21,11 +21,14 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <assert.h>
 #include <util.h>
 
+#include <HAL/Processor.hpp>
+
 #include <Scheduling/Mutex.hpp>
+#include <Scheduling/Scheduler.hpp>
 
 PMM* g_PMM = nullptr;
 
-PMM::PMM() : m_FreeListStart(nullptr), m_FreeListEnd(nullptr), m_FreeListNodeCount(0), m_FreePageCount(0), m_usedPageCount(0), m_totalPageCount(0), m_lock() {
+PMM::PMM() : m_freeLists(), m_freeBlockCounts(), m_orderBitmaps(), m_maxPFN(0), m_FreePageCount(0), m_cachedPageCount(0), m_usedPageCount(0), m_totalPageCount(0), m_lock() {
 
 }
 
@@ -34,292 +37,345 @@ PMM::~PMM() {
 }
 
 void PMM::Init(MemoryMapEntry** memoryMap, uint64_t memoryMapEntryCount) {
+    uint64_t maxAddress = 0;
     for (uint64_t i = 0; i < memoryMapEntryCount; i++) {
         if (memoryMap[i]->Type == MEMORY_MAP_ENTRY_USABLE) {
             if (memoryMap[i]->Base == 0) {
                 memoryMap[i]->Base += PAGE_SIZE;
                 memoryMap[i]->Length -= PAGE_SIZE;
-                if (memoryMap[i]->Length < PAGE_SIZE)
-                    continue;
-            }
-            m_totalPageCount += memoryMap[i]->Length >> 12;
-            m_FreePageCount += memoryMap[i]->Length >> 12;
-            m_FreeListNodeCount++;
-            // insert at end of list
-            if (m_FreeListEnd == nullptr) {
-                m_FreeListStart = (FreeListNode*)to_HHDM(memoryMap[i]->Base);
-                m_FreeListStart->PageCount = memoryMap[i]->Length >> 12;
-                m_FreeListStart->Next = nullptr;
-                m_FreeListEnd = m_FreeListStart;
-            }
-            else {
-                m_FreeListEnd->Next = (FreeListNode*)to_HHDM(memoryMap[i]->Base);
-                m_FreeListEnd = m_FreeListEnd->Next;
-                m_FreeListEnd->PageCount = memoryMap[i]->Length >> 12;
-                m_FreeListEnd->Next = nullptr;
             }
+            memoryMap[i]->Length = ALIGN_DOWN(memoryMap[i]->Length, PAGE_SIZE);
+            if (memoryMap[i]->Length < PAGE_SIZE)
+                continue;
+            if (memoryMap[i]->Base + memoryMap[i]->Length > maxAddress)
+                maxAddress = memoryMap[i]->Base + memoryMap[i]->Length;
         }
     }
 
-    m_usedPageCount = 0;
+    m_maxPFN = maxAddress >> PAGE_SIZE_SHIFT;
+
+    // Each order gets a bitmap with one bit per naturally aligned block
+    uint64_t bitmapSize = 0;
+    for (uint8_t order = 0; order <= PMM_MAX_ORDER; order++)
+        bitmapSize += ALIGN_UP(DIV_ROUNDUP((m_maxPFN >> order) + 1, 8), 8);
+    bitmapSize = ALIGN_UP(bitmapSize, PAGE_SIZE);
+
+    uint64_t bitmapBase = 0;
+    for (uint64_t i = 0; i < memoryMapEntryCount; i++) {
+        if (memoryMap[i]->Type == MEMORY_MAP_ENTRY_USABLE && memoryMap[i]->Length >= bitmapSize) {
+            bitmapBase = memoryMap[i]->Base;
+            memoryMap[i]->Base += bitmapSize;
+            memoryMap[i]->Length -= bitmapSize;
+            break;
+        }
+    }
+    assert(bitmapBase != 0);
+    memset((void*)to_HHDM(bitmapBase), 0, bitmapSize);
+
+    for (uint8_t order = 0; order <= PMM_MAX_ORDER; order++) {
+        m_orderBitmaps[order] = bitmapBase;
+        bitmapBase += ALIGN_UP(DIV_ROUNDUP((m_maxPFN >> order) + 1, 8), 8);
+    }
+
+    for (uint64_t i = 0; i < memoryMapEntryCount; i++) {
+        if (memoryMap[i]->Type == MEMORY_MAP_ENTRY_USABLE && memoryMap[i]->Length >= PAGE_SIZE) {
+            uint64_t pageCount = memoryMap[i]->Length >> PAGE_SIZE_SHIFT;
+            m_totalPageCount += pageCount;
+            m_usedPageCount += pageCount; // FreeRange takes them back off
+            FreeRange(memoryMap[i]->Base >> PAGE_SIZE_SHIFT, pageCount);
+        }
+    }
 }
 
 void* PMM::AllocatePage() {
-    m_lock.Lock();
-    assert(m_FreePageCount > 0);
+    int intState = Processor::DisableInterrupts();
+    PMM_PageCache* cache = GetLocalCache();
+    if (cache != nullptr && cache->count > 0) {
+        uint64_t page = cache->pages[--cache->count];
+        __atomic_sub_fetch(&m_cachedPageCount, 1, __ATOMIC_RELAXED);
+        Processor::EnableInterrupts(intState);
+        return (void*)page;
+    }
+    Processor::EnableInterrupts(intState);
 
-    FreeListNode* node = m_FreeListStart;
+    if (cache == nullptr) { // no per-CPU state yet
+        m_lock.Lock();
+        uint64_t pfn = AllocateBlock(0);
+        m_lock.Unlock();
+        return (void*)(pfn << PAGE_SIZE_SHIFT);
+    }
 
-    if (node->PageCount == 1) {
-        m_FreeListStart = m_FreeListStart->Next;
-        m_FreeListNodeCount--;
-        if (node == m_FreeListEnd)
-            m_FreeListEnd = nullptr;
+    // Refill in one go so the lock is only taken once per batch
+    uint64_t batch[PMM_PAGE_CACHE_BATCH];
+    uint64_t count = 0;
+    m_lock.Lock();
+    while (count < PMM_PAGE_CACHE_BATCH) {
+        uint64_t pfn = AllocateBlock(0);
+        if (pfn == 0)
+            break;
+        batch[count++] = pfn << PAGE_SIZE_SHIFT;
     }
-    else {
-        m_FreeListStart = (FreeListNode*)((uint64_t)m_FreeListStart + PAGE_SIZE);
-        m_FreeListStart->PageCount = node->PageCount - 1;
-        m_FreeListStart->Next = node->Next;
-        if (node == m_FreeListEnd)
-            m_FreeListEnd = m_FreeListStart;
+    m_lock.Unlock();
+
+    if (count == 0)
+        return nullptr;
+
+    uint64_t page = batch[--count];
+
+    // We may have migrated or been preempted, so re-fetch the cache
+    intState = Processor::DisableInterrupts();
+    cache = GetLocalCache();
+    while (count > 0 && cache->count < PMM_PAGE_CACHE_SIZE) {
+        cache->pages[cache->count++] = batch[--count];
+        __atomic_add_fetch(&m_cachedPageCount, 1, __ATOMIC_RELAXED);
     }
+    Processor::EnableInterrupts(intState);
 
-    m_FreePageCount--;
-    m_usedPageCount++;
+    if (count > 0) {
+        m_lock.Lock();
+        for (uint64_t i = 0; i < count; i++)
+            FreeBlock(batch[i] >> PAGE_SIZE_SHIFT, 0);
+        m_lock.Unlock();
+    }
 
-    m_lock.Unlock();
-    return (void*)from_HHDM(node);
+    return (void*)page;
 }
 
 void PMM::FreePage(void* page) {
-    m_lock.Lock();
-    FreeListNode* node = (FreeListNode*)to_HHDM(page);
-    
-    FreeListNode* current = m_FreeListStart;
-    FreeListNode* previous = nullptr;
-
-    while (current != nullptr) {
-        assert(previous < current);
-        if (current > node) {
-            if (previous == nullptr) {
-                if ((void*)((uint64_t)node + PAGE_SIZE) == current) {
-                    node->PageCount = current->PageCount + 1;
-                    node->Next = current->Next;
-                    if (m_FreeListEnd == current)
-                        m_FreeListEnd = node;
-                }
-                else {
-                    node->PageCount = 1;
-                    node->Next = m_FreeListStart;
-                    m_FreeListNodeCount++;
-                }
-                m_FreeListStart = node;
-            }
-            else {
-                assert(previous < node);
-                if ((void*)((uint64_t)previous + previous->PageCount * PAGE_SIZE) == node) {
-                    previous->PageCount++;
-                    node = previous;
-                }
-                else {
-                    previous->Next = node;
-                    m_FreeListNodeCount++;
-                    node->PageCount = 1;
-                }
-
-                if ((void*)((uint64_t)node + node->PageCount * PAGE_SIZE) == current) {
-                    node->PageCount += current->PageCount;
-                    node->Next = current->Next;
-                    m_FreeListNodeCount--;
-                    if (m_FreeListEnd == current)
-                        m_FreeListEnd = node;
-                }
-                else
-                    node->Next = current;
-            }
-            m_FreePageCount++;
-            m_usedPageCount--;
-            m_lock.Unlock();
-            return;
-        }
-        previous = current;
-        current = current->Next;
+    int intState = Processor::DisableInterrupts();
+    PMM_PageCache* cache = GetLocalCache();
+    if (cache != nullptr && cache->count < PMM_PAGE_CACHE_SIZE) {
+        cache->pages[cache->count++] = (uint64_t)page;
+        __atomic_add_fetch(&m_cachedPageCount, 1, __ATOMIC_RELAXED);
+        Processor::EnableInterrupts(intState);
+        return;
     }
 
-    // if we get here, we need to insert at the end
-    if (m_FreeListEnd == nullptr) {
-        m_FreeListStart = node;
-        m_FreeListEnd = node;
-        node->Next = nullptr;
-    }
-    else if ((void*)((uint64_t)m_FreeListEnd + m_FreeListEnd->PageCount * PAGE_SIZE) == node)
-        m_FreeListEnd->PageCount++;
-    else {
-        m_FreeListEnd->Next = node;
-        m_FreeListEnd = node;
-        node->Next = nullptr;
-        m_FreeListNodeCount++;
+    // Cache is full (or missing), drain a batch along with this page
+    uint64_t batch[PMM_PAGE_CACHE_BATCH + 1];
+    uint64_t count = 0;
+    batch[count++] = (uint64_t)page;
+    if (cache != nullptr) {
+        while (count <= PMM_PAGE_CACHE_BATCH && cache->count > 0)
+            batch[count++] = cache->pages[--cache->count];
+        __atomic_sub_fetch(&m_cachedPageCount, count - 1, __ATOMIC_RELAXED);
     }
+    Processor::EnableInterrupts(intState);
 
-    m_FreePageCount++;
-    m_usedPageCount--;
-
+    m_lock.Lock();
+    for (uint64_t i = 0; i < count; i++)
+        FreeBlock(batch[i] >> PAGE_SIZE_SHIFT, 0);
     m_lock.Unlock();
 }
 
 void* PMM::AllocatePages(uint64_t pageCount) {
     if (pageCount == 1)
         return AllocatePage(); // much faster
+    if (pageCount == 0)
+        return nullptr;
 
-    m_lock.Lock();
-    assert(m_FreePageCount > 0);
-
-    FreeListNode* current = m_FreeListStart;
-    FreeListNode* previous = nullptr;
-
-    while (current != nullptr) {
-        if (current->PageCount >= pageCount) {
-            if (current->PageCount == pageCount) {
-                if (previous == nullptr) {
-                    m_FreeListStart = current->Next;
-                    m_FreeListNodeCount--;
-                    if (current == m_FreeListEnd)
-                        m_FreeListEnd = nullptr;
-                }
-                else {
-                    previous->Next = current->Next;
-                    if (current == m_FreeListEnd)
-                        m_FreeListEnd = previous;
-                    m_FreeListNodeCount--;
-                }
-            }
-            else {
-                if (previous == nullptr) {
-                    m_FreeListStart = (FreeListNode*)((uint64_t)current + PAGE_SIZE * pageCount);
-                    m_FreeListStart->PageCount = current->PageCount - pageCount;
-                    m_FreeListStart->Next = current->Next;
-                    if (current == m_FreeListEnd)
-                        m_FreeListEnd = m_FreeListStart;
-                }
-                else {
-                    previous->Next = (FreeListNode*)((uint64_t)current + PAGE_SIZE * pageCount);
-                    previous->Next->PageCount = current->PageCount - pageCount;
-                    previous->Next->Next = current->Next;
-                    if (current == m_FreeListEnd)
-                        m_FreeListEnd = previous->Next;
-                }
-            }
-
-            m_FreePageCount -= pageCount;
-            m_usedPageCount += pageCount;
+    uint8_t order = 0;
+    while ((1UL << order) < pageCount)
+        order++;
+    if (order > PMM_MAX_ORDER)
+        return nullptr;
 
+    m_lock.Lock();
+    uint64_t pfn = AllocateBlock(order);
+    if (pfn == 0) {
+        m_lock.Unlock();
+        DrainLocalCache(); // cached single pages may be what stops blocks from coalescing
+        m_lock.Lock();
+        pfn = AllocateBlock(order);
+        if (pfn == 0) {
             m_lock.Unlock();
-            return (void*)from_HHDM(current);
+            return nullptr;
         }
-        previous = current;
-        current = current->Next;
     }
 
-    // if we get here, we failed to allocate
+    // give back the unused tail of the block
+    if ((1UL << order) > pageCount)
+        FreeRange(pfn + pageCount, (1UL << order) - pageCount);
     m_lock.Unlock();
-    return nullptr;
+
+    return (void*)(pfn << PAGE_SIZE_SHIFT);
 }
 
 void PMM::FreePages(void* pages, uint64_t pageCount) {
+    if (pageCount == 1)
+        return FreePage(pages);
+
     m_lock.Lock();
-    FreeListNode* node = (FreeListNode*)to_HHDM(pages);
-    
-    FreeListNode* current = m_FreeListStart;
-    FreeListNode* previous = nullptr;
-
-    while (current != nullptr) {
-        assert(previous < current);
-        if (current > node) {
-            if (previous == nullptr) {
-                if ((void*)((uint64_t)node + PAGE_SIZE * pageCount) == current) {
-                    node->PageCount = current->PageCount + pageCount;
-                    node->Next = current->Next;
-                    if (m_FreeListEnd == current)
-                        m_FreeListEnd = node;
-                }
-                else {
-                    node->PageCount = pageCount;
-                    node->Next = m_FreeListStart;
-                    m_FreeListNodeCount++;
-                }
-                m_FreeListStart = node;
-            }
-            else {
-                assert(previous < node);
-                if ((void*)((uint64_t)previous + previous->PageCount * PAGE_SIZE) == node) {
-                    previous->PageCount += pageCount;
-                    node = previous;
-                }
-                else {
-                    previous->Next = node;
-                    m_FreeListNodeCount++;
-                    node->PageCount = pageCount;
-                }
-
-                if ((void*)((uint64_t)node + node->PageCount * PAGE_SIZE) == current) {
-                    node->PageCount += current->PageCount;
-                    node->Next = current->Next;
-                    m_FreeListNodeCount--;
-                    if (m_FreeListEnd == current)
-                        m_FreeListEnd = node;
-                }
-                else
-                    node->Next = current;
-            }
-            m_FreePageCount += pageCount;
-            m_usedPageCount -= pageCount;
-            m_lock.Unlock();
-            return;
-        }
-        previous = current;
-        current = current->Next;
-    }
+    FreeRange((uint64_t)pages >> PAGE_SIZE_SHIFT, pageCount);
+    m_lock.Unlock();
+}
 
-    // if we get here, we need to insert at the end
-    if (m_FreeListEnd == nullptr) {
-        m_FreeListStart = node;
-        m_FreeListEnd = node;
-        node->Next = nullptr;
+void PMM::AddRange(void* base, uint64_t pageCount) {
+    uint64_t pfn = (uint64_t)base >> PAGE_SIZE_SHIFT;
+    if (pfn == 0 && pageCount > 0) { // 0 ends the free lists
+        pfn++;
+        pageCount--;
     }
-    else if ((void*)((uint64_t)m_FreeListEnd + m_FreeListEnd->PageCount * PAGE_SIZE) == node)
-        m_FreeListEnd->PageCount += pageCount;
-    else {
-        m_FreeListEnd->Next = node;
-        m_FreeListEnd = node;
-        node->Next = nullptr;
-        m_FreeListNodeCount++;
+    if (pfn >= m_maxPFN)
+        return;
+    pageCount = MIN(pageCount, m_maxPFN - pfn);
+    if (pageCount == 0)
+        return;
+
+    m_lock.Lock();
+    m_totalPageCount += pageCount;
+    m_usedPageCount += pageCount; // FreeRange takes them back off
+    FreeRange(pfn, pageCount);
+    m_lock.Unlock();
+}
+
+void PMM::DrainLocalCache() {
+    uint64_t batch[PMM_PAGE_CACHE_SIZE];
+    uint64_t count = 0;
+
+    int intState = Processor::DisableInterrupts();
+    PMM_PageCache* cache = GetLocalCache();
+    if (cache != nullptr) {
+        while (cache->count > 0)
+            batch[count++] = cache->pages[--cache->count];
+        __atomic_sub_fetch(&m_cachedPageCount, count, __ATOMIC_RELAXED);
     }
+    Processor::EnableInterrupts(intState);
 
-    m_FreePageCount += pageCount;
-    m_usedPageCount -= pageCount;
+    if (count == 0)
+        return;
 
+    m_lock.Lock();
+    for (uint64_t i = 0; i < count; i++)
+        FreeBlock(batch[i] >> PAGE_SIZE_SHIFT, 0);
     m_lock.Unlock();
 }
 
 uint64_t PMM::GetFreePageCount() {
-    return m_FreePageCount;
+    return m_FreePageCount + __atomic_load_n(&m_cachedPageCount, __ATOMIC_RELAXED);
+}
+
+uint64_t PMM::GetMaxPFN() const {
+    return m_maxPFN;
+}
+
+uint64_t PMM::AllocateBlock(uint8_t order) {
+    uint8_t current = order;
+    while (current <= PMM_MAX_ORDER && m_freeLists[current] == 0)
+        current++;
+    if (current > PMM_MAX_ORDER)
+        return 0;
+
+    uint64_t pfn = m_freeLists[current];
+    RemoveBlock(pfn, current);
+
+    // split down to the requested order, returning the upper halves
+    while (current > order) {
+        current--;
+        InsertBlock(pfn + (1UL << current), current);
+    }
+
+    m_FreePageCount -= 1UL << order;
+    m_usedPageCount += 1UL << order;
+    return pfn;
+}
+
+void PMM::FreeBlock(uint64_t pfn, uint8_t order) {
+    assert(pfn != 0 && pfn < m_maxPFN);
+    assert(!TestBit(order, pfn));
+
+    m_FreePageCount += 1UL << order;
+    m_usedPageCount -= 1UL << order;
+
+    while (order < PMM_MAX_ORDER) {
+        uint64_t buddy = pfn ^ (1UL << order);
+        if (buddy >= m_maxPFN || !TestBit(order, buddy))
+            break;
+        RemoveBlock(buddy, order);
+        pfn &= ~(1UL << order);
+        order++;
+    }
+
+    InsertBlock(pfn, order);
+}
+
+void PMM::FreeRange(uint64_t pfn, uint64_t pageCount) {
+    while (pageCount > 0) {
+        // largest naturally aligned block that fits
+        uint8_t order = 0;
+        while (order < PMM_MAX_ORDER && (pfn & (1UL << order)) == 0 && (2UL << order) <= pageCount)
+            order++;
+        FreeBlock(pfn, order);
+        pfn += 1UL << order;
+        pageCount -= 1UL << order;
+    }
+}
+
+void PMM::InsertBlock(uint64_t pfn, uint8_t order) {
+    FreeBlockNode* node = (FreeBlockNode*)to_HHDM(pfn << PAGE_SIZE_SHIFT);
+    node->Previous = 0;
+    node->Next = m_freeLists[order];
+    if (node->Next != 0)
+        ((FreeBlockNode*)to_HHDM(node->Next << PAGE_SIZE_SHIFT))->Previous = pfn;
+    m_freeLists[order] = pfn;
+    m_freeBlockCounts[order]++;
+    SetBit(order, pfn);
+}
+
+void PMM::RemoveBlock(uint64_t pfn, uint8_t order) {
+    FreeBlockNode* node = (FreeBlockNode*)to_HHDM(pfn << PAGE_SIZE_SHIFT);
+    if (node->Previous != 0)
+        ((FreeBlockNode*)to_HHDM(node->Previous << PAGE_SIZE_SHIFT))->Next = node->Next;
+    else
+        m_freeLists[order] = node->Next;
+    if (node->Next != 0)
+        ((FreeBlockNode*)to_HHDM(node->Next << PAGE_SIZE_SHIFT))->Previous = node->Previous;
+    m_freeBlockCounts[order]--;
+    ClearBit(order, pfn);
+}
+
+bool PMM::TestBit(uint8_t order, uint64_t pfn) const {
+    uint64_t index = pfn >> order;
+    uint64_t* bitmap = (uint64_t*)to_HHDM(m_orderBitmaps[order]);
+    return (bitmap[index / 64] & (1UL << (index % 64))) != 0;
+}
+
+void PMM::SetBit(uint8_t order, uint64_t pfn) {
+    uint64_t index = pfn >> order;
+    uint64_t* bitmap = (uint64_t*)to_HHDM(m_orderBitmaps[order]);
+    bitmap[index / 64] |= 1UL << (index % 64);
+}
+
+void PMM::ClearBit(uint8_t order, uint64_t pfn) {
+    uint64_t index = pfn >> order;
+    uint64_t* bitmap = (uint64_t*)to_HHDM(m_orderBitmaps[order]);
+    bitmap[index / 64] &= ~(1UL << (index % 64));
+}
+
+PMM_PageCache* PMM::GetLocalCache() {
+    Scheduler::ProcessorState* state = GetCurrentProcessorState();
+    if (state == nullptr)
+        return nullptr;
+    return &state->pageCache;
 }
 
 void PMM::Verify() {
-    FreeListNode* current = m_FreeListStart;
-    FreeListNode* previous = nullptr;
     uint64_t pageCount = 0;
-    for (uint64_t i = 0; i < m_FreeListNodeCount; i++) {
-        assert(current != nullptr);
-        if (previous != nullptr) {
-            assert((uint64_t)previous + previous->PageCount * PAGE_SIZE <= (uint64_t)current);
+    for (uint8_t order = 0; order <= PMM_MAX_ORDER; order++) {
+        uint64_t pfn = m_freeLists[order];
+        uint64_t previous = 0;
+        for (uint64_t i = 0; i < m_freeBlockCounts[order]; i++) {
+            assert(pfn != 0);
+            assert((pfn & ((1UL << order) - 1)) == 0);
+            assert(TestBit(order, pfn));
+            FreeBlockNode* node = (FreeBlockNode*)to_HHDM(pfn << PAGE_SIZE_SHIFT);
+            assert(node->Previous == previous);
+            pageCount += 1UL << order;
+            previous = pfn;
+            pfn = node->Next;
         }
-        pageCount += current->PageCount;
-        previous = current;
-        current = current->Next;
+        assert(pfn == 0);
     }
-    assert(current == nullptr);
     assert(pageCount == m_FreePageCount);
-    assert(m_FreeListEnd == previous);
     assert(m_totalPageCount == m_FreePageCount + m_usedPageCount);
 }
@@ -25,6 +25,17 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "MemoryMap.hpp"
 
+#define PMM_MAX_ORDER 18 // 1GiB blocks
+
+#define PMM_PAGE_CACHE_SIZE 64
+#define PMM_PAGE_CACHE_BATCH 32
+
+// Per-CPU magazine of free pages. Only touched by the owning CPU with interrupts disabled.
+struct PMM_PageCache {
+    uint64_t count;
+    uint64_t pages[PMM_PAGE_CACHE_SIZE]; // physical addresses
+};
+
 class PMM {
 public:
     PMM();
@@ -37,25 +48,46 @@ public:
 
     void* AllocatePages(uint64_t pageCount);
     void FreePages(void* pages, uint64_t pageCount);
+    void AddRange(void* base, uint64_t pageCount); // hand over memory that wasn't usable at Init, like bootloader modules. Pages above the highest usable page are ignored
+
+    void DrainLocalCache(); // return the current CPU's cached pages to the buddy allocator
 
     uint64_t GetFreePageCount();
+    uint64_t GetMaxPFN() const;
 
 private:
 
+    // all of these must be called with m_lock held
+    uint64_t AllocateBlock(uint8_t order); // returns a page frame number, or 0 on failure
+    void FreeBlock(uint64_t pfn, uint8_t order);
+    void FreeRange(uint64_t pfn, uint64_t pageCount);
+
+    void InsertBlock(uint64_t pfn, uint8_t order);
+    void RemoveBlock(uint64_t pfn, uint8_t order);
+
+    bool TestBit(uint8_t order, uint64_t pfn) const;
+    void SetBit(uint8_t order, uint64_t pfn);
+    void ClearBit(uint8_t order, uint64_t pfn);
+
+    PMM_PageCache* GetLocalCache(); // interrupts must be disabled
+
     void Verify();
 
 private:
 
-    struct FreeListNode {
-        uint64_t PageCount;
-        FreeListNode* Next;
+    // Stored in the first page of each free block. Links are page frame numbers, 0 is the end of the list.
+    struct FreeBlockNode {
+        uint64_t Next;
+        uint64_t Previous;
     };
 
-    FreeListNode* m_FreeListStart;
-    FreeListNode* m_FreeListEnd;
-    uint64_t m_FreeListNodeCount;
+    uint64_t m_freeLists[PMM_MAX_ORDER + 1];
+    uint64_t m_freeBlockCounts[PMM_MAX_ORDER + 1];
+    uint64_t m_orderBitmaps[PMM_MAX_ORDER + 1]; // physical addresses, one bit per possible block start
+    uint64_t m_maxPFN;
 
     uint64_t m_FreePageCount;
+    uint64_t m_cachedPageCount;
     uint64_t m_usedPageCount;
     uint64_t m_totalPageCount;
 
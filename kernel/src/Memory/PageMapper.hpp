@@ -22,21 +22,49 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "VMM.hpp"
 
+#define TLB_BATCH_MAX_RANGES 8
+
+// Ranges collected for a single remote TLB shootdown. Overflowing ranges degrade to a full flush.
+struct TLBShootdownBatch {
+    uint64_t count;
+    bool fullFlush;
+    bool global; // has kernel ranges, which are shared by every address space
+    struct {
+        uint64_t start;
+        uint64_t pageCount;
+    } ranges[TLB_BATCH_MAX_RANGES];
+};
+
 class PageMapper {
 public:
     virtual ~PageMapper() {}
 
     virtual bool MapPage(uint64_t virt, uint64_t phys, VMM::Protection prot, bool user, VMM::CacheType cacheType) = 0;
     virtual bool MapPages(uint64_t virt, uint64_t phys, size_t count, VMM::Protection prot, bool user, VMM::CacheType cacheType) = 0;
+    virtual bool MapPageArray(uint64_t virt, const uint64_t* phys, size_t count, VMM::Protection prot, bool user, VMM::CacheType cacheType) = 0; // phys[i] is mapped at virt + i * PAGE_SIZE, 0 entries are skipped
     virtual bool UnmapPage(uint64_t virt) = 0;
     virtual bool UnmapPages(uint64_t virt, size_t count) = 0;
     virtual bool RemapPage(uint64_t virt, VMM::Protection prot, bool user, VMM::CacheType cacheType) = 0;
     virtual bool RemapPages(uint64_t virt, size_t count, VMM::Protection prot, bool user, VMM::CacheType cacheType) = 0;
 
+    // Large pages are LARGE_PAGE_SIZE, and all addresses must be aligned to that.
+    // Normal page operations on part of a large page split it first, and fail if that fails.
+    // MapLargePage invalidates the TLB itself if it replaced an empty page table.
+    virtual bool LargePagesSupported() const = 0;
+    virtual bool MapLargePage(uint64_t virt, uint64_t phys, VMM::Protection prot, bool user, VMM::CacheType cacheType) = 0;
+    virtual bool UnmapLargePage(uint64_t virt) = 0;
+    virtual bool RemapLargePage(uint64_t virt, VMM::Protection prot, bool user, VMM::CacheType cacheType) = 0;
+    virtual bool IsLargePage(uint64_t virt) = 0; // true if virt is in a large page
+    virtual bool IsLargeRegionEmpty(uint64_t virt) = 0; // true if nothing at all is mapped in the large page at virt
+
     virtual uint64_t GetPhysicalAddr(uint64_t virt) = 0;
 
     virtual void InvalidatePages(uint64_t virt, size_t count, bool shootdown = false) = 0;
 
+    // Nothing is invalidated, locally or remotely, until FlushShootdown
+    virtual void QueueShootdown(TLBShootdownBatch* batch, uint64_t virt, size_t count) = 0;
+    virtual void FlushShootdown(TLBShootdownBatch* batch) = 0;
+
     virtual void* GetPageTable() const = 0;
 
     virtual bool isPermsReduction(VMM::Protection oldProt, VMM::Protection newProt) const = 0;
@@ -17,6 +17,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "Pager.hpp"
 #include "PMM.hpp"
+#include "VMM.hpp"
 
 namespace VMM {
     DefaultPager::DefaultPager() {
@@ -40,5 +41,18 @@ namespace VMM {
         g_PMM->FreePage(page);
     }
 
+    bool WiredPager::GetPage(MemoryObject* obj, uint64_t offset, Page** outPage, bool write) {
+        Page* page = obj->pages.Find(offset);
+        if (page == nullptr || (write && !(static_cast<uint8_t>(page->protection) & static_cast<uint8_t>(Protection::WRITE))))
+            return false;
+        *outPage = page;
+        return true;
+    }
+
+    void WiredPager::FreePage(void*) {
+
+    }
+
     DefaultPager* g_defaultPager = nullptr;
+    WiredPager g_wiredPager;
 }
\ No newline at end of file
@@ -36,7 +36,15 @@ namespace VMM {
 
     };
 
+    // Hands out the pages already in the object, for objects filled in up front like the vDSO or I/O rings. Mappings can never write-fault in new pages.
+    class WiredPager : public DefaultPager {
+    public:
+        virtual bool GetPage(MemoryObject* obj, uint64_t offset, Page** outPage, bool write) override;
+        virtual void FreePage(void* page) override; // no-op, the pages are freed with the object
+    };
+
     extern DefaultPager* g_defaultPager;
+    extern WiredPager g_wiredPager;
 }
 
 #endif /* _VMM_PAGER_HPP */
\ No newline at end of file
@@ -0,0 +1,321 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "PagingUtil.hpp"
+#include "PMM.hpp"
+#include "Slab.hpp"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <util.h>
+
+#include <HAL/Processor.hpp>
+
+#include <Scheduling/Scheduler.hpp>
+
+static const size_t g_slabClassSizes[SLAB_CLASS_COUNT] = {16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 1024, 2048};
+
+SlabAllocator g_SlabAllocator;
+
+SlabAllocator::SlabAllocator() : m_caches(), m_classLookup(), m_bitmap(0), m_maxSlabIndex(0) {
+
+}
+
+SlabAllocator::~SlabAllocator() {
+
+}
+
+void SlabAllocator::Init() {
+    uint8_t index = 0;
+    for (uint64_t i = 0; i <= SLAB_MAX_OBJECT_SIZE / 16; i++) {
+        while (g_slabClassSizes[index] < i * 16)
+            index++;
+        m_classLookup[i] = index;
+    }
+
+    for (uint8_t i = 0; i < SLAB_CLASS_COUNT; i++) {
+        SlabCache* cache = &m_caches[i];
+        cache->objectSize = g_slabClassSizes[i];
+        cache->objectsPerSlab = (SLAB_SIZE - sizeof(SlabHeader)) / cache->objectSize;
+        cache->index = i;
+        cache->partial = nullptr;
+        cache->empty = nullptr;
+        cache->emptyCount = 0;
+        cache->slabCount = 0;
+        cache->inUse = 0;
+    }
+
+    m_maxSlabIndex = DIV_ROUNDUP(g_PMM->GetMaxPFN(), 1UL << SLAB_ORDER);
+    uint64_t bitmapPages = DIV_ROUNDUP(DIV_ROUNDUP(m_maxSlabIndex, 8), PAGE_SIZE);
+    void* bitmap = g_PMM->AllocatePages(bitmapPages);
+    if (bitmap == nullptr)
+        return; // everything falls through to the section heaps
+    memset(to_HHDM(bitmap), 0, bitmapPages * PAGE_SIZE);
+    m_bitmap = (uint64_t)bitmap;
+}
+
+void* SlabAllocator::Allocate(size_t size) {
+    if (size > SLAB_MAX_OBJECT_SIZE || m_bitmap == 0)
+        return nullptr;
+
+    uint8_t index = m_classLookup[DIV_ROUNDUP(size, 16)];
+
+    int intState = Processor::DisableInterrupts();
+    SlabCPUCache* local = GetLocalCache(index);
+    if (local != nullptr && local->count > 0) {
+        void* obj = local->objects[--local->count];
+        local->hits++;
+        Processor::EnableInterrupts(intState);
+        return obj;
+    }
+    if (local != nullptr)
+        local->misses++;
+    Processor::EnableInterrupts(intState);
+
+    SlabCache* cache = &m_caches[index];
+    if (local == nullptr) {
+        void* obj = nullptr;
+        RefillBatch(cache, &obj, 1);
+        return obj;
+    }
+
+    void* batch[SLAB_CPU_CACHE_BATCH];
+    uint64_t count = RefillBatch(cache, batch, SLAB_CPU_CACHE_BATCH);
+    if (count == 0)
+        return nullptr;
+
+    void* obj = batch[--count];
+
+    // We may have migrated or been preempted, so re-fetch the cache
+    intState = Processor::DisableInterrupts();
+    local = GetLocalCache(index);
+    while (count > 0 && local->count < SLAB_CPU_CACHE_SIZE)
+        local->objects[local->count++] = batch[--count];
+    Processor::EnableInterrupts(intState);
+
+    if (count > 0)
+        ReleaseBatch(cache, batch, count);
+
+    return obj;
+}
+
+void SlabAllocator::Free(void* ptr) {
+    SlabHeader* slab = (SlabHeader*)ALIGN_DOWN((uint64_t)ptr, SLAB_SIZE);
+    SlabCache* cache = slab->cache;
+
+    int intState = Processor::DisableInterrupts();
+    SlabCPUCache* local = GetLocalCache(cache->index);
+    if (local != nullptr && local->count < SLAB_CPU_CACHE_SIZE) {
+        local->objects[local->count++] = ptr;
+        Processor::EnableInterrupts(intState);
+        return;
+    }
+
+    // Cache is full (or missing), drain a batch along with this object
+    void* batch[SLAB_CPU_CACHE_BATCH + 1];
+    uint64_t count = 0;
+    batch[count++] = ptr;
+    if (local != nullptr) {
+        while (count <= SLAB_CPU_CACHE_BATCH && local->count > 0)
+            batch[count++] = local->objects[--local->count];
+    }
+    Processor::EnableInterrupts(intState);
+
+    ReleaseBatch(cache, batch, count);
+}
+
+bool SlabAllocator::Owns(void* ptr) const {
+    if (m_bitmap == 0 || ptr == nullptr)
+        return false;
+
+    // Slabs only ever live in the HHDM
+    uint64_t phys = from_HHDM((uint64_t)ptr);
+    uint64_t index = phys >> (PAGE_SIZE_SHIFT + SLAB_ORDER);
+    if ((uint64_t)ptr < to_HHDM((uint64_t)0) || index >= m_maxSlabIndex)
+        return false;
+
+    uint64_t* bitmap = (uint64_t*)to_HHDM(m_bitmap);
+    return (bitmap[index / 64] & (1UL << (index % 64))) != 0;
+}
+
+size_t SlabAllocator::GetSize(void* ptr) const {
+    SlabHeader* slab = (SlabHeader*)ALIGN_DOWN((uint64_t)ptr, SLAB_SIZE);
+    return slab->cache->objectSize;
+}
+
+void SlabAllocator::GetStats(SlabStats* stats) {
+    memset(stats, 0, sizeof(SlabStats));
+
+    for (uint8_t i = 0; i < SLAB_CLASS_COUNT; i++) {
+        SlabCache* cache = &m_caches[i];
+        cache->lock.Lock();
+        stats->slabCount += cache->slabCount;
+        stats->usedBytes += cache->inUse * cache->objectSize;
+        cache->lock.Unlock();
+    }
+    stats->totalBytes = stats->slabCount * SLAB_SIZE;
+
+    // Racy reads of other CPUs' counters, good enough for statistics
+    Scheduler::ProcessorState* state = &Scheduler::g_BSPState;
+    for (uint64_t i = 0; i < Scheduler::GetProcessorCount() && state != nullptr; i++, state = state->next) {
+        for (uint8_t j = 0; j < SLAB_CLASS_COUNT; j++) {
+            SlabCPUCache* local = &state->slabCaches[j];
+            stats->hits += volatile_read64(local->hits);
+            stats->misses += volatile_read64(local->misses);
+            stats->cachedObjects += volatile_read64(local->count);
+        }
+    }
+}
+
+void SlabAllocator::DumpStats(fd_t fd) {
+    SlabStats stats;
+    GetStats(&stats);
+
+    uint64_t unused = stats.totalBytes - stats.usedBytes;
+    fprintf(fd, "Slab: %lu slabs, %lu bytes total, %lu bytes in use, %lu objects cached per-CPU\n", stats.slabCount, stats.totalBytes, stats.usedBytes, stats.cachedObjects);
+    fprintf(fd, "Slab: %lu hits, %lu misses, fragmentation = %lu%%\n", stats.hits, stats.misses, stats.totalBytes > 0 ? unused * 100 / stats.totalBytes : 0);
+    for (uint8_t i = 0; i < SLAB_CLASS_COUNT; i++) {
+        SlabCache* cache = &m_caches[i];
+        cache->lock.Lock();
+        fprintf(fd, "\t%lu: slabs = %lu, empty = %lu, objects in use = %lu\n", cache->objectSize, cache->slabCount, cache->emptyCount, cache->inUse);
+        cache->lock.Unlock();
+    }
+}
+
+uint64_t SlabAllocator::RefillBatch(SlabCache* cache, void** objects, uint64_t count) {
+    uint64_t i = 0;
+    cache->lock.Lock();
+    while (i < count) {
+        SlabHeader* slab = cache->partial;
+        if (slab == nullptr) {
+            slab = cache->empty;
+            if (slab != nullptr) {
+                ListRemove(&cache->empty, slab);
+                cache->emptyCount--;
+            } else {
+                slab = CreateSlab(cache);
+                if (slab == nullptr)
+                    break;
+            }
+            ListInsert(&cache->partial, slab);
+        }
+
+        while (i < count && slab->freeList != nullptr) {
+            void* obj = slab->freeList;
+            slab->freeList = *(void**)obj;
+            slab->inUse++;
+            objects[i++] = obj;
+        }
+
+        if (slab->freeList == nullptr)
+            ListRemove(&cache->partial, slab); // full slabs aren't on any list
+    }
+    cache->inUse += i;
+    cache->lock.Unlock();
+    return i;
+}
+
+void SlabAllocator::ReleaseBatch(SlabCache* cache, void** objects, uint64_t count) {
+    cache->lock.Lock();
+    for (uint64_t i = 0; i < count; i++) {
+        SlabHeader* slab = (SlabHeader*)ALIGN_DOWN((uint64_t)objects[i], SLAB_SIZE);
+        assert(slab->cache == cache && slab->inUse > 0);
+
+        if (slab->freeList == nullptr)
+            ListInsert(&cache->partial, slab); // was full
+
+        *(void**)objects[i] = slab->freeList;
+        slab->freeList = objects[i];
+        slab->inUse--;
+
+        if (slab->inUse == 0) {
+            ListRemove(&cache->partial, slab);
+            if (cache->emptyCount < SLAB_MAX_EMPTY) {
+                ListInsert(&cache->empty, slab);
+                cache->emptyCount++;
+            } else
+                DestroySlab(slab);
+        }
+    }
+    cache->inUse -= count;
+    cache->lock.Unlock();
+}
+
+SlabAllocator::SlabHeader* SlabAllocator::CreateSlab(SlabCache* cache) {
+    void* phys = g_PMM->AllocatePages(1UL << SLAB_ORDER); // buddy blocks are naturally aligned
+    if (phys == nullptr)
+        return nullptr;
+
+    SlabHeader* slab = (SlabHeader*)to_HHDM(phys);
+    slab->cache = cache;
+    slab->next = nullptr;
+    slab->prev = nullptr;
+    slab->inUse = 0;
+    slab->capacity = cache->objectsPerSlab;
+
+    // Build the free list back to front so objects are handed out in address order
+    void* next = nullptr;
+    for (uint32_t i = cache->objectsPerSlab; i > 0; i--) {
+        void* obj = (void*)((uint64_t)slab + sizeof(SlabHeader) + (i - 1) * cache->objectSize);
+        *(void**)obj = next;
+        next = obj;
+    }
+    slab->freeList = next;
+
+    uint64_t index = (uint64_t)phys >> (PAGE_SIZE_SHIFT + SLAB_ORDER);
+    uint64_t* bitmap = (uint64_t*)to_HHDM(m_bitmap);
+    __atomic_or_fetch(&bitmap[index / 64], 1UL << (index % 64), __ATOMIC_RELAXED);
+
+    cache->slabCount++;
+    return slab;
+}
+
+void SlabAllocator::DestroySlab(SlabHeader* slab) {
+    uint64_t phys = from_HHDM((uint64_t)slab);
+    uint64_t index = phys >> (PAGE_SIZE_SHIFT + SLAB_ORDER);
+    uint64_t* bitmap = (uint64_t*)to_HHDM(m_bitmap);
+    __atomic_and_fetch(&bitmap[index / 64], ~(1UL << (index % 64)), __ATOMIC_RELAXED);
+
+    slab->cache->slabCount--;
+    g_PMM->FreePages((void*)phys, 1UL << SLAB_ORDER);
+}
+
+void SlabAllocator::ListInsert(SlabHeader** head, SlabHeader* slab) {
+    slab->prev = nullptr;
+    slab->next = *head;
+    if (*head != nullptr)
+        (*head)->prev = slab;
+    *head = slab;
+}
+
+void SlabAllocator::ListRemove(SlabHeader** head, SlabHeader* slab) {
+    if (slab->prev != nullptr)
+        slab->prev->next = slab->next;
+    else
+        *head = slab->next;
+    if (slab->next != nullptr)
+        slab->next->prev = slab->prev;
+    slab->next = nullptr;
+    slab->prev = nullptr;
+}
+
+SlabCPUCache* SlabAllocator::GetLocalCache(uint8_t index) {
+    Scheduler::ProcessorState* state = GetCurrentProcessorState();
+    if (state == nullptr)
+        return nullptr;
+    return &state->slabCaches[index];
+}
@@ -0,0 +1,115 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef _SLAB_HPP
+#define _SLAB_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <util.h>
+
+#include <Scheduling/Mutex.hpp>
+
+#define SLAB_CLASS_COUNT 12
+#define SLAB_MAX_OBJECT_SIZE 2048
+
+#define SLAB_ORDER 2 // 16KiB slabs
+#define SLAB_SIZE (PAGE_SIZE << SLAB_ORDER)
+#define SLAB_MAX_EMPTY 1 // empty slabs kept per class before returning them to the PMM
+
+#define SLAB_CPU_CACHE_SIZE 16
+#define SLAB_CPU_CACHE_BATCH 8
+
+// Per-CPU object cache for one size class. Only touched by the owning CPU with interrupts disabled.
+struct SlabCPUCache {
+    uint64_t count;
+    void* objects[SLAB_CPU_CACHE_SIZE];
+    uint64_t hits;
+    uint64_t misses;
+};
+
+struct SlabStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t slabCount;
+    uint64_t totalBytes; // memory held by slabs
+    uint64_t usedBytes; // objects handed out, including those sitting in per-CPU caches
+    uint64_t cachedObjects;
+};
+
+class SlabAllocator {
+public:
+    SlabAllocator();
+    ~SlabAllocator();
+
+    void Init(); // PMM must be ready
+
+    void* Allocate(size_t size); // returns nullptr if size isn't handled by a slab class
+    void Free(void* ptr);
+
+    bool Owns(void* ptr) const;
+    size_t GetSize(void* ptr) const;
+
+    void GetStats(SlabStats* stats);
+    void DumpStats(fd_t fd);
+
+private:
+    struct SlabCache;
+
+    struct SlabHeader {
+        SlabCache* cache;
+        SlabHeader* next;
+        SlabHeader* prev;
+        void* freeList;
+        uint32_t inUse;
+        uint32_t capacity;
+        uint64_t _reserved[3];
+    };
+
+    struct SlabCache {
+        size_t objectSize;
+        uint32_t objectsPerSlab;
+        uint8_t index;
+        SlabHeader* partial;
+        SlabHeader* empty;
+        uint64_t emptyCount;
+        uint64_t slabCount;
+        uint64_t inUse;
+        Mutex lock;
+    };
+
+    uint64_t RefillBatch(SlabCache* cache, void** objects, uint64_t count); // takes the cache lock
+    void ReleaseBatch(SlabCache* cache, void** objects, uint64_t count); // takes the cache lock
+
+    SlabHeader* CreateSlab(SlabCache* cache);
+    void DestroySlab(SlabHeader* slab);
+
+    static void ListInsert(SlabHeader** head, SlabHeader* slab);
+    static void ListRemove(SlabHeader** head, SlabHeader* slab);
+
+    SlabCPUCache* GetLocalCache(uint8_t index); // interrupts must be disabled
+
+private:
+    SlabCache m_caches[SLAB_CLASS_COUNT];
+    uint8_t m_classLookup[SLAB_MAX_OBJECT_SIZE / 16 + 1];
+    uint64_t m_bitmap; // physical address, one bit per SLAB_SIZE block of physical memory
+    uint64_t m_maxSlabIndex;
+};
+
+extern SlabAllocator g_SlabAllocator;
+
+#endif /* _SLAB_HPP */
@@ -0,0 +1,40 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef _USER_ACCESS_HPP
+#define _USER_ACCESS_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+// All of these check the range is in the user region, and return -EFAULT rather than faulting on a bad pointer.
+
+// On a fault, *copied (if given) is set to the number of bytes copied before it
+int CopyFromUser(void* kDst, const void* userSrc, size_t size, size_t* copied = nullptr);
+int CopyToUser(void* userDst, const void* kSrc, size_t size, size_t* copied = nullptr);
+int64_t StrncpyFromUser(char* kDst, const char* userSrc, size_t maxSize); // returns the length without the NUL, or maxSize if none was found
+int ReadUser32(const uint32_t* userSrc, uint32_t* kDst);
+int CmpXchgUser32(uint32_t* userDst, uint32_t* expected, uint32_t desired); // -EAGAIN on mismatch, with *expected updated
+
+// Like the above, but never page anything in, so they can be used under a spinlock. -EFAULT if the page isn't mapped for the access
+int ReadUser32NoFault(const uint32_t* userSrc, uint32_t* kDst);
+int CmpXchgUser32NoFault(uint32_t* userDst, uint32_t* expected, uint32_t desired);
+
+// For code that must access user memory directly, such as the ELF loader. Doesn't protect against faults.
+void UserAccessBegin();
+void UserAccessEnd();
+
+#endif /* _USER_ACCESS_HPP */
@@ -48,11 +48,120 @@ namespace VMM {
         return true;
     }
 
-    VMM::VMM() : m_pageMapper(nullptr), m_vmRegionAllocator(nullptr), m_mapEntries(true) {
+    uint64_t g_faultAroundPages = VMM_FAULT_AROUND_PAGES;
 
+    void SetFaultAroundPages(uint64_t pages) {
+        __atomic_store_n(&g_faultAroundPages, MIN(pages, VMM_FAULT_AROUND_MAX_PAGES), __ATOMIC_RELAXED);
     }
 
-    VMM::VMM(PageMapper* pageMapper, VMRegionAllocator* vmRegionAllocator) : m_pageMapper(pageMapper), m_vmRegionAllocator(vmRegionAllocator), m_mapEntries(true) {
+    uint64_t GetFaultAroundPages() {
+        return __atomic_load_n(&g_faultAroundPages, __ATOMIC_RELAXED);
+    }
+
+    void ReleaseMemoryObject(MemoryObject* obj) {
+        spinlock_acquire(&obj->lock);
+        obj->refCount--;
+        if (obj->refCount > 0) {
+            spinlock_release(&obj->lock);
+            return;
+        }
+        // no mappings are left, so nothing needs unmapping
+        obj->pages.forEach([](void*, uint64_t, Page* page) -> void {
+            if (page->physAddr != 0)
+                g_PMM->FreePage(reinterpret_cast<void*>(page->physAddr));
+            kfree_vmm(page);
+        }, nullptr);
+        kfree_vmm(obj);
+    }
+
+    static Protection WithoutWrite(Protection prot) {
+        return static_cast<Protection>(static_cast<uint8_t>(prot) & ~static_cast<uint8_t>(Protection::WRITE));
+    }
+
+    // Give an entry its own copy of an AnonMap shared since a fork. The Anons stay shared, and are copied a page at a time on write.
+    // map must be locked, and stays locked.
+    static AnonMap* CopyAnonMap(AnonMap* map) {
+        AnonMap* newMap = (AnonMap*)kcalloc_vmm(1, sizeof(AnonMap));
+        Anon** slots = (Anon**)kcalloc_vmm(map->slotCount, sizeof(Anon*));
+        if (newMap == nullptr || slots == nullptr) {
+            if (newMap != nullptr)
+                kfree_vmm(newMap);
+            if (slots != nullptr)
+                kfree_vmm(slots);
+            return nullptr;
+        }
+
+        memcpy(slots, map->slots, map->slotCount * sizeof(Anon*));
+        for (uint64_t i = 0; i < map->slotCount; i++) {
+            if (slots[i] != nullptr)
+                slots[i]->refCount++;
+        }
+
+        newMap->slotCount = map->slotCount;
+        newMap->slots = slots;
+        newMap->refCount = 1;
+
+        map->refCount--;
+        return newMap;
+    }
+
+    uint64_t g_zeroPage = 0; // physical address, allocated on first use
+
+    // Shared read-only page of zeroes, mapped for read faults on zero-fill anonymous memory. 0 if it couldn't be allocated.
+    static uint64_t GetZeroPage() {
+        uint64_t page = __atomic_load_n(&g_zeroPage, __ATOMIC_ACQUIRE);
+        if (page != 0)
+            return page;
+
+        uint64_t newPage = reinterpret_cast<uint64_t>(g_PMM->AllocatePage());
+        if (newPage == 0)
+            return 0;
+        memset(to_HHDM(reinterpret_cast<void*>(newPage)), 0, PAGE_SIZE);
+        if (__atomic_compare_exchange_n(&g_zeroPage, &page, newPage, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            return newPage;
+        g_PMM->FreePage(reinterpret_cast<void*>(newPage)); // lost the race
+        return page;
+    }
+
+    static bool IsZeroPage(PageMapper* mapper, uint64_t virt) {
+        uint64_t zeroPage = __atomic_load_n(&g_zeroPage, __ATOMIC_ACQUIRE);
+        return zeroPage != 0 && mapper->GetPhysicalAddr(virt) == zeroPage;
+    }
+
+    // Pick the pages to map around a read fault. Faults landing just past the previous window are treated as sequential, and the window grows forwards.
+    // The MapEntry must be locked.
+    static void PlanFaultAround(MapEntry* entry, uint64_t pageIndex, uint64_t* first, uint64_t* count) {
+        uint64_t base = GetFaultAroundPages();
+        if (base == 0) {
+            *count = 0;
+            return;
+        }
+
+        uint64_t pageCount = (entry->endVirt - entry->startVirt) >> PAGE_SIZE_SHIFT;
+        uint64_t start;
+        uint64_t end;
+        if (entry->faultWindow != 0 && pageIndex == entry->faultNext) {
+            entry->faultWindow = MIN(entry->faultWindow * 2, VMM_FAULT_AROUND_MAX_PAGES);
+            start = pageIndex;
+            end = pageIndex + entry->faultWindow;
+        } else {
+            entry->faultWindow = base;
+            start = ALIGN_DOWN(pageIndex, base);
+            end = start + base;
+        }
+        if (end > pageCount)
+            end = pageCount;
+        entry->faultNext = end;
+
+        *first = start;
+        *count = end - start;
+    }
+
+    VMM::VMM() : m_pageMapper(nullptr), m_vmRegionAllocator(nullptr), m_mapEntries(true), m_objectFaults(0), m_faultAroundPages(0), m_zeroPageFaults(0) {
+
+    }
+
+    VMM::VMM(PageMapper* pageMapper, VMRegionAllocator* vmRegionAllocator) : m_pageMapper(pageMapper), m_vmRegionAllocator(vmRegionAllocator), m_mapEntries(true), m_objectFaults(0), m_faultAroundPages(0), m_zeroPageFaults(0) {
 
     }
 
@@ -66,7 +175,7 @@ namespace VMM {
     }
 
     void VMM::Delete() {
-        m_mapEntries.lock();
+        m_entriesLock.WriteLock();
         
         m_mapEntries.forEach([](void* data, uint64_t, MapEntry* entry) -> bool {
             VMM* current = (VMM*)data;
@@ -80,8 +189,13 @@ namespace VMM {
                 for (uint64_t i = 0; i < map->slotCount; i++) {
                     Anon* anon = map->slots[i];
                     if (anon != nullptr) {
-                        if (anon->physAddr != 0)
-                            current->m_pageMapper->UnmapPage(entry->startVirt + i * PAGE_SIZE);
+                        uint64_t virt = entry->startVirt + i * PAGE_SIZE;
+                        if (entry->flags.largePages && (virt & (LARGE_PAGE_SIZE - 1)) == 0 && map->slotCount - i >= (LARGE_PAGE_SIZE >> PAGE_SIZE_SHIFT) && current->m_pageMapper->IsLargePage(virt))
+                            current->m_pageMapper->UnmapLargePage(virt);
+                        else if (anon->physAddr != 0)
+                            current->m_pageMapper->UnmapPage(virt);
+                        if (map->refCount > 0)
+                            continue; // the Anons are still referenced through the map
                         anon->refCount--;
                         if (anon->refCount == 0) {
                             g_PMM->FreePage((void*)anon->physAddr);
@@ -124,7 +238,7 @@ namespace VMM {
         }, this);
 
         m_mapEntries.Clear();
-        m_mapEntries.unlock();
+        m_entriesLock.WriteUnlock();
     }
 
     void* VMM::AllocateAnonPages(uint64_t count, AllocFlags flags) {
@@ -135,20 +249,23 @@ namespace VMM {
         if (count == 0 || g_defaultPager == nullptr)
             return nullptr;
 
+        // Large user mappings that are populated on demand can use large pages, so prefer aligned regions for them
+        bool largePages = allocFlags.user && !allocFlags.allocPhys && count >= (LARGE_PAGE_SIZE >> PAGE_SIZE_SHIFT) && m_pageMapper->LargePagesSupported();
+
         // Step 1: get a VM region. doing this first as it is more likely to fail (whilst still being quite unlikely), and easier to cleanup
         void* pages = nullptr;
         if (addr == nullptr)
-            pages = m_vmRegionAllocator->AllocatePages(count);
+            pages = largePages ? AllocateAlignedRegion(count) : m_vmRegionAllocator->AllocatePages(count);
         else {
             pages = m_vmRegionAllocator->AllocatePages(addr, count);
             if (pages == nullptr) {
                 if (allocFlags.addrIsHint)
-                    pages = m_vmRegionAllocator->AllocatePages(count);
+                    pages = largePages ? AllocateAlignedRegion(count) : m_vmRegionAllocator->AllocatePages(count);
                 else if (allocFlags.replace) {
-                    m_mapEntries.lock();
+                    m_entriesLock.WriteLock();
                     m_vmRegionAllocator->Lock();
                     bool rc = Internal_FreePages(addr, count, true, false);
-                    m_mapEntries.unlock();
+                    m_entriesLock.WriteUnlock();
                     if (!rc) {
                         m_vmRegionAllocator->Unlock();
                         return nullptr;
@@ -211,10 +328,11 @@ namespace VMM {
         entry->flags.needsCopy = false;
         entry->flags.isPrivate = allocFlags.isPrivate;
         entry->flags.zero = allocFlags.zero;
+        entry->flags.largePages = largePages;
 
-        m_mapEntries.lock();
+        m_entriesLock.WriteLock();
         m_mapEntries.Insert((uint64_t)pages, entry);
-        m_mapEntries.unlock();
+        m_entriesLock.WriteUnlock();
 
         if (allocFlags.allocPhys)
             m_pageMapper->InvalidatePages((uint64_t)pages, count);
@@ -244,10 +362,10 @@ namespace VMM {
                 if (allocFlags.addrIsHint)
                     pages = m_vmRegionAllocator->AllocatePages(count);
                 else if (allocFlags.replace) {
-                    m_mapEntries.lock();
+                    m_entriesLock.WriteLock();
                     m_vmRegionAllocator->Lock();
                     bool rc = Internal_FreePages(addr, count, true, false);
-                    m_mapEntries.unlock();
+                    m_entriesLock.WriteUnlock();
                     if (!rc) {
                         m_vmRegionAllocator->Unlock();
                         return nullptr;
@@ -328,9 +446,9 @@ namespace VMM {
         obj->refCount++;
         spinlock_release(&obj->lock);
 
-        m_mapEntries.lock();
+        m_entriesLock.WriteLock();
         m_mapEntries.Insert((uint64_t)pages, entry);
-        m_mapEntries.unlock();
+        m_entriesLock.WriteUnlock();
 
         if (allocFlags.allocPhys)
             m_pageMapper->InvalidatePages((uint64_t)pages, count);
@@ -365,13 +483,19 @@ namespace VMM {
             obj->refCount = 1;
         } else {
             spinlock_acquire(&obj->lock);
+            lockedObj = true;
             obj->size += count;
             obj->refCount++;
         }
 
         MapEntry* entry = (MapEntry*)kcalloc_vmm(1, sizeof(MapEntry)); // allocate this now for easier error handling
         if (entry == nullptr) {
-            kfree_vmm(obj);
+            if (lockedObj) {
+                obj->size -= count;
+                obj->refCount--;
+                spinlock_release(&obj->lock);
+            } else
+                kfree_vmm(obj);
             m_vmRegionAllocator->FreePages(pages, count);
             return nullptr;
         }
@@ -403,9 +527,9 @@ namespace VMM {
         entry->flags.isPrivate = flags.isPrivate;
         entry->flags.zero = flags.zero;
 
-        m_mapEntries.lock();
+        m_entriesLock.WriteLock();
         m_mapEntries.Insert((uint64_t)pages, entry);
-        m_mapEntries.unlock();
+        m_entriesLock.WriteUnlock();
 
         if (lockedObj)
             spinlock_release(&obj->lock);
@@ -442,14 +566,14 @@ namespace VMM {
         bool shootdown = false;
 
         while (currentCount < totalCount) {
-            m_mapEntries.lock();
+            m_entriesLock.WriteLock();
             AVLTree::wAVLTreeNode* node = nullptr;
             if (full)
                 node = m_mapEntries.FindNode(virt);
             else
                 node = m_mapEntries.FindNodeOrLower(virt);
             if (node == nullptr || node->value == 0) {
-                m_mapEntries.unlock();
+                m_entriesLock.WriteUnlock();
                 return false;
             }
 
@@ -459,7 +583,7 @@ namespace VMM {
 
             MapEntry* entry = reinterpret_cast<MapEntry*>(node->value);
             if ((full && entry->startVirt != virt) || (!full && entry->endVirt < virt + count * PAGE_SIZE)) {
-                m_mapEntries.unlock();
+                m_entriesLock.WriteUnlock();
                 return false;
             }
 
@@ -472,7 +596,7 @@ namespace VMM {
                 if (entry->startVirt < virt) {
                     MapEntry* newEntry = SplitMapEntry(entry, (virt - entry->startVirt) >> PAGE_SIZE_SHIFT);
                     if (newEntry == nullptr) {
-                        m_mapEntries.unlock();
+                        m_entriesLock.WriteUnlock();
                         return false;
                     }
                     m_mapEntries.Insert(newEntry->startVirt, newEntry);
@@ -481,13 +605,13 @@ namespace VMM {
                 if (entry->endVirt > virt + count * PAGE_SIZE) {
                     MapEntry* newEntry = SplitMapEntry(entry, count);
                     if (newEntry == nullptr) {
-                        m_mapEntries.unlock();
+                        m_entriesLock.WriteUnlock();
                         return false;
                     }
                     m_mapEntries.Insert(newEntry->startVirt, newEntry);
                 }
                 if (!m_vmRegionAllocator->ResizeAllocatedRegion((void*)start, (end - start) >> PAGE_SIZE_SHIFT, virtAddr, count)) {
-                    m_mapEntries.unlock();
+                    m_entriesLock.WriteUnlock();
                     return false;
                 }
             } else if (full)
@@ -516,21 +640,28 @@ namespace VMM {
                     if (!data.valid) {
                         spinlock_release(&obj->lock);
                         spinlock_release(&map->lock);
-                        m_mapEntries.unlock();
+                        m_entriesLock.WriteUnlock();
                         return false;
                     }
                 }
                 
-                // Now that it is confirmed to be valid, we can remap
+                // Now that it is confirmed to be valid, we can remap. Pages shared copy-on-write must stay read-only.
+                bool sharedMap = entry->flags.needsCopy && map->refCount > 1;
                 for (uint64_t i = 0; i < count; i++) {
                     Anon* anon = map->slots[i];
-                    if (anon != nullptr) {
-                        m_pageMapper->RemapPage(virt + i * PAGE_SIZE, prot, user, cacheType);
+                    uint64_t largeCount = LARGE_PAGE_SIZE >> PAGE_SIZE_SHIFT;
+                    Protection anonProt = (anon != nullptr && (sharedMap || anon->refCount > 1)) ? WithoutWrite(prot) : prot;
+                    if (entry->flags.largePages && ((virt + i * PAGE_SIZE) & (LARGE_PAGE_SIZE - 1)) == 0 && count - i >= largeCount && m_pageMapper->IsLargePage(virt + i * PAGE_SIZE)) {
+                        m_pageMapper->RemapLargePage(virt + i * PAGE_SIZE, anonProt, user, cacheType);
+                        i += largeCount - 1;
+                    } else if (anon != nullptr) {
+                        m_pageMapper->RemapPage(virt + i * PAGE_SIZE, anonProt, user, cacheType);
                     } else if (obj != nullptr) {
                         Page* page = obj->pages.Find(entry->offset + i);
                         if (page != nullptr)
                             m_pageMapper->RemapPage(virt + i * PAGE_SIZE, prot, user, cacheType);
-                    }
+                    } else if (entry->flags.zero && IsZeroPage(m_pageMapper, virt + i * PAGE_SIZE)) // the zero page must stay read-only
+                        m_pageMapper->RemapPage(virt + i * PAGE_SIZE, static_cast<Protection>(static_cast<uint8_t>(prot) & ~static_cast<uint8_t>(Protection::WRITE)), user, cacheType);
                 }
 
                 if (obj != nullptr)
@@ -554,7 +685,7 @@ namespace VMM {
                 if (!data.valid) {
                     spinlock_release(&obj->lock);
                     spinlock_release(&map->lock);
-                    m_mapEntries.unlock();
+                    m_entriesLock.WriteUnlock();
                     return false;
                 }
 
@@ -580,7 +711,7 @@ namespace VMM {
             entry->flags.protection = prot;
             entry->flags.user = user;
 
-            m_mapEntries.unlock(); // need to hold the lock for the whole function to ensure it can't be unmapped on us part way through
+            m_entriesLock.WriteUnlock(); // need to hold the lock for the whole function to ensure it can't be unmapped on us part way through
 
             shootdown |= (user ^ wasUser ) || m_pageMapper->isPermsReduction(oldProt, prot);
 
@@ -594,39 +725,60 @@ namespace VMM {
     }
 
     bool VMM::MapPages(void* virtAddr, uint64_t count) {
-        m_mapEntries.lock();
+        m_entriesLock.ReadLock();
 
         AVLTree::wAVLTreeNode* node = m_mapEntries.FindNodeOrLower((uint64_t)virtAddr);
         if (node == nullptr || node->value == 0) {
-            m_mapEntries.unlock();
+            m_entriesLock.ReadUnlock();
             return false;
         }
 
         MapEntry* entry = (MapEntry*)node->value;
+        spinlock_acquire(&entry->lock);
         if (entry->endVirt <= (uint64_t)virtAddr || ((uint64_t)virtAddr + count * PAGE_SIZE) > entry->endVirt || entry->anonMap == nullptr) {
-            m_mapEntries.unlock();
+            spinlock_release(&entry->lock);
+            m_entriesLock.ReadUnlock();
             return false;
         }
         AnonMap* map = entry->anonMap;
 
         spinlock_acquire(&map->lock);
 
+        if (entry->flags.needsCopy && map->refCount > 1) {
+            AnonMap* newMap = CopyAnonMap(map);
+            spinlock_release(&map->lock);
+            if (newMap == nullptr) {
+                spinlock_release(&entry->lock);
+                m_entriesLock.ReadUnlock();
+                return false;
+            }
+            entry->anonMap = newMap;
+            map = newMap;
+            spinlock_acquire(&map->lock);
+        }
+
+        bool replacedZero = false;
         for (uint64_t i = ((uint64_t)virtAddr - entry->startVirt) >> PAGE_SIZE_SHIFT; i < map->slotCount; i++) {
             Anon* anon = map->slots[i];
             if (anon == nullptr) {
                 anon = (Anon*)kcalloc_vmm(1, sizeof(Anon));
                 anon->refCount = 1;
                 anon->physAddr = (uint64_t)g_PMM->AllocatePage();
+                if (entry->flags.zero) {
+                    memset(to_HHDM((void*)anon->physAddr), 0, PAGE_SIZE);
+                    replacedZero |= IsZeroPage(m_pageMapper, entry->startVirt + i * PAGE_SIZE);
+                }
                 m_pageMapper->MapPage(entry->startVirt + i * PAGE_SIZE, anon->physAddr, entry->flags.protection, entry->flags.user, entry->flags.cacheType);
                 map->slots[i] = anon;
             }
         }
 
         spinlock_release(&map->lock);
+        spinlock_release(&entry->lock);
         
-        m_mapEntries.unlock();
+        m_entriesLock.ReadUnlock();
         
-        m_pageMapper->InvalidatePages((uint64_t)virtAddr, count, false); // Not a permission reduction, shootdown is not required
+        m_pageMapper->InvalidatePages((uint64_t)virtAddr, count, replacedZero); // Not a permission reduction, so shootdown is only required if the zero page was replaced
         return true;
     }
 
@@ -634,19 +786,26 @@ namespace VMM {
         if (m_vmRegionAllocator == nullptr || virtAddr < m_vmRegionAllocator->GetStart() || virtAddr >= m_vmRegionAllocator->GetEnd())
             return false; // outside the region
 
-        m_mapEntries.lock();
+        // Faults only need the read side, so faults on different entries run in parallel
+        m_entriesLock.ReadLock();
         AVLTree::wAVLTreeNode* node = m_mapEntries.FindNodeOrLower(virtAddr);
         if (node == nullptr || node->value == 0) {
-            m_mapEntries.unlock();
+            m_entriesLock.ReadUnlock();
             return false;
         }
 
         MapEntry* entry = reinterpret_cast<MapEntry*>(node->value);
-        if (virtAddr < entry->startVirt || virtAddr >= entry->endVirt || (entry->anonMap == nullptr && entry->memoryObject == nullptr)) {
-            m_mapEntries.unlock();
-            return false;
-        }
+        spinlock_acquire(&entry->lock);
+        bool result = false;
+        if (virtAddr >= entry->startVirt && virtAddr < entry->endVirt && (entry->anonMap != nullptr || entry->memoryObject != nullptr))
+            result = HandleEntryFault(entry, code, virtAddr);
+        spinlock_release(&entry->lock);
+
+        m_entriesLock.ReadUnlock();
+        return result;
+    }
 
+    bool VMM::HandleEntryFault(MapEntry* entry, PageFaultCode code, uint64_t virtAddr) {
         AnonMap* map = entry->anonMap;
         MemoryObject* obj = entry->memoryObject;
         virtAddr = ALIGN_DOWN(virtAddr, PAGE_SIZE);
@@ -656,6 +815,9 @@ namespace VMM {
         bool user = entry->flags.user;
         bool zero = entry->flags.zero;
         bool copy = entry->flags.needsCopy;
+        bool largePages = entry->flags.largePages;
+        uint64_t entryStart = entry->startVirt;
+        uint64_t entryEnd = entry->endVirt;
         uint64_t offset = entry->offset;
 
         // need to validate that the page fault was actually caused by a mismatch in protection
@@ -680,14 +842,38 @@ namespace VMM {
             valid = true;
             break;
         }
-        if (!valid) {
-            m_mapEntries.unlock();
+        if (!valid)
             return false;
+
+        uint64_t aroundFirst = 0;
+        uint64_t aroundCount = 0;
+        if (obj != nullptr) {
+            __atomic_add_fetch(&m_objectFaults, 1, __ATOMIC_RELAXED);
+            if (!code.write && !code.present)
+                PlanFaultAround(entry, pageIndex, &aroundFirst, &aroundCount);
         }
         
         if (map != nullptr) {
             spinlock_acquire(&map->lock);
-            m_mapEntries.unlock();
+
+            // The AnonMap may still be shared since a fork. Anything that changes its slots needs a copy first.
+            if (copy && map->refCount > 1 && (code.write || (map->slots[pageIndex] == nullptr && obj == nullptr && !zero))) {
+                AnonMap* newMap = CopyAnonMap(map);
+                spinlock_release(&map->lock);
+                if (newMap == nullptr)
+                    return false;
+                entry->anonMap = newMap;
+                map = newMap;
+                spinlock_acquire(&map->lock);
+            }
+
+            if (copy && map->refCount > 1)
+                prot = WithoutWrite(prot); // still shared, so this can only be a read fault
+
+            if (largePages && obj == nullptr && MapLargeAnon(map, entryStart, entryEnd, virtAddr, code, prot, user, cacheType, zero)) {
+                spinlock_release(&map->lock);
+                return true;
+            }
 
             Anon* anon = map->slots[pageIndex];
 
@@ -814,9 +1000,18 @@ namespace VMM {
                 if (copy) // map as read-only if this is not a write fault, and it would need to be copied
                     prot = (Protection)((uint8_t)prot & ~(uint8_t)Protection::WRITE);
                 result = m_pageMapper->MapPage(virtAddr, page->physAddr, prot, user, cacheType);
+                if (result && aroundCount > 0)
+                    FaultAround(obj, map, entryStart, offset, aroundFirst, aroundCount, pageIndex, prot, user, cacheType);
                 spinlock_release(&obj->lock);
             } else {
-                if (!code.present) {
+                uint64_t zeroPage = 0;
+                if (!code.present && zero && !code.write && (zeroPage = GetZeroPage()) != 0) {
+                    // reads don't need their own page yet
+                    Protection readProt = static_cast<Protection>(static_cast<uint8_t>(prot) & ~static_cast<uint8_t>(Protection::WRITE));
+                    result = m_pageMapper->MapPage(virtAddr, zeroPage, readProt, user, cacheType);
+                    if (result)
+                        __atomic_add_fetch(&m_zeroPageFaults, 1, __ATOMIC_RELAXED);
+                } else if (!code.present || (zero && code.write)) { // a present write fault here is on the zero page
                     anon = (Anon*)kcalloc_vmm(1, sizeof(Anon));
                     if (anon == nullptr) {
                         spinlock_release(&map->lock);
@@ -829,6 +1024,8 @@ namespace VMM {
                     if (zero)
                         memset(reinterpret_cast<void*>(to_HHDM(anon->physAddr)), 0, PAGE_SIZE);
                     result = m_pageMapper->MapPage(virtAddr, anon->physAddr, prot, user, cacheType);
+                    if (result && code.present)
+                        m_pageMapper->InvalidatePages(virtAddr, 1, true); // other threads may still read the zero page
                 }
             }
 
@@ -836,7 +1033,6 @@ namespace VMM {
             return result;
         } else {
             spinlock_acquire(&obj->lock);
-            m_mapEntries.unlock();
 
             Page* page = nullptr;
             bool rc = obj->pager->GetPage(obj, offset + pageIndex * PAGE_SIZE, &page, code.write);
@@ -851,6 +1047,8 @@ namespace VMM {
                     result = m_pageMapper->RemapPage(virtAddr, prot, user, cacheType);
                 else
                     result = m_pageMapper->MapPage(virtAddr, page->physAddr, prot, user, cacheType);
+                if (result && aroundCount > 0)
+                    FaultAround(obj, nullptr, entryStart, offset, aroundFirst, aroundCount, pageIndex, prot, user, cacheType);
                 spinlock_release(&obj->lock);
                 return result;
             }
@@ -861,6 +1059,8 @@ namespace VMM {
                 if (zero)
                     memset(reinterpret_cast<void*>(to_HHDM(page->physAddr)), 0, PAGE_SIZE);
                 result = m_pageMapper->MapPage(virtAddr, page->physAddr, prot, user, cacheType);
+                if (result && aroundCount > 0)
+                    FaultAround(obj, nullptr, entryStart, offset, aroundFirst, aroundCount, pageIndex, prot, user, cacheType);
             }
 
             spinlock_release(&obj->lock);
@@ -871,24 +1071,24 @@ namespace VMM {
     bool VMM::ValidateRead(const void* addr, size_t size, bool user) {
         uint64_t virtAddr = (uint64_t)addr;
 
-        m_mapEntries.lock();
+        m_entriesLock.ReadLock();
 
         while (true) {
             AVLTree::wAVLTreeNode* node = m_mapEntries.FindNodeOrLower(virtAddr);
             if (node == nullptr || node->value == 0) {
-                m_mapEntries.unlock();
+                m_entriesLock.ReadUnlock();
                 return false;
             }
 
             MapEntry* entry = reinterpret_cast<MapEntry*>(node->value);
             Protection prot = entry->flags.protection;
             if (virtAddr < entry->startVirt || (user && !entry->flags.user) || (static_cast<uint8_t>(prot) & static_cast<uint8_t>(Protection::READ)) == 0) {
-                m_mapEntries.unlock();
+                m_entriesLock.ReadUnlock();
                 return false;
             }
 
             if ((virtAddr + size) <= entry->endVirt) {
-                m_mapEntries.unlock();
+                m_entriesLock.ReadUnlock();
                 return true;
             }
 
@@ -897,27 +1097,57 @@ namespace VMM {
         }
     }
 
+    MemoryObject* VMM::GetSharedObject(const void* addr, uint64_t* offset) {
+        uint64_t virtAddr = (uint64_t)addr;
+
+        m_entriesLock.ReadLock();
+
+        AVLTree::wAVLTreeNode* node = m_mapEntries.FindNodeOrLower(virtAddr);
+        if (node == nullptr || node->value == 0) {
+            m_entriesLock.ReadUnlock();
+            return nullptr;
+        }
+
+        MapEntry* entry = reinterpret_cast<MapEntry*>(node->value);
+        if (virtAddr >= entry->endVirt || entry->flags.isPrivate || entry->memoryObject == nullptr) {
+            m_entriesLock.ReadUnlock();
+            return nullptr;
+        }
+
+        MemoryObject* obj = entry->memoryObject;
+        if (offset != nullptr)
+            *offset = entry->offset * PAGE_SIZE + (virtAddr - entry->startVirt);
+
+        // the entry's reference keeps it alive until we have our own
+        spinlock_acquire(&obj->lock);
+        obj->refCount++;
+        spinlock_release(&obj->lock);
+
+        m_entriesLock.ReadUnlock();
+        return obj;
+    }
+
     bool VMM::ValidateWrite(const void* addr, size_t size, bool user) {
         uint64_t virtAddr = (uint64_t)addr;
 
-        m_mapEntries.lock();
+        m_entriesLock.ReadLock();
 
         while (true) {
             AVLTree::wAVLTreeNode* node = m_mapEntries.FindNodeOrLower(virtAddr);
             if (node == nullptr || node->value == 0) {
-                m_mapEntries.unlock();
+                m_entriesLock.ReadUnlock();
                 return false;
             }
 
             MapEntry* entry = reinterpret_cast<MapEntry*>(node->value);
             Protection prot = entry->flags.protection;
             if (virtAddr < entry->startVirt || (user && !entry->flags.user) || (static_cast<uint8_t>(prot) & static_cast<uint8_t>(Protection::WRITE)) == 0) {
-                m_mapEntries.unlock();
+                m_entriesLock.ReadUnlock();
                 return false;
             }
 
             if ((virtAddr + size) <= entry->endVirt) {
-                m_mapEntries.unlock();
+                m_entriesLock.ReadUnlock();
                 return true;
             }
 
@@ -926,126 +1156,15 @@ namespace VMM {
         }
     }
 
-    bool VMM::CopyStringFromUser(char* kernelDst, const void* userSrc, size_t maxSize, size_t* outSize, bool user) {
-        uint64_t virtAddr = reinterpret_cast<uint64_t>(userSrc);
-        size_t totalCopied = 0;
-
-        if (maxSize == 0) {
-            if (outSize != nullptr)
-                *outSize = 0;
-            return false;
-        }
-
-        m_mapEntries.lock();
-
-        while (totalCopied < maxSize) {
-            AVLTree::wAVLTreeNode* node = m_mapEntries.FindNodeOrLower(virtAddr);
-            if (node == nullptr || node->value == 0) {
-                m_mapEntries.unlock();
-                if (outSize != nullptr)
-                    *outSize = totalCopied;
-                return false; // Unmapped memory hit
-            }
-
-            MapEntry* entry = reinterpret_cast<MapEntry*>(node->value);
-            Protection prot = entry->flags.protection;
-
-            // Verify bounds and READ permissions
-            if (virtAddr < entry->startVirt || virtAddr >= entry->endVirt || 
-            (user && !entry->flags.user) || 
-            (static_cast<uint8_t>(prot) & static_cast<uint8_t>(Protection::READ)) == 0) {
-                m_mapEntries.unlock();
-                if (outSize != nullptr)
-                    *outSize = totalCopied;
-                return false; // Access violation
-            }
-
-            uint64_t pageIndex = (virtAddr - entry->startVirt) >> PAGE_SIZE_SHIFT;
-            uint64_t pageOffset = virtAddr & (PAGE_SIZE - 1);
-            size_t bytesInPage = PAGE_SIZE - pageOffset;
-            size_t bytesInRegion = entry->endVirt - virtAddr;
-            size_t bytesToProcess = MIN(bytesInPage, MIN(bytesInRegion, maxSize - totalCopied));
-
-            const char* srcHHDM = nullptr;
-            bool isZeroPage = false;
-
-            // Step 1: Resolve HHDM pointer or demand-zero state
-            if (entry->anonMap != nullptr) {
-                spinlock_acquire(&entry->anonMap->lock);
-                Anon* anon = entry->anonMap->slots[pageIndex];
-                if (anon != nullptr && anon->physAddr != 0)
-                    srcHHDM = reinterpret_cast<const char*>(to_HHDM(anon->physAddr)) + pageOffset;
-                else if (entry->flags.zero)
-                    isZeroPage = true;
-                spinlock_release(&entry->anonMap->lock);
-            } else if (entry->memoryObject != nullptr) {
-                MemoryObject* obj = entry->memoryObject;
-                spinlock_acquire(&obj->lock);
-                Page* page = obj->pages.Find(entry->offset + pageIndex * PAGE_SIZE);
-                if (page != nullptr && page->physAddr != 0)
-                    srcHHDM = reinterpret_cast<const char*>(to_HHDM(page->physAddr)) + pageOffset;
-                else if (entry->flags.zero)
-                    isZeroPage = true;
-                spinlock_release(&obj->lock);
-            }
-
-            // Step 2: Handle unpopulated file-backed pages safely
-            if (srcHHDM == nullptr && !isZeroPage) {
-                // Memory is mapped but frame isn't in RAM yet (e.g., pager needs to load it).
-                // Unlock m_mapEntries, trigger Page Fault to bring frame into RAM, then retry.
-                m_mapEntries.unlock();
-                PageFaultCode code = { .present = false, .write = false, .user = user, .execute = false };
-                if (!HandlePageFault(code, virtAddr)) {
-                    if (outSize != nullptr)
-                        *outSize = totalCopied;
-                    return false; // Pager failed to load page
-                }
-                m_mapEntries.lock();
-                continue; // Retry this address now that it's paged in
-            }
-
-            // Step 3: Copy & scan bytes
-            if (isZeroPage) {
-                // Demand-zero page: first byte is '\0'
-                kernelDst[totalCopied] = '\0';
-                m_mapEntries.unlock();
-                if (outSize != nullptr)
-                    *outSize = totalCopied + 1;
-                return true; // Successfully found null terminator!
-            }
-
-            for (size_t i = 0; i < bytesToProcess; ++i) {
-                char c = srcHHDM[i];
-                kernelDst[totalCopied] = c;
-                totalCopied++;
-
-                if (c == '\0') {
-                    m_mapEntries.unlock();
-                    if (outSize != nullptr)
-                        *outSize = totalCopied;
-                    return true; // Null terminator reached
-                }
-            }
-
-            virtAddr += bytesToProcess;
-        }
-
-        m_mapEntries.unlock();
-
-        // Reached maxSize without seeing '\0'
-        if (outSize != nullptr)
-            *outSize = totalCopied;
-        return false;
-    }
-
     bool VMM::Fork(VMM* other) {
-        other->m_mapEntries.lock();
-        m_mapEntries.lock();
+        other->m_entriesLock.WriteLock();
+        m_entriesLock.WriteLock();
         struct Data {
             VMM* current;
             VMM* other;
             bool success;
-        } data = {this, other, true};
+            TLBShootdownBatch shootdown;
+        } data = {this, other, true, {}};
         other->m_mapEntries.forEach([](void* data, uint64_t virt, MapEntry* entry) -> bool {
             Data* d = static_cast<Data*>(data);
             MapEntry* newEntry = (MapEntry*)kcalloc_vmm(1, sizeof(MapEntry));
@@ -1055,34 +1174,12 @@ namespace VMM {
             }
 
             if (entry->anonMap != nullptr) {
+                // Share the whole map. For private mappings, the first write fault on either side gives that side its own copy.
                 spinlock_acquire(&entry->anonMap->lock);
-                AnonMap* map = (AnonMap*)kcalloc_vmm(1, sizeof(AnonMap));
-                Anon** slots = (Anon**)kcalloc_vmm(entry->anonMap->slotCount, sizeof(Anon*));
-                if (map == nullptr || slots == nullptr) {
-                    if (map != nullptr)
-                        kfree_vmm(map);
-                    if (slots != nullptr)
-                        kfree_vmm(slots);
-                    kfree_vmm(newEntry);
-                    spinlock_release(&entry->anonMap->lock);
-                    d->success = false;
-                    return false;
-                }
-
-                memcpy(slots, entry->anonMap->slots, entry->anonMap->slotCount * sizeof(Anon*));
-
-                for (uint64_t i = 0; i < entry->anonMap->slotCount; i++) {
-                    if (slots[i] != nullptr)
-                        slots[i]->refCount++;
-                }
-
-                map->slotCount = entry->anonMap->slotCount;
-                map->slots = slots;
-                map->refCount = 1;
-
+                entry->anonMap->refCount++;
                 spinlock_release(&entry->anonMap->lock);
 
-                newEntry->anonMap = map;
+                newEntry->anonMap = entry->anonMap;
             }
 
             if (entry->memoryObject != nullptr) {
@@ -1104,18 +1201,70 @@ namespace VMM {
                 Protection roProt = static_cast<Protection>(static_cast<uint8_t>(entry->flags.protection) & ~static_cast<uint8_t>(Protection::WRITE));
                 uint64_t count = (entry->endVirt - entry->startVirt) >> PAGE_SIZE_SHIFT;
                 d->other->m_pageMapper->RemapPages(entry->startVirt, count, roProt, entry->flags.user, entry->flags.cacheType);
-                d->other->m_pageMapper->InvalidatePages(entry->startVirt, count, true); // Flush the TLB![cite: 10]
+                d->other->m_pageMapper->QueueShootdown(&d->shootdown, entry->startVirt, count);
             }
 
             d->current->m_mapEntries.Insert(newEntry->startVirt, newEntry);
 
             return true;
         }, &data);
-        m_mapEntries.unlock();
-        other->m_mapEntries.unlock();
+        // One shootdown round for every downgraded entry, must complete before the parent can write again
+        other->m_pageMapper->FlushShootdown(&data.shootdown);
+        m_entriesLock.WriteUnlock();
+        other->m_entriesLock.WriteUnlock();
         return data.success;
     }
 
+    void VMM::GetFaultStats(FaultStats* stats) {
+        stats->objectFaults = __atomic_load_n(&m_objectFaults, __ATOMIC_RELAXED);
+        stats->faultAroundPages = __atomic_load_n(&m_faultAroundPages, __ATOMIC_RELAXED);
+        stats->zeroPageFaults = __atomic_load_n(&m_zeroPageFaults, __ATOMIC_RELAXED);
+    }
+
+    void VMM::GetRSS(RSSInfo* rss) {
+        rss->anonPages = 0;
+        rss->objectPages = 0;
+        rss->zeroPages = 0;
+
+        m_entriesLock.ReadLock();
+        struct Data {
+            VMM* vmm;
+            RSSInfo* rss;
+        } data = {this, rss};
+        m_mapEntries.forEach([](void* data, uint64_t, MapEntry* entry) -> void {
+            Data* d = static_cast<Data*>(data);
+            spinlock_acquire(&entry->lock);
+            AnonMap* map = entry->anonMap;
+            MemoryObject* obj = entry->memoryObject;
+            uint64_t pageCount = (entry->endVirt - entry->startVirt) >> PAGE_SIZE_SHIFT;
+
+            if (map != nullptr) {
+                spinlock_acquire(&map->lock);
+                for (uint64_t i = 0; i < map->slotCount; i++) {
+                    if (map->slots[i] != nullptr)
+                        d->rss->anonPages++;
+                    else if (obj == nullptr && entry->flags.zero && IsZeroPage(d->vmm->m_pageMapper, entry->startVirt + i * PAGE_SIZE))
+                        d->rss->zeroPages++;
+                }
+                spinlock_release(&map->lock);
+            }
+
+            if (obj != nullptr) {
+                spinlock_acquire(&obj->lock);
+                uint64_t end = entry->offset + pageCount * PAGE_SIZE;
+                for (AVLTree::wAVLTreeNode* node = obj->pages.FindNodeOrHigher(entry->offset); node != nullptr && node->key < end; node = obj->pages.NextNode(node)) {
+                    Page* page = reinterpret_cast<Page*>(node->value);
+                    uint64_t index = (node->key - entry->offset) >> PAGE_SIZE_SHIFT;
+                    if (page->physAddr != 0 && (map == nullptr || map->slots[index] == nullptr))
+                        d->rss->objectPages++;
+                }
+                spinlock_release(&obj->lock);
+            }
+            spinlock_release(&entry->lock);
+        }, &data);
+        m_entriesLock.ReadUnlock();
+    }
+
     PageMapper* VMM::GetPageMapper() {
         return m_pageMapper;
     }
@@ -1125,11 +1274,14 @@ namespace VMM {
     }
 
     void VMM::DumpRegions(fd_t fd) {
-        fprintf(fd, "\nMap Entries:\n");
-        m_mapEntries.lock();
+        RSSInfo rss;
+        GetRSS(&rss);
+        fprintf(fd, "\nRSS: anon = %lu pages, object = %lu pages, zero page mappings = %lu\n", rss.anonPages, rss.objectPages, rss.zeroPages);
+        fprintf(fd, "Map Entries:\n");
+        m_entriesLock.ReadLock();
         m_mapEntries.forEach([](void* data, uint64_t key, MapEntry* entry) -> void {
             fd_t fd = (fd_t)data;
-            fprintf(fd, "Entry: %lx-%lx, offset = %lx, anonMap = %p, memoryObject = %p, Flags:\n\tprot = %x\n\tcacheType = %x\n\tuser = %s, needsCopy = %s, isPrivate = %s, zero = %s\n", entry->startVirt, entry->endVirt, entry->offset, entry->anonMap, entry->memoryObject, entry->flags.protection, entry->flags.cacheType, entry->flags.user ? "true" : "false", entry->flags.needsCopy ? "true" : "false", entry->flags.isPrivate ? "true" : "false", entry->flags.zero ? "true" : "false");
+            fprintf(fd, "Entry: %lx-%lx, offset = %lx, anonMap = %p, memoryObject = %p, Flags:\n\tprot = %x\n\tcacheType = %x\n\tuser = %s, needsCopy = %s, isPrivate = %s, zero = %s, largePages = %s\n", entry->startVirt, entry->endVirt, entry->offset, entry->anonMap, entry->memoryObject, entry->flags.protection, entry->flags.cacheType, entry->flags.user ? "true" : "false", entry->flags.needsCopy ? "true" : "false", entry->flags.isPrivate ? "true" : "false", entry->flags.zero ? "true" : "false", entry->flags.largePages ? "true" : "false");
             if (entry->anonMap != nullptr) {
                 AnonMap* map = entry->anonMap;
                 spinlock_acquire(&map->lock);
@@ -1144,10 +1296,143 @@ namespace VMM {
             }
             fputc(fd, '\n');
         }, (void*)fd);
-        m_mapEntries.unlock();
+        m_entriesLock.ReadUnlock();
+        fprintf(fd, "Object faults: %lu, pages mapped by fault-around: %lu, zero page faults: %lu\n", __atomic_load_n(&m_objectFaults, __ATOMIC_RELAXED), __atomic_load_n(&m_faultAroundPages, __ATOMIC_RELAXED), __atomic_load_n(&m_zeroPageFaults, __ATOMIC_RELAXED));
         fputc(fd, '\n');
     }
 
+    // Map the already resident pages in [first, first + count) that aren't mapped yet, skipping the page that faulted
+    void VMM::FaultAround(MemoryObject* obj, AnonMap* map, uint64_t entryStart, uint64_t offset, uint64_t first, uint64_t count, uint64_t skip, Protection prot, bool user, CacheType cacheType) {
+        constexpr uint64_t batchSize = 32;
+        uint64_t phys[batchSize];
+        uint64_t mapped = 0;
+
+        for (uint64_t i = 0; i < count; i += batchSize) {
+            uint64_t batch = MIN(count - i, batchSize);
+            bool any = false;
+            for (uint64_t j = 0; j < batch; j++) {
+                uint64_t index = first + i + j;
+                phys[j] = 0;
+                if (index == skip || (map != nullptr && map->slots[index] != nullptr))
+                    continue; // private copies are left to fault normally
+                Page* page = obj->pages.Find(offset + index * PAGE_SIZE);
+                if (page == nullptr || page->physAddr == 0 || !isLessOrEqualProt(prot, page->protection))
+                    continue;
+                if (m_pageMapper->GetPhysicalAddr(entryStart + index * PAGE_SIZE) != 0)
+                    continue;
+                phys[j] = page->physAddr;
+                any = true;
+                mapped++;
+            }
+            if (any)
+                m_pageMapper->MapPageArray(entryStart + (first + i) * PAGE_SIZE, phys, batch, prot, user, cacheType);
+        }
+
+        __atomic_add_fetch(&m_faultAroundPages, mapped, __ATOMIC_RELAXED);
+    }
+
+    void* VMM::AllocateAlignedRegion(uint64_t count) {
+        uint64_t extra = (LARGE_PAGE_SIZE >> PAGE_SIZE_SHIFT) - 1;
+        void* region = m_vmRegionAllocator->AllocatePages(count + extra);
+        if (region == nullptr)
+            return m_vmRegionAllocator->AllocatePages(count);
+
+        uint64_t start = (uint64_t)region;
+        uint64_t aligned = ALIGN_UP(start, LARGE_PAGE_SIZE);
+        uint64_t head = (aligned - start) >> PAGE_SIZE_SHIFT;
+        uint64_t tail = extra - head;
+        if (head == 0 && tail == 0)
+            return region;
+
+        if (!m_vmRegionAllocator->ResizeAllocatedRegion(region, count + extra, (void*)aligned, count)) {
+            m_vmRegionAllocator->FreePages(region, count + extra);
+            return m_vmRegionAllocator->AllocatePages(count);
+        }
+        if (head > 0)
+            m_vmRegionAllocator->FreePages(region, head);
+        if (tail > 0)
+            m_vmRegionAllocator->FreePages((void*)(aligned + count * PAGE_SIZE), tail);
+        return (void*)aligned;
+    }
+
+    // Map the whole large page around virtAddr if its slots are either all empty, or all physically contiguous and equally shared
+    bool VMM::MapLargeAnon(AnonMap* map, uint64_t entryStart, uint64_t entryEnd, uint64_t virtAddr, PageFaultCode code, Protection prot, bool user, CacheType cacheType, bool zero) {
+        constexpr uint64_t largeCount = LARGE_PAGE_SIZE >> PAGE_SIZE_SHIFT;
+        uint64_t base = ALIGN_DOWN(virtAddr, LARGE_PAGE_SIZE);
+        if (base < entryStart || base + LARGE_PAGE_SIZE > entryEnd)
+            return false;
+
+        Anon** slots = &map->slots[(base - entryStart) >> PAGE_SIZE_SHIFT];
+
+        if (slots[0] == nullptr) {
+            if (code.present || (zero && !code.write))
+                return false; // reads of zero-fill memory use the zero page instead
+            for (uint64_t i = 1; i < largeCount; i++) {
+                if (slots[i] != nullptr)
+                    return false;
+            }
+            // empty slots can still have zero page mappings, which MapLargePage won't replace
+            if (!m_pageMapper->IsLargeRegionEmpty(base))
+                return false;
+
+            uint64_t phys = (uint64_t)g_PMM->AllocatePages(largeCount);
+            if (phys == 0)
+                return false;
+            if ((phys & (LARGE_PAGE_SIZE - 1)) != 0) {
+                g_PMM->FreePages((void*)phys, largeCount);
+                return false;
+            }
+
+            for (uint64_t i = 0; i < largeCount; i++) {
+                Anon* anon = (Anon*)kcalloc_vmm(1, sizeof(Anon));
+                if (anon == nullptr) {
+                    for (uint64_t j = 0; j < i; j++) {
+                        kfree_vmm(slots[j]);
+                        slots[j] = nullptr;
+                    }
+                    g_PMM->FreePages((void*)phys, largeCount);
+                    return false;
+                }
+                anon->refCount = 1;
+                anon->physAddr = phys + i * PAGE_SIZE;
+                slots[i] = anon;
+            }
+
+            if (zero)
+                memset(to_HHDM((void*)phys), 0, LARGE_PAGE_SIZE);
+
+            if (!m_pageMapper->MapLargePage(base, phys, prot, user, cacheType)) {
+                for (uint64_t i = 0; i < largeCount; i++) {
+                    kfree_vmm(slots[i]);
+                    slots[i] = nullptr;
+                }
+                g_PMM->FreePages((void*)phys, largeCount);
+                return false;
+            }
+            return true;
+        }
+
+        uint64_t phys = slots[0]->physAddr;
+        bool shared = slots[0]->refCount > 1;
+        if ((phys & (LARGE_PAGE_SIZE - 1)) != 0)
+            return false;
+        for (uint64_t i = 1; i < largeCount; i++) {
+            if (slots[i] == nullptr || slots[i]->physAddr != phys + i * PAGE_SIZE || (slots[i]->refCount > 1) != shared)
+                return false;
+        }
+        if (shared && code.write)
+            return false; // needs copying, which happens a page at a time
+
+        Protection mapProt = prot;
+        if (shared)
+            mapProt = static_cast<Protection>(static_cast<uint8_t>(prot) & ~static_cast<uint8_t>(Protection::WRITE));
+
+        if (code.present)
+            return m_pageMapper->IsLargePage(base) && m_pageMapper->RemapLargePage(base, mapProt, user, cacheType);
+
+        return m_pageMapper->MapLargePage(base, phys, mapProt, user, cacheType);
+    }
+
     // split a map entry so that entry has a page count of newPageCount, returns the new upper part
     MapEntry* VMM::SplitMapEntry(MapEntry* entry, uint64_t newPageCount) {
         MapEntry* newEntry = (MapEntry*)kcalloc_vmm(1, sizeof(MapEntry));
@@ -1197,6 +1482,12 @@ namespace VMM {
                 memcpy(newSlots, entry->anonMap->slots, sizeof(Anon*) * newPageCount);
                 memcpy(map->slots, &entry->anonMap->slots[newPageCount], sizeof(Anon*) * upperPageCount);
 
+                // both new maps hold their own reference to each Anon, the old map keeps its references until it is freed
+                for (uint64_t i = 0; i < entry->anonMap->slotCount; i++) {
+                    if (entry->anonMap->slots[i] != nullptr)
+                        entry->anonMap->slots[i]->refCount++;
+                }
+
                 entry->anonMap->refCount--;
                 spinlock_release(&entry->anonMap->lock);
 
@@ -1246,7 +1537,7 @@ namespace VMM {
 
         while (currentCount < totalCount) {
             if (lock)
-                m_mapEntries.lock();
+                m_entriesLock.WriteLock();
             AVLTree::wAVLTreeNode* node = nullptr;
             if (full)
                 node = m_mapEntries.FindNode(virt);
@@ -1254,7 +1545,7 @@ namespace VMM {
                 node = m_mapEntries.FindNodeOrLower(virt);
             if (node == nullptr || node->value == 0) {
                 if (lock)
-                    m_mapEntries.unlock();
+                    m_entriesLock.WriteUnlock();
                 return false;
             }
 
@@ -1265,7 +1556,7 @@ namespace VMM {
             MapEntry* entry = reinterpret_cast<MapEntry*>(node->value);
             if ((full && entry->startVirt != virt) || (!full && entry->endVirt < virt + count * PAGE_SIZE)) {
                 if (lock)
-                    m_mapEntries.unlock();
+                    m_entriesLock.WriteUnlock();
                 return false;
             }
 
@@ -1277,7 +1568,7 @@ namespace VMM {
                     MapEntry* newEntry = SplitMapEntry(entry, (virt - entry->startVirt) >> PAGE_SIZE_SHIFT);
                     if (newEntry == nullptr) {
                         if (lock)
-                            m_mapEntries.unlock();
+                            m_entriesLock.WriteUnlock();
                         return false;
                     }
                     entry = newEntry;
@@ -1287,7 +1578,7 @@ namespace VMM {
                     MapEntry* newEntry = SplitMapEntry(entry, count);
                     if (newEntry == nullptr) {
                         if (lock)
-                            m_mapEntries.unlock();
+                            m_entriesLock.WriteUnlock();
                         return false;
                     }
                     m_mapEntries.Insert(newEntry->startVirt, newEntry);
@@ -1299,7 +1590,7 @@ namespace VMM {
             }
 
             if (lock)
-                m_mapEntries.unlock();
+                m_entriesLock.WriteUnlock();
 
             m_vmRegionAllocator->FreePages(reinterpret_cast<void*>(virt), count, full, lock);
 
@@ -1319,11 +1610,19 @@ namespace VMM {
                 // go through once and unmap the pages
                 for (uint64_t i = 0; i < map->slotCount; i++) {
                     Anon* anon = map->slots[i];
-                    if (anon != nullptr) {
+                    uint64_t largeCount = LARGE_PAGE_SIZE >> PAGE_SIZE_SHIFT;
+                    uint64_t pageVirt = entry->startVirt + i * PAGE_SIZE;
+                    if (entry->flags.largePages && (pageVirt & (LARGE_PAGE_SIZE - 1)) == 0 && map->slotCount - i >= largeCount && m_pageMapper->IsLargePage(pageVirt)) {
+                        if (lowestMapped > i)
+                            lowestMapped = i;
+                        highestMapped = i + largeCount - 1;
+                        m_pageMapper->UnmapLargePage(pageVirt);
+                        i += largeCount - 1;
+                    } else if (anon != nullptr) {
                         if (lowestMapped > i)
                             lowestMapped = i;
                         highestMapped = i;
-                        m_pageMapper->UnmapPage(entry->startVirt + i * PAGE_SIZE);
+                        m_pageMapper->UnmapPage(pageVirt);
                     } else if (obj != nullptr) {
                         Page* page = obj->pages.Find(entry->offset + i);
                         if (page != nullptr) {
@@ -1332,28 +1631,34 @@ namespace VMM {
                             highestMapped = i;
                             m_pageMapper->UnmapPage(entry->startVirt + i * PAGE_SIZE);
                         }
+                    } else if (entry->flags.zero && IsZeroPage(m_pageMapper, pageVirt)) {
+                        if (lowestMapped > i)
+                            lowestMapped = i;
+                        highestMapped = i;
+                        m_pageMapper->UnmapPage(pageVirt);
                     }
                 }
 
                 // Invalidate the unmapped pages
                 if (lowestMapped != UINT64_MAX)
-                    m_pageMapper->InvalidatePages(reinterpret_cast<uint64_t>(virtAddr) + lowestMapped * PAGE_SIZE, (highestMapped - lowestMapped) * PAGE_SIZE, true);
+                    m_pageMapper->InvalidatePages(entry->startVirt + lowestMapped * PAGE_SIZE, highestMapped - lowestMapped + 1, true);
 
-                // go through a second time and free the underlying pages and structures
-                for (uint64_t i = 0; i < map->slotCount; i++) {
-                    Anon* anon = map->slots[i];
-                    if (anon != nullptr) {
-                        map->slots[i] = nullptr;
-                        g_PMM->FreePage(reinterpret_cast<void*>(anon->physAddr));
-                        anon->refCount--;
-                        if (anon->refCount == 0)
-                            kfree_vmm(anon);
+                // go through a second time and free the underlying pages and structures, unless another address space still uses the map
+                if (map->refCount == 0) {
+                    for (uint64_t i = 0; i < map->slotCount; i++) {
+                        Anon* anon = map->slots[i];
+                        if (anon != nullptr) {
+                            map->slots[i] = nullptr;
+                            anon->refCount--;
+                            if (anon->refCount == 0) {
+                                g_PMM->FreePage(reinterpret_cast<void*>(anon->physAddr));
+                                kfree_vmm(anon);
+                            }
+                        }
                     }
-                }
-
-                if (map->refCount == 0)
+                    kfree_vmm(map->slots);
                     kfree_vmm(map);
-                else
+                } else
                     spinlock_release(&map->lock);
 
                 if (obj != nullptr) {
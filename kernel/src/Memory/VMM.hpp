@@ -24,6 +24,8 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <DataStructures/AVLTree.hpp>
 
+#include <Scheduling/RWLock.hpp>
+
 #include "Pager.hpp"
 
 class PageMapper;
@@ -87,6 +89,9 @@ namespace VMM {
         spinlock_new(lock);
     };
 
+#define VMM_FAULT_AROUND_PAGES 16 // default window for read faults on object-backed mappings
+#define VMM_FAULT_AROUND_MAX_PAGES 256 // limit for the window when access is sequential
+
     struct MapEntry {
         uint64_t startVirt;
         uint64_t endVirt;
@@ -102,11 +107,35 @@ namespace VMM {
             bool needsCopy; // True if write fault should trigger an anonoymous copy
             bool isPrivate;
             bool zero;
+            bool largePages; // anonymous pages may be mapped with large pages where aligned
         } flags;
         
         uint64_t wireCount; // currently unused
+
+        spinlock_new(lock); // serialises faults on this entry, which only hold the read side of the entry tree lock
+
+        // fault-around sequential access detection
+        uint64_t faultNext; // page index just after the last fault-around window
+        uint64_t faultWindow; // in pages, 0 if there hasn't been a fault yet
     };
 
+    struct FaultStats {
+        uint64_t objectFaults; // faults on object-backed mappings
+        uint64_t faultAroundPages; // pages mapped ahead of time, each one a fault avoided if touched
+        uint64_t zeroPageFaults; // read faults served by the shared zero page instead of a new page
+    };
+
+    struct RSSInfo {
+        uint64_t anonPages; // private pages, including ones shared copy-on-write with another address space
+        uint64_t objectPages; // resident memory object pages that are mapped directly
+        uint64_t zeroPages; // mappings of the shared zero page, which don't use any memory
+    };
+
+    void SetFaultAroundPages(uint64_t pages); // 0 disables fault-around
+    uint64_t GetFaultAroundPages();
+
+    void ReleaseMemoryObject(MemoryObject* obj); // drops a reference from GetSharedObject, the last one frees the object and its pages
+
     struct AllocFlags {
         Protection protection;
         CacheType cacheType;
@@ -151,7 +180,11 @@ namespace VMM {
 
         bool ValidateRead(const void* addr, size_t size, bool user = true);
         bool ValidateWrite(const void* addr, size_t size, bool user = true);
-        bool CopyStringFromUser(char* kernelDst, const void* userSrc, size_t maxSize, size_t* outSize, bool user = true);
+
+        MemoryObject* GetSharedObject(const void* addr, uint64_t* offset); // null if addr isn't in a shared object-backed mapping, offset is in bytes. Referenced, see ReleaseMemoryObject
+
+        void GetFaultStats(FaultStats* stats);
+        void GetRSS(RSSInfo* rss);
 
         bool Fork(VMM* other); // this function does NOT perform cleanup of created regions on error
 
@@ -162,12 +195,21 @@ namespace VMM {
 
     private:
         MapEntry* SplitMapEntry(MapEntry* entry, uint64_t newPageCount); // split a map entry so that entry has a page count of newPageCount, returns the new upper part
+        bool HandleEntryFault(MapEntry* entry, PageFaultCode code, uint64_t virtAddr); // entry must be locked
         bool Internal_FreePages(void* virtAddr, uint64_t totalCount, bool multipleRegions, bool lock); // lock controls whether the mapEntries should be locked, and if the vmRegionAllocator should be locked
+        void* AllocateAlignedRegion(uint64_t count); // region aligned to LARGE_PAGE_SIZE
+        void FaultAround(MemoryObject* obj, AnonMap* map, uint64_t entryStart, uint64_t offset, uint64_t first, uint64_t count, uint64_t skip, Protection prot, bool user, CacheType cacheType); // obj, and map if present, must be locked
+        bool MapLargeAnon(AnonMap* map, uint64_t entryStart, uint64_t entryEnd, uint64_t virtAddr, PageFaultCode code, Protection prot, bool user, CacheType cacheType, bool zero); // map lock must be held
 
         // UVM fields
         PageMapper* m_pageMapper;
         VMRegionAllocator* m_vmRegionAllocator;
         AVLTree::wAVLTree<uint64_t, MapEntry*> m_mapEntries; // Key is startVirt
+        RWLock m_entriesLock; // write side for anything that changes the tree or an entry's range, flags or pages
+
+        uint64_t m_objectFaults;
+        uint64_t m_faultAroundPages;
+        uint64_t m_zeroPageFaults;
     };
 
     extern VMM* g_KVMM; // to be implemented in arch-specific code
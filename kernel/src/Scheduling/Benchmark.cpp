@@ -0,0 +1,113 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "Benchmark.hpp"
+#include "Process.hpp"
+#include "Scheduler.hpp"
+#include "Semaphore.hpp"
+#include "Thread.hpp"
+
+#include <stdio.h>
+
+#include <HAL/Time.hpp>
+
+#define YIELD_BENCHMARK_THREADS 2
+
+namespace Scheduler {
+
+    struct BenchmarkRun {
+        void (*entry)(void*);
+        void* data;
+    };
+
+    // Globals, because a thread can still be inside Signal() after the last Wait() in RunBenchmarkThreads returns.
+    // Nothing else is touched after entry returns, which is why the caller's data can be on its stack.
+    BenchmarkRun g_benchmarkRun;
+    Semaphore g_benchmarkDone;
+
+    void BenchmarkThread(void*) {
+        g_benchmarkRun.entry(g_benchmarkRun.data);
+        // the caller may delete our process once every thread has signalled
+        Thread::MoveCurrentToKernelProcess();
+        g_benchmarkDone.Signal();
+        Thread::ExitCurrentThread(true, false, false);
+    }
+
+    bool RunBenchmarkThreads(void (*entry)(void*), void* data, uint64_t count, ProcessorState* cpu, Process* process) {
+        if (count == 0)
+            return false;
+        if (process == nullptr)
+            process = g_KProcess;
+        Thread** threads = new Thread*[count];
+        if (threads == nullptr)
+            return false;
+
+        for (uint64_t i = 0; i < count; i++) {
+            threads[i] = new Thread({BenchmarkThread, nullptr}, process);
+            if (threads[i] == nullptr || !threads[i]->Init()) {
+                delete threads[i];
+                for (uint64_t j = 0; j < i; j++) {
+                    threads[j]->Delete();
+                    delete threads[j];
+                }
+                delete[] threads;
+                return false;
+            }
+        }
+
+        g_benchmarkRun = {entry, data};
+        for (uint64_t i = 0; i < count; i++) {
+            process->AddThread(threads[i]);
+            ScheduleThread(threads[i], cpu);
+        }
+        delete[] threads;
+
+        for (uint64_t i = 0; i < count; i++)
+            g_benchmarkDone.Wait();
+        return true;
+    }
+
+    struct YieldBenchmarkData {
+        uint64_t iterations;
+        uint64_t yields;
+    };
+
+    void YieldBenchmarkThread(void* arg) {
+        YieldBenchmarkData* data = static_cast<YieldBenchmarkData*>(arg);
+        for (uint64_t i = 0; i < data->iterations; i++)
+            YieldCurrentThread();
+        __atomic_add_fetch(&data->yields, data->iterations, __ATOMIC_RELAXED);
+    }
+
+    uint64_t RunYieldBenchmark(uint64_t iterations) {
+        YieldBenchmarkData data = {iterations, 0};
+
+        // Both threads go on this CPU so every yield is a switch between them, unless another CPU steals one
+        uint64_t start = HAL_GetNSTicks();
+        if (!RunBenchmarkThreads(YieldBenchmarkThread, &data, YIELD_BENCHMARK_THREADS, GetCurrentProcessorState())) {
+            printf("Scheduler: failed to create yield benchmark threads\n");
+            return 0;
+        }
+        uint64_t elapsed = HAL_GetNSTicks() - start;
+
+        uint64_t yields = __atomic_load_n(&data.yields, __ATOMIC_RELAXED);
+        uint64_t rate = elapsed > 0 ? yields * 1'000'000'000 / elapsed : 0;
+        printf("Scheduler: %lu yields in %lu us, %lu context switches/s\n", yields, elapsed / 1000, rate);
+        return rate;
+    }
+
+} // namespace Scheduler
@@ -0,0 +1,38 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef _SCHEDULER_BENCHMARK_HPP
+#define _SCHEDULER_BENCHMARK_HPP
+
+#include <stdint.h>
+
+#include "Scheduler.hpp"
+
+class Process;
+
+namespace Scheduler {
+
+    // Harness for the kernel microbenchmarks. Runs entry(data) on `count` new threads of `process` (the kernel process if null),
+    // all on `cpu` unless it is null, and blocks until every one has returned. Every thread is created before any is scheduled,
+    // so on failure nothing ran. data only needs to outlive the call. Only one run at a time.
+    bool RunBenchmarkThreads(void (*entry)(void*), void* data, uint64_t count, ProcessorState* cpu = nullptr, Process* process = nullptr);
+
+    // Two kernel threads yield to each other `iterations` times each. Blocks until both finish, prints and returns context switches per second.
+    uint64_t RunYieldBenchmark(uint64_t iterations);
+
+} // namespace Scheduler
+
+#endif /* _SCHEDULER_BENCHMARK_HPP */
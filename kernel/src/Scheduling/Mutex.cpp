@@ -0,0 +1,253 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "Mutex.hpp"
+#include "Scheduler.hpp"
+#include "Thread.hpp"
+#include "ThreadList.hpp"
+
+#include <spinlock.h>
+#include <stdio.h>
+
+#include <HAL/HAL.hpp>
+#include <HAL/Processor.hpp>
+#include <HAL/Time.hpp>
+
+#if _FROSTYOS_ENABLE_MUTEX_STATS
+
+struct MutexGlobalStats {
+    uint64_t acquireCount;
+    uint64_t contendedCount;
+    uint64_t blockCount;
+    uint64_t maxHoldNS;
+    Mutex* maxHoldMutex;
+    void* maxHoldCaller;
+    spinlock_t maxHoldLock;
+};
+
+MutexGlobalStats g_MutexGlobalStats = {0, 0, 0, 0, nullptr, nullptr, SPINLOCK_DEFAULT_VALUE};
+
+#endif
+
+namespace {
+    uint64_t GetSelf() {
+        int intState = Processor::DisableInterrupts();
+        Scheduler::ProcessorState* state = GetCurrentProcessorState();
+        Thread* thread = state != nullptr ? state->currentThread : nullptr;
+        Processor::EnableInterrupts(intState);
+        return thread != nullptr ? (uint64_t)thread : MUTEX_ANONYMOUS_OWNER;
+    }
+
+    // Only a hint, the owner can be descheduled as soon as we look. It may also have exited, so it must not be dereferenced.
+    bool IsOwnerRunning(uint64_t state) {
+        uint64_t owner = state & ~MUTEX_WAITERS;
+        if (owner == MUTEX_ANONYMOUS_OWNER)
+            return true;
+        return Scheduler::IsThreadOnCPU((Thread*)owner);
+    }
+
+    bool CanBlock() {
+        Scheduler::ProcessorState* state = GetCurrentProcessorState();
+        return Scheduler::isRunning() && state != nullptr && state->processor != nullptr && state->currentThread != nullptr;
+    }
+}
+
+Mutex::Mutex() : m_state(0), m_waitingThreads(), m_waitLock(SPINLOCK_DEFAULT_VALUE) {
+#if _FROSTYOS_ENABLE_MUTEX_STATS
+    m_acquireTime = 0;
+    m_acquireCaller = nullptr;
+    m_stats = {0, 0, 0, 0, 0, nullptr};
+#endif
+}
+
+Mutex::~Mutex() {
+    spinlock_acquire(&m_waitLock);
+    while (m_waitingThreads.getCount() > 0) {
+        Thread* thread = m_waitingThreads.popFront();
+        assert(thread != nullptr);
+        thread->yieldCallback = {};
+        assert(Scheduler::AddExistingThread(thread));
+    }
+    spinlock_release(&m_waitLock);
+}
+
+void Mutex::Lock() {
+    uint64_t self = GetSelf();
+    uint64_t expected = 0;
+    if (__atomic_compare_exchange_n(&m_state, &expected, self, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+#if _FROSTYOS_ENABLE_MUTEX_STATS
+        RecordAcquire(false, false, __builtin_return_address(0));
+#endif
+        return;
+    }
+    LockSlow(self, __builtin_return_address(0));
+}
+
+bool Mutex::TryLock() {
+    uint64_t self = GetSelf();
+    uint64_t state = __atomic_load_n(&m_state, __ATOMIC_RELAXED);
+    while ((state & ~MUTEX_WAITERS) == 0) {
+        if (__atomic_compare_exchange_n(&m_state, &state, self | state, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+#if _FROSTYOS_ENABLE_MUTEX_STATS
+            RecordAcquire(false, false, __builtin_return_address(0));
+#endif
+            return true;
+        }
+    }
+    return false;
+}
+
+void Mutex::Unlock() {
+#if _FROSTYOS_ENABLE_MUTEX_STATS
+    uint64_t holdTime = HAL_GetNSTicks() - m_acquireTime;
+    m_stats.totalHoldNS += holdTime;
+    if (holdTime > m_stats.maxHoldNS) {
+        m_stats.maxHoldNS = holdTime;
+        m_stats.maxHoldCaller = m_acquireCaller;
+    }
+    if (holdTime > __atomic_load_n(&g_MutexGlobalStats.maxHoldNS, __ATOMIC_RELAXED)) {
+        spinlock_acquire(&g_MutexGlobalStats.maxHoldLock);
+        if (holdTime > g_MutexGlobalStats.maxHoldNS) {
+            __atomic_store_n(&g_MutexGlobalStats.maxHoldNS, holdTime, __ATOMIC_RELAXED);
+            g_MutexGlobalStats.maxHoldMutex = this;
+            g_MutexGlobalStats.maxHoldCaller = m_acquireCaller;
+        }
+        spinlock_release(&g_MutexGlobalStats.maxHoldLock);
+    }
+#endif
+    uint64_t state = __atomic_load_n(&m_state, __ATOMIC_RELAXED);
+    if ((state & MUTEX_WAITERS) == 0 && __atomic_compare_exchange_n(&m_state, &state, 0, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        return;
+    UnlockSlow();
+}
+
+Thread* Mutex::GetOwner() const {
+    uint64_t owner = __atomic_load_n(&m_state, __ATOMIC_RELAXED) & ~MUTEX_WAITERS;
+    if (owner == MUTEX_ANONYMOUS_OWNER)
+        return nullptr;
+    return (Thread*)owner;
+}
+
+void Mutex::LockSlow(uint64_t self, void* caller) {
+    bool blocked = false;
+    uint64_t spins = 0;
+    while (true) {
+        uint64_t state = __atomic_load_n(&m_state, __ATOMIC_RELAXED);
+        if ((state & ~MUTEX_WAITERS) == 0) {
+            // keep MUTEX_WAITERS so our Unlock wakes whoever is still queued
+            if (__atomic_compare_exchange_n(&m_state, &state, self | state, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+                break;
+            continue;
+        }
+
+        // The owner is likely to release soon if it is on a CPU, so don't pay for a context switch yet
+        if ((spins < MUTEX_SPIN_LIMIT && IsOwnerRunning(state)) || !CanBlock()) {
+            spins++;
+            PAUSE();
+            continue;
+        }
+
+        int intState = Processor::DisableInterrupts();
+        spinlock_acquire(&m_waitLock);
+        // Publish MUTEX_WAITERS under m_waitLock so UnlockSlow can't miss us
+        state = __atomic_load_n(&m_state, __ATOMIC_RELAXED);
+        if ((state & ~MUTEX_WAITERS) == 0 || !CanBlock() || ((state & MUTEX_WAITERS) == 0 && !__atomic_compare_exchange_n(&m_state, &state, state | MUTEX_WAITERS, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))) {
+            spinlock_release(&m_waitLock);
+            Processor::EnableInterrupts(intState);
+            continue;
+        }
+
+        Thread* thread = Scheduler::RemoveCurrentThread(true);
+        assert(thread != nullptr);
+        thread->sleepDeadline = 0;
+        thread->yieldCallback = {};
+        m_waitingThreads.pushBack(thread); // queue waiter before yielding to avoid lost wakeups
+        spinlock_release(&m_waitLock);
+        Scheduler_SaveAndYield(thread);
+        Processor::EnableInterrupts(intState);
+        blocked = true;
+        spins = 0;
+    }
+#if _FROSTYOS_ENABLE_MUTEX_STATS
+    RecordAcquire(true, blocked, caller);
+#else
+    (void)blocked;
+    (void)caller;
+#endif
+}
+
+void Mutex::UnlockSlow() {
+    int intState = Processor::DisableInterrupts();
+    spinlock_acquire(&m_waitLock);
+    Thread* thread = m_waitingThreads.getCount() > 0 ? m_waitingThreads.popFront() : nullptr;
+    // The woken thread has to compete for the lock again, so leave the bit set for anyone still queued
+    __atomic_store_n(&m_state, m_waitingThreads.getCount() > 0 ? MUTEX_WAITERS : 0, __ATOMIC_RELEASE);
+    if (thread != nullptr) {
+        thread->yieldCallback = {};
+        thread->sleepDeadline = 0;
+        assert(Scheduler::AddExistingThread(thread));
+    }
+    spinlock_release(&m_waitLock);
+    Processor::EnableInterrupts(intState);
+}
+
+#if _FROSTYOS_ENABLE_MUTEX_STATS
+
+void Mutex::RecordAcquire(bool contended, bool blocked, void* caller) {
+    // called with the mutex held, so only the global counters need to be atomic
+    m_acquireTime = HAL_GetNSTicks();
+    m_acquireCaller = caller;
+    m_stats.acquireCount++;
+    __atomic_add_fetch(&g_MutexGlobalStats.acquireCount, 1, __ATOMIC_RELAXED);
+    if (contended) {
+        m_stats.contendedCount++;
+        __atomic_add_fetch(&g_MutexGlobalStats.contendedCount, 1, __ATOMIC_RELAXED);
+    }
+    if (blocked) {
+        m_stats.blockCount++;
+        __atomic_add_fetch(&g_MutexGlobalStats.blockCount, 1, __ATOMIC_RELAXED);
+    }
+}
+
+const Mutex::Stats& Mutex::GetStats() const {
+    return m_stats;
+}
+
+void Mutex::DumpStats(fd_t fd) const {
+    fprintf(fd, "Mutex %p: owner %p, %lu acquires, %lu contended, %lu blocked, average hold %lu ns, max hold %lu ns (acquired at %p)\n", this, GetOwner(), m_stats.acquireCount, m_stats.contendedCount, m_stats.blockCount, m_stats.acquireCount > 0 ? m_stats.totalHoldNS / m_stats.acquireCount : 0, m_stats.maxHoldNS, m_stats.maxHoldCaller);
+}
+
+void Mutex::DumpGlobalStats(fd_t fd) {
+    uint64_t acquires = __atomic_load_n(&g_MutexGlobalStats.acquireCount, __ATOMIC_RELAXED);
+    uint64_t contended = __atomic_load_n(&g_MutexGlobalStats.contendedCount, __ATOMIC_RELAXED);
+    fprintf(fd, "Mutexes: %lu acquires, %lu contended (%lu%%), %lu blocked\n", acquires, contended, acquires > 0 ? contended * 100 / acquires : 0, __atomic_load_n(&g_MutexGlobalStats.blockCount, __ATOMIC_RELAXED));
+    spinlock_acquire(&g_MutexGlobalStats.maxHoldLock);
+    fprintf(fd, "Longest hold: %lu ns on mutex %p, acquired at %p\n", g_MutexGlobalStats.maxHoldNS, g_MutexGlobalStats.maxHoldMutex, g_MutexGlobalStats.maxHoldCaller);
+    spinlock_release(&g_MutexGlobalStats.maxHoldLock);
+}
+
+#else
+
+void Mutex::DumpStats(fd_t fd) const {
+    fprintf(fd, "Mutex %p: owner %p\n", this, GetOwner());
+}
+
+void Mutex::DumpGlobalStats(fd_t fd) {
+    fprintf(fd, "Mutex stats are not enabled, rebuild with FROSTYOS_ENABLE_MUTEX_STATS\n");
+}
+
+#endif
@@ -14,27 +14,64 @@ GNU General Public License for more details.
 You should have received a copy of the GNU General Public License
 along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
-
 #ifndef _MUTEX_HPP
 #define _MUTEX_HPP
 
-#include "Semaphore.hpp"
+#include <spinlock.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ThreadList.hpp"
+
+class Thread;
+
+#define MUTEX_WAITERS 1UL // set while m_waitingThreads may be non-empty
+#define MUTEX_ANONYMOUS_OWNER 2UL // held by something that isn't a scheduled thread, e.g. during early boot
+#define MUTEX_SPIN_LIMIT 4096 // PAUSE iterations spent waiting on a running owner before blocking
 
 class Mutex {
 public:
-    Mutex() : m_semaphore(1, 1) {}
-    ~Mutex() {}
+    Mutex();
+    ~Mutex();
+
+    void Lock();
+    bool TryLock();
+    void Unlock();
 
-    inline void Lock() {
-        m_semaphore.Wait();
-    }
+    Thread* GetOwner() const; // nullptr if unlocked or not held by a thread
 
-    inline void Unlock() {
-        m_semaphore.Signal();
-    }
+#if _FROSTYOS_ENABLE_MUTEX_STATS
+    struct Stats {
+        uint64_t acquireCount;
+        uint64_t contendedCount; // had to wait at all
+        uint64_t blockCount; // had to leave the CPU
+        uint64_t totalHoldNS;
+        uint64_t maxHoldNS;
+        void* maxHoldCaller;
+    };
+
+    const Stats& GetStats() const;
+#endif
+
+    void DumpStats(fd_t fd) const;
+    static void DumpGlobalStats(fd_t fd); // prints a notice if stats are not enabled
 
 private:
-    Semaphore m_semaphore;
+    void LockSlow(uint64_t self, void* caller);
+    void UnlockSlow();
+
+    // owning Thread* or MUTEX_ANONYMOUS_OWNER, plus MUTEX_WAITERS
+    uint64_t m_state;
+    ThreadList m_waitingThreads;
+    spinlock_t m_waitLock;
+
+#if _FROSTYOS_ENABLE_MUTEX_STATS
+    void RecordAcquire(bool contended, bool blocked, void* caller);
+
+    uint64_t m_acquireTime;
+    void* m_acquireCaller;
+    Stats m_stats;
+#endif
 };
 
-#endif /* _MUTEX_HPP */
\ No newline at end of file
+#endif /* _MUTEX_HPP */
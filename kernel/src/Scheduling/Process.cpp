@@ -127,6 +127,12 @@ bool Process::Create(bool initAlloc) {
 
 void Process::Delete() {
     // TODO: delete all threads
+    // descriptors first, I/O rings have threads running in the address space
+    if (m_FDManager != nullptr) {
+        m_FDManager->Delete();
+        delete m_FDManager;
+        m_FDManager = nullptr;
+    }
     if (m_VMM != nullptr) {
         m_VMM->Delete(); // Clear the VMM mappings before deleting its mapper or allocator
         PageMapper* mapper = m_VMM->GetPageMapper();
@@ -138,11 +144,6 @@ void Process::Delete() {
         delete m_VMM;
         m_VMM = nullptr;
     }
-    if (m_FDManager != nullptr) {
-        m_FDManager->Delete();
-        delete m_FDManager;
-        m_FDManager = nullptr;
-    }
 }
 
 bool Process::CreateMainThread(ThreadEntryPoint entryPoint) {
@@ -292,9 +293,5 @@ bool Process::Fork(Process* other, uint64_t newMainReturn) {
     return true;
 }
 
-AVLTree::wAVLTree<uint64_t, FutexWaitQueue*>& Process::GetFutextList() {
-    return m_futexList;
-}
-
 
 Process* g_KProcess = nullptr;
@@ -43,7 +43,6 @@ struct Credential {
 };
 
 class FileDescriptorManager;
-class FutexWaitQueue;
 
 namespace FS {
     class VNode;
@@ -92,8 +91,6 @@ public:
 
     bool Fork(Process* other, uint64_t newMainReturn);
 
-    AVLTree::wAVLTree<uint64_t, FutexWaitQueue*>& GetFutextList();
-
 private:
     ProcessMode m_Mode;
     VMM::VMM* m_VMM;
@@ -106,7 +103,6 @@ private:
     Credential m_cred;
     FileDescriptorManager* m_FDManager;
     FS::VNode* m_cwd;
-    AVLTree::wAVLTree<uint64_t, FutexWaitQueue*> m_futexList;
 };
 
 extern Process* g_KProcess;
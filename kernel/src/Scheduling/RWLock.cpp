@@ -0,0 +1,169 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "RWLock.hpp"
+#include "Scheduler.hpp"
+#include "Thread.hpp"
+#include "ThreadList.hpp"
+
+#include <spinlock.h>
+
+#include <HAL/Processor.hpp>
+
+namespace {
+    // Never sleep with interrupts off. That includes the page fault handler, which runs from an interrupt gate, so faults always spin
+    bool CanBlock() {
+        if (!Processor::AreInterruptsEnabled())
+            return false;
+        Scheduler::ProcessorState* state = GetCurrentProcessorState();
+        return Scheduler::isRunning() && state != nullptr && state->processor != nullptr && state->currentThread != nullptr;
+    }
+}
+
+RWLock::RWLock() : m_state(0), m_waitingReaders(), m_waitingWriters(), m_waitLock(SPINLOCK_DEFAULT_VALUE) {
+
+}
+
+RWLock::~RWLock() {
+
+}
+
+void RWLock::ReadLock() {
+    uint64_t state = __atomic_load_n(&m_state, __ATOMIC_RELAXED);
+    if ((state & (RWLOCK_WRITER | RWLOCK_WRITER_WAITING)) == 0 && __atomic_compare_exchange_n(&m_state, &state, state + RWLOCK_READER, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return;
+    ReadLockSlow();
+}
+
+void RWLock::ReadUnlock() {
+    uint64_t state = __atomic_sub_fetch(&m_state, RWLOCK_READER, __ATOMIC_RELEASE);
+    if (state < RWLOCK_READER && (state & RWLOCK_WAITERS) != 0)
+        Wake();
+}
+
+void RWLock::WriteLock() {
+    uint64_t state = __atomic_load_n(&m_state, __ATOMIC_RELAXED);
+    if ((state & ~(RWLOCK_WAITERS | RWLOCK_WRITER_WAITING)) == 0 && __atomic_compare_exchange_n(&m_state, &state, state | RWLOCK_WRITER, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return;
+    WriteLockSlow();
+}
+
+void RWLock::WriteUnlock() {
+    uint64_t state = __atomic_fetch_and(&m_state, ~RWLOCK_WRITER, __ATOMIC_RELEASE);
+    if ((state & RWLOCK_WAITERS) != 0)
+        Wake();
+}
+
+void RWLock::ReadLockSlow() {
+    uint64_t spins = 0;
+    while (true) {
+        uint64_t state = __atomic_load_n(&m_state, __ATOMIC_RELAXED);
+        if ((state & (RWLOCK_WRITER | RWLOCK_WRITER_WAITING)) == 0) {
+            if (__atomic_compare_exchange_n(&m_state, &state, state + RWLOCK_READER, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+                return;
+            continue;
+        }
+
+        if (spins < RWLOCK_SPIN_LIMIT || !CanBlock()) {
+            spins++;
+            PAUSE();
+            continue;
+        }
+
+        Block(&m_waitingReaders, RWLOCK_WRITER | RWLOCK_WRITER_WAITING, RWLOCK_WAITERS);
+        spins = 0;
+    }
+}
+
+void RWLock::WriteLockSlow() {
+    uint64_t spins = 0;
+    while (true) {
+        uint64_t state = __atomic_load_n(&m_state, __ATOMIC_RELAXED);
+        if ((state & ~(RWLOCK_WAITERS | RWLOCK_WRITER_WAITING)) == 0) {
+            // keep the waiter bits so our unlock wakes whoever is still queued
+            if (__atomic_compare_exchange_n(&m_state, &state, state | RWLOCK_WRITER, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+                return;
+            continue;
+        }
+
+        if (spins < RWLOCK_SPIN_LIMIT || !CanBlock()) {
+            spins++;
+            PAUSE();
+            continue;
+        }
+
+        Block(&m_waitingWriters, ~(RWLOCK_WAITERS | RWLOCK_WRITER_WAITING), RWLOCK_WAITERS | RWLOCK_WRITER_WAITING);
+        spins = 0;
+    }
+}
+
+void RWLock::Block(ThreadList* list, uint64_t blockMask, uint64_t setBits) {
+    int intState = Processor::DisableInterrupts();
+    spinlock_acquire(&m_waitLock);
+    // Publish the waiter bits under m_waitLock so Wake can't miss us
+    uint64_t state = __atomic_load_n(&m_state, __ATOMIC_RELAXED);
+    while ((state & blockMask) != 0 && (state & setBits) != setBits) {
+        if (__atomic_compare_exchange_n(&m_state, &state, state | setBits, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+    }
+    if ((state & blockMask) == 0 || !CanBlock()) {
+        spinlock_release(&m_waitLock);
+        Processor::EnableInterrupts(intState);
+        return;
+    }
+
+    Thread* thread = Scheduler::RemoveCurrentThread(true);
+    assert(thread != nullptr);
+    thread->sleepDeadline = 0;
+    thread->yieldCallback = {};
+    list->pushBack(thread); // queue waiter before yielding to avoid lost wakeups
+    spinlock_release(&m_waitLock);
+    Scheduler_SaveAndYield(thread);
+    Processor::EnableInterrupts(intState);
+}
+
+// Queued writers go first, otherwise every queued reader is woken. Woken threads compete for the lock again.
+void RWLock::Wake() {
+    int intState = Processor::DisableInterrupts();
+    spinlock_acquire(&m_waitLock);
+
+    ThreadList woken;
+    if (m_waitingWriters.getCount() > 0)
+        woken.pushBack(m_waitingWriters.popFront());
+    else {
+        while (m_waitingReaders.getCount() > 0)
+            woken.pushBack(m_waitingReaders.popFront());
+    }
+
+    uint64_t bits = 0;
+    if (m_waitingWriters.getCount() > 0)
+        bits = RWLOCK_WAITERS | RWLOCK_WRITER_WAITING;
+    else if (m_waitingReaders.getCount() > 0)
+        bits = RWLOCK_WAITERS;
+    uint64_t state = __atomic_load_n(&m_state, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&m_state, &state, (state & ~(RWLOCK_WAITERS | RWLOCK_WRITER_WAITING)) | bits, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    while (woken.getCount() > 0) {
+        Thread* thread = woken.popFront();
+        thread->yieldCallback = {};
+        thread->sleepDeadline = 0;
+        assert(Scheduler::AddExistingThread(thread));
+    }
+
+    spinlock_release(&m_waitLock);
+    Processor::EnableInterrupts(intState);
+}
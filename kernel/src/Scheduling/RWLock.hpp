@@ -0,0 +1,55 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef _RWLOCK_HPP
+#define _RWLOCK_HPP
+
+#include <spinlock.h>
+#include <stdint.h>
+
+#include "ThreadList.hpp"
+
+#define RWLOCK_WRITER 1UL // held for writing
+#define RWLOCK_WAITERS 2UL // set while either wait list may be non-empty
+#define RWLOCK_WRITER_WAITING 4UL // a writer is queued, so new readers wait behind it
+#define RWLOCK_READER 8UL // reader count is m_state / RWLOCK_READER
+#define RWLOCK_SPIN_LIMIT 4096 // PAUSE iterations before blocking
+
+// Sleeping reader-writer lock. Not recursive, and a reader can't upgrade to a writer.
+class RWLock {
+public:
+    RWLock();
+    ~RWLock();
+
+    void ReadLock();
+    void ReadUnlock();
+
+    void WriteLock();
+    void WriteUnlock();
+
+private:
+    void ReadLockSlow();
+    void WriteLockSlow();
+    void Wake();
+    void Block(ThreadList* list, uint64_t blockMask, uint64_t setBits); // returns without blocking if (m_state & blockMask) == 0
+
+    uint64_t m_state;
+    ThreadList m_waitingReaders;
+    ThreadList m_waitingWriters;
+    spinlock_t m_waitLock;
+};
+
+#endif /* _RWLOCK_HPP */
@@ -36,6 +36,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #ifdef __x86_64__
 #include <arch/x86_64/Memory/PagingInit.hpp>
+#include <arch/x86_64/Memory/PCID.hpp>
 
 #include <arch/x86_64/Scheduling/Task.hpp>
 #include <arch/x86_64/Scheduling/TaskUtil.hpp>
@@ -43,6 +44,13 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #define MAX_RUN_COUNT 2
 
+#define STEAL_NEIGHBOUR_PROBES 2 // on each side of the current processor
+#define STEAL_RANDOM_PROBES 2
+#define STEAL_MAX_BATCH 32
+
+#define BALANCE_INTERVAL 20'000'000 // ns
+#define BALANCE_MIN_IMBALANCE 2 // in runnable threads
+
 namespace Scheduler {
 
     ProcessorState g_BSPState;
@@ -52,8 +60,9 @@ namespace Scheduler {
     spinlock_t g_PIDLock;
     uint64_t g_isRunning = 0;
     spinlock_t g_ProcessorsLock = SPINLOCK_DEFAULT_VALUE;
-    spinlock_t g_StealLock = SPINLOCK_DEFAULT_VALUE;
     uint64_t g_processorCount = 1;
+    ProcessorState* g_ProcessorTable[SCHED_MAX_PROCESSORS]; // indexed by id, read without g_ProcessorsLock
+    uint64_t g_idleProcessors = 0;
 
     ThreadList g_deadThreads;
     Semaphore g_deadThreadsSemaphore(0, 1);
@@ -64,6 +73,9 @@ namespace Scheduler {
         ProcessorState* state = GetCurrentProcessorState();
         Process* parent = thread->GetParent();
 #ifdef __x86_64__
+        VMM::VMM* vmm = parent != nullptr ? parent->GetVMM() : nullptr;
+        CPU_Registers& regs = thread->GetMutableRegisters();
+        regs.CR3 = x86_64_PCID_PrepareSwitch(vmm != nullptr ? vmm->GetPageMapper() : nullptr, regs.CR3);
         if (parent != nullptr && parent->GetMode() == ProcessMode::USER) {
             state->processor->SwitchKernelStack(thread->GetKernelStack());
             state->processor->RestoreExtraContext(thread->GetExtraContext());
@@ -85,6 +97,275 @@ namespace Scheduler {
 #endif
     }
 
+    // Run queue helpers, runQueueLock must be held
+    void RunQueuePush(ProcessorState* state, Thread* thread, uint64_t nice) {
+        state->threads[nice].pushBack(thread);
+        state->readyMask |= 1U << nice;
+        __atomic_store_n(&state->nrRunnable, state->nrRunnable + 1, __ATOMIC_RELAXED);
+    }
+
+    Thread* RunQueuePop(ProcessorState* state, int nice) {
+        ThreadList& list = state->threads[nice];
+        Thread* thread = list.popFront();
+        if (list.getCount() == 0)
+            state->readyMask &= ~(1U << nice);
+        __atomic_store_n(&state->nrRunnable, state->nrRunnable - 1, __ATOMIC_RELAXED);
+        return thread;
+    }
+
+    void EnqueueThread(ProcessorState* state, Thread* thread, uint64_t nice) {
+        int intState = Processor::DisableInterrupts();
+        spinlock_acquire(&state->runQueueLock);
+        RunQueuePush(state, thread, nice);
+        spinlock_release(&state->runQueueLock);
+        Processor::EnableInterrupts(intState);
+    }
+
+    // Idle processors take no timer interrupts when tickless, so they have to be woken to steal new work
+    void SetIdle(ProcessorState* state, bool idle) {
+        uint32_t value = idle ? 1 : 0;
+        // seq_cst pairs with the fence in KickIdleProcessor: either the enqueuer sees us idle, or we see its thread when stealing
+        if (__atomic_exchange_n(&state->isIdle, value, __ATOMIC_SEQ_CST) == value)
+            return;
+        if (idle)
+            __atomic_add_fetch(&g_idleProcessors, 1, __ATOMIC_RELAXED);
+        else
+            __atomic_sub_fetch(&g_idleProcessors, 1, __ATOMIC_RELAXED);
+    }
+
+    bool Kick(ProcessorState* state) {
+        if (__atomic_exchange_n(&state->kickPending, 1, __ATOMIC_ACQ_REL) == 0)
+            state->processor->SendReschedule();
+        return true;
+    }
+
+    // Call after making a thread runnable on state
+    void KickIdleProcessor(ProcessorState* state) {
+        if (!HAL_IsTickless())
+            return;
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+        ProcessorState* current = GetCurrentProcessorState();
+        if (state != current) {
+            if (__atomic_load_n(&state->isIdle, __ATOMIC_RELAXED) != 0)
+                Kick(state);
+            return;
+        }
+        if (__atomic_load_n(&current->isIdle, __ATOMIC_RELAXED) != 0 || __atomic_load_n(&g_idleProcessors, __ATOMIC_RELAXED) == 0)
+            return;
+
+        uint64_t count = __atomic_load_n(&g_processorCount, __ATOMIC_RELAXED);
+        if (count > SCHED_MAX_PROCESSORS)
+            count = SCHED_MAX_PROCESSORS;
+        for (uint64_t i = 1; i < count; i++) {
+            ProcessorState* other = __atomic_load_n(&g_ProcessorTable[(current->id + i) % count], __ATOMIC_ACQUIRE);
+            if (other != nullptr && __atomic_load_n(&other->isIdle, __ATOMIC_RELAXED) != 0 && Kick(other))
+                return;
+        }
+    }
+
+    void AccountTime(ProcessorState* state, uint64_t now) {
+        if (state->isIdle == 0)
+            state->busyTime += now - state->lastAccountTime;
+        state->lastAccountTime = now;
+    }
+
+    // Must be run on state's processor with interrupts disabled
+    void ProgramNextEvent(ProcessorState* state) {
+        state->timers.lock();
+        uint64_t next = state->timers.GetNextDeadline();
+        state->timers.unlock();
+        if (state->isIdle == 0 && state->sliceEnd < next)
+            next = state->sliceEnd;
+        HAL_SetTimerDeadline(next == UINT64_MAX ? 0 : next);
+    }
+
+    void ArmTimerOn(ProcessorState* state, Timer* timer, uint64_t deadline) {
+        timer->deadline = deadline;
+        state->timers.lock();
+        state->timers.Insert(timer);
+        state->timers.unlock();
+    }
+
+    void RunExpiredTimers(ProcessorState* state, uint64_t now) {
+        state->timers.lock();
+        Timer* timer;
+        while ((timer = state->timers.PopExpired(now)) != nullptr) {
+            state->timers.unlock();
+            timer->callback(timer, timer->data);
+            state->timers.lock();
+            state->timers.Finished(timer);
+        }
+        state->timers.unlock();
+    }
+
+    void WakeSleepingThread(Timer*, void* data) {
+        Thread* thread = static_cast<Thread*>(data);
+        ProcessorState* state = GetCurrentProcessorState();
+        thread->sleepDeadline = 0;
+        EnqueueThread(state, thread, thread->GetParent()->GetNice());
+        KickIdleProcessor(state);
+    }
+
+    // Picks the highest level that hasn't used up its run count, falling back to the lowest non-empty level.
+    // readyMask may belong to another processor, the run counts are always the current processor's.
+    int SelectLevel(uint32_t readyMask, ProcessorState* current) {
+        if (readyMask == 0)
+            return -1;
+        uint32_t lowest = 1U << __builtin_ctz(readyMask);
+        if (current->exhaustedMask & lowest) {
+            current->runCounts[__builtin_ctz(readyMask)] = 0;
+            current->exhaustedMask &= ~lowest;
+        }
+        return 31 - __builtin_clz(readyMask & ~current->exhaustedMask);
+    }
+
+    // nice < 0 means the idle thread was picked
+    void ChargeLevel(ProcessorState* current, int nice) {
+        if (nice >= 0 && ++current->runCounts[nice] >= MAX_RUN_COUNT)
+            current->exhaustedMask |= 1U << nice;
+
+        // every level above the one that ran gets a fresh share
+        uint32_t above = nice < 0 ? UINT32_MAX : ~((2U << nice) - 1);
+        uint32_t reset = current->exhaustedMask & above;
+        while (reset != 0) {
+            current->runCounts[__builtin_ctz(reset)] = 0;
+            reset &= reset - 1;
+        }
+        current->exhaustedMask &= ~above;
+    }
+
+    Thread* PopNextThread(ProcessorState* state, int* niceOut) {
+        spinlock_acquire(&state->runQueueLock);
+        int nice = SelectLevel(state->readyMask, state);
+        Thread* thread = nice >= 0 ? RunQueuePop(state, nice) : nullptr;
+        spinlock_release(&state->runQueueLock);
+        *niceOut = nice;
+        return thread;
+    }
+
+    void InitLoadTracking(ProcessorState* state) {
+        state->readyMask = 0;
+        state->exhaustedMask = 0;
+        spinlock_init(&state->runQueueLock);
+        state->nrRunnable = 0;
+        state->utilisation = 0;
+        state->kickPending = 0;
+        state->busyTime = 0;
+        state->lastAccountTime = 0;
+        state->lastBalance = 0;
+        state->nextBalance = 0;
+        state->sliceEnd = 0;
+        state->probeSeed = state->id * 0x9E3779B97F4A7C15UL + 1;
+        if (state->id < SCHED_MAX_PROCESSORS)
+            __atomic_store_n(&g_ProcessorTable[state->id], state, __ATOMIC_RELEASE);
+    }
+
+    // running thread plus queued threads
+    uint32_t GetLoad(ProcessorState* state) {
+        return __atomic_load_n(&state->nrRunnable, __ATOMIC_RELAXED) + (__atomic_load_n(&state->isIdle, __ATOMIC_RELAXED) == 0 ? 1 : 0);
+    }
+
+    void ConsiderVictim(ProcessorState* current, uint64_t id, uint32_t minRunnable, ProcessorState** best) {
+        ProcessorState* state = __atomic_load_n(&g_ProcessorTable[id], __ATOMIC_ACQUIRE);
+        if (state == nullptr || state == current)
+            return;
+        uint32_t runnable = __atomic_load_n(&state->nrRunnable, __ATOMIC_RELAXED);
+        if (runnable < minRunnable)
+            return;
+        if (*best != nullptr) {
+            uint32_t bestRunnable = __atomic_load_n(&(*best)->nrRunnable, __ATOMIC_RELAXED);
+            if (runnable < bestRunnable || (runnable == bestRunnable && __atomic_load_n(&state->utilisation, __ATOMIC_RELAXED) <= __atomic_load_n(&(*best)->utilisation, __ATOMIC_RELAXED)))
+                return;
+        }
+        *best = state;
+    }
+
+    // Probes the nearest ids first, as adjacent ids tend to share a core or package, then a few random ones.
+    // Small systems just get every processor checked.
+    ProcessorState* FindBusiest(ProcessorState* current, uint32_t minRunnable) {
+        uint64_t count = __atomic_load_n(&g_processorCount, __ATOMIC_RELAXED);
+        if (count > SCHED_MAX_PROCESSORS)
+            count = SCHED_MAX_PROCESSORS;
+        if (count < 2)
+            return nullptr;
+
+        ProcessorState* best = nullptr;
+        if (count - 1 <= STEAL_NEIGHBOUR_PROBES * 2 + STEAL_RANDOM_PROBES) {
+            for (uint64_t id = 0; id < count; id++)
+                ConsiderVictim(current, id, minRunnable, &best);
+            return best;
+        }
+
+        uint64_t self = current->id % count;
+        for (uint64_t i = 1; i <= STEAL_NEIGHBOUR_PROBES; i++) {
+            ConsiderVictim(current, (self + i) % count, minRunnable, &best);
+            ConsiderVictim(current, (self + count - i) % count, minRunnable, &best);
+        }
+        for (uint64_t i = 0; i < STEAL_RANDOM_PROBES; i++) {
+            uint64_t x = current->probeSeed; // xorshift64
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            current->probeSeed = x;
+            ConsiderVictim(current, x % count, minRunnable, &best);
+        }
+        return best;
+    }
+
+    // Moves up to half of victim's run queue, and at most maxCount threads, to current. Gives up if victim's queue is busy.
+    uint32_t PullThreads(ProcessorState* current, ProcessorState* victim, uint32_t maxCount) {
+        if (!spinlock_try_acquire(&victim->runQueueLock))
+            return 0;
+
+        uint32_t target = (victim->nrRunnable + 1) / 2;
+        if (target > maxCount)
+            target = maxCount;
+        if (target > STEAL_MAX_BATCH)
+            target = STEAL_MAX_BATCH;
+
+        // Half of each level, from the back, as those would have waited longest on the victim
+        Thread* stolen[STEAL_MAX_BATCH];
+        uint32_t count = 0;
+        uint32_t ready = victim->readyMask;
+        while (count < target && ready != 0) {
+            int nice = 31 - __builtin_clz(ready);
+            ready &= ~(1U << nice);
+            ThreadList& list = victim->threads[nice];
+            uint64_t take = (list.getCount() + 1) / 2;
+            for (uint64_t i = 0; i < take && count < target; i++) {
+                Thread* thread = list.getTail();
+                list.remove(thread);
+                stolen[count++] = thread;
+            }
+            if (list.getCount() == 0)
+                victim->readyMask &= ~(1U << nice);
+        }
+        __atomic_store_n(&victim->nrRunnable, victim->nrRunnable - count, __ATOMIC_RELAXED);
+        spinlock_release(&victim->runQueueLock);
+
+        if (count == 0)
+            return 0;
+
+        // Never hold two run queue locks at once, the victim could be pulling from us
+        for (uint32_t i = 0; i < count; i++) {
+            Thread::CPUInfo* info = stolen[i]->GetCPUInfo();
+            spinlock_acquire(&info->lock);
+            info->state = current;
+            spinlock_release(&info->lock);
+        }
+        spinlock_acquire(&current->runQueueLock);
+        for (uint32_t i = 0; i < count; i++)
+            RunQueuePush(current, stolen[i], stolen[i]->GetParent()->GetNice());
+        spinlock_release(&current->runQueueLock);
+        return count;
+    }
+
+    void RequeueYieldedThread(Thread* thread, void*) {
+        thread->yieldCallback = {};
+        EnqueueThread(GetCurrentProcessorState(), thread, thread->GetParent()->GetNice());
+    }
+
     // public functions
 
 
@@ -105,6 +386,7 @@ namespace Scheduler {
         processor->isIdle = 0;
         processor->startAllowed = 0;
         memset(processor->runCounts, 0, sizeof(processor->runCounts));
+        InitLoadTracking(processor);
         processor->currentThread = nullptr;
         memset(&(processor->registers), 0, sizeof(processor->registers));
 
@@ -136,6 +418,8 @@ namespace Scheduler {
                     head->prev->next = head->next;
                 if (head->next != nullptr)
                     head->next->prev = head->prev;
+                if (head->id < SCHED_MAX_PROCESSORS)
+                    __atomic_store_n(&g_ProcessorTable[head->id], nullptr, __ATOMIC_RELEASE);
                 g_processorCount--;
                 spinlock_release(&g_ProcessorsLock);
                 return;
@@ -149,6 +433,18 @@ namespace Scheduler {
         return g_processorCount;
     }
 
+    bool IsThreadOnCPU(const Thread* thread) {
+        uint64_t count = __atomic_load_n(&g_processorCount, __ATOMIC_RELAXED);
+        if (count > SCHED_MAX_PROCESSORS)
+            count = SCHED_MAX_PROCESSORS;
+        for (uint64_t id = 0; id < count; id++) {
+            ProcessorState* state = __atomic_load_n(&g_ProcessorTable[id], __ATOMIC_ACQUIRE);
+            if (state != nullptr && __atomic_load_n(&state->currentThread, __ATOMIC_RELAXED) == thread)
+                return true;
+        }
+        return false;
+    }
+
     void AddProcess(Process* process) {
         spinlock_acquire(&g_PIDLock);
         process->SetPID(g_LastPID++);
@@ -195,8 +491,7 @@ namespace Scheduler {
         if (nice >= NICE_LEVELS)
             return;
 
-        thread->SetTimeRemaining(DEFAULT_TIMESLICE);
-        thread->sleepRemainingTime = 0;
+        thread->sleepDeadline = 0;
 
         PageMapper* mapper = g_KPageMapper;
         VMM::VMM* vmm = process->GetVMM();
@@ -216,13 +511,15 @@ namespace Scheduler {
         if (state == nullptr)
             state = GetCurrentProcessorState();
 
-        ThreadList& list = state->threads[nice];
-        list.lock();
+        int intState = Processor::DisableInterrupts();
+        spinlock_acquire(&state->runQueueLock);
         spinlock_acquire(&thread->GetCPUInfo()->lock);
         thread->GetCPUInfo()->state = state;
         spinlock_release(&thread->GetCPUInfo()->lock);
-        list.pushBack(thread);
-        list.unlock();
+        RunQueuePush(state, thread, nice);
+        spinlock_release(&state->runQueueLock);
+        KickIdleProcessor(state);
+        Processor::EnableInterrupts(intState);
     }
 
     bool AddExistingThread(Thread* thread) {
@@ -238,19 +535,20 @@ namespace Scheduler {
         if (state == nullptr)
             return false;
 
-        thread->SetTimeRemaining(DEFAULT_TIMESLICE);
-        thread->sleepRemainingTime = 0;
+        thread->sleepDeadline = 0;
 
-        ThreadList& list = state->threads[nice];
-        list.lock();
+        int intState = Processor::DisableInterrupts();
+        spinlock_acquire(&state->runQueueLock);
         spinlock_acquire(&thread->GetCPUInfo()->lock);
         thread->GetCPUInfo()->state = state;
         spinlock_release(&thread->GetCPUInfo()->lock);
         // Clear the thread's link pointers before adding to ensure clean state
         ThreadListItemInternalData cleanData = {nullptr, nullptr};
         thread->SetThreadListData(cleanData);
-        list.pushBack(thread);
-        list.unlock();
+        RunQueuePush(state, thread, nice);
+        spinlock_release(&state->runQueueLock);
+        KickIdleProcessor(state);
+        Processor::EnableInterrupts(intState);
 
         return true;
     }
@@ -300,8 +598,58 @@ namespace Scheduler {
     }
 
     void SleepCurrentThread(uint64_t ms) {
-        if (ms == 0)
-            return;
+        SleepCurrentThreadNS(ms * 1'000'000);
+    }
+
+    bool SleepCurrentThreadNS(uint64_t ns) {
+        if (ns == 0)
+            return true;
+        int intState = Processor::DisableInterrupts();
+        Thread* thread = RemoveCurrentThread(true);
+        if (thread == nullptr) {
+            Processor::EnableInterrupts(intState);
+            return false;
+        }
+
+        thread->sleepDeadline = HAL_GetNSTicks() + ns; // armed by Yield once the thread is saved
+
+        Scheduler_SaveAndYield(thread);
+        Processor::EnableInterrupts(intState);
+        return true;
+    }
+
+    void ArmTimer(Timer* timer, uint64_t deadline) {
+        int intState = Processor::DisableInterrupts();
+        ProcessorState* state = GetCurrentProcessorState();
+        ArmTimerOn(state, timer, deadline);
+        ProgramNextEvent(state);
+        Processor::EnableInterrupts(intState);
+    }
+
+    bool CancelTimer(Timer* timer) {
+        while (true) {
+            TimerQueue* queue = __atomic_load_n(&timer->queue, __ATOMIC_ACQUIRE);
+            if (queue == nullptr)
+                return false;
+
+            queue->lock();
+            if (timer->queue != queue) { // fired or moved while we were taking the lock
+                queue->unlock();
+                continue;
+            }
+            if (queue->Remove(timer)) {
+                queue->unlock();
+                return true; // the processor may still get an interrupt for it, which is harmless
+            }
+            queue->unlock();
+
+            // the callback is running on another processor, it may re-arm the timer somewhere else
+            while (__atomic_load_n(&timer->queue, __ATOMIC_ACQUIRE) == queue && !__atomic_load_n(&timer->pending, __ATOMIC_ACQUIRE))
+                PAUSE();
+        }
+    }
+
+    void YieldCurrentThread() {
         int intState = Processor::DisableInterrupts();
         Thread* thread = RemoveCurrentThread(true);
         if (thread == nullptr) {
@@ -309,13 +657,14 @@ namespace Scheduler {
             return;
         }
 
-        thread->sleepRemainingTime = ms;
+        thread->sleepDeadline = 0;
+        thread->yieldCallback = {RequeueYieldedThread, nullptr}; // requeued once its registers are saved
 
         Scheduler_SaveAndYield(thread);
         Processor::EnableInterrupts(intState);
     }
 
-    void TimerTick(uint64_t msSinceLast, void* data) {
+    void TimerTick(uint64_t, void* data) {
         ProcessorState* state = GetCurrentProcessorState();
         if (state == nullptr)
             return;
@@ -323,47 +672,32 @@ namespace Scheduler {
         if (state->startAllowed == 0)
             return;
 
-        state->sleepingThreads.lock();
-        state->sleepingThreads.Enumerate([](Thread* thread, void* data) -> ThreadList::IteratorDecision {
-            uint64_t msSinceLast = *static_cast<uint64_t*>(data);
-            ProcessorState* state = GetCurrentProcessorState();
-            if (msSinceLast >= thread->sleepRemainingTime) {
-                thread->sleepRemainingTime = 0;
-                state->sleepingThreads.remove(thread);
-
-                int oldNice = thread->GetParent()->GetNice();
-
-                ThreadList& list = state->threads[oldNice];
-                list.lock();
-                list.pushBack(thread);
-                list.unlock();
-            } else
-                thread->sleepRemainingTime -= msSinceLast;
-            return ThreadList::IteratorDecision::Continue;
-        }, &msSinceLast);
-        state->sleepingThreads.unlock();
-
-        int oldNice = -1;
-        
+        uint64_t now = HAL_GetNSTicks();
+        RunExpiredTimers(state, now);
+
+        AccountTime(state, now);
+        if (now >= state->nextBalance) {
+            uint64_t window = now - state->lastBalance;
+            uint64_t busy = state->busyTime < window ? state->busyTime : window;
+            if (window > 0)
+                __atomic_store_n(&state->utilisation, (state->utilisation + busy * SCHED_UTIL_SCALE / window) / 2, __ATOMIC_RELAXED);
+            state->busyTime = 0;
+            state->lastBalance = now;
+            state->nextBalance = now + BALANCE_INTERVAL;
+            if (state->isIdle == 0) // idle processors steal from PickNext instead
+                BalanceLoad(state);
+        }
+
         Thread* oldThread = state->currentThread;
         if (oldThread != nullptr) {
             SaveThreadFromINT(oldThread, data);
-            uint64_t timeRemaining = oldThread->GetTimeRemaining();
-            if (msSinceLast >= timeRemaining)
-                oldThread->SetTimeRemaining(0);
-            else
-                oldThread->SetTimeRemaining(timeRemaining - msSinceLast);
-            if (oldThread->GetTimeRemaining() > 0 && state->isIdle == 0)
+            if (now < state->sliceEnd && state->isIdle == 0) {
+                ProgramNextEvent(state);
                 return;
-
-            if (state->isIdle == 0) {
-                oldNice = oldThread->GetParent()->GetNice();
-
-                ThreadList& list = state->threads[oldNice];
-                list.lock();
-                list.pushBack(oldThread);
-                list.unlock();
             }
+
+            if (state->isIdle == 0)
+                EnqueueThread(state, oldThread, oldThread->GetParent()->GetNice());
             state->currentThread = nullptr;
         }
 
@@ -372,7 +706,7 @@ namespace Scheduler {
         if (state->currentThread == nullptr)
             PANIC("Scheduler: Nothing to run on timer tick");
 
-        state->currentThread->SetTimeRemaining(DEFAULT_TIMESLICE);
+        ProgramNextEvent(state);
 
         HAL_EndTimerTick();
         RunThread(state->currentThread, true);
@@ -417,10 +751,10 @@ namespace Scheduler {
         spinlock_acquire(&state->lock);
 
         if (oldThread != nullptr) {
-            if (oldThread->sleepRemainingTime > 0) {
-                state->sleepingThreads.lock();
-                state->sleepingThreads.pushBack(oldThread);
-                state->sleepingThreads.unlock();
+            if (oldThread->sleepDeadline > 0) {
+                oldThread->wakeTimer.callback = WakeSleepingThread;
+                oldThread->wakeTimer.data = oldThread;
+                ArmTimerOn(state, &oldThread->wakeTimer, oldThread->sleepDeadline);
             } else if (oldThread->yieldCallback.func != nullptr)
                 oldThread->yieldCallback.func(oldThread, oldThread->yieldCallback.data);
             oldThread = nullptr;
@@ -430,11 +764,7 @@ namespace Scheduler {
                 if (data != nullptr)
                     SaveThreadFromINT(oldThread, data);
 
-                int oldNice = oldThread->GetParent()->GetNice();
-                ThreadList& list = state->threads[oldNice];
-                list.lock();
-                list.pushBack(oldThread);
-                list.unlock();
+                EnqueueThread(state, oldThread, oldThread->GetParent()->GetNice());
                 state->currentThread = nullptr;
             }
         }
@@ -448,9 +778,8 @@ namespace Scheduler {
             PANIC("Scheduler::Yield: Nothing to run!");
         }
 
-        state->currentThread->SetTimeRemaining(DEFAULT_TIMESLICE);
-
         spinlock_release(&(state->lock));
+        ProgramNextEvent(state);
         RunThread(state->currentThread, data != nullptr);
     }
 
@@ -459,111 +788,60 @@ namespace Scheduler {
         if (state == nullptr)
             return;
 
-        Thread* thread = nullptr;
+        int intState = Processor::DisableInterrupts();
+
+        uint64_t now = HAL_GetNSTicks();
+        AccountTime(state, now);
+        __atomic_store_n(&state->kickPending, 0, __ATOMIC_RELAXED);
+
         int nice = -1;
-        int lastNice = -1;
-        
-        // go forwards through nice levels
-        for (int i = 0; i < NICE_LEVELS; i++) {
-            ThreadList& list = state->threads[i];
-            list.lock();
-            if (list.getCount() == 0 || (state->runCounts[i] >= MAX_RUN_COUNT && i != 0 && thread != nullptr)) {
-                list.unlock();
-                continue;
-            }
-            
-            if (thread != nullptr)
-                state->threads[nice].unlock();
-            else if (state->runCounts[i] >= MAX_RUN_COUNT)
-                state->runCounts[i] = 0;
-            thread = list.getHead();
-            nice = i;
+        Thread* thread = PopNextThread(state, &nice);
+        if (thread == nullptr) {
+            SetIdle(state, true); // before stealing, see SetIdle
+            if (StealThreads(state) > 0)
+                thread = PopNextThread(state, &nice);
         }
 
-        lastNice = nice;
-
-        bool normal = true;
         bool idle = false;
-
         if (thread == nullptr) {
-            thread = StealThreadFromOther(state, &nice);
-            if (thread == nullptr) {
-                thread = state->idleThread;
-                idle = true;
-            } else {
-                Thread::CPUInfo* info = thread->GetCPUInfo(); // already locked by above function
-                info->state = state;
-                spinlock_release(&info->lock);
-            }
+            thread = state->idleThread;
+            idle = true;
             if (thread == nullptr)
                 PANIC("Scheduler: Nothing to run on current CPU");
-            normal = false;
-        }
-        
-        if (!idle && nice >= 0)
-            state->runCounts[nice]++;
-        if (normal)
-            state->threads[nice].popFront();
-        if (lastNice >= 0)
-            state->threads[lastNice].unlock();
-
-        for (int i = nice + 1; i < NICE_LEVELS; i++) {
-            if (state->runCounts[i] >= MAX_RUN_COUNT)
-                state->runCounts[i] = 0;
         }
 
+        ChargeLevel(state, idle ? -1 : nice);
+
         if (lockState)
             spinlock_acquire(&(state->lock));
 
-        state->isIdle = thread == state->idleThread ? 1 : 0;
+        SetIdle(state, idle);
+        state->sliceEnd = now + DEFAULT_TIMESLICE;
 
         state->currentThread = thread;
 
         if (lockState)
             spinlock_release(&(state->lock));
+
+        Processor::EnableInterrupts(intState);
     }
 
-    Thread* StealThreadFromOther(ProcessorState* current, int* niceOut) {
-        spinlock_acquire(&g_StealLock);
-        ProcessorState* state;
-        for (state = &g_BSPState; state != nullptr; state = state->next) {
-            if (state->id == current->id)
-                continue;
-            
-            Thread* thread = nullptr;
-            int nice = -1;
-            
-            // go forwards through nice levels
-            for (int i = 0; i < NICE_LEVELS; i++) {
-                ThreadList& list = state->threads[i];
-                list.lock();
-                if (list.getCount() == 0 || (current->runCounts[i] >= MAX_RUN_COUNT && i != 0 && thread != nullptr)) {
-                    list.unlock();
-                    continue;
-                }
-                
-                if (thread != nullptr)
-                    state->threads[nice].unlock();
-                else if (current->runCounts[i] >= MAX_RUN_COUNT)
-                    current->runCounts[i] = 0;
-                thread = list.getHead();
-                nice = i;
-            }
+    uint32_t StealThreads(ProcessorState* current) {
+        ProcessorState* victim = FindBusiest(current, 1);
+        if (victim == nullptr)
+            return 0;
+        return PullThreads(current, victim, UINT32_MAX);
+    }
 
-            if (thread != nullptr) {
-                spinlock_acquire(&thread->GetCPUInfo()->lock);
-                if (niceOut != nullptr)
-                    *niceOut = nice;
-                Thread* t2 = state->threads[nice].popFront();
-                assert(t2 == thread);
-                state->threads[nice].unlock();
-                spinlock_release(&g_StealLock);
-                return thread;
-            } else if (nice >= 0)
-                state->threads[nice].unlock();
-        }
-        spinlock_release(&g_StealLock);
-        return nullptr;
+    void BalanceLoad(ProcessorState* current) {
+        uint32_t load = GetLoad(current);
+        ProcessorState* victim = FindBusiest(current, load + BALANCE_MIN_IMBALANCE - 1);
+        if (victim == nullptr)
+            return;
+        uint32_t victimLoad = GetLoad(victim);
+        if (victimLoad < load + BALANCE_MIN_IMBALANCE)
+            return;
+        PullThreads(current, victim, (victimLoad - load) / 2);
     }
 
     void InitBSPState() {
@@ -575,6 +853,7 @@ namespace Scheduler {
         g_BSPState.startAllowed = 0;
         for (uint32_t i = 0; i < NICE_LEVELS; i++)
             g_BSPState.runCounts[i] = 0;
+        InitLoadTracking(&g_BSPState);
     }
 
     ProcessorState* InitNewProcessor(Processor* proc) {
@@ -606,6 +885,7 @@ namespace Scheduler {
 
         }
 
+        ProgramNextEvent(current);
         RunThread(current->currentThread, false);
     }
 
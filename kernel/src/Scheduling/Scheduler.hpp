@@ -25,13 +25,20 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <HAL/HAL.hpp>
 #include <HAL/Processor.hpp>
 
+#include <Memory/PMM.hpp>
+#include <Memory/Slab.hpp>
+
 #include "Thread.hpp"
 #include "Process.hpp"
 #include "ThreadList.hpp"
+#include "TimerQueue.hpp"
 
 #define NICE_LEVELS 16
 #define DEFAULT_NICE 8
-#define DEFAULT_TIMESLICE 10
+#define DEFAULT_TIMESLICE 10'000'000 // ns
+
+#define SCHED_MAX_PROCESSORS 256
+#define SCHED_UTIL_SCALE 1024
 
 namespace Scheduler {
     
@@ -44,12 +51,26 @@ namespace Scheduler {
         void* kernelStack;
         Thread* currentThread; // must only be modified by the processor that owns this state. Reads must be done with the lock held
         Thread* idleThread;
-        uint32_t runCounts[NICE_LEVELS]; // share locks with thread lists
-        ThreadList threads[NICE_LEVELS];
-        ThreadList sleepingThreads;
+        uint32_t runCounts[NICE_LEVELS]; // only touched by the processor that owns this state
+        ThreadList threads[NICE_LEVELS]; // protected by runQueueLock, the lists' own locks are unused
+        uint32_t readyMask; // bit n is set while threads[n] is non-empty, protected by runQueueLock
+        uint32_t exhaustedMask; // bit n is set while runCounts[n] >= MAX_RUN_COUNT
+        spinlock_t runQueueLock; // must be taken with interrupts disabled
+        uint32_t nrRunnable; // threads in the run queue, protected by runQueueLock. Other processors read it unlocked as a hint
+        uint32_t utilisation; // decaying average of busy time, out of SCHED_UTIL_SCALE
+        uint32_t kickPending; // a reschedule has been sent to wake this processor from idle
+        uint64_t busyTime; // ns spent not idle since lastBalance
+        uint64_t lastAccountTime;
+        uint64_t lastBalance;
+        uint64_t nextBalance;
+        uint64_t sliceEnd; // when the current thread gets preempted
+        uint64_t probeSeed; // for picking random victims
+        TimerQueue timers;
         uint32_t isIdle;
         uint32_t startAllowed;
         spinlock_t lock;
+        PMM_PageCache pageCache;
+        SlabCPUCache slabCaches[SLAB_CLASS_COUNT];
         
         ProcessorState* next;
         ProcessorState* prev;
@@ -62,6 +83,7 @@ namespace Scheduler {
     ProcessorState* GetProcessor(uint64_t id);
     void RemoveProcessor(uint64_t id);
     uint64_t GetProcessorCount();
+    bool IsThreadOnCPU(const Thread* thread); // lock-free hint, thread is only compared against each processor's current thread so it may already be freed
     
     void AddProcess(Process* process);
     Process* GetProcess(uint64_t pid);
@@ -77,14 +99,20 @@ namespace Scheduler {
     bool DeleteThread(Thread* thread); // Adds the thread to a list of threads to be deleted, already assumed to be removed
 
     void SleepCurrentThread(uint64_t ms);
+    bool SleepCurrentThreadNS(uint64_t ns); // returns false if there is no current thread to put to sleep
+    void YieldCurrentThread(); // voluntarily give up the rest of the timeslice, stays runnable
+
+    void ArmTimer(Timer* timer, uint64_t deadline); // on the current processor, callback and data must already be set
+    bool CancelTimer(Timer* timer); // waits for a running callback to finish. Returns true if the timer hadn't fired yet
 
-    void TimerTick(uint64_t msSinceLast, void* data);
+    void TimerTick(uint64_t msSinceLast, void* data); // also the reschedule interrupt handler, time is taken from HAL_GetNSTicks()
     bool SaveOnInt(void* data);
 
     void Yield(Thread* oldThread = nullptr, bool forceSwitch = false, void* data = nullptr, bool swapStack = true); // data != nullptr means this is run in an interrupt context
     
     void PickNext(bool lockState = true);
-    Thread* StealThreadFromOther(ProcessorState* current, int* niceOut = nullptr);
+    uint32_t StealThreads(ProcessorState* current); // moves up to half of a busier processor's run queue to current, returns how many were moved
+    void BalanceLoad(ProcessorState* current); // pulls work from an overloaded processor even if current isn't idle
     
     void InitBSPState();
     ProcessorState* InitNewProcessor(Processor* proc);
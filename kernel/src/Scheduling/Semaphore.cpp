@@ -54,7 +54,7 @@ void Semaphore::Wait() {
         if (Scheduler::isRunning() && state != nullptr && state->processor != nullptr && state->currentThread != nullptr) {
             Thread* thread = Scheduler::RemoveCurrentThread(true);
             assert(thread != nullptr);
-            thread->sleepRemainingTime = 0;
+            thread->sleepDeadline = 0;
             thread->yieldCallback = {};
             m_waitingThreads.pushBack(thread); // queue waiter before yielding to avoid lost wakeups
             spinlock_release(&m_lock);
@@ -82,7 +82,7 @@ void Semaphore::Signal() {
         if (Scheduler::isRunning() && m_waitingThreads.getCount() > 0) {
             Thread* thread = m_waitingThreads.popFront();
             thread->yieldCallback = {};
-            thread->sleepRemainingTime = 0;
+            thread->sleepDeadline = 0;
             assert(Scheduler::AddExistingThread(thread));
         }
     }
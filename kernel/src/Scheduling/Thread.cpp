@@ -32,16 +32,18 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <SystemCalls/Futex.hpp>
 
-Thread::Thread() : m_EntryPoint({nullptr, nullptr}), m_Parent(nullptr), m_TID(UINT64_MAX), m_Stack(0), m_KernelStack(0), m_ThreadListData{nullptr, nullptr}, m_ProcThreadListData{nullptr, nullptr}, m_TimeRemaining(0), m_CPUInfo(nullptr, SPINLOCK_DEFAULT_VALUE), m_InSchedList(false), m_InProcList(false), m_IsSleeping(false), m_deleteProp(false, false, true, -1) {
-    sleepRemainingTime = 0;
+Thread::Thread() : m_EntryPoint({nullptr, nullptr}), m_Parent(nullptr), m_TID(UINT64_MAX), m_Stack(0), m_KernelStack(0), m_ThreadListData{nullptr, nullptr}, m_ProcThreadListData{nullptr, nullptr}, m_CPUInfo(nullptr, SPINLOCK_DEFAULT_VALUE), m_InSchedList(false), m_InProcList(false), m_IsSleeping(false), m_deleteProp(false, false, true, -1) {
+    sleepDeadline = 0;
+    wakeTimer = TIMER_INITIALISER(nullptr, nullptr);
     yieldCallback = {nullptr, nullptr};
     m_InSchedList = false;
     m_InProcList = false;
 
 }
 
-Thread::Thread(ThreadEntryPoint entryPoint, Process* parent, uint64_t tid) : m_EntryPoint(entryPoint), m_Parent(parent), m_TID(tid), m_Stack(0), m_KernelStack(0), m_ThreadListData{nullptr, nullptr}, m_ProcThreadListData{nullptr, nullptr}, m_TimeRemaining(0), m_CPUInfo(nullptr, SPINLOCK_DEFAULT_VALUE), m_InSchedList(false), m_InProcList(false), m_IsSleeping(false), m_deleteProp(false, false, true -1) {
-    sleepRemainingTime = 0;
+Thread::Thread(ThreadEntryPoint entryPoint, Process* parent, uint64_t tid) : m_EntryPoint(entryPoint), m_Parent(parent), m_TID(tid), m_Stack(0), m_KernelStack(0), m_ThreadListData{nullptr, nullptr}, m_ProcThreadListData{nullptr, nullptr}, m_CPUInfo(nullptr, SPINLOCK_DEFAULT_VALUE), m_InSchedList(false), m_InProcList(false), m_IsSleeping(false), m_deleteProp(false, false, true -1) {
+    sleepDeadline = 0;
+    wakeTimer = TIMER_INITIALISER(nullptr, nullptr);
     yieldCallback = {nullptr, nullptr};
 
     m_InSchedList = false;
@@ -81,8 +83,8 @@ bool Thread::Delete() {
     if (m_Parent->GetMode() == ProcessMode::USER && !vmm->FreePages(reinterpret_cast<void*>(m_Stack - DEFAULT_USER_STACK_SIZE)))
         return false;
 
-    if (blockedFutex != nullptr)
-        blockedFutex->Remove(this, FutexWakeReason::Interrupted);
+    Scheduler::CancelTimer(&wakeTimer);
+    FutexWaitQueue::Remove(this, FutexWakeReason::Interrupted);
 
     m_Stack = 0;
     m_KernelStack = 0;
@@ -110,6 +112,18 @@ Thread* Thread::GetCurrentThread() {
     return thread;
 }
 
+void Thread::MoveCurrentToKernelProcess() {
+    Thread* self = GetCurrentThread();
+    Process* parent = self->GetParent();
+    if (parent == g_KProcess)
+        return;
+    // the scheduler loads CR3 from the parent, so switch away from the old address space now too
+    parent->RemoveThread(self);
+    self->SetParent(g_KProcess);
+    g_KProcess->AddThread(self);
+    g_KPageMapper->SwapToThis();
+}
+
 void Thread::SetEntryPoint(ThreadEntryPoint entryPoint) {
     m_EntryPoint = entryPoint;
 }
@@ -222,14 +236,6 @@ ThreadListItemInternalData& Thread::GetProcThreadListData() {
     return m_ProcThreadListData;
 }
 
-void Thread::SetTimeRemaining(uint64_t timeRemaining) {
-    m_TimeRemaining = timeRemaining;
-}
-
-uint64_t Thread::GetTimeRemaining() const {
-    return m_TimeRemaining;
-}
-
 Thread::CPUInfo* Thread::GetCPUInfo() {
     return &m_CPUInfo;
 }
@@ -274,7 +280,6 @@ bool Thread::Fork(Thread* other, uint64_t newReturnValue) {
     m_Stack = other->m_Stack;
 
     m_EntryPoint = other->m_EntryPoint;
-    m_TimeRemaining = 0;
     
     memcpy(&m_deleteProp, &other->m_deleteProp, sizeof(m_deleteProp));
 
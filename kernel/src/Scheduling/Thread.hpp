@@ -23,6 +23,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <HAL/HAL.hpp>
 
 #include "ThreadList.hpp"
+#include "TimerQueue.hpp"
 
 #define DEFAULT_USER_STACK_SIZE 1048576 /* 1MiB */
 
@@ -46,6 +47,12 @@ enum class FutexWakeReason : uint8_t {
 
 class FutexWaitQueue;
 
+struct FutexKey {
+    uint64_t object; // VMM for private futexes, MemoryObject for shared ones. Only used as an identity
+    uint64_t offset; // virtual address for private futexes, byte offset into the object for shared ones
+    bool shared; // holds a reference on the MemoryObject
+};
+
 class Thread {
 public:
     struct CPUInfo {
@@ -69,6 +76,7 @@ public:
 
     static bool ExitCurrentThread(bool deleteThis, bool deleteParent, bool removeProc);
     static Thread* GetCurrentThread();
+    static void MoveCurrentToKernelProcess(); // so the old parent and its address space can be deleted before this thread exits
 
     void SetEntryPoint(ThreadEntryPoint entryPoint);
     ThreadEntryPoint GetEntryPoint() const;
@@ -97,9 +105,6 @@ public:
     void SetProcThreadListData(ThreadListItemInternalData& data);
     ThreadListItemInternalData& GetProcThreadListData();
 
-    void SetTimeRemaining(uint64_t timeRemaining);
-    uint64_t GetTimeRemaining() const;
-
     CPUInfo* GetCPUInfo();
 
     void SetInSchedList(bool inList);
@@ -116,10 +121,12 @@ public:
 
     bool Fork(Thread* other, uint64_t newReturnValue);
 
-    uint64_t sleepRemainingTime;
+    uint64_t sleepDeadline; // absolute HAL_GetNSTicks() time, 0 if not sleeping
+    Timer wakeTimer; // for sleeps and blocking timeouts
     YieldCallback yieldCallback;
 
-    FutexWaitQueue* blockedFutex = nullptr;
+    FutexWaitQueue* blockedFutex = nullptr; // hash bucket, only changes with its lock held
+    FutexKey futexKey = {0, 0, false};
     FutexWakeReason wakeReason = FutexWakeReason::None;
 
 private:
@@ -132,7 +139,6 @@ private:
     uint64_t m_KernelStack;
     ThreadListItemInternalData m_ThreadListData;
     ThreadListItemInternalData m_ProcThreadListData;
-    uint64_t m_TimeRemaining;
     CPUInfo m_CPUInfo;
 
     bool m_InSchedList;
@@ -0,0 +1,148 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "TimerQueue.hpp"
+
+#include <spinlock.h>
+#include <stdint.h>
+
+#include <HAL/Processor.hpp>
+
+TimerQueue::TimerQueue() : m_root(nullptr), m_lock(SPINLOCK_DEFAULT_VALUE), m_intState(0) {
+}
+
+TimerQueue::~TimerQueue() {
+}
+
+void TimerQueue::Insert(Timer* timer) {
+    timer->child = nullptr;
+    timer->next = nullptr;
+    timer->prev = nullptr;
+    __atomic_store_n(&timer->pending, true, __ATOMIC_RELAXED);
+    __atomic_store_n(&timer->queue, this, __ATOMIC_RELEASE);
+    m_root = Meld(m_root, timer);
+}
+
+bool TimerQueue::Remove(Timer* timer) {
+    if (timer->queue != this || !timer->pending)
+        return false;
+
+    if (timer == m_root) {
+        m_root = MergePairs(timer->child);
+        if (m_root != nullptr)
+            m_root->prev = nullptr;
+    } else {
+        if (timer->prev->child == timer)
+            timer->prev->child = timer->next;
+        else
+            timer->prev->next = timer->next;
+        if (timer->next != nullptr)
+            timer->next->prev = timer->prev;
+        timer->next = nullptr;
+        timer->prev = nullptr;
+        m_root = Meld(m_root, MergePairs(timer->child));
+    }
+
+    timer->child = nullptr;
+    __atomic_store_n(&timer->pending, false, __ATOMIC_RELAXED);
+    __atomic_store_n(&timer->queue, nullptr, __ATOMIC_RELEASE);
+    return true;
+}
+
+Timer* TimerQueue::PopExpired(uint64_t now) {
+    Timer* timer = m_root;
+    if (timer == nullptr || timer->deadline > now)
+        return nullptr;
+
+    m_root = MergePairs(timer->child);
+    if (m_root != nullptr)
+        m_root->prev = nullptr;
+    timer->child = nullptr;
+    __atomic_store_n(&timer->pending, false, __ATOMIC_RELAXED);
+    return timer;
+}
+
+void TimerQueue::Finished(Timer* timer) {
+    // the callback may have let someone re-arm it, possibly on another queue, which must be left alone
+    if (__atomic_load_n(&timer->pending, __ATOMIC_ACQUIRE))
+        return;
+    TimerQueue* expected = this;
+    __atomic_compare_exchange_n(&timer->queue, &expected, nullptr, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+uint64_t TimerQueue::GetNextDeadline() const {
+    return m_root != nullptr ? m_root->deadline : UINT64_MAX;
+}
+
+void TimerQueue::lock() const {
+    int intState = Processor::DisableInterrupts();
+    spinlock_acquire(&m_lock);
+    m_intState = intState; // only access member variable while lock is held
+}
+
+void TimerQueue::unlock() const {
+    int intState = m_intState;
+    spinlock_release(&m_lock); // only access member variable while lock is held
+    Processor::EnableInterrupts(intState);
+}
+
+// a and b must be roots, i.e. have no siblings
+Timer* TimerQueue::Meld(Timer* a, Timer* b) {
+    if (a == nullptr)
+        return b;
+    if (b == nullptr)
+        return a;
+    if (b->deadline < a->deadline) {
+        Timer* temp = a;
+        a = b;
+        b = temp;
+    }
+    b->prev = a;
+    b->next = a->child;
+    if (a->child != nullptr)
+        a->child->prev = b;
+    a->child = b;
+    return a;
+}
+
+// Standard two-pass merge: meld siblings in pairs left to right, then fold the results right to left
+Timer* TimerQueue::MergePairs(Timer* first) {
+    Timer* pairs = nullptr; // reversed list linked through next
+    while (first != nullptr) {
+        Timer* a = first;
+        Timer* b = a->next;
+        first = b != nullptr ? b->next : nullptr;
+        a->next = nullptr;
+        a->prev = nullptr;
+        if (b != nullptr) {
+            b->next = nullptr;
+            b->prev = nullptr;
+        }
+        Timer* melded = Meld(a, b);
+        melded->next = pairs;
+        pairs = melded;
+    }
+
+    Timer* root = nullptr;
+    while (pairs != nullptr) {
+        Timer* next = pairs->next;
+        pairs->next = nullptr;
+        root = Meld(root, pairs);
+        pairs = next;
+    }
+    return root;
+}
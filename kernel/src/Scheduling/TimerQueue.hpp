@@ -0,0 +1,66 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef _TIMER_QUEUE_HPP
+#define _TIMER_QUEUE_HPP
+
+#include <stdint.h>
+
+#include <spinlock.h>
+
+class TimerQueue;
+
+struct Timer {
+    uint64_t deadline; // absolute, in HAL_GetNSTicks() time
+    void (*callback)(Timer* timer, void* data); // run on the queue's processor with interrupts disabled. Must not re-arm or cancel its own timer
+    void* data;
+
+    // Internal, owned by the queue
+    Timer* child;
+    Timer* next;
+    Timer* prev; // parent if this is the first child, otherwise the previous sibling
+    TimerQueue* queue; // set while queued or while the callback is running
+    bool pending; // in the heap, as opposed to running
+};
+
+#define TIMER_INITIALISER(callback, data) {0, callback, data, nullptr, nullptr, nullptr, nullptr, false}
+
+// Pairing heap of timers ordered by deadline. All operations other than lock/unlock need the lock held.
+class TimerQueue {
+public:
+    TimerQueue();
+    ~TimerQueue();
+
+    void Insert(Timer* timer);
+    bool Remove(Timer* timer); // returns false if the timer isn't pending in this queue
+    Timer* PopExpired(uint64_t now); // leaves timer->queue set so cancellation can wait for the callback, call Finished() after running it
+    void Finished(Timer* timer); // clears timer->queue unless the timer has been re-armed since
+
+    uint64_t GetNextDeadline() const; // UINT64_MAX if empty
+
+    void lock() const;
+    void unlock() const;
+
+private:
+    static Timer* Meld(Timer* a, Timer* b);
+    static Timer* MergePairs(Timer* first);
+
+    Timer* m_root;
+    mutable spinlock_t m_lock;
+    mutable int m_intState;
+};
+
+#endif /* _TIMER_QUEUE_HPP */
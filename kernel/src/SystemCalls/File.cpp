@@ -21,16 +21,21 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <errno.h>
 #include <stddef.h>
 #include <string.h>
+#include <util.h>
 
 #include <fs/FDManager.hpp>
 #include <fs/FileDescriptor.hpp>
+#include <fs/Pipe.hpp>
+#include <fs/UIO.hpp>
 #include <fs/VFS.hpp>
 
 #include <Scheduling/Process.hpp>
 
 int sys_open(const char* path, size_t pathLen, int flags, mode_t mode) {
-    Thread* current = Thread::GetCurrentThread();
-    Process* proc = current->GetParent();
+    return OpenFile(Thread::GetCurrentThread()->GetParent(), path, pathLen, flags, mode);
+}
+
+int OpenFile(Process* proc, const char* path, size_t pathLen, int flags, mode_t mode) {
     FileDescriptorManager* manager = proc->GetFDManager();
     if (manager == nullptr)
         return -ENOSYS;
@@ -124,8 +129,10 @@ int sys_open(const char* path, size_t pathLen, int flags, mode_t mode) {
 }
 
 int sys_close(int fd) {
-    Thread* current = Thread::GetCurrentThread();
-    Process* proc = current->GetParent();
+    return CloseFile(Thread::GetCurrentThread()->GetParent(), fd);
+}
+
+int CloseFile(Process* proc, int fd) {
     FileDescriptorManager* manager = proc->GetFDManager();
     if (manager == nullptr)
         return -ENOSYS;
@@ -139,8 +146,10 @@ int sys_close(int fd) {
     
     desc->Close();
 
-    if (desc->GetType() != FDType::File)
+    if (desc->GetType() != FDType::File) {
+        delete desc;
         return ESUCCESS; // nothing more to do
+    }
 
     FS::VNode* vnode = desc->GetVNode();
     if (vnode == nullptr)
@@ -155,42 +164,24 @@ int sys_close(int fd) {
     return ESUCCESS;
 }
 
-ssize_t sys_read(int fd, void* buf, size_t count) {
-    if (count == 0)
-        return -EINVAL;
-
-    Thread* current = Thread::GetCurrentThread();
-    Process* proc = current->GetParent();
+ssize_t FileIO(Process* proc, int fd, FS::UIO* uio, bool write, int64_t offset) {
     FileDescriptorManager* manager = proc->GetFDManager();
     if (manager == nullptr)
         return -ENOSYS;
 
-    VMM::VMM* vmm = proc->GetVMM();
-    if (!vmm->ValidateWrite(buf, count))
-        return -EFAULT;
-
     FileDescriptor* desc = manager->Get(fd);
     if (desc == nullptr || !desc->isOpen())
         return -EBADF;
 
-    uint8_t* kBuf = new uint8_t[count];
-
     size_t realCount = 0;
-    int rc = desc->Read(kBuf, count, &realCount);
-    ssize_t result = rc < 0 ? rc : realCount;
-
-    UserWrite(buf, kBuf, realCount, proc, false);
-    
-    delete[] kBuf;
-    return result;
+    int rc = write ? desc->Write(uio, &realCount, offset) : desc->Read(uio, &realCount, offset);
+    // report a partial transfer rather than the error that ended it
+    if (rc < 0 && realCount == 0)
+        return rc;
+    return realCount;
 }
 
-ssize_t sys_write(int fd, const void* buf, size_t count) {
-    if (count == 0)
-        return -EINVAL;
-
-    Thread* current = Thread::GetCurrentThread();
-    Process* proc = current->GetParent();
+int SyncFile(Process* proc, int fd) {
     FileDescriptorManager* manager = proc->GetFDManager();
     if (manager == nullptr)
         return -ENOSYS;
@@ -198,20 +189,91 @@ ssize_t sys_write(int fd, const void* buf, size_t count) {
     FileDescriptor* desc = manager->Get(fd);
     if (desc == nullptr || !desc->isOpen())
         return -EBADF;
+    return ESUCCESS; // nothing has a backing store to flush to yet
+}
 
-    uint8_t* kBuf = new uint8_t[count];
+static ssize_t DoIO(int fd, FS::UIO* uio, bool write, int64_t offset) {
+    return FileIO(Thread::GetCurrentThread()->GetParent(), fd, uio, write, offset);
+}
 
-    if (!UserRead(buf, kBuf, count, proc)) {
-        delete[] kBuf;
+// Copies the iovec array in and checks the total length fits in a ssize_t
+static int CopyIOVecsFromUser(const FS::IOVec* iov, int iovcnt, FS::IOVec* kIov, Process* proc) {
+    if (!UserRead(iov, kIov, sizeof(FS::IOVec) * iovcnt, proc))
         return -EFAULT;
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        if (kIov[i].length > SSIZE_MAX - total)
+            return -EINVAL;
+        total += kIov[i].length;
     }
+    return ESUCCESS;
+}
 
-    size_t realCount = 0;
-    int rc = desc->Write(kBuf, count, &realCount);
-    ssize_t result = rc < 0 ? rc : realCount;
-    
-    delete[] kBuf;
-    return result;
+static ssize_t DoVectorIO(int fd, const FS::IOVec* iov, int iovcnt, bool write) {
+    if (iovcnt <= 0 || iovcnt > UIO_MAX_IOV)
+        return -EINVAL;
+
+    FS::IOVec fastIov[UIO_FAST_IOV];
+    FS::IOVec* kIov = fastIov;
+    if (iovcnt > UIO_FAST_IOV) {
+        kIov = new FS::IOVec[iovcnt];
+        if (kIov == nullptr)
+            return -ENOMEM;
+    }
+
+    ssize_t rc = CopyIOVecsFromUser(iov, iovcnt, kIov, Thread::GetCurrentThread()->GetParent());
+    if (rc == ESUCCESS) {
+        FS::UIO uio(kIov, iovcnt, FS::UIOSpace::USER);
+        rc = uio.GetResidual() == 0 ? 0 : DoIO(fd, &uio, write, -1);
+    }
+
+    if (kIov != fastIov)
+        delete[] kIov;
+    return rc;
+}
+
+ssize_t sys_read(int fd, void* buf, size_t count) {
+    if (count == 0)
+        return -EINVAL;
+
+    FS::UIO uio(buf, MIN(count, SSIZE_MAX), FS::UIOSpace::USER);
+    return DoIO(fd, &uio, false, -1);
+}
+
+ssize_t sys_write(int fd, const void* buf, size_t count) {
+    if (count == 0)
+        return -EINVAL;
+
+    FS::UIO uio(const_cast<void*>(buf), MIN(count, SSIZE_MAX), FS::UIOSpace::USER);
+    return DoIO(fd, &uio, true, -1);
+}
+
+ssize_t sys_readv(int fd, const FS::IOVec* iov, int iovcnt) {
+    return DoVectorIO(fd, iov, iovcnt, false);
+}
+
+ssize_t sys_writev(int fd, const FS::IOVec* iov, int iovcnt) {
+    return DoVectorIO(fd, iov, iovcnt, true);
+}
+
+ssize_t sys_pread(int fd, void* buf, size_t count, off_t offset) {
+    if (offset < 0)
+        return -EINVAL;
+    if (count == 0)
+        return 0;
+
+    FS::UIO uio(buf, MIN(count, SSIZE_MAX), FS::UIOSpace::USER);
+    return DoIO(fd, &uio, false, offset);
+}
+
+ssize_t sys_pwrite(int fd, const void* buf, size_t count, off_t offset) {
+    if (offset < 0)
+        return -EINVAL;
+    if (count == 0)
+        return 0;
+
+    FS::UIO uio(const_cast<void*>(buf), MIN(count, SSIZE_MAX), FS::UIOSpace::USER);
+    return DoIO(fd, &uio, true, offset);
 }
 
 off_t sys_seek(int fd, off_t offset, int whence) {
@@ -251,6 +313,77 @@ off_t sys_seek(int fd, off_t offset, int whence) {
     return realOffset;
 }
 
+int sys_fallocate(int fd, int mode, off_t offset, off_t len) {
+    if (offset < 0 || len <= 0)
+        return -EINVAL;
+    if (mode != 0)
+        return -EOPNOTSUPP;
+
+    Thread* current = Thread::GetCurrentThread();
+    Process* proc = current->GetParent();
+    FileDescriptorManager* manager = proc->GetFDManager();
+    if (manager == nullptr)
+        return -ENOSYS;
+
+    FileDescriptor* desc = manager->Get(fd);
+    if (desc == nullptr || !desc->isOpen())
+        return -EBADF;
+
+    return desc->Allocate(offset, len);
+}
+
+int sys_pipe(int* fds, int flags) {
+    if ((flags & ~(O_NONBLOCK | O_CLOEXEC)) != 0)
+        return -EINVAL;
+
+    Thread* current = Thread::GetCurrentThread();
+    Process* proc = current->GetParent();
+    FileDescriptorManager* manager = proc->GetFDManager();
+    if (manager == nullptr)
+        return -ENOSYS;
+
+    FS::Pipe* pipe = new FS::Pipe();
+    if (pipe == nullptr)
+        return -ENOMEM;
+    if (!pipe->Init()) {
+        delete pipe;
+        return -ENOMEM;
+    }
+
+    FileDescriptor* ends[2] = {new FileDescriptor(proc, FDType::PipeRead, pipe), new FileDescriptor(proc, FDType::PipeWrite, pipe)};
+    if (ends[0] == nullptr || ends[1] == nullptr) {
+        delete ends[0];
+        delete ends[1];
+        delete pipe;
+        return -ENOMEM;
+    }
+    // from here on the pipe is freed when both ends are closed
+    ends[0]->Open(flags);
+    ends[1]->Open(flags);
+
+    int kFds[2] = {-1, -1};
+    int rc = ESUCCESS;
+    for (int i = 0; i < 2 && rc == ESUCCESS; i++) {
+        fd_t fd = manager->Allocate(ends[i]);
+        if (fd < 0)
+            rc = fd;
+        else
+            kFds[i] = fd;
+    }
+    if (rc == ESUCCESS && !UserWrite(fds, kFds, sizeof(kFds), proc))
+        rc = -EFAULT;
+
+    if (rc < 0) {
+        for (int i = 0; i < 2; i++) {
+            if (kFds[i] >= 0)
+                manager->Free(kFds[i]);
+            ends[i]->Close();
+            delete ends[i];
+        }
+    }
+    return rc;
+}
+
 int sys_isatty(int fd) {
     Thread* current = Thread::GetCurrentThread();
     Process* proc = current->GetParent();
@@ -313,10 +446,6 @@ int sys_getcwd(char* buf, size_t size) {
 
     Thread* current = Thread::GetCurrentThread();
     Process* proc = current->GetParent();
-    VMM::VMM* vmm = proc->GetVMM();
-    if (!vmm->ValidateWrite(buf, size))
-        return -EFAULT;
-
     FS::VNode* vnode = proc->GetCWD();
 
     char* kBuf = new char[size];
@@ -329,7 +458,7 @@ int sys_getcwd(char* buf, size_t size) {
         return rc;
     }
 
-    bool ret = UserWrite(buf, kBuf, size, proc, false);
+    bool ret = UserWrite(buf, kBuf, size, proc);
 
     delete[] kBuf;
 
@@ -20,10 +20,14 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <stddef.h>
 
+#include <fs/UIO.hpp>
+
 typedef unsigned int mode_t;
 typedef long ssize_t;
 typedef long off_t;
 
+#define SSIZE_MAX 0x7FFF'FFFF'FFFF'FFFFL
+
 #define O_PATH 010000000
 
 #define O_ACCMODE (03 | O_PATH)
@@ -75,12 +79,35 @@ int sys_close(int fd);
 ssize_t sys_read(int fd, void* buf, size_t count);
 ssize_t sys_write(int fd, const void* buf, size_t count);
 
+#define UIO_FAST_IOV 8 // iovec arrays up to this size are copied onto the stack
+
+ssize_t sys_readv(int fd, const FS::IOVec* iov, int iovcnt);
+ssize_t sys_writev(int fd, const FS::IOVec* iov, int iovcnt);
+ssize_t sys_pread(int fd, void* buf, size_t count, off_t offset);
+ssize_t sys_pwrite(int fd, const void* buf, size_t count, off_t offset);
+
 off_t sys_seek(int fd, off_t offset, int whence);
 
+#define FALLOC_FL_KEEP_SIZE 0x01
+#define FALLOC_FL_PUNCH_HOLE 0x02
+
+int sys_fallocate(int fd, int mode, off_t offset, off_t len); // only mode 0 is supported
+
+int sys_pipe(int* fds, int flags); // fds[0] is the read end. flags may hold O_NONBLOCK and O_CLOEXEC
+
 int sys_isatty(int fd);
 
 int sys_getdents(int fd, void* buf, size_t maxRead, size_t* bytesRead);
 
 int sys_getcwd(char* buf, size_t size);
 
+class Process;
+
+// The system calls above act on the current process, these act on proc for kernel code working on its behalf, like I/O ring workers.
+// User pointers must still be valid in the current address space.
+int OpenFile(Process* proc, const char* path, size_t pathLen, int flags, mode_t mode);
+int CloseFile(Process* proc, int fd);
+ssize_t FileIO(Process* proc, int fd, FS::UIO* uio, bool write, int64_t offset); // offset < 0 uses the descriptor's offset
+int SyncFile(Process* proc, int fd);
+
 #endif /* _SYSCALL_FILE_HPP */
\ No newline at end of file
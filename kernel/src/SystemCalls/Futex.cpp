@@ -22,37 +22,77 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <stdint.h>
 #include <time.h>
 
-#include <DataStructures/AVLTree.hpp>
-
 #include <HAL/Processor.hpp>
+#include <HAL/Time.hpp>
 
 #include <Memory/PageMapper.hpp>
+#include <Memory/UserAccess.hpp>
 #include <Memory/VMM.hpp>
 
-#include <Scheduling/Mutex.hpp>
 #include <Scheduling/Process.hpp>
 #include <Scheduling/Scheduler.hpp>
 #include <Scheduling/Thread.hpp>
 #include <Scheduling/ThreadList.hpp>
 
 
-FutexWaitQueue::FutexWaitQueue() : refCount(1), m_waitingThreads(), m_lock(SPINLOCK_DEFAULT_VALUE) {
+FutexWaitQueue g_futexTable[1 << FUTEX_HASH_BITS];
+
+FutexWaitQueue::FutexWaitQueue() : m_waitingThreads(), m_lock(SPINLOCK_DEFAULT_VALUE) {
 }
 
 FutexWaitQueue::~FutexWaitQueue() {
 }
 
-int FutexWaitQueue::Wait(uint32_t* futexPtr, Process* proc, uint32_t expected, timespec* tm) {
+static bool FutexKeyEqual(const FutexKey& a, const FutexKey& b) {
+    return a.object == b.object && a.offset == b.offset;
+}
+
+static void RefFutexKey(const FutexKey& key) {
+    if (!key.shared)
+        return;
+    VMM::MemoryObject* obj = reinterpret_cast<VMM::MemoryObject*>(key.object);
+    spinlock_acquire(&obj->lock);
+    obj->refCount++;
+    spinlock_release(&obj->lock);
+}
+
+// Pages the word in for writing. A locked cmpxchg always writes, so exchanging 0 for 0 write-faults without changing it
+static bool FutexFaultInWritable(uint32_t* futexPtr, Process* proc) {
+    uint32_t expected = 0;
+    return UserCmpXchg32(futexPtr, &expected, 0, proc) || expected != 0;
+}
+
+static void FutexTimeout(Timer*, void* data) {
+    FutexWaitQueue::Remove(static_cast<Thread*>(data), FutexWakeReason::TimedOut);
+}
+
+// relative timeout, saturating
+static uint64_t FutexDeadline(const timespec* tm) {
+    uint64_t now = HAL_GetNSTicks();
+    uint64_t sec = (uint64_t)tm->tv_sec;
+    if (sec > (UINT64_MAX - now) / 1'000'000'000)
+        return UINT64_MAX;
+    uint64_t deadline = now + sec * 1'000'000'000;
+    if ((uint64_t)tm->tv_nsec > UINT64_MAX - deadline)
+        return UINT64_MAX;
+    return deadline + tm->tv_nsec;
+}
+
+int FutexWaitQueue::Wait(const FutexKey& key, uint32_t* futexPtr, Process* proc, uint32_t expected, timespec* tm) {
     int intState = Processor::DisableInterrupts();
     spinlock_acquire(&m_lock);
 
     // re-check under the lock -- this is what closes the lost-wakeup race.
     // nothing can mutate *futexPtr and call Wake() between this check and us joining m_waitingThreads.
     uint32_t word;
-    if (!UserReadAtomic32(futexPtr, &word, proc)) {
+    while (ReadUser32NoFault(futexPtr, &word) != 0) {
+        // not resident, so page it in without the lock and check again
         spinlock_release(&m_lock);
         Processor::EnableInterrupts(intState);
-        return -EFAULT;
+        if (!UserReadAtomic32(futexPtr, &word, proc))
+            return -EFAULT;
+        intState = Processor::DisableInterrupts();
+        spinlock_acquire(&m_lock);
     }
     if (word != expected) {
         spinlock_release(&m_lock);
@@ -63,14 +103,23 @@ int FutexWaitQueue::Wait(uint32_t* futexPtr, Process* proc, uint32_t expected, t
     Thread* thread = Scheduler::RemoveCurrentThread(true);
     assert(thread != nullptr);
     thread->yieldCallback = {};
-    thread->sleepRemainingTime = 0; // TODO: timeout
-    thread->blockedFutex = this;
+    thread->sleepDeadline = 0;
+    thread->futexKey = key;
     thread->wakeReason = FutexWakeReason::None;
+    __atomic_store_n(&thread->blockedFutex, this, __ATOMIC_RELEASE);
     m_waitingThreads.pushBack(thread);
+    if (tm != nullptr) {
+        // local to this processor, so it cannot fire until we have switched away
+        thread->wakeTimer.callback = FutexTimeout;
+        thread->wakeTimer.data = thread;
+        Scheduler::ArmTimer(&thread->wakeTimer, FutexDeadline(tm));
+    }
     spinlock_release(&m_lock);
     Scheduler_SaveAndYield(thread);
     // resumed here — by Wake(), a timeout, or a forced kill
     Processor::EnableInterrupts(intState);
+    if (tm != nullptr)
+        Scheduler::CancelTimer(&thread->wakeTimer);
     switch (thread->wakeReason) {
     case FutexWakeReason::Woken:
         return ESUCCESS;
@@ -83,80 +132,230 @@ int FutexWaitQueue::Wait(uint32_t* futexPtr, Process* proc, uint32_t expected, t
     }
 }
 
-int FutexWaitQueue::Wake(uint32_t maxCount) {
+int FutexWaitQueue::Wake(const FutexKey& key, uint32_t maxCount) {
     int intState = Processor::DisableInterrupts();
     spinlock_acquire(&m_lock);
-    int woken = 0;
-    while (woken < (int)maxCount && m_waitingThreads.getCount() > 0) {
-        Thread* thread = m_waitingThreads.popFront();
-        thread->yieldCallback = {};
-        thread->sleepRemainingTime = 0;
-        thread->blockedFutex = nullptr;
-        thread->wakeReason = FutexWakeReason::Woken;
-        assert(Scheduler::AddExistingThread(thread));
-        woken++;
-    }
+    int woken = WakeLocked(key, maxCount);
     spinlock_release(&m_lock);
     Processor::EnableInterrupts(intState);
     return woken;
 }
 
 void FutexWaitQueue::Remove(Thread* thread, FutexWakeReason reason) {
-    spinlock_acquire(&m_lock);
-    // guard: thread may have already been popped by a racing Wake() or another
-    // Remove() call between when the caller decided to act and now. If so,
-    // blockedFutex was already cleared and this is a no-op.
-    if (thread->blockedFutex == this) {
-        m_waitingThreads.remove(thread);
-        thread->blockedFutex = nullptr;
+    int intState = Processor::DisableInterrupts();
+    while (true) {
+        FutexWaitQueue* q = __atomic_load_n(&thread->blockedFutex, __ATOMIC_ACQUIRE);
+        if (q == nullptr)
+            break; // already woken
+
+        spinlock_acquire(&q->m_lock);
+        if (thread->blockedFutex != q) { // requeued or woken before we got the lock
+            spinlock_release(&q->m_lock);
+            continue;
+        }
+        q->m_waitingThreads.remove(thread);
+        __atomic_store_n(&thread->blockedFutex, nullptr, __ATOMIC_RELEASE);
         thread->wakeReason = reason;
         assert(Scheduler::AddExistingThread(thread));
+        spinlock_release(&q->m_lock);
+        break;
     }
-    spinlock_release(&m_lock);
+    Processor::EnableInterrupts(intState);
+}
+
+int FutexWaitQueue::Requeue(const FutexKey& key, const FutexKey& key2, uint32_t* futexPtr, Process* proc, uint32_t wakeCount, uint32_t requeueCount, const uint32_t* expected) {
+    FutexWaitQueue* src = GetFutexQueue(key);
+    FutexWaitQueue* dst = GetFutexQueue(key2);
+
+    int intState = Processor::DisableInterrupts();
+    LockPair(src, dst);
+
+    if (expected != nullptr) {
+        uint32_t word;
+        while (ReadUser32NoFault(futexPtr, &word) != 0) {
+            UnlockPair(src, dst);
+            Processor::EnableInterrupts(intState);
+            if (!UserReadAtomic32(futexPtr, &word, proc))
+                return -EFAULT;
+            intState = Processor::DisableInterrupts();
+            LockPair(src, dst);
+        }
+        if (word != *expected) {
+            UnlockPair(src, dst);
+            Processor::EnableInterrupts(intState);
+            return -EAGAIN;
+        }
+    }
+
+    int count = src->WakeLocked(key, wakeCount);
+
+    Thread* thread = src->m_waitingThreads.getHead();
+    uint64_t remaining = src->m_waitingThreads.getCount();
+    for (uint32_t moved = 0; thread != nullptr && remaining > 0 && moved < requeueCount; remaining--) {
+        Thread* next = thread->GetThreadListData().next;
+        if (FutexKeyEqual(thread->futexKey, key)) {
+            // the waiter's reference moves with it. Ours on key stops the release from freeing anything here
+            RefFutexKey(key2);
+            PutFutexKey(key);
+            thread->futexKey = key2;
+            if (src != dst) {
+                src->m_waitingThreads.remove(thread);
+                dst->m_waitingThreads.pushBack(thread);
+                __atomic_store_n(&thread->blockedFutex, dst, __ATOMIC_RELEASE);
+            }
+            moved++;
+            count++;
+        }
+        thread = next;
+    }
+
+    UnlockPair(src, dst);
+    Processor::EnableInterrupts(intState);
+    return count;
+}
+
+int FutexWaitQueue::WakeOp(const FutexKey& key, const FutexKey& key2, uint32_t* futexPtr2, Process* proc, uint32_t wakeCount, uint32_t wakeCount2, uint32_t op) {
+    uint32_t opType = (op >> 28) & 0xF;
+    uint32_t cmp = (op >> 24) & 0xF;
+    // both arguments are signed 12-bit fields
+    uint32_t opArg = (uint32_t)(((int32_t)(op << 8)) >> 20);
+    uint32_t cmpArg = (uint32_t)(((int32_t)(op << 20)) >> 20);
+    if (opType & FUTEX_OP_OPARG_SHIFT) {
+        opType &= ~FUTEX_OP_OPARG_SHIFT;
+        if (opArg > 31)
+            return -EINVAL;
+        opArg = 1U << opArg;
+    }
+    if (opType > FUTEX_OP_XOR || cmp > FUTEX_OP_CMP_GE)
+        return -EINVAL;
+
+    FutexWaitQueue* q = GetFutexQueue(key);
+    FutexWaitQueue* q2 = GetFutexQueue(key2);
+
+    int intState = Processor::DisableInterrupts();
+    LockPair(q, q2);
+
+    uint32_t old = 0; // only a guess, a mismatch gives us the real value
+    while (true) {
+        uint32_t value;
+        switch (opType) {
+        case FUTEX_OP_SET:
+            value = opArg;
+            break;
+        case FUTEX_OP_ADD:
+            value = old + opArg;
+            break;
+        case FUTEX_OP_OR:
+            value = old | opArg;
+            break;
+        case FUTEX_OP_ANDN:
+            value = old & ~opArg;
+            break;
+        default:
+            value = old ^ opArg;
+            break;
+        }
+        uint32_t expected = old;
+        int rc = CmpXchgUser32NoFault(futexPtr2, &expected, value);
+        if (rc == 0)
+            break;
+        if (rc == -EAGAIN) {
+            old = expected;
+            continue;
+        }
+        // not resident or not writable, so fault it in without the locks and try again
+        UnlockPair(q, q2);
+        Processor::EnableInterrupts(intState);
+        if (!FutexFaultInWritable(futexPtr2, proc))
+            return -EFAULT;
+        intState = Processor::DisableInterrupts();
+        LockPair(q, q2);
+    }
+
+    int count = q->WakeLocked(key, wakeCount);
+
+    // comparisons are signed, like the old value
+    int32_t oldSigned = (int32_t)old;
+    int32_t cmpSigned = (int32_t)cmpArg;
+    bool result;
+    switch (cmp) {
+    case FUTEX_OP_CMP_EQ:
+        result = oldSigned == cmpSigned;
+        break;
+    case FUTEX_OP_CMP_NE:
+        result = oldSigned != cmpSigned;
+        break;
+    case FUTEX_OP_CMP_LT:
+        result = oldSigned < cmpSigned;
+        break;
+    case FUTEX_OP_CMP_LE:
+        result = oldSigned <= cmpSigned;
+        break;
+    case FUTEX_OP_CMP_GT:
+        result = oldSigned > cmpSigned;
+        break;
+    default:
+        result = oldSigned >= cmpSigned;
+        break;
+    }
+    if (result)
+        count += q2->WakeLocked(key2, wakeCount2);
+
+    UnlockPair(q, q2);
+    Processor::EnableInterrupts(intState);
+    return count;
 }
 
-FutexWaitQueue* GetOrCreateFutex(Process* proc, uint64_t virt) {
-    AVLTree::wAVLTree<uint64_t, FutexWaitQueue*>& tree = proc->GetFutextList();
-    tree.lock();
-    FutexWaitQueue* q = tree.Find(virt);
-    if (q == nullptr) {
-        q = new FutexWaitQueue();
-        tree.Insert(virt, q);
+int FutexWaitQueue::WakeLocked(const FutexKey& key, uint32_t maxCount) {
+    int woken = 0;
+    Thread* thread = m_waitingThreads.getHead();
+    uint64_t remaining = m_waitingThreads.getCount();
+    for (; thread != nullptr && remaining > 0 && woken < (int)maxCount; remaining--) {
+        Thread* next = thread->GetThreadListData().next; // the list data is reused by the run queue
+        if (FutexKeyEqual(thread->futexKey, key)) {
+            m_waitingThreads.remove(thread);
+            thread->yieldCallback = {};
+            thread->sleepDeadline = 0;
+            __atomic_store_n(&thread->blockedFutex, nullptr, __ATOMIC_RELEASE);
+            thread->wakeReason = FutexWakeReason::Woken;
+            assert(Scheduler::AddExistingThread(thread));
+            woken++;
+        }
+        thread = next;
     }
-    q->refCount++;
-    tree.unlock();
-    return q;
-}
-
-FutexWaitQueue* GetFutexForWake(Process* proc, uint64_t virt) {
-    AVLTree::wAVLTree<uint64_t, FutexWaitQueue*>& tree = proc->GetFutextList();
-    tree.lock();
-    FutexWaitQueue* q = tree.Find(virt);
-    if (q != nullptr)
-        q->refCount++;
-    tree.unlock();
-    return q;
-}
-
-void PutFutex(Process* proc, uint64_t virt, FutexWaitQueue* q) {
-    AVLTree::wAVLTree<uint64_t, FutexWaitQueue*>& tree = proc->GetFutextList();
-    tree.lock();
-    q->refCount--;
-    if (q->refCount == 0) {
-        tree.Remove(virt);
-        tree.unlock();
-        delete q;
+    return woken;
+}
+
+// lock order is by address
+void FutexWaitQueue::LockPair(FutexWaitQueue* a, FutexWaitQueue* b) {
+    if (a == b) {
+        spinlock_acquire(&a->m_lock);
         return;
     }
-    tree.unlock();
+    if (a > b) {
+        FutexWaitQueue* tmp = a;
+        a = b;
+        b = tmp;
+    }
+    spinlock_acquire(&a->m_lock);
+    spinlock_acquire(&b->m_lock);
+}
+
+void FutexWaitQueue::UnlockPair(FutexWaitQueue* a, FutexWaitQueue* b) {
+    spinlock_release(&a->m_lock);
+    if (a != b)
+        spinlock_release(&b->m_lock);
 }
 
-int sys_futex(int operation, uint32_t* futexPtr, uint32_t value, timespec* tm) {
-    if ((operation != FUTEX_WAKE && operation != FUTEX_WAIT) || futexPtr == nullptr)
+FutexWaitQueue* GetFutexQueue(const FutexKey& key) {
+    uint64_t hash = (key.object ^ (key.offset * 0x9E3779B97F4A7C15)) * 0xBF58476D1CE4E5B9;
+    return &g_futexTable[hash >> (64 - FUTEX_HASH_BITS)];
+}
+
+int GetFutexKey(uint32_t* futexPtr, Process* proc, bool isPrivate, FutexKey* key) {
+    if (futexPtr == nullptr || ((uint64_t)futexPtr & 3) != 0)
         return -EINVAL;
 
-    Thread* current = Thread::GetCurrentThread();
-    Process* proc = current->GetParent();
     VMM::VMM* vmm = proc->GetVMM();
     if (vmm == nullptr || vmm->GetPageMapper() == nullptr)
         return -ENOSYS;
@@ -164,31 +363,78 @@ int sys_futex(int operation, uint32_t* futexPtr, uint32_t value, timespec* tm) {
     if (!vmm->ValidateRead(futexPtr, sizeof(uint32_t)))
         return -EFAULT;
 
-    timespec ktm = {0, 0};
-    if (tm != nullptr) {
-        if (!UserRead(tm, &ktm, sizeof(timespec), proc))
-            return -EFAULT;
-    }
+    uint64_t offset = 0;
+    VMM::MemoryObject* obj = isPrivate ? nullptr : vmm->GetSharedObject(futexPtr, &offset);
+    if (obj != nullptr)
+        *key = {(uint64_t)obj, offset, true};
+    else
+        *key = {(uint64_t)vmm, (uint64_t)futexPtr, false};
+    return ESUCCESS;
+}
+
+void PutFutexKey(const FutexKey& key) {
+    if (key.shared)
+        VMM::ReleaseMemoryObject(reinterpret_cast<VMM::MemoryObject*>(key.object));
+}
+
+int sys_futex(uint64_t operation, uint32_t* futexPtr, uint32_t value, timespec* tm, uint32_t* futexPtr2) {
+    int command = operation & FUTEX_CMD_MASK;
+    bool isPrivate = (operation & FUTEX_PRIVATE_FLAG) != 0;
+    uint32_t value3 = operation >> 32;
+    uint32_t value2 = (uint32_t)(uint64_t)tm;
 
-    uint64_t virt = (uint64_t)futexPtr;
+    if ((operation & 0xFFFF'FFFF & ~(FUTEX_CMD_MASK | FUTEX_PRIVATE_FLAG)) != 0)
+        return -EINVAL;
+
+    Thread* current = Thread::GetCurrentThread();
+    Process* proc = current->GetParent();
+
+    FutexKey key;
+    int rc = GetFutexKey(futexPtr, proc, isPrivate, &key);
+    if (rc != ESUCCESS)
+        return rc;
 
-    int rc = ESUCCESS;
-    FutexWaitQueue* q;
+    FutexKey key2 = {0, 0, false};
 
-    switch (operation) {
-    case FUTEX_WAIT:
-        q = GetOrCreateFutex(proc, virt);
-        rc = q->Wait(futexPtr, proc, value, &ktm);
-        PutFutex(proc, virt, q);
+    switch (command) {
+    case FUTEX_WAIT: {
+        timespec ktm = {0, 0};
+        if (tm != nullptr) {
+            if (!UserRead(tm, &ktm, sizeof(timespec), proc))
+                rc = -EFAULT;
+            else if (ktm.tv_sec < 0 || ktm.tv_nsec < 0 || ktm.tv_nsec >= 1'000'000'000)
+                rc = -EINVAL;
+            if (rc != ESUCCESS)
+                break;
+        }
+        // a requeue moves us, and our reference, to another key
+        current->futexKey = key;
+        rc = GetFutexQueue(key)->Wait(key, futexPtr, proc, value, tm != nullptr ? &ktm : nullptr);
+        key = current->futexKey;
         break;
+    }
     case FUTEX_WAKE:
-        q = GetFutexForWake(proc, virt);
-        if (q == nullptr)
-            return 0;
-        rc = q->Wake(value);
-        PutFutex(proc, virt, q);
+        rc = GetFutexQueue(key)->Wake(key, value);
+        break;
+    case FUTEX_REQUEUE:
+    case FUTEX_CMP_REQUEUE:
+        rc = GetFutexKey(futexPtr2, proc, isPrivate, &key2);
+        if (rc != ESUCCESS)
+            break;
+        rc = FutexWaitQueue::Requeue(key, key2, futexPtr, proc, value, value2, command == FUTEX_CMP_REQUEUE ? &value3 : nullptr);
+        break;
+    case FUTEX_WAKE_OP:
+        rc = GetFutexKey(futexPtr2, proc, isPrivate, &key2);
+        if (rc != ESUCCESS)
+            break;
+        rc = FutexWaitQueue::WakeOp(key, key2, futexPtr2, proc, value, value2, value3);
+        break;
+    default:
+        rc = -ENOSYS;
         break;
     }
 
+    PutFutexKey(key);
+    PutFutexKey(key2);
     return rc;
 }
@@ -14,7 +14,6 @@ GNU General Public License for more details.
 You should have received a copy of the GNU General Public License
 along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
-
 #ifndef _SYSCALL_FUTEX_HPP
 #define _SYSCALL_FUTEX_HPP
 
@@ -27,26 +26,62 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #define FUTEX_WAIT 0
 #define FUTEX_WAKE 1
+#define FUTEX_REQUEUE 3
+#define FUTEX_CMP_REQUEUE 4
+#define FUTEX_WAKE_OP 5
+
+#define FUTEX_PRIVATE_FLAG 128 // futex is not shared between address spaces, skips the mapping lookup
+#define FUTEX_CMD_MASK 0x7F
+
+// FUTEX_WAKE_OP encoding, val3 = (op << 28) | (cmp << 24) | (oparg << 12) | cmparg, oparg and cmparg are signed 12-bit
+#define FUTEX_OP_SET 0
+#define FUTEX_OP_ADD 1
+#define FUTEX_OP_OR 2
+#define FUTEX_OP_ANDN 3
+#define FUTEX_OP_XOR 4
+#define FUTEX_OP_OPARG_SHIFT 8 // use (1 << oparg) as the operand
+
+#define FUTEX_OP_CMP_EQ 0
+#define FUTEX_OP_CMP_NE 1
+#define FUTEX_OP_CMP_LT 2
+#define FUTEX_OP_CMP_LE 3
+#define FUTEX_OP_CMP_GT 4
+#define FUTEX_OP_CMP_GE 5
+
+#define FUTEX_HASH_BITS 8
 
 class Process;
 
+// A bucket of the global futex hash table. Waiters on different keys can share a bucket.
 class FutexWaitQueue {
 public:
     FutexWaitQueue();
     ~FutexWaitQueue();
 
-    int Wait(uint32_t* futexPtr, Process* proc, uint32_t expected, timespec* tm);
-    int Wake(uint32_t maxCount);
-    void Remove(Thread* thread, FutexWakeReason reason);
+    int Wait(const FutexKey& key, uint32_t* futexPtr, Process* proc, uint32_t expected, timespec* tm); // tm is relative, null to wait forever
+    int Wake(const FutexKey& key, uint32_t maxCount);
 
-    uint64_t refCount;
+    static void Remove(Thread* thread, FutexWakeReason reason); // no-op if the thread isn't waiting
+
+    static int Requeue(const FutexKey& key, const FutexKey& key2, uint32_t* futexPtr, Process* proc, uint32_t wakeCount, uint32_t requeueCount, const uint32_t* expected); // expected is null for plain FUTEX_REQUEUE
+    static int WakeOp(const FutexKey& key, const FutexKey& key2, uint32_t* futexPtr2, Process* proc, uint32_t wakeCount, uint32_t wakeCount2, uint32_t op);
 
 private:
+    int WakeLocked(const FutexKey& key, uint32_t maxCount);
+
+    static void LockPair(FutexWaitQueue* a, FutexWaitQueue* b);
+    static void UnlockPair(FutexWaitQueue* a, FutexWaitQueue* b);
+
     ThreadList m_waitingThreads;
     spinlock_t m_lock;
 };
 
-int sys_futex(int operation, uint32_t* futexPtr, uint32_t value, timespec* tm);
+FutexWaitQueue* GetFutexQueue(const FutexKey& key);
+int GetFutexKey(uint32_t* futexPtr, Process* proc, bool isPrivate, FutexKey* key); // shared keys hold a reference on their object until PutFutexKey
+void PutFutexKey(const FutexKey& key);
+
+// The upper 32 bits of operation hold val3 for FUTEX_CMP_REQUEUE and FUTEX_WAKE_OP, and tm holds val2 for them and FUTEX_REQUEUE
+int sys_futex(uint64_t operation, uint32_t* futexPtr, uint32_t value, timespec* tm, uint32_t* futexPtr2);
 
 
-#endif /* _SYSCALL_FUTEX_HPP */
\ No newline at end of file
+#endif /* _SYSCALL_FUTEX_HPP */
@@ -0,0 +1,106 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "IORing.hpp"
+#include "SystemCall.hpp"
+
+#include <errno.h>
+#include <stdint.h>
+
+#include <fs/FDManager.hpp>
+#include <fs/FileDescriptor.hpp>
+#include <fs/IORing.hpp>
+
+#include <Memory/VMM.hpp>
+
+#include <Scheduling/Process.hpp>
+#include <Scheduling/Thread.hpp>
+
+int sys_ioring_setup(uint32_t entries, IORingParams* params) {
+    Thread* current = Thread::GetCurrentThread();
+    Process* proc = current->GetParent();
+    FileDescriptorManager* manager = proc->GetFDManager();
+    if (manager == nullptr)
+        return -ENOSYS;
+
+    IORingParams kParams;
+    if (!UserRead(params, &kParams, sizeof(IORingParams), proc))
+        return -EFAULT;
+
+    FS::IORing* ring = new FS::IORing(proc);
+    if (ring == nullptr)
+        return -ENOMEM;
+
+    int rc = ring->Init(entries, kParams.flags, kParams.workers);
+    if (rc < 0) {
+        delete ring;
+        return rc;
+    }
+
+    void* addr = ring->Map(proc->GetVMM());
+    if (addr == nullptr) {
+        delete ring;
+        return -ENOMEM;
+    }
+
+    kParams.sqEntries = ring->GetSQEntries();
+    kParams.cqEntries = ring->GetCQEntries();
+    kParams.ringAddr = reinterpret_cast<uint64_t>(addr);
+    kParams.ringSize = ring->GetSize();
+    if (!UserWrite(params, &kParams, sizeof(IORingParams), proc)) {
+        proc->GetVMM()->FreePages(addr);
+        delete ring;
+        return -EFAULT;
+    }
+
+    FileDescriptor* desc = new FileDescriptor(proc, ring);
+    if (desc == nullptr) {
+        proc->GetVMM()->FreePages(addr);
+        delete ring;
+        return -ENOMEM;
+    }
+    desc->Open(0); // takes the only reference to ring
+
+    fd_t fd = manager->Allocate(desc);
+    if (fd < 0) {
+        proc->GetVMM()->FreePages(addr);
+        desc->Close();
+        delete desc;
+    }
+    return fd;
+}
+
+int sys_ioring_enter(int fd, uint32_t toSubmit, uint32_t minComplete, uint32_t flags) {
+    Thread* current = Thread::GetCurrentThread();
+    Process* proc = current->GetParent();
+    FileDescriptorManager* manager = proc->GetFDManager();
+    if (manager == nullptr)
+        return -ENOSYS;
+
+    FileDescriptor* desc = manager->Get(fd);
+    if (desc == nullptr)
+        return -EBADF;
+
+    // the reference keeps the ring alive if another thread closes it while this one is waiting
+    FS::IORing* ring = desc->GetIORing();
+    if (ring == nullptr)
+        return -EBADF;
+    int rc = ring->Enter(toSubmit, minComplete, flags);
+    if (ring->Unref())
+        delete ring;
+    return rc;
+}
@@ -0,0 +1,32 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SYSCALL_IO_RING_HPP
+#define _SYSCALL_IO_RING_HPP
+
+#include <stdint.h>
+
+#include <fs/IORingData.h>
+
+// Returns a descriptor for the ring, and fills in the out fields of params, including where the ring was mapped
+int sys_ioring_setup(uint32_t entries, IORingParams* params);
+
+// Takes up to toSubmit entries from the SQ (all of them are left to the poller with IORING_SETUP_SQPOLL), then with
+// IORING_ENTER_GETEVENTS waits until minComplete completions are ready or nothing is left in flight. Returns the number taken
+int sys_ioring_enter(int fd, uint32_t toSubmit, uint32_t minComplete, uint32_t flags);
+
+#endif /* _SYSCALL_IO_RING_HPP */
@@ -0,0 +1,138 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "Poll.hpp"
+#include "SystemCall.hpp"
+
+#include <errno.h>
+#include <stdint.h>
+#include <util.h>
+
+#include <fs/EventPoll.hpp>
+#include <fs/FDManager.hpp>
+#include <fs/FileDescriptor.hpp>
+
+#include <Scheduling/Process.hpp>
+#include <Scheduling/Thread.hpp>
+
+// referenced so a concurrent close can't free it, release with PutEventPoll
+static FS::EventPoll* GetEventPoll(int epfd, FileDescriptorManager* manager) {
+    FileDescriptor* desc = manager->Get(epfd);
+    if (desc == nullptr)
+        return nullptr;
+    return desc->GetEventPoll();
+}
+
+static void PutEventPoll(FS::EventPoll* poll) {
+    if (poll->Unref())
+        delete poll;
+}
+
+int sys_epoll_create(int flags) {
+    if ((flags & ~EPOLL_CLOEXEC) != 0)
+        return -EINVAL;
+
+    Thread* current = Thread::GetCurrentThread();
+    Process* proc = current->GetParent();
+    FileDescriptorManager* manager = proc->GetFDManager();
+    if (manager == nullptr)
+        return -ENOSYS;
+
+    FS::EventPoll* poll = new FS::EventPoll();
+    if (poll == nullptr)
+        return -ENOMEM;
+
+    FileDescriptor* desc = new FileDescriptor(proc, poll);
+    if (desc == nullptr) {
+        delete poll;
+        return -ENOMEM;
+    }
+    desc->Open(0); // takes the only reference to poll
+
+    fd_t fd = manager->Allocate(desc);
+    if (fd < 0) {
+        desc->Close();
+        delete desc;
+    }
+    return fd;
+}
+
+int sys_epoll_ctl(int epfd, int op, int fd, const FS::EPollEvent* event) {
+    if (epfd == fd)
+        return -EINVAL;
+
+    Thread* current = Thread::GetCurrentThread();
+    Process* proc = current->GetParent();
+    FileDescriptorManager* manager = proc->GetFDManager();
+    if (manager == nullptr)
+        return -ENOSYS;
+
+    FS::EventPoll* poll = GetEventPoll(epfd, manager);
+    if (poll == nullptr)
+        return -EBADF;
+
+    FileDescriptor* desc = manager->Get(fd);
+    if (desc == nullptr || !desc->isOpen()) {
+        PutEventPoll(poll);
+        return -EBADF;
+    }
+
+    FS::EPollEvent kEvent = {};
+    if (op != EPOLL_CTL_DEL && !UserRead(event, &kEvent, sizeof(FS::EPollEvent), proc)) {
+        PutEventPoll(poll);
+        return -EFAULT;
+    }
+
+    int rc = poll->Control(op, fd, desc, op == EPOLL_CTL_DEL ? nullptr : &kEvent);
+    PutEventPoll(poll);
+    return rc;
+}
+
+int sys_epoll_wait(int epfd, FS::EPollEvent* events, int maxEvents, int timeout) {
+    if (maxEvents <= 0)
+        return -EINVAL;
+    maxEvents = MIN(maxEvents, EPOLL_MAX_WAIT_EVENTS); // returning fewer is always allowed
+
+    Thread* current = Thread::GetCurrentThread();
+    Process* proc = current->GetParent();
+    FileDescriptorManager* manager = proc->GetFDManager();
+    if (manager == nullptr)
+        return -ENOSYS;
+
+    FS::EventPoll* poll = GetEventPoll(epfd, manager);
+    if (poll == nullptr)
+        return -EBADF;
+
+    FS::EPollEvent fastEvents[EPOLL_FAST_EVENTS];
+    FS::EPollEvent* kEvents = fastEvents;
+    if (maxEvents > EPOLL_FAST_EVENTS) {
+        kEvents = new FS::EPollEvent[maxEvents];
+        if (kEvents == nullptr) {
+            PutEventPoll(poll);
+            return -ENOMEM;
+        }
+    }
+
+    int rc = poll->Wait(kEvents, maxEvents, timeout);
+    PutEventPoll(poll);
+    if (rc > 0 && !UserWrite(events, kEvents, sizeof(FS::EPollEvent) * rc, proc))
+        rc = -EFAULT;
+
+    if (kEvents != fastEvents)
+        delete[] kEvents;
+    return rc;
+}
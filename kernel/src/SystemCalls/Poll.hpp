@@ -0,0 +1,29 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SYSCALL_POLL_HPP
+#define _SYSCALL_POLL_HPP
+
+#include <fs/EventPoll.hpp>
+
+#define EPOLL_FAST_EVENTS 16 // event arrays up to this size are built on the stack
+
+int sys_epoll_create(int flags); // flags may hold EPOLL_CLOEXEC
+int sys_epoll_ctl(int epfd, int op, int fd, const FS::EPollEvent* event); // -EPERM for regular files, directories and TTY input
+int sys_epoll_wait(int epfd, FS::EPollEvent* events, int maxEvents, int timeout); // timeout in ms, -1 to wait forever
+
+#endif /* _SYSCALL_POLL_HPP */
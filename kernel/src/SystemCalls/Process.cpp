@@ -280,13 +280,13 @@ int sys_exec(const char* path, char* const argv[], char* const env[]) {
     char** kEnv;
     int rc = CopyArgEnvFromUser(const_cast<const char**>(argv), const_cast<const char**>(env), &argc, &kArgv, &envc, &kEnv, currentProc);
     if (rc < 0) {
-        delete kPath;
+        kfree(kPath);
         return rc;
     }
 
     rc = CreateELFProcess(kPath, parent, kArgv, kEnv, true, &newProc);
 
-    delete kPath;
+    kfree(kPath);
     CleanupArgEnv(argc, argc, kArgv, envc, envc, kEnv);
 
     if (rc < 0)
@@ -304,6 +304,7 @@ int sys_exec(const char* path, char* const argv[], char* const env[]) {
     Scheduler::RemoveProcess(currentProc->GetPID());
 
     if (!newProc->Start()) {
+        Scheduler::RemoveProcess(newProc->GetPID());
         newProc->Delete();
         delete newProc;
     }
@@ -313,3 +314,60 @@ int sys_exec(const char* path, char* const argv[], char* const env[]) {
     PANIC("sys_exec: Thread::ExitCurrentThread returned!");
 }
 
+pid_t sys_spawn(const char* path, char* const argv[], char* const env[]) {
+    if (path == nullptr || argv == nullptr || env == nullptr)
+        return -EFAULT;
+
+    Thread* current = Thread::GetCurrentThread();
+    Process* currentProc = current->GetParent();
+    VMM::VMM* currentVMM = currentProc->GetVMM();
+    if (currentVMM == nullptr)
+        return -ENOSYS;
+
+    size_t pathLen = 0;
+    char* kPath = nullptr;
+    if (!UserReadString(path, &kPath, &pathLen, currentProc))
+        return -EFAULT;
+
+    uint64_t argc;
+    uint64_t envc;
+    char** kArgv;
+    char** kEnv;
+    int rc = CopyArgEnvFromUser(const_cast<const char**>(argv), const_cast<const char**>(env), &argc, &kArgv, &envc, &kEnv, currentProc);
+    if (rc < 0) {
+        kfree(kPath);
+        return rc;
+    }
+
+    Process* newProc = nullptr;
+    rc = CreateELFProcess(kPath, currentProc, kArgv, kEnv, true, &newProc);
+
+    // CreateELFProcess finishes on the kernel page tables
+    currentVMM->GetPageMapper()->SwapToThis();
+
+    kfree(kPath);
+    CleanupArgEnv(argc, argc, kArgv, envc, envc, kEnv);
+
+    if (rc < 0)
+        return rc;
+
+    newProc->SetCWD(currentProc->GetCWD());
+    newProc->SetCred(currentProc->GetCred());
+
+    FileDescriptorManager* FDManager = newProc->GetFDManager();
+    FDManager->Delete();
+    if (!FDManager->Fork(currentProc->GetFDManager(), newProc)) {
+        newProc->Delete(); // not registered until Start
+        delete newProc;
+        return -ENOMEM;
+    }
+
+    if (!newProc->Start()) {
+        Scheduler::RemoveProcess(newProc->GetPID());
+        newProc->Delete();
+        delete newProc;
+        return -ENOMEM;
+    }
+
+    return newProc->GetPID();
+}
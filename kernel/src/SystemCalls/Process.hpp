@@ -52,4 +52,6 @@ pid_t sys_fork();
 
 int sys_exec(const char* path, char* const argv[], char* const env[]);
 
+pid_t sys_spawn(const char* path, char* const argv[], char* const env[]); // like fork then exec, without copying the address space
+
 #endif /* _SYSCALL_PROCESS_HPP */
\ No newline at end of file
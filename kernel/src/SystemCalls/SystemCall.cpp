@@ -17,19 +17,24 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "File.hpp"
 #include "Futex.hpp"
+#include "IORing.hpp"
 #include "Memory.hpp"
+#include "Poll.hpp"
 #include "Process.hpp"
 #include "SystemCall.hpp"
 #include "Time.hpp"
 
 #include <errno.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
-#include <Memory/VMM.hpp>
+#include <Memory/UserAccess.hpp>
 
 #include <Scheduling/Process.hpp>
 
+#define USER_STRING_INITIAL_SIZE 64
+
 typedef uint64_t (*systemCall_t)(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t);
 
 #pragma GCC diagnostic push
@@ -54,53 +59,53 @@ uint64_t HandleSystemCall(uint64_t num, uint64_t arg1, uint64_t arg2, uint64_t a
 bool UserRead(const void* userBuf, void* kBuf, size_t size, Process* currentProc) {
     if (userBuf == nullptr || kBuf == nullptr || size == 0 || currentProc == nullptr)
         return false;
-    VMM::VMM* vmm = currentProc->GetVMM();
-    if (!vmm->ValidateRead(userBuf, size))
-        return false;
-    memcpy(kBuf, userBuf, size);
-    return true;
+    return CopyFromUser(kBuf, userBuf, size) == 0;
 }
 
-bool UserWrite(void* userBuf, const void* kBuf, size_t size, Process* currentProc, bool validate) {
+bool UserWrite(void* userBuf, const void* kBuf, size_t size, Process* currentProc) {
     if (userBuf == nullptr || kBuf == nullptr || size == 0 || currentProc == nullptr)
         return false;
-    VMM::VMM* vmm = currentProc->GetVMM();
-    if (validate && !vmm->ValidateWrite(userBuf, size))
-        return false;
-    memcpy(userBuf, kBuf, size);
-    return true;
+    return CopyToUser(userBuf, kBuf, size) == 0;
 }
 
 bool UserReadString(const char* userStr, char** kBuf, size_t* size, Process* currentProc) {
     if (userStr == nullptr || kBuf == nullptr || size == nullptr || currentProc == nullptr)
         return false;
-    VMM::VMM* vmm = currentProc->GetVMM();
-    size_t currentSize = 0;
-    char* buffer = (char*)kmalloc(64);
+    size_t capacity = USER_STRING_INITIAL_SIZE;
+    size_t length = 0;
+    char* buffer = (char*)kmalloc(capacity);
+    if (buffer == nullptr)
+        return false;
     while (true) {
-        size_t blockSize = 0;
-        bool rc = vmm->CopyStringFromUser(&buffer[currentSize], &userStr[currentSize], 64, &blockSize);
-        currentSize += blockSize;
-        if (!rc) {
-            if (blockSize == 64)
-                buffer = (char*)krealloc(buffer, currentSize + 64);
-            else {
-                kfree(buffer);
-                return false;
-            }
+        int64_t rc = StrncpyFromUser(&buffer[length], &userStr[length], capacity - length);
+        if (rc < 0) {
+            kfree(buffer);
+            return false;
         }
-        *size = currentSize;
-        *kBuf = buffer;
-        return true;
+        length += rc;
+        if (length < capacity) { // found the NUL
+            *size = length + 1;
+            *kBuf = buffer;
+            return true;
+        }
+        capacity *= 2;
+        char* newBuffer = (char*)krealloc(buffer, capacity);
+        if (newBuffer == nullptr) {
+            kfree(buffer);
+            return false;
+        }
+        buffer = newBuffer;
     }
 }
 
 bool UserReadAtomic32(const uint32_t* userBuf, uint32_t* kBuf, Process* currentProc) {
-    if (userBuf == nullptr || kBuf == nullptr || currentProc == nullptr)
+    if (userBuf == nullptr || kBuf == nullptr || currentProc == nullptr || ((uint64_t)userBuf & 3) != 0)
         return false;
-    VMM::VMM* vmm = currentProc->GetVMM();
-    if (!vmm->ValidateRead(userBuf, 4))
+    return ReadUser32(userBuf, kBuf) == 0;
+}
+
+bool UserCmpXchg32(uint32_t* userBuf, uint32_t* expected, uint32_t desired, Process* currentProc) {
+    if (userBuf == nullptr || expected == nullptr || currentProc == nullptr || ((uint64_t)userBuf & 3) != 0)
         return false;
-    *kBuf = __atomic_load_n(userBuf, __ATOMIC_SEQ_CST);
-    return true;
+    return CmpXchgUser32(userBuf, expected, desired) == 0;
 }
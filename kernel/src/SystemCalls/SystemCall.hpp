@@ -26,9 +26,10 @@ class Process;
 uint64_t HandleSystemCall(uint64_t num, uint64_t arg1, uint64_t arg2, uint64_t arg3, uint64_t arg4, uint64_t arg5);
 
 bool UserRead(const void* userBuf, void* kBuf, size_t size, Process* currentProc);
-bool UserWrite(void* userBuf, const void* kBuf, size_t size, Process* currentProc, bool validate = true);
+bool UserWrite(void* userBuf, const void* kBuf, size_t size, Process* currentProc);
 bool UserReadString(const char* userStr, char** kBuf, size_t* size, Process* currentProc);
 bool UserReadAtomic32(const uint32_t* userBuf, uint32_t* kBuf, Process* currentProc);
+bool UserCmpXchg32(uint32_t* userBuf, uint32_t* expected, uint32_t desired, Process* currentProc); // false on fault or mismatch, *expected is updated on mismatch
 
 #define ENUMERATE_SYSTEM_CALLS(SC) \
     SC(EXIT, exit) \
@@ -52,7 +53,19 @@ bool UserReadAtomic32(const uint32_t* userBuf, uint32_t* kBuf, Process* currentP
     SC(FORK, fork) \
     SC(EXEC, exec) \
     SC(FUTEX, futex) \
-    SC(GETCWD, getcwd)
+    SC(GETCWD, getcwd) \
+    SC(SPAWN, spawn) \
+    SC(READV, readv) \
+    SC(WRITEV, writev) \
+    SC(PREAD, pread) \
+    SC(PWRITE, pwrite) \
+    SC(FALLOCATE, fallocate) \
+    SC(PIPE, pipe) \
+    SC(EPOLL_CREATE, epoll_create) \
+    SC(EPOLL_CTL, epoll_ctl) \
+    SC(EPOLL_WAIT, epoll_wait) \
+    SC(IORING_SETUP, ioring_setup) \
+    SC(IORING_ENTER, ioring_enter)
 
 enum SystemCalls : uint64_t {
 #define ENUMERATE_CALL(u, l) SYS_##u,
@@ -60,6 +73,6 @@ enum SystemCalls : uint64_t {
 #undef ENUMERATE_CALL
 };
 
-#define SYSTEM_CALL_COUNT 22
+#define SYSTEM_CALL_COUNT 34
 
 #endif /* _SYSTEM_CALL_HPP */
\ No newline at end of file
@@ -22,7 +22,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <errno.h>
 #include <time.h>
 
-#include <HAL/Time.hpp>
+#include <Exec/VDSO.hpp>
 
 #include <Scheduling/Process.hpp>
 #include <Scheduling/Thread.hpp>
@@ -32,22 +32,9 @@ int sys_clockget(int clock, timespec* time) {
     Process* proc = current->GetParent();
 
     timespec t;
-    
-    switch (clock) {
-    case CLOCK_REALTIME:
-        t.tv_sec = HAL_GetUnixEpochTime();
-        if (t.tv_sec == INT64_MAX)
-            return -ENOSYS;
-        t.tv_nsec = t.tv_sec * 1'000'000'000;
-        break;
-    case CLOCK_MONOTONIC:
-    case CLOCK_BOOTTIME:
-        t.tv_nsec = HAL_GetNSTicks();
-        t.tv_sec = t.tv_nsec / 1'000'000'000;
-        break;
-    default:
-        return -ENOSYS;
-    }
+    int rc = VDSO_KernelClockGet(clock, &t);
+    if (rc < 0)
+        return rc;
 
     if (!UserWrite(time, &t, sizeof(timespec), proc))
         return -EFAULT;
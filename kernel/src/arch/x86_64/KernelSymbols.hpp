@@ -35,6 +35,8 @@ extern uint8_t __ctors_start;
 extern uint8_t __ctors_end;
 extern uint8_t __dtors_start;
 extern uint8_t __dtors_end;
+extern uint8_t __ex_table_start;
+extern uint8_t __ex_table_end;
 
 extern const void* _kernel_start_addr;
 extern const void* _text_start_addr;
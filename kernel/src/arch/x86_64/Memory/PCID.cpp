@@ -0,0 +1,180 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "PageMapper.hpp"
+#include "PagingInit.hpp"
+#include "PagingUtil.hpp"
+#include "PCID.hpp"
+#include "TLBShootdown.hpp"
+
+#include "../Processor.hpp"
+
+#include <spinlock.h>
+#include <string.h>
+#include <util.h>
+
+#include <Memory/PageMapper.hpp>
+#include <Memory/PagingUtil.hpp>
+
+bool g_PCIDEnabled = false;
+bool g_INVPCIDSupported = false;
+
+spinlock_t g_ASIDLock = SPINLOCK_DEFAULT_VALUE;
+uint64_t g_ASIDGeneration = 1;
+uint64_t g_NextASID = 1; // ASID 0 belongs to the kernel mapper
+uint64_t g_NextASIDInfoID = 1;
+uint64_t g_KernelTLBGeneration = 0;
+
+void x86_64_PCID_Init() {
+    x86_64_Processor* proc = static_cast<x86_64_Processor*>(GetCurrentProcessor());
+    if (proc == nullptr)
+        return;
+
+    const x86_64_CPUInfo* info = proc->GetCPUInfo();
+    if (proc->isBSP()) {
+        g_PCIDEnabled = info->PCID;
+        g_INVPCIDSupported = info->INVPCID;
+    }
+    if (!g_PCIDEnabled || !info->PCID)
+        return;
+
+    x86_64_PCIDState* state = new x86_64_PCIDState;
+    memset(state, 0, sizeof(x86_64_PCIDState));
+    proc->PCIDState = state;
+
+    // CR3 still holds PCID 0 here, which is required to set CR4.PCIDE
+    x86_64_EnablePCID();
+}
+
+bool x86_64_PCID_IsEnabled() {
+    return g_PCIDEnabled;
+}
+
+void x86_64_PCID_InitASIDInfo(x86_64_ASIDInfo* info) {
+    info->id = __atomic_fetch_add(&g_NextASIDInfoID, 1, __ATOMIC_RELAXED);
+    info->asid = 0;
+    info->generation = 0;
+    info->tlbGeneration = 0;
+}
+
+uint64_t x86_64_PCID_GetASID(x86_64_ASIDInfo* info) {
+    if (__atomic_load_n(&info->generation, __ATOMIC_ACQUIRE) == __atomic_load_n(&g_ASIDGeneration, __ATOMIC_ACQUIRE))
+        return __atomic_load_n(&info->asid, __ATOMIC_RELAXED);
+
+    spinlock_acquire(&g_ASIDLock);
+    if (info->generation != g_ASIDGeneration) {
+        if (g_NextASID == PCID_ASID_COUNT) {
+            __atomic_add_fetch(&g_ASIDGeneration, 1, __ATOMIC_RELEASE);
+            g_NextASID = 1;
+        }
+        __atomic_store_n(&info->asid, g_NextASID++, __ATOMIC_RELAXED);
+        __atomic_store_n(&info->generation, g_ASIDGeneration, __ATOMIC_RELEASE);
+    }
+    uint64_t asid = info->asid;
+    spinlock_release(&g_ASIDLock);
+    return asid;
+}
+
+uint64_t x86_64_PCID_PrepareSwitch(PageMapper* mapper, uint64_t cr3) {
+    uint64_t root = cr3 & PCID_ROOT_MASK;
+    x86_64_TLBShootdown_SetActive(root);
+
+    x86_64_Processor* proc = static_cast<x86_64_Processor*>(GetCurrentProcessor());
+    if (proc == nullptr || proc->PCIDState == nullptr)
+        return root;
+    x86_64_PCIDState* state = proc->PCIDState;
+
+    // The thread may have temporarily swapped to a different mapper than its owner's
+    x86_64_PageMapper* map = static_cast<x86_64_PageMapper*>(mapper);
+    if (map == nullptr || (uint64_t)from_HHDM(map->GetPageTable()) != root)
+        map = static_cast<x86_64_PageMapper*>(g_KPageMapper);
+    if (map != nullptr && (uint64_t)from_HHDM(map->GetPageTable()) != root)
+        map = nullptr;
+
+    uint64_t asid = 0;
+    uint64_t owner = 0;
+    uint64_t tlbGeneration = 0;
+    if (map != nullptr) {
+        x86_64_ASIDInfo* info = map->GetASIDInfo();
+        if (map != g_KPageMapper)
+            asid = x86_64_PCID_GetASID(info);
+        owner = info->id;
+        tlbGeneration = __atomic_load_n(&info->tlbGeneration, __ATOMIC_SEQ_CST);
+    }
+    uint64_t kernelTLBGeneration = __atomic_load_n(&g_KernelTLBGeneration, __ATOMIC_SEQ_CST);
+
+    x86_64_ASIDSlot* slot = &state->slots[asid];
+    bool flush = owner == 0 || slot->owner != owner || slot->tlbGeneration != tlbGeneration || slot->kernelTLBGeneration != kernelTLBGeneration;
+    slot->owner = owner;
+    slot->tlbGeneration = tlbGeneration;
+    slot->kernelTLBGeneration = kernelTLBGeneration;
+    state->currentASID = asid;
+
+    return root | asid | (flush ? 0 : PCID_NOFLUSH);
+}
+
+void x86_64_PCID_InvalidateASID(uint64_t asid, const TLBShootdownBatch* batch) {
+    if (batch->fullFlush) {
+        x86_64_INVPCID(INVPCID_TYPE_SINGLE, asid, 0);
+        return;
+    }
+    for (uint64_t i = 0; i < batch->count; i++) {
+        for (uint64_t j = 0; j < batch->ranges[i].pageCount; j++)
+            x86_64_INVPCID(INVPCID_TYPE_ADDRESS, asid, batch->ranges[i].start + j * PAGE_SIZE);
+    }
+}
+
+void x86_64_PCID_UpdateSlot(x86_64_PCIDState* state, uint64_t asid, bool kernel, uint64_t generation, const TLBShootdownBatch* batch, bool useINVPCID) {
+    x86_64_ASIDSlot* slot = &state->slots[asid];
+    uint64_t* slotGeneration = kernel ? &slot->kernelTLBGeneration : &slot->tlbGeneration;
+    if (*slotGeneration != generation - 1)
+        return;
+
+    // The current ASID has already been invalidated with invlpg
+    if (asid != state->currentASID) {
+        if (!useINVPCID)
+            return;
+        x86_64_PCID_InvalidateASID(asid, batch);
+    }
+    *slotGeneration = generation;
+}
+
+void x86_64_PCID_OnShootdown(x86_64_PageMapper* mapper, bool kernel, const TLBShootdownBatch* batch) {
+    if (!g_PCIDEnabled)
+        return;
+
+    x86_64_ASIDInfo* info = mapper->GetASIDInfo();
+    uint64_t generation = __atomic_add_fetch(kernel ? &g_KernelTLBGeneration : &info->tlbGeneration, 1, __ATOMIC_SEQ_CST);
+
+    x86_64_Processor* proc = static_cast<x86_64_Processor*>(GetCurrentProcessor());
+    if (proc == nullptr || proc->PCIDState == nullptr)
+        return;
+    x86_64_PCIDState* state = proc->PCIDState;
+
+    uint64_t pageCount = 0;
+    for (uint64_t i = 0; i < batch->count; i++)
+        pageCount += batch->ranges[i].pageCount;
+    bool useINVPCID = g_INVPCIDSupported && (batch->fullFlush || pageCount <= PCID_INVPCID_MAX_PAGES);
+
+    // Slots that were up to date before this shootdown can be kept that way, everything else flushes on its next load
+    if (kernel) {
+        for (uint64_t asid = 0; asid < PCID_ASID_COUNT; asid++) {
+            if (state->slots[asid].owner != 0)
+                x86_64_PCID_UpdateSlot(state, asid, true, generation, batch, useINVPCID);
+        }
+    } else if (state->slots[info->asid].owner == info->id)
+        x86_64_PCID_UpdateSlot(state, info->asid, false, generation, batch, useINVPCID);
+}
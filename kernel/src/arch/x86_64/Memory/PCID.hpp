@@ -0,0 +1,72 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef _x86_64_PCID_HPP
+#define _x86_64_PCID_HPP
+
+#include <stdint.h>
+
+#include <Memory/PageMapper.hpp>
+
+#define PCID_ASID_COUNT 256 // of the 4096 the hardware allows, keeps the per-CPU table small
+#define PCID_NOFLUSH (1UL << 63)
+#define PCID_ROOT_MASK 0x000F'FFFF'FFFF'F000
+#define PCID_INVPCID_MAX_PAGES 32 // beyond this a stale ASID is left to be flushed on its next load
+
+#define INVPCID_TYPE_ADDRESS 0
+#define INVPCID_TYPE_SINGLE 1
+
+/*
+ASIDs are handed out to page mappers from a global counter. When it runs out the
+generation is bumped and every mapper gets a new ASID the next time it is loaded.
+Collisions between generations are harmless, as each CPU remembers which mapper
+last used each ASID and flushes it on a mismatch. Each mapper, and the kernel half,
+also has a TLB generation that is bumped on every shootdown, so a CPU that still
+has stale entries cached under an inactive ASID flushes them on its next load.
+*/
+
+struct x86_64_ASIDInfo {
+    uint64_t id; // never reused, unlike the root table
+    uint64_t asid;
+    uint64_t generation;
+    uint64_t tlbGeneration;
+};
+
+struct x86_64_ASIDSlot {
+    uint64_t owner; // ASIDInfo id, 0 for unknown
+    uint64_t tlbGeneration;
+    uint64_t kernelTLBGeneration;
+};
+
+struct x86_64_PCIDState {
+    uint64_t currentASID;
+    x86_64_ASIDSlot slots[PCID_ASID_COUNT];
+};
+
+class x86_64_PageMapper;
+
+void x86_64_PCID_Init(); // must be called on each CPU, the BSP first
+bool x86_64_PCID_IsEnabled();
+
+void x86_64_PCID_InitASIDInfo(x86_64_ASIDInfo* info);
+
+// Must be called with interrupts disabled. Returns the value to load into CR3.
+uint64_t x86_64_PCID_PrepareSwitch(PageMapper* mapper, uint64_t cr3);
+
+// Must be called with interrupts disabled, after the local invalidation and before any remote CPUs are sampled
+void x86_64_PCID_OnShootdown(x86_64_PageMapper* mapper, bool kernel, const TLBShootdownBatch* batch);
+
+#endif /* _x86_64_PCID_HPP */
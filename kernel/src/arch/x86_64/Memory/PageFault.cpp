@@ -16,6 +16,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include "PageFault.hpp"
+#include "UserAccess.hpp"
 
 #include <stdio.h>
 
@@ -26,6 +27,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <Scheduling/Scheduler.hpp>
 
 #include "../Panic.hpp"
+#include "../Processor.hpp"
 
 bool inPageFault = false;
 
@@ -37,7 +39,14 @@ void x86_64_PageFaultHandler(x86_64_ISR_Frame* frame) {
     code.reservedWrite = (frame->ERR & 8) > 0;
     code.execute = (frame->ERR & 16) > 0;
 
-    if (!code.reservedWrite) {
+    // A kernel access to a user page outside a UserAccessBegin/End pair is a bug, not something to page in
+    bool smapViolation = !code.user && code.present && g_x86_64_SMAPEnabled && (frame->RFLAGS & RFLAGS_AC) == 0 && IsInUserRegion(frame->CR2);
+
+    // A non-faulting user access made under a spinlock, so don't page anything in
+    x86_64_Processor* proc = static_cast<x86_64_Processor*>(GetCurrentProcessor());
+    bool noFault = !code.user && proc != nullptr && proc->noUserFaults && IsInUserRegion(frame->CR2);
+
+    if (!code.reservedWrite && !smapViolation && !noFault) {
         Process* process = nullptr;
         if (Scheduler::isRunning()) {
             Scheduler::ProcessorState* currentState = GetCurrentProcessorState();
@@ -49,7 +58,7 @@ void x86_64_PageFaultHandler(x86_64_ISR_Frame* frame) {
 
         if (process != nullptr) {
             VMM::VMM* vmm;
-            if (process->GetMode() == ProcessMode::USER && !IsInUserRegion(frame->CR2))
+            if (!IsInUserRegion(frame->CR2) || process->GetVMM() == nullptr) // kernel mode I/O threads can run in a user address space
                 vmm = VMM::g_KVMM;
             else
                 vmm = process->GetVMM();
@@ -58,6 +67,17 @@ void x86_64_PageFaultHandler(x86_64_ISR_Frame* frame) {
         }
     }
 
+    if (!code.reservedWrite && !smapViolation) {
+        // Fault in one of the user copy routines, make it return an error
+        if (!code.user) {
+            uint64_t fixup = x86_64_FindExceptionFixup(frame->RIP);
+            if (fixup != 0) {
+                frame->RIP = fixup;
+                return;
+            }
+        }
+    }
+
 
     // not returning to normal code from here, prevent recursive page faults
     if (inPageFault) {
@@ -74,6 +94,8 @@ void x86_64_PageFaultHandler(x86_64_ISR_Frame* frame) {
         operation = "execute";
     else if (code.reservedWrite)
         operation = "write reserved metadata";
+    else if (smapViolation)
+        operation = "access (SMAP)";
     else
         operation = "read";
 
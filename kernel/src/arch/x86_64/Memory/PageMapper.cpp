@@ -20,53 +20,52 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "PagingInit.hpp"
 #include "PagingUtil.hpp"
 #include "PAT.hpp"
-
-#include "../interrupts/APIC/LocalAPIC.hpp"
-
-#include "../interrupts/NMI.hpp"
-
-#include "../Processor.hpp"
+#include "PCID.hpp"
+#include "TLBShootdown.hpp"
 
 #include <spinlock.h>
 #include <util.h>
 
+#include <HAL/Processor.hpp>
+
 #include <Memory/PageMapper.hpp>
 #include <Memory/PagingUtil.hpp>
 #include <Memory/PMM.hpp>
 #include <Memory/VMM.hpp>
+#include <Memory/VMRegionAllocator.hpp>
 
 x86_64_PageMapper::x86_64_PageMapper() : m_pageTable(nullptr), m_lock(SPINLOCK_DEFAULT_VALUE) {
-    
+    x86_64_PCID_InitASIDInfo(&m_asidInfo);
 }
 
 x86_64_PageMapper::x86_64_PageMapper(void* pageTable) : m_pageTable(pageTable), m_lock(SPINLOCK_DEFAULT_VALUE) {
-
+    x86_64_PCID_InitASIDInfo(&m_asidInfo);
 }
 
 x86_64_PageMapper::~x86_64_PageMapper() {
 
 }
 
-bool x86_64_PageMapper::MapPage(uint64_t virt, uint64_t phys, VMM::Protection prot, bool user, VMM::CacheType cacheType) {
-    uint32_t flags = 1; // Present
+static bool x86_64_GetMappingFlags(VMM::Protection prot, bool user, VMM::CacheType cacheType, uint32_t* flags) {
+    *flags = 1; // Present
     switch (prot) {
     case VMM::Protection::READ:
-        flags |= 0x800'0000; // Read-only, No execute
+        *flags |= 0x800'0000; // Read-only, No execute
         break;
     case VMM::Protection::READ_WRITE:
-        flags |= 0x800'0002; // Read-write, No execute
+        *flags |= 0x800'0002; // Read-write, No execute
         break;
     case VMM::Protection::READ_EXECUTE:
-        flags |= 0; // Execute
+        *flags |= 0; // Execute
         break;
     case VMM::Protection::READ_WRITE_EXECUTE:
-        flags |= 2; // Read-write + execute
+        *flags |= 2; // Read-write + execute
         break;
     default:
         return false; // Invalid protection
     }
     if (user)
-        flags |= 4;
+        *flags |= 4;
     x86_64_PATOffset offset = x86_64_PATOffset::Default;
     switch (cacheType) {
     case VMM::CacheType::UNCACHABLE:
@@ -85,8 +84,19 @@ bool x86_64_PageMapper::MapPage(uint64_t virt, uint64_t phys, VMM::Protection pr
         offset = x86_64_PATOffset::WriteCombining;
         break;
     }
-    flags |= x86_64_PAT_GetPageMappingFlags(offset);
+    *flags |= x86_64_PAT_GetPageMappingFlags(offset);
+    return true;
+}
+
+bool x86_64_PageMapper::MapPage(uint64_t virt, uint64_t phys, VMM::Protection prot, bool user, VMM::CacheType cacheType) {
+    uint32_t flags;
+    if (!x86_64_GetMappingFlags(prot, user, cacheType, &flags))
+        return false;
     spinlock_acquire(&m_lock);
+    if (!x86_64_Split2MiBPage(m_pageTable, virt)) { // no-op unless there is a large page here
+        spinlock_release(&m_lock);
+        return false;
+    }
     x86_64_MapPage(m_pageTable, virt, phys, flags);
     spinlock_release(&m_lock);
     return true;
@@ -100,74 +110,131 @@ bool x86_64_PageMapper::MapPages(uint64_t virt, uint64_t phys, size_t count, VMM
     return true;
 }
 
+bool x86_64_PageMapper::MapPageArray(uint64_t virt, const uint64_t* phys, size_t count, VMM::Protection prot, bool user, VMM::CacheType cacheType) {
+    uint32_t flags;
+    if (!x86_64_GetMappingFlags(prot, user, cacheType, &flags))
+        return false;
+    spinlock_acquire(&m_lock);
+    for (size_t i = 0; i < count; i++) {
+        if (phys[i] == 0)
+            continue;
+        if (!x86_64_Split2MiBPage(m_pageTable, virt + i * PAGE_SIZE)) {
+            spinlock_release(&m_lock);
+            return false;
+        }
+        x86_64_MapPage(m_pageTable, virt + i * PAGE_SIZE, phys[i], flags);
+    }
+    spinlock_release(&m_lock);
+    return true;
+}
+
 bool x86_64_PageMapper::UnmapPage(uint64_t virt) {
     spinlock_acquire(&m_lock);
+    if (!x86_64_Split2MiBPage(m_pageTable, virt)) {
+        spinlock_release(&m_lock);
+        return false;
+    }
     x86_64_UnmapPage(m_pageTable, virt);
     spinlock_release(&m_lock);
     return true;
 }
 
 bool x86_64_PageMapper::UnmapPages(uint64_t virt, size_t count) {
-    for (size_t i = 0; i < count; i++) {
-        if (!UnmapPage(virt + i * PAGE_SIZE))
+    for (size_t i = 0; i < count;) {
+        uint64_t addr = virt + i * PAGE_SIZE;
+        if ((addr & (LARGE_PAGE_SIZE - 1)) == 0 && count - i >= (LARGE_PAGE_SIZE >> PAGE_SIZE_SHIFT) && IsLargePage(addr)) {
+            UnmapLargePage(addr);
+            i += LARGE_PAGE_SIZE >> PAGE_SIZE_SHIFT;
+            continue;
+        }
+        if (!UnmapPage(addr))
             return false;
+        i++;
     }
     return true;
 }
 
 bool x86_64_PageMapper::RemapPage(uint64_t virt, VMM::Protection prot, bool user, VMM::CacheType cacheType) {
-    uint32_t flags = 1; // Present
-    switch (prot) {
-    case VMM::Protection::READ:
-        flags |= 0x800'0000; // Read-only, No execute
-        break;
-    case VMM::Protection::READ_WRITE:
-        flags |= 0x800'0002; // Read-write, No execute
-        break;
-    case VMM::Protection::READ_EXECUTE:
-        flags |= 0; // Execute
-        break;
-    case VMM::Protection::READ_WRITE_EXECUTE:
-        flags |= 2; // Read-write + execute
-        break;
-    default:
-        return false; // Invalid protection
-    }
-    if (user)
-        flags |= 4;
-    x86_64_PATOffset offset = x86_64_PATOffset::Default;
-    switch (cacheType) {
-    case VMM::CacheType::UNCACHABLE:
-        offset = x86_64_PATOffset::Uncachable;
-        break;
-    case VMM::CacheType::WRITE_BACK:
-        offset = x86_64_PATOffset::WriteBack;
-        break;
-    case VMM::CacheType::WRITE_THROUGH:
-        offset = x86_64_PATOffset::WriteThrough;
-        break;
-    case VMM::CacheType::WRITE_PROTECTED:
-        offset = x86_64_PATOffset::WriteProtected;
-        break;
-    case VMM::CacheType::WRITE_COMBINING:
-        offset = x86_64_PATOffset::WriteCombining;
-        break;
-    }
-    flags |= x86_64_PAT_GetPageMappingFlags(offset);
+    uint32_t flags;
+    if (!x86_64_GetMappingFlags(prot, user, cacheType, &flags))
+        return false;
     spinlock_acquire(&m_lock);
+    if (!x86_64_Split2MiBPage(m_pageTable, virt)) {
+        spinlock_release(&m_lock);
+        return false;
+    }
     x86_64_RemapPage(m_pageTable, virt, flags);
     spinlock_release(&m_lock);
     return true;
 }
 
 bool x86_64_PageMapper::RemapPages(uint64_t virt, size_t count, VMM::Protection prot, bool user, VMM::CacheType cacheType) {
-    for (size_t i = 0; i < count; i++) {
-        if (!RemapPage(virt + i * PAGE_SIZE, prot, user, cacheType))
+    for (size_t i = 0; i < count;) {
+        uint64_t addr = virt + i * PAGE_SIZE;
+        if ((addr & (LARGE_PAGE_SIZE - 1)) == 0 && count - i >= (LARGE_PAGE_SIZE >> PAGE_SIZE_SHIFT) && IsLargePage(addr)) {
+            if (!RemapLargePage(addr, prot, user, cacheType))
+                return false;
+            i += LARGE_PAGE_SIZE >> PAGE_SIZE_SHIFT;
+            continue;
+        }
+        if (!RemapPage(addr, prot, user, cacheType))
             return false;
+        i++;
     }
     return true;
 }
 
+bool x86_64_PageMapper::LargePagesSupported() const {
+    return x86_64_Is2MiBPageSupported();
+}
+
+bool x86_64_PageMapper::MapLargePage(uint64_t virt, uint64_t phys, VMM::Protection prot, bool user, VMM::CacheType cacheType) {
+    uint32_t flags;
+    if (!x86_64_Is2MiBPageSupported() || !x86_64_GetMappingFlags(prot, user, cacheType, &flags))
+        return false;
+    void* replacedTable;
+    spinlock_acquire(&m_lock);
+    bool rc = x86_64_Map2MiBPage(m_pageTable, virt, phys, x86_64_ConvertToLargePageFlags(flags), &replacedTable);
+    spinlock_release(&m_lock);
+    if (replacedTable != nullptr) {
+        // drop any cached walks through the old table before it can be reused
+        InvalidatePages(virt, 1, true);
+        g_PMM->FreePage(replacedTable);
+    }
+    return rc;
+}
+
+bool x86_64_PageMapper::UnmapLargePage(uint64_t virt) {
+    spinlock_acquire(&m_lock);
+    x86_64_Unmap2MiBPage(m_pageTable, virt);
+    spinlock_release(&m_lock);
+    return true;
+}
+
+bool x86_64_PageMapper::RemapLargePage(uint64_t virt, VMM::Protection prot, bool user, VMM::CacheType cacheType) {
+    uint32_t flags;
+    if (!x86_64_GetMappingFlags(prot, user, cacheType, &flags))
+        return false;
+    spinlock_acquire(&m_lock);
+    x86_64_Remap2MiBPage(m_pageTable, virt, x86_64_ConvertToLargePageFlags(flags));
+    spinlock_release(&m_lock);
+    return true;
+}
+
+bool x86_64_PageMapper::IsLargePage(uint64_t virt) {
+    spinlock_acquire(&m_lock);
+    bool rc = x86_64_Is2MiBPage(m_pageTable, virt);
+    spinlock_release(&m_lock);
+    return rc;
+}
+
+bool x86_64_PageMapper::IsLargeRegionEmpty(uint64_t virt) {
+    spinlock_acquire(&m_lock);
+    bool rc = x86_64_Is2MiBRegionEmpty(m_pageTable, virt);
+    spinlock_release(&m_lock);
+    return rc;
+}
+
 uint64_t x86_64_PageMapper::GetPhysicalAddr(uint64_t virt) {
     spinlock_acquire(&m_lock);
     uint64_t phys = x86_64_GetPhysicalAddress(m_pageTable, virt);
@@ -176,16 +243,36 @@ uint64_t x86_64_PageMapper::GetPhysicalAddr(uint64_t virt) {
 }
 
 void x86_64_PageMapper::InvalidatePages(uint64_t virt, size_t count, bool shootdown) {
-    x86_64_InvalidatePages(virt, count * PAGE_SIZE);
-    if (shootdown) {
-        x86_64_Processor* proc = static_cast<x86_64_Processor*>(GetCurrentProcessor());
-        if (proc != nullptr) {
-            x86_64_NMI_InvPagesData data = {virt, count};
-            x86_64_LAPIC* lapic = proc->GetLAPIC();
-            if (lapic != nullptr)
-                x86_64_GlobalNMI::Raise(lapic, x86_64_NMIType::INVPAGES, &data);
-        }
+    if (!shootdown) {
+        x86_64_InvalidatePages(virt, count * PAGE_SIZE);
+        return;
+    }
+
+    TLBShootdownBatch batch = {};
+    QueueShootdown(&batch, virt, count);
+    FlushShootdown(&batch);
+}
+
+void x86_64_PageMapper::QueueShootdown(TLBShootdownBatch* batch, uint64_t virt, size_t count) {
+    if (!IsInUserRegion(virt))
+        batch->global = true;
+    if (batch->count == TLB_BATCH_MAX_RANGES || count >= FULL_FLUSH_THRESHOLD) {
+        batch->fullFlush = true;
+        return;
     }
+    batch->ranges[batch->count].start = virt;
+    batch->ranges[batch->count].pageCount = count;
+    batch->count++;
+}
+
+void x86_64_PageMapper::FlushShootdown(TLBShootdownBatch* batch) {
+    if (m_pageTable == nullptr)
+        return;
+
+    x86_64_TLBShootdown_Flush(this, batch->global || this == g_KPageMapper, batch);
+    batch->count = 0;
+    batch->fullFlush = false;
+    batch->global = false;
 }
 
 void x86_64_PageMapper::SetPageTable(void* pageTable) {
@@ -196,6 +283,10 @@ void* x86_64_PageMapper::GetPageTable() const {
     return m_pageTable;
 }
 
+x86_64_ASIDInfo* x86_64_PageMapper::GetASIDInfo() {
+    return &m_asidInfo;
+}
+
 bool x86_64_PageMapper::isPermsReduction(VMM::Protection oldProt, VMM::Protection newProt) const {
     using namespace VMM;
     switch (newProt) {
@@ -228,7 +319,9 @@ bool x86_64_PageMapper::SwapToThis() {
     if (m_pageTable == nullptr)
         return false;
 
-    x86_64_LoadCR3((uint64_t)from_HHDM(m_pageTable));
+    int flags = Processor::DisableInterrupts();
+    x86_64_LoadCR3(x86_64_PCID_PrepareSwitch(this, (uint64_t)from_HHDM(m_pageTable)));
+    Processor::EnableInterrupts(flags);
     return true;
 }
 
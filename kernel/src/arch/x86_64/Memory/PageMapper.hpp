@@ -18,6 +18,8 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #ifndef _x86_64_PAGE_MAPPER_HPP
 #define _x86_64_PAGE_MAPPER_HPP
 
+#include "PCID.hpp"
+
 #include <spinlock.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -32,18 +34,30 @@ public:
 
     bool MapPage(uint64_t virt, uint64_t phys, VMM::Protection prot, bool user, VMM::CacheType cacheType) override;
     bool MapPages(uint64_t virt, uint64_t phys, size_t count, VMM::Protection prot, bool user, VMM::CacheType cacheType) override;
+    bool MapPageArray(uint64_t virt, const uint64_t* phys, size_t count, VMM::Protection prot, bool user, VMM::CacheType cacheType) override;
     bool UnmapPage(uint64_t virt) override;
     bool UnmapPages(uint64_t virt, size_t count) override;
     bool RemapPage(uint64_t virt, VMM::Protection prot, bool user, VMM::CacheType cacheType) override;
     bool RemapPages(uint64_t virt, size_t count, VMM::Protection prot, bool user, VMM::CacheType cacheType) override;
 
+    bool LargePagesSupported() const override;
+    bool MapLargePage(uint64_t virt, uint64_t phys, VMM::Protection prot, bool user, VMM::CacheType cacheType) override;
+    bool UnmapLargePage(uint64_t virt) override;
+    bool RemapLargePage(uint64_t virt, VMM::Protection prot, bool user, VMM::CacheType cacheType) override;
+    bool IsLargePage(uint64_t virt) override;
+    bool IsLargeRegionEmpty(uint64_t virt) override;
+
     uint64_t GetPhysicalAddr(uint64_t virt) override;
 
     void InvalidatePages(uint64_t virt, size_t count, bool shootdown) override;
+    void QueueShootdown(TLBShootdownBatch* batch, uint64_t virt, size_t count) override;
+    void FlushShootdown(TLBShootdownBatch* batch) override;
 
     void SetPageTable(void* pageTable);
     void* GetPageTable() const override;
 
+    x86_64_ASIDInfo* GetASIDInfo();
+
     bool isPermsReduction(VMM::Protection oldProt, VMM::Protection newProt) const override;
 
     void Create() override;
@@ -54,6 +68,7 @@ public:
 private:
     void* m_pageTable;
     spinlock_t m_lock;
+    x86_64_ASIDInfo m_asidInfo;
 };
 
 PageMapper* CreatePageMapper();
@@ -20,6 +20,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <assert.h>
 #include <string.h>
+#include <util.h>
 
 #include <Memory/PagingUtil.hpp>
 #include <Memory/PMM.hpp>
@@ -68,14 +69,15 @@ uint64_t x86_64_GetPhysicalAddress(void* pageTable, uint64_t virtualAddress) {
         }
         void* newPageTable = x86_64_GetNextPageTable((void*)pageTableEntry, i);
         if (newPageTable == nullptr) {
+            // return the 4 KiB frame within the large page, like for normal pages
             if (i == 3 && ((x86_64_PML3Entry*)pageTableEntry)->PageSize == 1 && ((x86_64_PML3Entry*)pageTableEntry)->Present == 1) {
                 uint64_t* entry = (uint64_t*)pageTableEntry;
-                return *entry & 0x000F'FFFF'C000'0000;
+                return (*entry & 0x000F'FFFF'C000'0000) + (virtualAddress & 0x3FFF'F000);
             }
 
             if (i == 2 && ((x86_64_PML2Entry*)pageTableEntry)->PageSize == 1 && ((x86_64_PML2Entry*)pageTableEntry)->Present == 1) {
                 uint64_t* entry = (uint64_t*)pageTableEntry;
-                return *entry & 0x000F'FFFF'FFE0'0000;
+                return (*entry & 0x000F'FFFF'FFE0'0000) + (virtualAddress & 0x001F'F000);
             }
 
             return 0;
@@ -191,25 +193,40 @@ void x86_64_UnmapPage(void* pageTable, uint64_t virtualAddress) {
     }
 }
 
-void x86_64_Map2MiBPage(void* pageTable, uint64_t virtualAddress, uint64_t physicalAddress, uint32_t flags) {
+bool x86_64_Map2MiBPage(void* pageTable, uint64_t virtualAddress, uint64_t physicalAddress, uint32_t flags, void** replacedTable) {
     uint64_t i = x86_64_Is5LevelPagingSupported() ? 5 : 4;
+    if (replacedTable != nullptr)
+        *replacedTable = nullptr;
 
     while (pageTable != nullptr) {
         if (i < 2)
-            return;
+            return false;
         uint64_t pageTableEntry = (uint64_t)pageTable + ((virtualAddress >> (12 + (i - 1) * 9)) & 0x1FF) * 8;
         void* newPageTable = x86_64_GetNextPageTable((void*)pageTableEntry, i);
+        if (i == 2 && newPageTable != nullptr) {
+            // an existing page table can only be replaced if nothing is mapped in it
+            if (replacedTable == nullptr)
+                return false;
+            uint64_t* table = (uint64_t*)to_HHDM(newPageTable);
+            for (uint64_t j = 0; j < 512; j++) {
+                if (table[j] & 1)
+                    return false;
+            }
+            // other CPUs may still walk through it, so the caller frees it after the shootdown
+            *replacedTable = newPageTable;
+            newPageTable = nullptr;
+        }
         if (newPageTable == nullptr) {
             // few options here: out of bounds index (not possible), 1 GiB page, 2 MiB page, or missing page table
             // if we have a 1 GiB page we can't map a 2 MiB page
             if (i == 3 && ((x86_64_PML3Entry*)pageTableEntry)->PageSize == 1 && ((x86_64_PML3Entry*)pageTableEntry)->Present == 1)
-                return;
+                return false;
 
             // if we have a 2 MiB page location, we can map it and exit
             if (i == 2) {
                 uint64_t* entry = (uint64_t*)pageTableEntry;
                 *entry = (physicalAddress & 0x000F'FFFF'FFE0'0000) | (((uint64_t)flags & 0x0800'0000) << (52 - 16)) | ((uint64_t)flags & 0x0000'1FFF) | 1 | (1 << 7);
-                return;
+                return true;
             }
 
             // if we don't have a page table, we need to create one
@@ -229,6 +246,7 @@ void x86_64_Map2MiBPage(void* pageTable, uint64_t virtualAddress, uint64_t physi
         pageTable = newPageTable;
         i--;
     }
+    return false;
 }
 
 void x86_64_Remap2MiBPage(void* pageTable, uint64_t virtualAddress, uint32_t flags) {
@@ -295,6 +313,69 @@ void x86_64_Unmap2MiBPage(void* pageTable, uint64_t virtualAddress) {
     }
 }
 
+// Returns the level 2 entry if it maps a present 2 MiB page
+static uint64_t* x86_64_Find2MiBEntry(void* pageTable, uint64_t virtualAddress) {
+    uint64_t i = x86_64_Is5LevelPagingSupported() ? 5 : 4;
+
+    while (pageTable != nullptr && i >= 2) {
+        uint64_t pageTableEntry = (uint64_t)pageTable + ((virtualAddress >> (12 + (i - 1) * 9)) & 0x1FF) * 8;
+        void* newPageTable = x86_64_GetNextPageTable((void*)pageTableEntry, i);
+        if (newPageTable == nullptr) {
+            if (i == 2 && ((x86_64_PML2Entry*)pageTableEntry)->PageSize == 1 && ((x86_64_PML2Entry*)pageTableEntry)->Present == 1)
+                return (uint64_t*)pageTableEntry;
+            return nullptr;
+        }
+        pageTable = to_HHDM(newPageTable);
+        i--;
+    }
+    return nullptr;
+}
+
+bool x86_64_Is2MiBPage(void* pageTable, uint64_t virtualAddress) {
+    return x86_64_Find2MiBEntry(pageTable, virtualAddress) != nullptr;
+}
+
+bool x86_64_Is2MiBRegionEmpty(void* pageTable, uint64_t virtualAddress) {
+    uint64_t i = x86_64_Is5LevelPagingSupported() ? 5 : 4;
+
+    while (pageTable != nullptr && i >= 2) {
+        uint64_t pageTableEntry = (uint64_t)pageTable + ((virtualAddress >> (12 + (i - 1) * 9)) & 0x1FF) * 8;
+        void* newPageTable = x86_64_GetNextPageTable((void*)pageTableEntry, i);
+        if (newPageTable == nullptr)
+            return (*(uint64_t*)pageTableEntry & 1) == 0; // missing table, or a present large page
+        pageTable = to_HHDM(newPageTable);
+        i--;
+    }
+
+    uint64_t* table = (uint64_t*)pageTable;
+    for (uint64_t j = 0; j < 512; j++) {
+        if (table[j] & 1)
+            return false;
+    }
+    return true;
+}
+
+bool x86_64_Split2MiBPage(void* pageTable, uint64_t virtualAddress) {
+    uint64_t* entry = x86_64_Find2MiBEntry(pageTable, virtualAddress);
+    if (entry == nullptr)
+        return true;
+
+    void* phys = g_PMM->AllocatePage();
+    if (phys == nullptr)
+        return false;
+    uint64_t* table = (uint64_t*)to_HHDM(phys);
+
+    uint64_t raw = *entry;
+    uint64_t base = raw & 0x000F'FFFF'FFE0'0000;
+    // keep everything but the page size bit, and move the PAT bit from bit 12 to bit 7
+    uint64_t pageFlags = (raw & 0x8000'0000'0000'0F7F) | ((raw & (1 << 12)) >> (12 - 7));
+    for (uint64_t j = 0; j < 512; j++)
+        table[j] = (base + j * PAGE_SIZE) | pageFlags;
+
+    *entry = (uint64_t)phys | (raw & 0x0000'0000'0000'0007);
+    return true;
+}
+
 void x86_64_Map1GiBPage(void* pageTable, uint64_t virtualAddress, uint64_t physicalAddress, uint32_t flags) {
     uint64_t i = x86_64_Is5LevelPagingSupported() ? 5 : 4;
 
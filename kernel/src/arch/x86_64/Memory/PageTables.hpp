@@ -140,10 +140,14 @@ void x86_64_MapPage(void* pageTable, uint64_t virtualAddress, uint64_t physicalA
 void x86_64_RemapPage(void* pageTable, uint64_t virtualAddress, uint32_t flags);
 void x86_64_UnmapPage(void* pageTable, uint64_t virtualAddress);
 
-void x86_64_Map2MiBPage(void* pageTable, uint64_t virtualAddress, uint64_t physicalAddress, uint32_t flags);
+bool x86_64_Map2MiBPage(void* pageTable, uint64_t virtualAddress, uint64_t physicalAddress, uint32_t flags, void** replacedTable = nullptr); // fails if there is a page table with pages mapped in the way. An empty page table in the way is unlinked and returned in replacedTable for the caller to free after invalidating, or fails if replacedTable is null
 void x86_64_Remap2MiBPage(void* pageTable, uint64_t virtualAddress, uint32_t flags);
 void x86_64_Unmap2MiBPage(void* pageTable, uint64_t virtualAddress);
 
+bool x86_64_Is2MiBPage(void* pageTable, uint64_t virtualAddress);
+bool x86_64_Is2MiBRegionEmpty(void* pageTable, uint64_t virtualAddress); // true if no page of any size is mapped in the 2 MiB region
+bool x86_64_Split2MiBPage(void* pageTable, uint64_t virtualAddress); // replace a 2 MiB page with a page table mapping the same memory. TLB is not invalidated. Only fails if the page table can't be allocated
+
 void x86_64_Map1GiBPage(void* pageTable, uint64_t virtualAddress, uint64_t physicalAddress, uint32_t flags);
 void x86_64_Remap1GiBPage(void* pageTable, uint64_t virtualAddress, uint32_t flags);
 void x86_64_Unmap1GiBPage(void* pageTable, uint64_t virtualAddress);
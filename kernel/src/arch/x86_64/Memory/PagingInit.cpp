@@ -29,6 +29,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <Memory/Pager.hpp>
 #include <Memory/PagingUtil.hpp>
 #include <Memory/PMM.hpp>
+#include <Memory/Slab.hpp>
 #include <Memory/VMM.hpp>
 #include <Memory/VMRegionAllocator.hpp>
 
@@ -50,6 +51,7 @@ void x86_64_InitPaging(uint64_t HHDMOffset, MemoryMapEntry** memoryMap, uint64_t
     
     KPMM.Init(memoryMap, memoryMapEntryCount);
     g_PMM = &KPMM;
+    g_SlabAllocator.Init();
 
     if (!x86_64_EnsureNXSupport())
         PANIC("No-Execute bit is not supported!");
@@ -22,6 +22,8 @@ global x86_64_Ensure1GiBPageSupport
 global x86_64_LoadCR3
 global x86_64_InvalidatePage
 global x86_64_FlushTLB
+global x86_64_EnablePCID
+global x86_64_INVPCID
 
 x86_64_Internal_Is5LevelPagingSupported:
     push rbp
@@ -156,3 +158,17 @@ x86_64_FlushTLB:
     mov rax, cr3
     mov cr3, rax
     ret
+
+x86_64_EnablePCID:
+    mov rax, cr4
+    or rax, 1<<17
+    mov cr4, rax
+    ret
+
+x86_64_INVPCID:
+    ; descriptor is the PCID followed by the address
+    push rdx
+    push rsi
+    invpcid rdi, [rsp]
+    add rsp, 16
+    ret
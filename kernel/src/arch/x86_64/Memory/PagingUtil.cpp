@@ -22,8 +22,6 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <stdio.h>
 #include <util.h>
 
-#define FULL_FLUSH_THRESHOLD 0x1000 // 2 whole level 1 tables
-
 bool g_x86_64_5LevelPagingSupportChecked = false;
 bool g_x86_64_2MiBPageSupportChecked = false;
 bool g_x86_64_1GiBPageSupportChecked = false;
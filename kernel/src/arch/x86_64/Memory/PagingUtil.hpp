@@ -20,6 +20,8 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <stdint.h>
 
+#define FULL_FLUSH_THRESHOLD 0x1000 // 2 whole level 1 tables
+
 enum class x86_64_PagingMode {
     _4LVL,
     _5LVL
@@ -39,6 +41,8 @@ bool x86_64_Ensure1GiBPageSupport();
 void x86_64_LoadCR3(uint64_t cr3);
 void x86_64_InvalidatePage(uint64_t virtualAddress);
 void x86_64_FlushTLB();
+void x86_64_EnablePCID();
+void x86_64_INVPCID(uint64_t type, uint64_t pcid, uint64_t virtualAddress);
 
 }
 
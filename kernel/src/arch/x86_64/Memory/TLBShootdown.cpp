@@ -0,0 +1,171 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "PageMapper.hpp"
+#include "PagingInit.hpp"
+#include "PagingUtil.hpp"
+#include "PCID.hpp"
+#include "TLBShootdown.hpp"
+
+#include "../Processor.hpp"
+
+#include "../interrupts/ISR.hpp"
+
+#include "../interrupts/APIC/IPI.hpp"
+#include "../interrupts/APIC/LocalAPIC.hpp"
+
+#include <spinlock.h>
+#include <string.h>
+#include <util.h>
+
+#include <HAL/Processor.hpp>
+
+#include <Memory/PageMapper.hpp>
+#include <Memory/PagingUtil.hpp>
+
+#include <Scheduling/Scheduler.hpp>
+
+// Must be called with interrupts disabled, on the CPU that owns the queue
+void x86_64_TLBShootdown_Drain(x86_64_TLBShootdownQueue* queue) {
+    if (__atomic_load_n(&queue->completed, __ATOMIC_ACQUIRE) == __atomic_load_n(&queue->requested, __ATOMIC_ACQUIRE))
+        return;
+
+    spinlock_acquire(&queue->lock);
+    if (queue->fullFlush)
+        x86_64_FlushTLB();
+    else {
+        for (uint64_t i = 0; i < queue->count; i++)
+            x86_64_InvalidatePages(queue->ranges[i].start, queue->ranges[i].pageCount * PAGE_SIZE);
+    }
+    queue->count = 0;
+    queue->fullFlush = false;
+    uint64_t ticket = queue->requested;
+    spinlock_release(&queue->lock);
+
+    __atomic_store_n(&queue->completed, ticket, __ATOMIC_RELEASE);
+}
+
+void x86_64_TLBShootdown_Handler(x86_64_ISR_Frame*) {
+    x86_64_Processor* proc = static_cast<x86_64_Processor*>(GetCurrentProcessor());
+    if (proc->TLBShootdownQueue != nullptr)
+        x86_64_TLBShootdown_Drain(proc->TLBShootdownQueue);
+    proc->GetLAPIC()->SendEOI();
+}
+
+void x86_64_TLBShootdown_Init() {
+    x86_64_Processor* proc = static_cast<x86_64_Processor*>(GetCurrentProcessor());
+    if (proc == nullptr)
+        return;
+
+    x86_64_TLBShootdownQueue* queue = new x86_64_TLBShootdownQueue;
+    memset(queue, 0, sizeof(x86_64_TLBShootdownQueue));
+    queue->lock = SPINLOCK_DEFAULT_VALUE;
+    queue->activePageTable = (uint64_t)from_HHDM(g_KernelRootPageTable);
+    proc->TLBShootdownQueue = queue;
+
+    x86_64_ISR_RegisterHandler(TLB_SHOOTDOWN_INT, x86_64_TLBShootdown_Handler);
+
+    // Anything cached before this CPU became a target must go
+    __atomic_store_n(&queue->online, true, __ATOMIC_SEQ_CST);
+    x86_64_FlushTLB();
+}
+
+void x86_64_TLBShootdown_SetActive(uint64_t pageTable) {
+    x86_64_Processor* proc = static_cast<x86_64_Processor*>(GetCurrentProcessor());
+    if (proc == nullptr || proc->TLBShootdownQueue == nullptr)
+        return;
+
+    // Full barrier, so a sender either sees the new table or we see its page table updates
+    __atomic_store_n(&proc->TLBShootdownQueue->activePageTable, pageTable, __ATOMIC_SEQ_CST);
+}
+
+void x86_64_TLBShootdown_Flush(x86_64_PageMapper* mapper, bool kernel, const TLBShootdownBatch* batch) {
+    if (batch->count == 0 && !batch->fullFlush)
+        return;
+
+    int flags = Processor::DisableInterrupts();
+
+    if (batch->fullFlush)
+        x86_64_FlushTLB();
+    else {
+        for (uint64_t i = 0; i < batch->count; i++)
+            x86_64_InvalidatePages(batch->ranges[i].start, batch->ranges[i].pageCount * PAGE_SIZE);
+    }
+    x86_64_PCID_OnShootdown(mapper, kernel, batch);
+
+    x86_64_Processor* proc = static_cast<x86_64_Processor*>(GetCurrentProcessor());
+    x86_64_LAPIC* lapic = proc != nullptr ? proc->GetLAPIC() : nullptr;
+    if (lapic == nullptr || Scheduler::GetProcessorCount() < 2) {
+        Processor::EnableInterrupts(flags);
+        return;
+    }
+    x86_64_TLBShootdownQueue* local = proc->TLBShootdownQueue;
+    uint64_t pageTable = (uint64_t)from_HHDM(mapper->GetPageTable());
+
+    // Pairs with the barrier in SetActive
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    struct {
+        x86_64_TLBShootdownQueue* queue;
+        uint64_t ticket;
+    } targets[TLB_SHOOTDOWN_MAX_TARGETS];
+
+    Scheduler::ProcessorState* state = &Scheduler::g_BSPState;
+    while (state != nullptr) {
+        uint64_t targetCount = 0;
+        for (; state != nullptr && targetCount < TLB_SHOOTDOWN_MAX_TARGETS; state = state->next) {
+            x86_64_Processor* target = static_cast<x86_64_Processor*>(state->processor);
+            if (target == nullptr || target == proc)
+                continue;
+
+            x86_64_TLBShootdownQueue* queue = target->TLBShootdownQueue;
+            x86_64_LAPIC* targetLAPIC = target->GetLAPIC();
+            if (queue == nullptr || targetLAPIC == nullptr || !__atomic_load_n(&queue->online, __ATOMIC_ACQUIRE))
+                continue;
+            if (!kernel && __atomic_load_n(&queue->activePageTable, __ATOMIC_SEQ_CST) != pageTable)
+                continue;
+
+            spinlock_acquire(&queue->lock);
+            if (batch->fullFlush || queue->count + batch->count > TLB_BATCH_MAX_RANGES)
+                queue->fullFlush = true;
+            else {
+                for (uint64_t i = 0; i < batch->count; i++) {
+                    queue->ranges[queue->count].start = batch->ranges[i].start;
+                    queue->ranges[queue->count].pageCount = batch->ranges[i].pageCount;
+                    queue->count++;
+                }
+            }
+            uint64_t ticket = ++queue->requested;
+            spinlock_release(&queue->lock);
+
+            x86_64_IPI::RaiseIPI(lapic, targetLAPIC->GetID(), TLB_SHOOTDOWN_INT);
+            targets[targetCount].queue = queue;
+            targets[targetCount].ticket = ticket;
+            targetCount++;
+        }
+
+        for (uint64_t i = 0; i < targetCount; i++) {
+            while (__atomic_load_n(&targets[i].queue->completed, __ATOMIC_ACQUIRE) < targets[i].ticket) {
+                // The target may be spinning here waiting on us, so service our own queue
+                if (local != nullptr)
+                    x86_64_TLBShootdown_Drain(local);
+                __asm__ volatile ("pause" ::: "memory");
+            }
+        }
+    }
+
+    Processor::EnableInterrupts(flags);
+}
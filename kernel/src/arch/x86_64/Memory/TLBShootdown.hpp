@@ -0,0 +1,56 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef _x86_64_TLB_SHOOTDOWN_HPP
+#define _x86_64_TLB_SHOOTDOWN_HPP
+
+#include <spinlock.h>
+#include <stdint.h>
+
+#include <Memory/PageMapper.hpp>
+
+#define TLB_SHOOTDOWN_MAX_TARGETS 64
+
+/*
+Per-CPU queue of pending remote invalidations. Senders append ranges and take a
+ticket from requested, then wait for completed to reach it. The owning CPU drains
+the queue from the shootdown IPI, or while it is itself waiting on another CPU.
+*/
+struct x86_64_TLBShootdownQueue {
+    spinlock_t lock;
+    uint64_t count;
+    bool fullFlush;
+    struct {
+        uint64_t start;
+        uint64_t pageCount;
+    } ranges[TLB_BATCH_MAX_RANGES];
+    uint64_t requested;
+    uint64_t completed;
+    uint64_t activePageTable; // physical address of the root table currently loaded
+    bool online;
+};
+
+void x86_64_TLBShootdown_Init(); // must be called on each CPU, just before it starts taking interrupts
+
+// Must be called with interrupts disabled, before the new root table is loaded
+void x86_64_TLBShootdown_SetActive(uint64_t pageTable);
+
+class x86_64_PageMapper;
+
+// Invalidates the batch locally, then on every other CPU that could have it cached
+void x86_64_TLBShootdown_Flush(x86_64_PageMapper* mapper, bool kernel, const TLBShootdownBatch* batch);
+
+#endif /* _x86_64_TLB_SHOOTDOWN_HPP */
@@ -0,0 +1,96 @@
+; Copyright (©) 2026  Frosty515
+
+; This program is free software: you can redistribute it and/or modify
+; it under the terms of the GNU General Public License as published by
+; the Free Software Foundation, either version 3 of the License, or
+; (at your option) any later version.
+
+; This program is distributed in the hope that it will be useful,
+; but WITHOUT ANY WARRANTY; without even the implied warranty of
+; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+; GNU General Public License for more details.
+
+; You should have received a copy of the GNU General Public License
+; along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+[bits 64]
+
+global x86_64_CopyUser
+global x86_64_StrncpyFromUser
+global x86_64_ReadUser32
+global x86_64_CmpXchgUser32
+global x86_64_EnableSMAP
+
+; Records that a fault at %1 should resume at %2, see x86_64_FindExceptionFixup
+%macro EX_TABLE_ENTRY 2
+section .ex_table progbits alloc noexec nowrite align=8
+    dq %1, %2
+section .text
+%endmacro
+
+x86_64_CopyUser:
+    mov rcx, rdx
+.copy:
+    rep movsb
+    xor eax, eax
+    ret
+.fault:
+    mov rax, rcx ; bytes left uncopied
+    ret
+
+EX_TABLE_ENTRY x86_64_CopyUser.copy, x86_64_CopyUser.fault
+
+x86_64_StrncpyFromUser:
+    xor eax, eax
+.loop:
+    cmp rax, rdx
+    je .done
+.load:
+    mov cl, BYTE [rsi+rax]
+    mov BYTE [rdi+rax], cl
+    test cl, cl
+    jz .done
+    inc rax
+    jmp .loop
+.done:
+    ret
+.fault:
+    mov rax, -1
+    ret
+
+EX_TABLE_ENTRY x86_64_StrncpyFromUser.load, x86_64_StrncpyFromUser.fault
+
+x86_64_ReadUser32:
+.load:
+    mov eax, DWORD [rdi]
+    mov DWORD [rsi], eax
+    xor eax, eax
+    ret
+.fault:
+    mov eax, -1
+    ret
+
+EX_TABLE_ENTRY x86_64_ReadUser32.load, x86_64_ReadUser32.fault
+
+x86_64_CmpXchgUser32:
+    mov eax, DWORD [rsi]
+.cmpxchg:
+    lock cmpxchg DWORD [rdi], edx
+    jne .mismatch
+    xor eax, eax
+    ret
+.mismatch:
+    mov DWORD [rsi], eax
+    mov eax, 1
+    ret
+.fault:
+    mov eax, -1
+    ret
+
+EX_TABLE_ENTRY x86_64_CmpXchgUser32.cmpxchg, x86_64_CmpXchgUser32.fault
+
+x86_64_EnableSMAP:
+    mov rax, cr4
+    or rax, 1<<21
+    mov cr4, rax
+    ret
@@ -0,0 +1,161 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "PagingInit.hpp"
+#include "PagingUtil.hpp"
+#include "UserAccess.hpp"
+
+#include "../KernelSymbols.hpp"
+#include "../Processor.hpp"
+
+#include <errno.h>
+#include <stdint.h>
+
+#include <Memory/UserAccess.hpp>
+
+struct x86_64_ExceptionTableEntry {
+    uint64_t faultRIP;
+    uint64_t fixupRIP;
+};
+
+bool g_x86_64_SMAPEnabled = false;
+
+void x86_64_SMAP_Init() {
+    x86_64_Processor* proc = static_cast<x86_64_Processor*>(GetCurrentProcessor());
+    if (proc == nullptr)
+        return;
+
+    const x86_64_CPUInfo* info = proc->GetCPUInfo();
+    if (proc->isBSP())
+        g_x86_64_SMAPEnabled = info->SMAP;
+    if (!g_x86_64_SMAPEnabled || !info->SMAP)
+        return;
+
+    x86_64_EnableSMAP();
+}
+
+uint64_t x86_64_FindExceptionFixup(uint64_t rip) {
+    const x86_64_ExceptionTableEntry* start = reinterpret_cast<const x86_64_ExceptionTableEntry*>(&__ex_table_start);
+    const x86_64_ExceptionTableEntry* end = reinterpret_cast<const x86_64_ExceptionTableEntry*>(&__ex_table_end);
+    for (const x86_64_ExceptionTableEntry* entry = start; entry < end; entry++) {
+        if (entry->faultRIP == rip)
+            return entry->fixupRIP;
+    }
+    return 0;
+}
+
+static bool IsUserRange(const void* addr, size_t size) {
+    uint64_t start = reinterpret_cast<uint64_t>(addr);
+    uint64_t end = x86_64_Is5LevelPagingSupported() ? USER_MEMORY_END_5LVL : USER_MEMORY_END_4LVL;
+    return start >= USER_MEMORY_START && start <= end && size - 1 <= end - start;
+}
+
+int CopyFromUser(void* kDst, const void* userSrc, size_t size, size_t* copied) {
+    if (copied != nullptr)
+        *copied = 0;
+    if (size == 0)
+        return 0;
+    if (!IsUserRange(userSrc, size))
+        return -EFAULT;
+    x86_64_UserAccessBegin();
+    uint64_t left = x86_64_CopyUser(kDst, userSrc, size);
+    x86_64_UserAccessEnd();
+    if (copied != nullptr)
+        *copied = size - left;
+    return left == 0 ? 0 : -EFAULT;
+}
+
+int CopyToUser(void* userDst, const void* kSrc, size_t size, size_t* copied) {
+    if (copied != nullptr)
+        *copied = 0;
+    if (size == 0)
+        return 0;
+    if (!IsUserRange(userDst, size))
+        return -EFAULT;
+    x86_64_UserAccessBegin();
+    uint64_t left = x86_64_CopyUser(userDst, kSrc, size);
+    x86_64_UserAccessEnd();
+    if (copied != nullptr)
+        *copied = size - left;
+    return left == 0 ? 0 : -EFAULT;
+}
+
+int64_t StrncpyFromUser(char* kDst, const char* userSrc, size_t maxSize) {
+    if (maxSize == 0)
+        return 0;
+    if (!IsUserRange(userSrc, 1))
+        return -EFAULT;
+
+    // Don't let the scan run off the end of the user region
+    uint64_t start = reinterpret_cast<uint64_t>(userSrc);
+    uint64_t end = x86_64_Is5LevelPagingSupported() ? USER_MEMORY_END_5LVL : USER_MEMORY_END_4LVL;
+    size_t limit = maxSize - 1 > end - start ? end - start + 1 : maxSize;
+
+    x86_64_UserAccessBegin();
+    int64_t length = x86_64_StrncpyFromUser(kDst, userSrc, limit);
+    x86_64_UserAccessEnd();
+    if (length < 0 || (static_cast<size_t>(length) == limit && limit < maxSize))
+        return -EFAULT;
+    return length;
+}
+
+int ReadUser32(const uint32_t* userSrc, uint32_t* kDst) {
+    if (!IsUserRange(userSrc, sizeof(uint32_t)))
+        return -EFAULT;
+    x86_64_UserAccessBegin();
+    int rc = x86_64_ReadUser32(userSrc, kDst);
+    x86_64_UserAccessEnd();
+    return rc < 0 ? -EFAULT : 0;
+}
+
+int CmpXchgUser32(uint32_t* userDst, uint32_t* expected, uint32_t desired) {
+    if (!IsUserRange(userDst, sizeof(uint32_t)))
+        return -EFAULT;
+    x86_64_UserAccessBegin();
+    int rc = x86_64_CmpXchgUser32(userDst, expected, desired);
+    x86_64_UserAccessEnd();
+    if (rc < 0)
+        return -EFAULT;
+    return rc == 0 ? 0 : -EAGAIN;
+}
+
+int ReadUser32NoFault(const uint32_t* userSrc, uint32_t* kDst) {
+    int intState = Processor::DisableInterrupts();
+    x86_64_Processor* proc = static_cast<x86_64_Processor*>(GetCurrentProcessor());
+    proc->noUserFaults = true;
+    int rc = ReadUser32(userSrc, kDst);
+    proc->noUserFaults = false;
+    Processor::EnableInterrupts(intState);
+    return rc;
+}
+
+int CmpXchgUser32NoFault(uint32_t* userDst, uint32_t* expected, uint32_t desired) {
+    int intState = Processor::DisableInterrupts();
+    x86_64_Processor* proc = static_cast<x86_64_Processor*>(GetCurrentProcessor());
+    proc->noUserFaults = true;
+    int rc = CmpXchgUser32(userDst, expected, desired);
+    proc->noUserFaults = false;
+    Processor::EnableInterrupts(intState);
+    return rc;
+}
+
+void UserAccessBegin() {
+    x86_64_UserAccessBegin();
+}
+
+void UserAccessEnd() {
+    x86_64_UserAccessEnd();
+}
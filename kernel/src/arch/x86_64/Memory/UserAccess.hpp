@@ -0,0 +1,59 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef _x86_64_USER_ACCESS_HPP
+#define _x86_64_USER_ACCESS_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RFLAGS_AC (1UL << 18)
+
+/*
+The user copy routines below are written so that any instruction that can fault on
+a user address has an entry in the exception table (.ex_table). When the VMM can't
+resolve a kernel-mode fault, the page fault handler looks up the faulting RIP there
+and resumes at the fixup, which makes the routine return an error instead.
+*/
+
+extern "C" {
+
+uint64_t x86_64_CopyUser(void* dst, const void* src, size_t size); // returns the number of bytes left uncopied
+int64_t x86_64_StrncpyFromUser(char* dst, const char* src, size_t maxSize); // length without the NUL, maxSize if there wasn't one, or -1 on fault
+int x86_64_ReadUser32(const uint32_t* src, uint32_t* dst); // 0 or -1 on fault
+int x86_64_CmpXchgUser32(uint32_t* dst, uint32_t* expected, uint32_t desired); // 0, 1 on mismatch, or -1 on fault
+
+void x86_64_EnableSMAP();
+
+}
+
+extern bool g_x86_64_SMAPEnabled;
+
+void x86_64_SMAP_Init(); // on the current processor, must be called on BSP first
+
+uint64_t x86_64_FindExceptionFixup(uint64_t rip); // 0 if rip has no fixup
+
+inline void x86_64_UserAccessBegin() {
+    if (g_x86_64_SMAPEnabled)
+        __asm__ volatile ("stac" ::: "memory");
+}
+
+inline void x86_64_UserAccessEnd() {
+    if (g_x86_64_SMAPEnabled)
+        __asm__ volatile ("clac" ::: "memory");
+}
+
+#endif /* _x86_64_USER_ACCESS_HPP */
@@ -30,8 +30,12 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "interrupts/NMI.hpp"
 
 #include "interrupts/APIC/IOAPIC.hpp"
+#include "interrupts/APIC/IPI.hpp"
 
 #include "Memory/PagingInit.hpp"
+#include "Memory/PCID.hpp"
+#include "Memory/TLBShootdown.hpp"
+#include "Memory/UserAccess.hpp"
 
 #include "Scheduling/Task.hpp"
 #include "Scheduling/TaskUtil.hpp"
@@ -61,7 +65,7 @@ Processor* g_BSP = &g_x86_64_BSP;
 // Implemented in assembly
 extern "C" void x86_64_SIMDInit(uint64_t xcr0);
 
-x86_64_Processor::x86_64_Processor(bool BSP) : apLock(SPINLOCK_LOCKED_VALUE), m_IRQData(nullptr), m_LAPIC(nullptr), m_TSCAvailable(false) {
+x86_64_Processor::x86_64_Processor(bool BSP) : apLock(SPINLOCK_LOCKED_VALUE), NMIData(nullptr), TLBShootdownQueue(nullptr), PCIDState(nullptr), noUserFaults(false), m_IRQData(nullptr), m_LAPIC(nullptr), m_TSCAvailable(false) {
     m_BSP = BSP; // member of parent class
 }
 
@@ -96,12 +100,17 @@ x86_64_Processor::~x86_64_Processor() {
 
     spinlock_release(&apLock);
 
+    x86_64_TSCSyncCheck(false);
+
     Scheduler::WaitForStart(m_state);
 
     if (!m_LAPIC->InitTimer())
         PANIC("AP LAPIC timer init failed");
 
     x86_64_LocalNMI::Init();
+    x86_64_TLBShootdown_Init();
+    x86_64_PCID_Init();
+    x86_64_SMAP_Init();
 
     assert(x86_64_InitSyscall());
 
@@ -119,6 +128,7 @@ void x86_64_Processor::Init(uint64_t HHDMOffset, MemoryMapEntry** memoryMap, uin
     x86_64_InitIDT();
 
     FillCPUInfo();
+    x86_64_SetMemFeatures((m_info.ERMS ? X86_64_MEM_ERMS : 0) | (m_info.FSRM ? X86_64_MEM_FSRM : 0), X86_64_MEM_NT_THRESHOLD); // APs are assumed to match
     
     Scheduler::InitBSPState();
     x86_64_SetGSBases(0, (uint64_t)&Scheduler::g_BSPState);
@@ -141,6 +151,9 @@ void x86_64_Processor::Init(uint64_t HHDMOffset, MemoryMapEntry** memoryMap, uin
     InitTSS(&Scheduler::g_BSPState);
 
     x86_64_LocalNMI::Init();
+    x86_64_TLBShootdown_Init();
+    x86_64_PCID_Init();
+    x86_64_SMAP_Init();
 
     Scheduler::CreateIdleThread();
 
@@ -195,6 +208,14 @@ void x86_64_Processor::Yield(bool forceSwitch) {
     x86_64_LocalNMI::Raise(proc, this, x86_64_NMIType::YIELD, &forceSwitch, true);
 }
 
+void x86_64_Processor::SendReschedule() {
+    x86_64_Processor* proc = static_cast<x86_64_Processor*>(GetCurrentProcessor());
+    if (this == proc || proc == nullptr || m_LAPIC == nullptr)
+        return; // the caller will get to the scheduler on its own
+
+    x86_64_IPI::RaiseIPI(proc->GetLAPIC(), m_LAPIC->GetID(), RESCHEDULE_INT);
+}
+
 void x86_64_Processor::SwitchKernelStack(uint64_t stack) {
     Scheduler::ProcessorState* state = GetCurrentProcessorState();
     m_TSS.RSP[0] = (uint64_t)stack;
@@ -362,6 +383,22 @@ void x86_64_Processor::FillCPUInfo() {
         m_info.SIMDInfo.saveMethod = x86_64_SIMDSaveMethod::FXSAVE;
         m_info.SIMDInfo.XCR0 = 0;
     }
+
+    // Paging features
+    result = x86_64_CPUID(1, 0);
+    m_info.PCID = (result.ECX & (1 << 17)) > 0;
+    if (m_info.maxCPUID >= 0x7) {
+        result = x86_64_CPUID(7, 0);
+        m_info.INVPCID = (result.EBX & (1 << 10)) > 0;
+        m_info.SMAP = (result.EBX & (1 << 20)) > 0;
+        m_info.ERMS = (result.EBX & (1 << 9)) > 0;
+        m_info.FSRM = (result.EDX & (1 << 4)) > 0;
+    } else {
+        m_info.INVPCID = false;
+        m_info.SMAP = false;
+        m_info.ERMS = false;
+        m_info.FSRM = false;
+    }
 }
 
 void x86_64_Processor::SetIRQData(x86_64_ProcessorIRQData* data) {
@@ -388,6 +425,10 @@ const x86_64_CPUInfo* x86_64_Processor::GetCPUInfo() const {
     return &m_info;
 }
 
+bool x86_64_Processor::isTSCAvailable() const {
+    return m_TSCAvailable;
+}
+
 // Static methods from parent class
 
 int Processor::DisableInterrupts() {
@@ -401,6 +442,12 @@ void Processor::EnableInterrupts(int state) {
         x86_64_EnableInterrupts();
 }
 
+bool Processor::AreInterruptsEnabled() {
+    uint64_t flags;
+    __asm__ volatile ("pushf; pop %0" : "=r"(flags));
+    return (flags & (1 << 9)) != 0;
+}
+
 void Processor::SwapStack(void (*func)(void*), void* data, void* stack) {
     if (func == nullptr || stack == nullptr)
         return;
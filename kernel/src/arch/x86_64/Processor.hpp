@@ -74,6 +74,11 @@ struct x86_64_CPUInfo {
     uint8_t hypervisor;
     char hypervisorStr[12];
     uint32_t maxHypervisorCPUID;
+    bool PCID; // CR4.PCIDE
+    bool INVPCID;
+    bool SMAP; // CR4.SMAP, STAC, CLAC
+    bool ERMS; // fast rep movsb/stosb
+    bool FSRM; // fast short rep movsb
     struct SIMDInfo {
         bool FPU;
         bool MMX;
@@ -93,6 +98,9 @@ struct x86_64_CPUInfo {
     } SIMDInfo;
 };
 
+struct x86_64_PCIDState;
+struct x86_64_TLBShootdownQueue;
+
 #define AP_TRAMP_LOAD 0
 #define AP_TRAMP_LOAD_ADDR (void*)0
 #define AP_TRAMP_DATA_ADDR (void*)0xF80
@@ -112,6 +120,7 @@ public:
 
     void Halt(bool wait = true) override;
     void Yield(bool forceSwitch = false) override;
+    void SendReschedule() override;
 
     // Next group of functions must be called with interrupts disabled
     void SwitchKernelStack(uint64_t stack) override;
@@ -132,8 +141,13 @@ public:
     // Will only return null if this is null
     const x86_64_CPUInfo* GetCPUInfo() const;
 
+    bool isTSCAvailable() const; // invariant with a known frequency
+
     spinlock_t apLock; // starts locked
     void* NMIData; // not managed by this class, just needs to be per-CPU
+    x86_64_TLBShootdownQueue* TLBShootdownQueue; // same as above
+    x86_64_PCIDState* PCIDState; // same as above, null when PCIDs are not in use
+    bool noUserFaults; // kernel faults on user memory skip the VMM and go straight to their fixup
 
 private:
     void InitTSS(Scheduler::ProcessorState* state);
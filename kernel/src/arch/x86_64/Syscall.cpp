@@ -53,7 +53,7 @@ bool x86_64_InitSyscall() {
     x86_64_WriteMSR(MSR_STAR, star);
     x86_64_WriteMSR(MSR_LSTAR, (uint64_t)&x86_64_SyscallEntry);
     x86_64_WriteMSR(MSR_CSTAR, 0);
-    x86_64_WriteMSR(MSR_FMASK, 1 << 9); // bit 9: IF
+    x86_64_WriteMSR(MSR_FMASK, 1 << 9 | 1 << 18); // bit 9: IF, bit 18: AC
 
     return true;
 }
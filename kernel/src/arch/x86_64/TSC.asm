@@ -40,6 +40,6 @@ global x86_64_TSCEnable
 
 x86_64_TSCEnable:
     mov rax, cr4
-    or rax, 4 ; bit 2
+    and rax, ~4 ; clear TSD (bit 2) so user mode can read the TSC for the vDSO clock
     mov cr4, rax
     ret
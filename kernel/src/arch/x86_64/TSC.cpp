@@ -15,12 +15,37 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include "ArchDefs.h"
 #include "CPUID.h"
 #include "Processor.hpp"
 #include "TSC.hpp"
 
+#include <spinlock.h>
+#include <stdint.h>
+#include <util.h>
+
+#include <HAL/drivers/HPET.hpp>
+
+#define TSC_CALIBRATION_NS 10'000'000 // per round
+#define TSC_CALIBRATION_ROUNDS 3
+#define TSC_CLOCK_SHIFT 32
+#define TSC_SYNC_ITERATIONS 10'000
+
 extern "C" void x86_64_TSCEnable();
 
+uint64_t g_x86_64_TSCFrequency = 0;
+x86_64_TSCClock g_x86_64_TSCClock;
+
+struct x86_64_TSCSyncState {
+    spinlock_t lock;
+    uint64_t last;
+    uint64_t maxWarp;
+    uint32_t arrived;
+    uint32_t done;
+};
+
+x86_64_TSCSyncState g_x86_64_TSCSync;
+
 bool x86_64_IsInvariantTSCSupported(x86_64_Processor* proc) {
     x86_64_CPUIDResult res = x86_64_CPUID(1, 0);
     if ((res.EDX & 0x10) == 0)
@@ -61,6 +86,38 @@ uint64_t x86_64_TSCNativeGetFrequency(x86_64_Processor* proc) {
     return crystalFreq * result.EBX / result.EAX;
 }
 
+// Times the TSC against the HPET's main counter, taking the median of a few rounds
+uint64_t x86_64_TSCCalibrate() {
+    if (g_HPET == nullptr)
+        return 0;
+
+    uint64_t period = g_HPET->GetPeriod(); // fs
+    uint64_t hpetTicks = TSC_CALIBRATION_NS * 1'000'000UL / period;
+    uint64_t freqs[TSC_CALIBRATION_ROUNDS];
+
+    g_HPET->Lock();
+    for (uint64_t i = 0; i < TSC_CALIBRATION_ROUNDS; i++) {
+        uint64_t hpetStart = g_HPET->GetCounter();
+        uint64_t tscStart = x86_64_ReadTSCFence();
+        uint64_t hpetEnd;
+        while ((hpetEnd = g_HPET->GetCounter()) - hpetStart < hpetTicks)
+            PAUSE();
+        uint64_t tscEnd = x86_64_ReadTSCFence();
+        uint64_t ns = (hpetEnd - hpetStart) * period / 1'000'000;
+        freqs[i] = (tscEnd - tscStart) * 1'000'000'000UL / ns;
+    }
+    g_HPET->Unlock();
+
+    for (uint64_t i = 1; i < TSC_CALIBRATION_ROUNDS; i++) {
+        for (uint64_t j = i; j > 0 && freqs[j - 1] > freqs[j]; j--) {
+            uint64_t temp = freqs[j];
+            freqs[j] = freqs[j - 1];
+            freqs[j - 1] = temp;
+        }
+    }
+    return freqs[TSC_CALIBRATION_ROUNDS / 2];
+}
+
 bool x86_64_TSCInit(x86_64_Processor* proc) {
     if (proc == nullptr) {
         proc = static_cast<x86_64_Processor*>(GetCurrentProcessor());
@@ -73,9 +130,58 @@ bool x86_64_TSCInit(x86_64_Processor* proc) {
 
     x86_64_TSCEnable();
 
-    uint64_t freq = x86_64_TSCNativeGetFrequency(proc);
+    uint64_t freq = x86_64_TSCNativeGetFrequency(proc); // also sets the LAPIC timer period when it is known
+    if (!proc->isBSP())
+        return g_x86_64_TSCFrequency > 0;
+
     if (freq == 0)
+        freq = x86_64_TSCCalibrate();
+    g_x86_64_TSCFrequency = freq;
+    return freq > 0;
+}
+
+uint64_t x86_64_GetTSCFrequency() {
+    return g_x86_64_TSCFrequency;
+}
+
+bool x86_64_TSCClockInit(uint64_t nsNow) {
+    if (g_x86_64_TSCFrequency == 0)
         return false;
 
+    g_x86_64_TSCClock.mult = (1'000'000'000UL << TSC_CLOCK_SHIFT) / g_x86_64_TSCFrequency;
+    g_x86_64_TSCClock.shift = TSC_CLOCK_SHIFT;
+    g_x86_64_TSCClock.nsBase = nsNow;
+    g_x86_64_TSCClock.tscBase = x86_64_ReadTSCFence();
     return true;
 }
+
+const x86_64_TSCClock* x86_64_GetTSCClock() {
+    return &g_x86_64_TSCClock;
+}
+
+void x86_64_TSCSyncPrepare() {
+    g_x86_64_TSCSync = {SPINLOCK_DEFAULT_VALUE, 0, 0, 0, 0};
+}
+
+// Both CPUs take turns reading the TSC under a lock. A read lower than the one before it, which may have come from the other CPU, means the TSCs have drifted apart.
+uint64_t x86_64_TSCSyncCheck(bool BSP) {
+    __atomic_add_fetch(&g_x86_64_TSCSync.arrived, 1, __ATOMIC_ACQ_REL);
+    while (__atomic_load_n(&g_x86_64_TSCSync.arrived, __ATOMIC_ACQUIRE) < 2)
+        PAUSE();
+
+    for (uint64_t i = 0; i < TSC_SYNC_ITERATIONS; i++) {
+        spinlock_acquire(&g_x86_64_TSCSync.lock);
+        uint64_t now = x86_64_ReadTSCFence();
+        if (now < g_x86_64_TSCSync.last)
+            g_x86_64_TSCSync.maxWarp = MAX(g_x86_64_TSCSync.maxWarp, g_x86_64_TSCSync.last - now);
+        g_x86_64_TSCSync.last = now;
+        spinlock_release(&g_x86_64_TSCSync.lock);
+    }
+
+    __atomic_add_fetch(&g_x86_64_TSCSync.done, 1, __ATOMIC_ACQ_REL);
+    if (!BSP)
+        return 0;
+    while (__atomic_load_n(&g_x86_64_TSCSync.done, __ATOMIC_ACQUIRE) < 2)
+        PAUSE();
+    return g_x86_64_TSCSync.maxWarp;
+}
@@ -26,7 +26,29 @@ class x86_64_Processor;
 extern "C" uint64_t x86_64_ReadTSC();
 extern "C" uint64_t x86_64_ReadTSCFence();
 
-bool x86_64_IsInvariantTSCSupported();
+bool x86_64_IsInvariantTSCSupported(x86_64_Processor* proc);
 bool x86_64_TSCInit(x86_64_Processor* proc = nullptr); // proc must be the current processor
 
+uint64_t x86_64_GetTSCFrequency(); // in Hz, 0 if the TSC isn't invariant or its frequency is unknown
+
+// ns = nsBase + (((tsc - tscBase) * mult) >> shift), with a 128-bit product
+struct x86_64_TSCClock {
+    uint64_t tscBase;
+    uint64_t nsBase;
+    uint64_t mult;
+    uint32_t shift;
+};
+
+bool x86_64_TSCClockInit(uint64_t nsNow); // BSP only, the clock starts at nsNow. false if the TSC can't be used as a clock
+const x86_64_TSCClock* x86_64_GetTSCClock();
+
+inline uint64_t x86_64_TSCToNS(const x86_64_TSCClock* clock, uint64_t tsc) {
+    __extension__ typedef unsigned __int128 uint128_t;
+    return clock->nsBase + (uint64_t)(((uint128_t)(tsc - clock->tscBase) * clock->mult) >> clock->shift);
+}
+
+// The BSP and a starting AP call x86_64_TSCSyncCheck at the same time. Returns, on the BSP, how many cycles the AP's TSC was seen behind, 0 if in sync
+void x86_64_TSCSyncPrepare(); // BSP only, before starting the AP
+uint64_t x86_64_TSCSyncCheck(bool BSP);
+
 #endif /* _x86_64_TSC_HPP */
\ No newline at end of file
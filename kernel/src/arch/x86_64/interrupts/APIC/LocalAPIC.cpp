@@ -25,6 +25,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "../../MSR.h"
 #include "../../Panic.hpp"
 #include "../../Processor.hpp"
+#include "../../TSC.hpp"
 
 #include "../../Memory/PagingInit.hpp"
 #include "../../Memory/PagingUtil.hpp"
@@ -86,7 +87,16 @@ void x86_64_LAPIC_TimerInterrupt(x86_64_ISR_Frame* frame) {
     lapic->TimerInterrupt(proc, frame);
 }
 
-x86_64_LAPIC::x86_64_LAPIC(bool BSP, uint8_t ID) : m_BSP(BSP), m_ID(ID), m_LAPICBase(0), m_addressOverride(false), m_NMISources({false, false, false}, {false, false, false}), m_timerPeriod(0) {
+void x86_64_LAPIC_RescheduleInterrupt(x86_64_ISR_Frame* frame) {
+    x86_64_Processor* proc = static_cast<x86_64_Processor*>(GetCurrentProcessor());
+    x86_64_LAPIC* lapic = proc->GetLAPIC();
+    if (lapic == nullptr)
+        x86_64_Panic("Reschedule interrupt occurred, but no LAPIC", frame, true);
+
+    lapic->RescheduleInterrupt(proc, frame);
+}
+
+x86_64_LAPIC::x86_64_LAPIC(bool BSP, uint8_t ID) : m_BSP(BSP), m_ID(ID), m_LAPICBase(0), m_addressOverride(false), m_NMISources({false, false, false}, {false, false, false}), m_timerPeriod(0), m_oneShot(false) {
     if (BSP)
         g_BSP_LAPIC = this;
 }
@@ -184,6 +194,32 @@ bool x86_64_LAPIC::InitTimer() {
     if (m_timerPeriod > LAPIC_TIMER_PERIOD)
         return false; // timer is too slow
 
+    // Register the ISR Handlers
+    if (m_BSP) {
+        x86_64_ISR_RegisterHandler(LAPIC_TIMER_INT, x86_64_LAPIC_TimerInterrupt);
+        x86_64_ISR_RegisterHandler(RESCHEDULE_INT, x86_64_LAPIC_RescheduleInterrupt);
+    }
+
+    // One-shot mode needs a free running clock to measure deadlines against
+    if (g_HPET != nullptr) {
+        m_oneShot = true;
+        m_timerDivisor = 1;
+        m_timerTicks = 0;
+
+        uint32_t value = ReadRegister(x86_64_LAPIC_Register::DivideConfig);
+        value &= ~0xB;
+        value |= g_LAPICDivisorLookup[0];
+        WriteRegister(x86_64_LAPIC_Register::DivideConfig, value);
+
+        value = ReadRegister(x86_64_LAPIC_Register::LVT_Timer);
+        value &= ~0x700FF; // clear mode, vector, and mask. One-shot mode is 0
+        value |= LAPIC_TIMER_INT;
+        WriteRegister(x86_64_LAPIC_Register::LVT_Timer, value);
+
+        WriteRegister(x86_64_LAPIC_Register::InitialCount, 0); // armed by the scheduler
+        return true;
+    }
+
     int divisor;
 
     for (divisor = 7; divisor > 0; divisor--) {
@@ -197,13 +233,9 @@ bool x86_64_LAPIC::InitTimer() {
     m_timerDivisor = 1 << divisor;
     m_timerTicks = LAPIC_TIMER_PERIOD / (m_timerPeriod * m_timerDivisor);
 
-    // Register the ISR Handler
-    if (m_BSP)
-        x86_64_ISR_RegisterHandler(LAPIC_TIMER_INT, x86_64_LAPIC_TimerInterrupt);
-
     // Start by setting divide config
     uint32_t value = ReadRegister(x86_64_LAPIC_Register::DivideConfig);
-    value &= 0xB;
+    value &= ~0xB;
     value |= g_LAPICDivisorLookup[divisor];
     WriteRegister(x86_64_LAPIC_Register::DivideConfig, value);
 
@@ -256,6 +288,8 @@ void x86_64_LAPIC::StartCPU() {
 
     printf("Starting AP %hhu\n", m_ID);
 
+    x86_64_TSCSyncPrepare();
+
     {
         using namespace x86_64_IPI;
 
@@ -271,6 +305,14 @@ void x86_64_LAPIC::StartCPU() {
     }
     spinlock_acquire(&proc->apLock);
 
+    uint64_t warp = x86_64_TSCSyncCheck(true);
+    if (!proc->isTSCAvailable())
+        HAL_DisableTSCClock("TSC is not invariant on an AP");
+    else if (warp > 0) {
+        printf("AP %hhu TSC is out of sync by %lu cycles\n", m_ID, warp);
+        HAL_DisableTSCClock("TSCs are not synchronised");
+    }
+
     printf("AP %hhu is online!\n", m_ID);
 
     g_KPageMapper->UnmapPage(AP_TRAMP_LOAD);
@@ -306,7 +348,36 @@ void x86_64_LAPIC::SetTimerPeriod(uint64_t period) {
     m_timerPeriod = period;
 }
 
+bool x86_64_LAPIC::IsOneShot() const {
+    return m_oneShot;
+}
+
+void x86_64_LAPIC::SetDeadline(uint64_t deadline) {
+    if (deadline == 0) {
+        WriteRegister(x86_64_LAPIC_Register::InitialCount, 0);
+        return;
+    }
+
+    uint64_t now = HAL_GetNSTicks();
+    uint64_t count = 1; // already passed, fire as soon as possible
+    if (deadline > now) {
+        uint64_t delta = deadline - now;
+        if (delta > UINT64_MAX / 1000)
+            count = UINT32_MAX;
+        else
+            count = DIV_ROUNDUP(delta * 1000, m_timerPeriod);
+        if (count > UINT32_MAX)
+            count = UINT32_MAX; // a spurious early tick just reprograms the timer
+    }
+    WriteRegister(x86_64_LAPIC_Register::InitialCount, count);
+}
+
 void x86_64_LAPIC::TimerInterrupt(x86_64_Processor* proc, x86_64_ISR_Frame* frame) {
-    HAL_TimerTick(proc, LAPIC_TIMER_PERIOD / 1'000'000'000, frame);
+    HAL_TimerTick(proc, m_oneShot ? 0 : LAPIC_TIMER_PERIOD / 1'000'000'000, frame);
+    SendEOI();
+}
+
+void x86_64_LAPIC::RescheduleInterrupt(x86_64_Processor* proc, x86_64_ISR_Frame* frame) {
+    HAL_TimerTick(proc, 0, frame);
     SendEOI();
 }
@@ -75,6 +75,8 @@ enum class x86_64_LAPIC_Register {
 
 #define LAPIC_TIMER_PERIOD 2'000'000'000 // 2ms in picoseconds, 500Hz
 #define LAPIC_TIMER_INT 0xFE
+#define TLB_SHOOTDOWN_INT 0xFD
+#define RESCHEDULE_INT 0xFC
 
 class x86_64_Processor;
 
@@ -103,7 +105,11 @@ public:
 
     void SetTimerPeriod(uint64_t period); // in picoseconds
 
+    bool IsOneShot() const;
+    void SetDeadline(uint64_t deadline); // in HAL_GetNSTicks() time, 0 to stop. Only valid in one-shot mode, must be called on this LAPIC's processor
+
     void TimerInterrupt(x86_64_Processor* proc, x86_64_ISR_Frame* frame);
+    void RescheduleInterrupt(x86_64_Processor* proc, x86_64_ISR_Frame* frame);
 
 private:
     bool m_BSP;
@@ -118,6 +124,7 @@ private:
     uint64_t m_timerPeriod; // picoseconds
     uint32_t m_timerTicks;
     uint8_t m_timerDivisor;
+    bool m_oneShot;
 };
 
 extern x86_64_LAPIC* g_BSP_LAPIC;
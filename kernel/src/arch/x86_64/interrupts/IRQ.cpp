@@ -20,6 +20,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "PIC.hpp"
 
 #include "APIC/IOAPIC.hpp"
+#include "APIC/LocalAPIC.hpp"
 
 #include "../Processor.hpp"
 
@@ -102,7 +103,7 @@ bool x86_64_RegisterGSIHandler(uint32_t GSI, x86_64_GSIHandler_t handler, void*
     if (data == nullptr)
         return false; // not initialised yet
 
-    for (int i = 0x30; i < 0xFE; i++) {
+    for (int i = 0x30; i < RESCHEDULE_INT; i++) {
         if (!data->usedInterrupts.Get(i)) {
             x86_64_LAPIC* lapic = proc->GetLAPIC();
             if (lapic == nullptr)
@@ -354,8 +354,13 @@ x86_64_ISR_Common:
 
     add rsp, 16
 
+    ; only reload CR3 if it changed, reloading it flushes the TLB
     pop rax
+    mov rdx, cr3
+    cmp rax, rdx
+    je .same_cr3
     mov cr3, rax
+.same_cr3:
     
     add rsp, 8
 
@@ -22,6 +22,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "../Panic.hpp"
 
 #include "../Memory/PageFault.hpp"
+#include "../Memory/UserAccess.hpp"
 
 const char* g_Exceptions[32] = {
     "Divide by zero",
@@ -103,6 +104,10 @@ void x86_64_ISR_RegisterHandler(uint8_t vector, x86_64_ISRHandler_t handler) {
 bool in_exception = false;
 
 extern "C" void x86_64_ISR_Handler(x86_64_ISR_Frame* frame) {
+    // user mode can set AC itself, which would disable SMAP here. iretq restores it.
+    if ((frame->CS & 3) == 3)
+        x86_64_UserAccessEnd();
+
     if (g_ISR_Handlers[frame->INT] != nullptr)
         return g_ISR_Handlers[frame->INT](frame);
 
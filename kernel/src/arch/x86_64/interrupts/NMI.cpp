@@ -50,7 +50,7 @@ namespace x86_64_GlobalNMI {
     GlobalNMIData g_NMIData = {x86_64_NMIType::NONE, {0, 0}, false, 0, 0, SPINLOCK_DEFAULT_VALUE, SPINLOCK_DEFAULT_VALUE};
 
     void ForceAllowRaise() {
-        spinlock_release(&g_NMIData.raiseLock);
+        spinlock_init(&g_NMIData.raiseLock); // the holder may never release it, so can't just queue behind it
     }
 
     void SetData(x86_64_NMIType type, void* data, uint64_t cpuCount) {
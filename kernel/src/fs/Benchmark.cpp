@@ -0,0 +1,222 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "Benchmark.hpp"
+#include "IORingData.h"
+#include "VFS.hpp"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <util.h>
+
+#include <fs/TempFS/TempFS.hpp>
+
+#include <HAL/Time.hpp>
+
+#include <Memory/PagingUtil.hpp>
+#include <Memory/UserAccess.hpp>
+#include <Memory/VMM.hpp>
+
+#include <Scheduling/Benchmark.hpp>
+#include <Scheduling/Process.hpp>
+#include <Scheduling/Scheduler.hpp>
+
+#include <SystemCalls/File.hpp>
+#include <SystemCalls/IORing.hpp>
+#include <SystemCalls/SystemCall.hpp>
+
+#define IORING_BENCH_FILE_SIZE 65536
+#define IORING_BENCH_IO_SIZE 4096
+#define IORING_BENCH_ENTRIES 32
+#define IORING_BENCH_WORKERS 2
+
+namespace FS {
+
+    uint8_t g_tempFSBenchmarkBuffer[PAGE_SIZE];
+
+    uint64_t RunTempFSBenchmark(const char* name, size_t writeSize, uint64_t writes, Credential cred) {
+        if (writeSize == 0 || writeSize > PAGE_SIZE || writes == 0)
+            return 0;
+
+        VNode* vnode = nullptr;
+        int rc = VFS_CreateFile("/", name, nullptr, cred, &vnode);
+        if (rc < 0 || vnode->GetVFS()->GetType() != FSType::TempFS) {
+            printf("TempFS: failed to create benchmark file /%s\n", name);
+            return 0;
+        }
+
+        memset(g_tempFSBenchmarkBuffer, 0xAA, PAGE_SIZE);
+
+        vnode->Lock();
+        uint64_t offset = 0;
+        uint64_t start = HAL_GetNSTicks();
+        for (uint64_t i = 0; i < writes; i++) {
+            size_t bytes = 0;
+            rc = vnode->Write(g_tempFSBenchmarkBuffer, writeSize, 0, offset, &bytes, cred);
+            if (rc < 0 || bytes != writeSize)
+                break;
+            offset += bytes;
+        }
+        uint64_t writeTime = HAL_GetNSTicks() - start;
+
+        uint64_t read = 0;
+        start = HAL_GetNSTicks();
+        while (read < offset) {
+            size_t bytes = 0;
+            rc = vnode->Read(g_tempFSBenchmarkBuffer, PAGE_SIZE, 0, read, &bytes, cred);
+            if (rc < 0 || bytes == 0)
+                break;
+            read += bytes;
+        }
+        uint64_t readTime = HAL_GetNSTicks() - start;
+        uint64_t extents = static_cast<TempFSVNode*>(vnode)->GetExtentCount();
+        vnode->Unlock();
+
+        uint64_t writeRate = writeTime > 0 ? offset * 1'000'000'000 / writeTime : 0;
+        uint64_t readRate = readTime > 0 ? read * 1'000'000'000 / readTime : 0;
+        printf("TempFS: appended %lu bytes in %lu-byte writes in %lu us, %lu KiB/s, %lu extents\n", offset, writeSize, writeTime / 1000, writeRate / 1024, extents);
+        printf("TempFS: read back %lu bytes in %lu us, %lu KiB/s\n", read, readTime / 1000, readRate / 1024);
+        return writeRate;
+    }
+
+    struct IORingBenchmarkData {
+        Process* proc;
+        uint64_t ops;
+        uint8_t* user; // the first page holds the path and IORingParams, the rest is the read buffer
+        int fd;
+        uint64_t inlineRate;
+    };
+
+    static uint64_t IORingBenchmarkRun(IORingBenchmarkData* data, const char* name, uint32_t flags, uint32_t workers) {
+        IORingParams* userParams = reinterpret_cast<IORingParams*>(data->user + 64);
+        uint8_t* buf = data->user + PAGE_SIZE;
+
+        IORingParams params = {flags, workers, 0, 0, 0, 0};
+        CopyToUser(userParams, &params, sizeof(IORingParams));
+        int ringFd = sys_ioring_setup(IORING_BENCH_ENTRIES, userParams);
+        if (ringFd < 0 || CopyFromUser(&params, userParams, sizeof(IORingParams)) < 0) {
+            printf("IORing: failed to set up %s ring: %d\n", name, ringFd);
+            return 0;
+        }
+
+        IORingHeader* header = reinterpret_cast<IORingHeader*>(params.ringAddr);
+        UserAccessBegin();
+        IORingSQE* sqes = reinterpret_cast<IORingSQE*>(params.ringAddr + header->sqOffset);
+        IORingCQE* cqes = reinterpret_cast<IORingCQE*>(params.ringAddr + header->cqOffset);
+        UserAccessEnd();
+        bool sqPoll = (flags & IORING_SETUP_SQPOLL) > 0;
+
+        uint64_t submitted = 0;
+        uint64_t completed = 0;
+        uint64_t errors = 0;
+        uint64_t start = HAL_GetNSTicks();
+        while (completed < data->ops) {
+            // never more outstanding than the SQ holds, the CQ is twice that so it can't fill up
+            uint32_t batch = MIN(params.sqEntries - (submitted - completed), data->ops - submitted);
+            bool wake = false;
+            UserAccessBegin();
+            uint32_t tail = header->sqTail;
+            for (uint32_t i = 0; i < batch; i++, submitted++) {
+                uint64_t offset = (submitted * IORING_BENCH_IO_SIZE) % IORING_BENCH_FILE_SIZE;
+                sqes[(tail + i) & (params.sqEntries - 1)] = {IORING_OP_READ, static_cast<uint8_t>(workers > 0 ? IORING_SQE_ASYNC : 0), 0, data->fd, static_cast<int64_t>(offset), reinterpret_cast<uint64_t>(buf + offset), IORING_BENCH_IO_SIZE, 0, submitted};
+            }
+            __atomic_store_n(&header->sqTail, tail + batch, __ATOMIC_RELEASE);
+            if (sqPoll) {
+                __atomic_thread_fence(__ATOMIC_SEQ_CST);
+                wake = (__atomic_load_n(&header->sqFlags, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP) > 0;
+            }
+            UserAccessEnd();
+
+            if (!sqPoll)
+                sys_ioring_enter(ringFd, batch, batch, IORING_ENTER_GETEVENTS);
+            else if (wake)
+                sys_ioring_enter(ringFd, 0, 0, IORING_ENTER_SQ_WAKEUP);
+
+            UserAccessBegin();
+            uint32_t head = header->cqHead;
+            uint32_t cqTail = __atomic_load_n(&header->cqTail, __ATOMIC_ACQUIRE);
+            for (; head != cqTail; head++, completed++) {
+                if (cqes[head & (params.cqEntries - 1)].result != IORING_BENCH_IO_SIZE)
+                    errors++;
+            }
+            __atomic_store_n(&header->cqHead, head, __ATOMIC_RELEASE);
+            UserAccessEnd();
+
+            if (sqPoll && batch == 0) // let the poller run if it shares this CPU
+                Scheduler::YieldCurrentThread();
+        }
+        uint64_t elapsed = HAL_GetNSTicks() - start;
+
+        sys_close(ringFd);
+        data->proc->GetVMM()->FreePages(reinterpret_cast<void*>(params.ringAddr));
+
+        uint64_t rate = elapsed > 0 ? completed * 1'000'000'000 / elapsed : 0;
+        printf("IORing: %lu reads %s in %lu us, %lu ops/s, %lu errors\n", completed, name, elapsed / 1000, rate, errors);
+        return rate;
+    }
+
+    void IORingBenchmarkThread(void* arg) {
+        IORingBenchmarkData* data = static_cast<IORingBenchmarkData*>(arg);
+        Process* proc = data->proc;
+
+        const char path[] = "/ioring-bench";
+        data->user = static_cast<uint8_t*>(proc->GetVMM()->AllocateAnonPages(IORING_BENCH_FILE_SIZE / PAGE_SIZE + 1, VMM::DEFAULT_ALLOC_FLAGS));
+        if (data->user != nullptr && CopyToUser(data->user, path, sizeof(path) - 1) == 0)
+            data->fd = sys_open(reinterpret_cast<char*>(data->user), sizeof(path) - 1, O_CREAT | O_RDWR, 0);
+        if (data->fd >= 0 && sys_pwrite(data->fd, data->user + PAGE_SIZE, IORING_BENCH_FILE_SIZE, 0) == IORING_BENCH_FILE_SIZE) {
+            // one system call per read, through the dispatcher so only the user/kernel transition itself is missing
+            uint64_t errors = 0;
+            uint64_t start = HAL_GetNSTicks();
+            for (uint64_t i = 0; i < data->ops; i++) {
+                uint64_t offset = (i * IORING_BENCH_IO_SIZE) % IORING_BENCH_FILE_SIZE;
+                if (HandleSystemCall(SYS_PREAD, data->fd, reinterpret_cast<uint64_t>(data->user + PAGE_SIZE + offset), IORING_BENCH_IO_SIZE, offset, 0) != IORING_BENCH_IO_SIZE)
+                    errors++;
+            }
+            uint64_t elapsed = HAL_GetNSTicks() - start;
+            uint64_t rate = elapsed > 0 ? data->ops * 1'000'000'000 / elapsed : 0;
+            printf("IORing: %lu reads with pread in %lu us, %lu ops/s, %lu errors\n", data->ops, elapsed / 1000, rate, errors);
+
+            data->inlineRate = IORingBenchmarkRun(data, "batched inline", 0, 0);
+            IORingBenchmarkRun(data, "on workers", 0, IORING_BENCH_WORKERS);
+            IORingBenchmarkRun(data, "with SQPOLL", IORING_SETUP_SQPOLL, 0);
+        } else
+            printf("IORing: failed to create benchmark file %s\n", path);
+    }
+
+    uint64_t RunIORingBenchmark(uint64_t ops, Credential cred) {
+        Process* proc = new Process(ProcessMode::KERNEL, nullptr, DEFAULT_NICE);
+        if (proc == nullptr)
+            return 0;
+        proc->SetCred(cred);
+        // a user address space and descriptor table, while the thread itself stays in kernel mode
+        if (!proc->Create(true)) {
+            printf("IORing: failed to create benchmark process\n");
+            delete proc;
+            return 0;
+        }
+
+        // the harness moves the thread back to the kernel process before the process is deleted
+        IORingBenchmarkData data = {proc, ops, nullptr, -1, 0};
+        if (!Scheduler::RunBenchmarkThreads(IORingBenchmarkThread, &data, 1, nullptr, proc))
+            printf("IORing: failed to create benchmark thread\n");
+        proc->Delete();
+        delete proc;
+        return data.inlineRate;
+    }
+
+} // namespace FS
@@ -0,0 +1,38 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _FS_BENCHMARK_HPP
+#define _FS_BENCHMARK_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <Scheduling/Process.hpp>
+
+namespace FS {
+
+    // Creates /name, appends `writes` writes of `writeSize` bytes, then reads it back a page at a time. Prints both rates and returns the append rate in bytes per second. The file is left behind, as TempFS can't unlink yet.
+    uint64_t RunTempFSBenchmark(const char* name, size_t writeSize, uint64_t writes, Credential cred);
+
+    // Reads a 64 KiB file `ops` times in 4 KiB pieces, first with one pread system call each, then through an I/O ring: in batches
+    // submitted inline, on worker threads, and with an SQPOLL thread. Runs in a throwaway process so the buffers and ring are in user memory.
+    // Returns the inline batched rate in operations per second.
+    uint64_t RunIORingBenchmark(uint64_t ops, Credential cred);
+
+} // namespace FS
+
+#endif /* _FS_BENCHMARK_HPP */
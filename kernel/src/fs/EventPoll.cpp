@@ -0,0 +1,352 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "EventPoll.hpp"
+#include "FileDescriptor.hpp"
+
+#include <errno.h>
+#include <spinlock.h>
+#include <stdint.h>
+
+#include <HAL/Time.hpp>
+
+#include <Scheduling/Mutex.hpp>
+#include <Scheduling/Scheduler.hpp>
+
+// Serialises changes to interest sets and watcher lists. Taken before any watchers lock, which is taken before any ready lock.
+Mutex g_EPollLock;
+
+namespace FS {
+
+    PollWatchers::PollWatchers() : m_head(nullptr), m_count(0), m_lock(SPINLOCK_DEFAULT_VALUE) {
+
+    }
+
+    PollWatchers::~PollWatchers() {
+
+    }
+
+    // Callers publish their new state with a sequentially consistent operation first, pairing with the re-check in EventPoll::Control
+    void PollWatchers::Notify(uint32_t events) {
+        if (__atomic_load_n(&m_count, __ATOMIC_SEQ_CST) == 0)
+            return;
+
+        spinlock_acquire(&m_lock);
+        for (EPollEntry* entry = m_head; entry != nullptr; entry = entry->next)
+            entry->poll->Queue(entry, events);
+        spinlock_release(&m_lock);
+    }
+
+    void PollWatchers::RemoveDesc(FileDescriptor* desc) {
+        if (__atomic_load_n(&m_count, __ATOMIC_SEQ_CST) == 0)
+            return;
+
+        g_EPollLock.Lock();
+        spinlock_acquire(&m_lock);
+        EPollEntry* entry = m_head;
+        while (entry != nullptr) {
+            EPollEntry* next = entry->next;
+            if (entry->desc == desc) {
+                // stays in the interest set until it is deleted or replaced, like Linux does for closed fds
+                if (entry->prev != nullptr)
+                    entry->prev->next = entry->next;
+                else
+                    m_head = entry->next;
+                if (entry->next != nullptr)
+                    entry->next->prev = entry->prev;
+                entry->watchers = nullptr;
+                m_count--;
+
+                EventPoll* poll = entry->poll;
+                spinlock_acquire(&poll->m_readyLock);
+                if (entry->queued)
+                    poll->Dequeue(entry);
+                entry->desc = nullptr;
+                spinlock_release(&poll->m_readyLock);
+            }
+            entry = next;
+        }
+        spinlock_release(&m_lock);
+        g_EPollLock.Unlock();
+    }
+
+    void PollWatchers::Add(EPollEntry* entry) {
+        spinlock_acquire(&m_lock);
+        entry->prev = nullptr;
+        entry->next = m_head;
+        if (m_head != nullptr)
+            m_head->prev = entry;
+        m_head = entry;
+        entry->watchers = this;
+        __atomic_add_fetch(&m_count, 1, __ATOMIC_SEQ_CST);
+        spinlock_release(&m_lock);
+    }
+
+    void PollWatchers::Remove(EPollEntry* entry) {
+        spinlock_acquire(&m_lock);
+        if (entry->prev != nullptr)
+            entry->prev->next = entry->next;
+        else
+            m_head = entry->next;
+        if (entry->next != nullptr)
+            entry->next->prev = entry->prev;
+        entry->watchers = nullptr;
+        __atomic_sub_fetch(&m_count, 1, __ATOMIC_SEQ_CST);
+
+        EventPoll* poll = entry->poll;
+        spinlock_acquire(&poll->m_readyLock);
+        if (entry->queued)
+            poll->Dequeue(entry);
+        spinlock_release(&poll->m_readyLock);
+        spinlock_release(&m_lock);
+    }
+
+    EventPoll::EventPoll() : m_interest(), m_readyHead(nullptr), m_readyTail(nullptr), m_waiters(nullptr), m_readyLock(SPINLOCK_DEFAULT_VALUE), m_refCount(0) {
+
+    }
+
+    EventPoll::~EventPoll() {
+        g_EPollLock.Lock();
+        m_interest.forEach([](void*, fd_t, EPollEntry* entry) {
+            if (entry->watchers != nullptr)
+                entry->watchers->Remove(entry);
+            delete entry;
+        });
+        m_interest.Clear();
+        g_EPollLock.Unlock();
+    }
+
+    void EventPoll::Ref() {
+        __atomic_add_fetch(&m_refCount, 1, __ATOMIC_RELAXED);
+    }
+
+    bool EventPoll::Unref() {
+        return __atomic_sub_fetch(&m_refCount, 1, __ATOMIC_ACQ_REL) == 0;
+    }
+
+    int EventPoll::Control(int op, fd_t fd, FileDescriptor* desc, const EPollEvent* event) {
+        if (desc == nullptr)
+            return -EBADF;
+        if (op != EPOLL_CTL_DEL && event == nullptr)
+            return -EFAULT;
+
+        g_EPollLock.Lock();
+
+        EPollEntry* entry = m_interest.Find(fd);
+        if (entry != nullptr && entry->desc == nullptr) { // left behind when its descriptor was closed
+            m_interest.Remove(fd);
+            delete entry;
+            entry = nullptr;
+        }
+
+        int rc = ESUCCESS;
+        switch (op) {
+        case EPOLL_CTL_ADD: {
+            if (entry != nullptr) {
+                rc = -EEXIST;
+                break;
+            }
+            PollWatchers* watchers = nullptr;
+            rc = desc->GetPollWatchers(&watchers);
+            if (rc < 0)
+                break;
+            entry = new EPollEntry{this, desc, nullptr, fd, event->events, event->data, false, false, nullptr, nullptr, nullptr, nullptr};
+            if (entry == nullptr) {
+                rc = -ENOMEM;
+                break;
+            }
+            m_interest.Insert(fd, entry);
+            watchers->Add(entry);
+            // a close that saw no watchers won't call RemoveDesc, so it must be seen here instead
+            if (!desc->isOpen()) {
+                watchers->Remove(entry);
+                m_interest.Remove(fd);
+                delete entry;
+                rc = -EBADF;
+                break;
+            }
+            Queue(entry, desc->Poll());
+            break;
+        }
+        case EPOLL_CTL_MOD:
+            if (entry == nullptr) {
+                rc = -ENOENT;
+                break;
+            }
+            spinlock_acquire(&m_readyLock);
+            entry->events = event->events;
+            entry->data = event->data;
+            entry->disabled = false;
+            spinlock_release(&m_readyLock);
+            Queue(entry, entry->desc->Poll());
+            break;
+        case EPOLL_CTL_DEL:
+            if (entry == nullptr) {
+                rc = -ENOENT;
+                break;
+            }
+            entry->watchers->Remove(entry);
+            m_interest.Remove(fd);
+            delete entry;
+            break;
+        default:
+            rc = -EINVAL;
+            break;
+        }
+
+        g_EPollLock.Unlock();
+        return rc;
+    }
+
+    int EventPoll::Wait(EPollEvent* events, int maxEvents, int64_t timeout) {
+        if (events == nullptr || maxEvents <= 0)
+            return -EINVAL;
+
+        EPollWaiter waiter;
+        Timer timer = TIMER_INITIALISER(WaitTimeout, &waiter);
+        bool armed = false;
+
+        int count;
+        while (true) {
+            count = Harvest(events, maxEvents);
+            if (count > 0 || timeout == 0 || __atomic_load_n(&waiter.expired, __ATOMIC_ACQUIRE))
+                break;
+
+            if (timeout > 0 && !armed) {
+                Scheduler::ArmTimer(&timer, HAL_GetNSTicks() + timeout * 1'000'000);
+                armed = true;
+            }
+
+            spinlock_acquire(&m_readyLock);
+            bool empty = m_readyHead == nullptr;
+            if (empty && !waiter.queued) {
+                waiter.next = m_waiters;
+                m_waiters = &waiter;
+                waiter.queued = true;
+            }
+            spinlock_release(&m_readyLock);
+            if (empty)
+                waiter.wakeup.Wait();
+        }
+
+        if (armed)
+            Scheduler::CancelTimer(&timer);
+
+        // WakeAll signals under m_readyLock, so once we hold it nobody can still be touching waiter
+        spinlock_acquire(&m_readyLock);
+        if (waiter.queued) {
+            EPollWaiter** link = &m_waiters;
+            while (*link != &waiter)
+                link = &(*link)->next;
+            *link = waiter.next;
+        }
+        spinlock_release(&m_readyLock);
+        return count;
+    }
+
+    void EventPoll::Queue(EPollEntry* entry, uint32_t events) {
+        spinlock_acquire(&m_readyLock);
+        if (entry->desc != nullptr && !entry->disabled && !entry->queued && (events & (entry->events | EPOLLERR | EPOLLHUP) & EPOLL_EVENT_MASK) != 0) {
+            Append(entry);
+            WakeAll();
+        }
+        spinlock_release(&m_readyLock);
+    }
+
+    void EventPoll::Append(EPollEntry* entry) {
+        entry->readyNext = nullptr;
+        entry->readyPrev = m_readyTail;
+        if (m_readyTail != nullptr)
+            m_readyTail->readyNext = entry;
+        else
+            m_readyHead = entry;
+        m_readyTail = entry;
+        entry->queued = true;
+    }
+
+    void EventPoll::Dequeue(EPollEntry* entry) {
+        if (entry->readyPrev != nullptr)
+            entry->readyPrev->readyNext = entry->readyNext;
+        else
+            m_readyHead = entry->readyNext;
+        if (entry->readyNext != nullptr)
+            entry->readyNext->readyPrev = entry->readyPrev;
+        else
+            m_readyTail = entry->readyPrev;
+        entry->readyNext = nullptr;
+        entry->readyPrev = nullptr;
+        entry->queued = false;
+    }
+
+    // Only looks at queued entries. Each one is polled again, as it may have stopped being ready since it was queued.
+    int EventPoll::Harvest(EPollEvent* events, int maxEvents) {
+        spinlock_acquire(&m_readyLock);
+
+        EPollEntry* requeueHead = nullptr;
+        EPollEntry* requeueTail = nullptr;
+        int count = 0;
+        while (count < maxEvents && m_readyHead != nullptr) {
+            EPollEntry* entry = m_readyHead;
+            Dequeue(entry);
+
+            uint32_t ready = entry->desc->Poll() & (entry->events | EPOLLERR | EPOLLHUP) & EPOLL_EVENT_MASK;
+            if (ready == 0)
+                continue;
+
+            events[count].events = ready;
+            events[count].data = entry->data;
+            count++;
+
+            if (entry->events & EPOLLONESHOT)
+                entry->disabled = true;
+            else if ((entry->events & EPOLLET) == 0) { // level-triggered, check it again on the next wait
+                entry->readyNext = nullptr;
+                if (requeueTail != nullptr)
+                    requeueTail->readyNext = entry;
+                else
+                    requeueHead = entry;
+                requeueTail = entry;
+            }
+        }
+
+        while (requeueHead != nullptr) {
+            EPollEntry* next = requeueHead->readyNext;
+            Append(requeueHead);
+            requeueHead = next;
+        }
+
+        spinlock_release(&m_readyLock);
+        return count;
+    }
+
+    // Every waiter harvests again, so none can sleep through events that another one left on the list
+    void EventPoll::WakeAll() {
+        while (m_waiters != nullptr) {
+            EPollWaiter* waiter = m_waiters;
+            m_waiters = waiter->next;
+            waiter->queued = false;
+            waiter->wakeup.Signal();
+        }
+    }
+
+    void EventPoll::WaitTimeout(Timer*, void* data) {
+        EPollWaiter* waiter = static_cast<EPollWaiter*>(data);
+        __atomic_store_n(&waiter->expired, true, __ATOMIC_RELEASE);
+        waiter->wakeup.Signal();
+    }
+
+}
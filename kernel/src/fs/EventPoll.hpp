@@ -0,0 +1,143 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _EVENT_POLL_HPP
+#define _EVENT_POLL_HPP
+
+#include <spinlock.h>
+#include <stdint.h>
+
+#include <DataStructures/AVLTree.hpp>
+
+#include <Scheduling/Semaphore.hpp>
+#include <Scheduling/TimerQueue.hpp>
+
+#define EPOLLIN 0x001
+#define EPOLLPRI 0x002
+#define EPOLLOUT 0x004
+#define EPOLLERR 0x008
+#define EPOLLHUP 0x010
+#define EPOLLRDHUP 0x2000
+#define EPOLLONESHOT (1U << 30)
+#define EPOLLET (1U << 31)
+
+#define EPOLL_EVENT_MASK (EPOLLIN | EPOLLPRI | EPOLLOUT | EPOLLERR | EPOLLHUP | EPOLLRDHUP)
+
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+
+#define EPOLL_CLOEXEC 02000000
+
+#define EPOLL_MAX_WAIT_EVENTS 1024 // per epoll_wait call
+
+typedef long fd_t;
+
+class FileDescriptor;
+
+namespace FS {
+
+    // Same layout as the Linux struct epoll_event
+    struct [[gnu::packed]] EPollEvent {
+        uint32_t events;
+        uint64_t data;
+    };
+
+    class EventPoll;
+    class PollWatchers;
+
+    struct EPollEntry {
+        EventPoll* poll;
+        FileDescriptor* desc; // null once the descriptor is closed, the entry then only waits to be freed
+        PollWatchers* watchers;
+        fd_t fd;
+        uint32_t events; // interest, including EPOLLET and EPOLLONESHOT
+        uint64_t data;
+        bool queued; // on the ready list
+        bool disabled; // EPOLLONESHOT has fired, until the next EPOLL_CTL_MOD
+
+        EPollEntry* next; // in the watchers list
+        EPollEntry* prev;
+        EPollEntry* readyNext;
+        EPollEntry* readyPrev;
+    };
+
+    // The set of epoll entries watching one readiness source, like one end of a pipe
+    class PollWatchers {
+    public:
+        PollWatchers();
+        ~PollWatchers();
+
+        void Notify(uint32_t events); // queues every interested entry, cheap when nobody is watching
+        void RemoveDesc(FileDescriptor* desc); // detaches desc's entries, must be called when desc is closed
+
+    private:
+        friend class EventPoll;
+
+        void Add(EPollEntry* entry);
+        void Remove(EPollEntry* entry);
+
+        EPollEntry* m_head;
+        uint32_t m_count;
+        spinlock_t m_lock;
+    };
+
+    // A thread in EventPoll::Wait, lives on its stack
+    struct EPollWaiter {
+        EPollWaiter() : wakeup(0, 1), next(nullptr), queued(false), expired(false) {}
+
+        Semaphore wakeup;
+        EPollWaiter* next;
+        bool queued; // on the waiter list
+        bool expired; // set by the timeout
+    };
+
+    // Interest set in a tree keyed by fd, and an intrusive ready list fed by PollWatchers::Notify, so waiting never scans the interest set.
+    // Level-triggered entries go back on the ready list after being reported, and are dropped on the next wait if no longer ready.
+    class EventPoll {
+    public:
+        EventPoll();
+        ~EventPoll();
+
+        void Ref();
+        bool Unref(); // returns true when the last reference is gone and the EventPoll can be deleted
+
+        int Control(int op, fd_t fd, FileDescriptor* desc, const EPollEvent* event);
+        int Wait(EPollEvent* events, int maxEvents, int64_t timeout); // timeout in ms, < 0 to wait forever. Returns the event count
+
+    private:
+        friend class PollWatchers;
+
+        void Queue(EPollEntry* entry, uint32_t events); // needs the entry's watchers lock or g_EPollLock, so the descriptor can't go away
+        void Append(EPollEntry* entry); // both need m_readyLock
+        void Dequeue(EPollEntry* entry);
+        int Harvest(EPollEvent* events, int maxEvents);
+        void WakeAll(); // needs m_readyLock
+
+        static void WaitTimeout(Timer* timer, void* data);
+
+        AVLTree::wAVLTree<fd_t, EPollEntry*> m_interest; // protected by g_EPollLock
+        EPollEntry* m_readyHead;
+        EPollEntry* m_readyTail;
+        EPollWaiter* m_waiters; // protected by m_readyLock
+        spinlock_t m_readyLock;
+        uint32_t m_refCount;
+    };
+
+}
+
+#endif /* _EVENT_POLL_HPP */
@@ -46,6 +46,26 @@ bool FileDescriptorManager::Init() {
 }
 
 void FileDescriptorManager::Delete() {
+    // Close I/O rings first, outside the tree lock. Their threads use the other descriptors, and closing a ring waits for them.
+    uint64_t next = 0;
+    while (true) {
+        m_currentFDs.lock();
+        AVLTree::wAVLTreeNode* node = m_currentFDs.FindNodeOrHigher(next);
+        while (node != nullptr && (node->value == 0 || ((FileDescriptor*)node->value)->GetType() != FDType::IORing))
+            node = m_currentFDs.FindNodeOrHigher(node->key + 1);
+        if (node == nullptr) {
+            m_currentFDs.unlock();
+            break;
+        }
+        FileDescriptor* desc = (FileDescriptor*)node->value;
+        next = node->key + 1;
+        m_currentFDs.RemoveNode(node);
+        m_currentFDs.unlock();
+        if (desc->isOpen())
+            desc->Close();
+        delete desc;
+    }
+
     m_bitmapLock.Lock();
     delete[] m_bitmap.GetBuffer();
     m_bitmap.SetBuffer(nullptr);
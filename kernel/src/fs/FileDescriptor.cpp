@@ -15,13 +15,18 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include "EventPoll.hpp"
 #include "FileDescriptor.hpp"
+#include "IORing.hpp"
+#include "Pipe.hpp"
+#include "UIO.hpp"
 #include "VFS.hpp"
 
 #include <errno.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <util.h>
 
 #include <Scheduling/Mutex.hpp>
 
@@ -30,15 +35,27 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <tty/TTY.hpp>
 #include <tty/TTYBackend.hpp>
 
-FileDescriptor::FileDescriptor() : m_proc(nullptr), m_type(FDType::Invalid), m_offset(0), m_open(false), m_append(false), m_vnode(nullptr), m_tty(nullptr), m_ttyStream(TTYStream::INVALID) {
+FileDescriptor::FileDescriptor() : m_proc(nullptr), m_type(FDType::Invalid), m_offset(0), m_open(false), m_append(false), m_nonBlock(false), m_vnode(nullptr), m_tty(nullptr), m_ttyStream(TTYStream::INVALID), m_pipe(nullptr), m_epoll(nullptr), m_ioring(nullptr) {
 
 }
 
-FileDescriptor::FileDescriptor(Process* proc, FDType type, FS::VNode* vnode) : m_proc(proc), m_type(type), m_offset(0), m_open(false), m_append(false), m_vnode(vnode), m_tty(nullptr), m_ttyStream(TTYStream::INVALID) {
+FileDescriptor::FileDescriptor(Process* proc, FDType type, FS::VNode* vnode) : m_proc(proc), m_type(type), m_offset(0), m_open(false), m_append(false), m_nonBlock(false), m_vnode(vnode), m_tty(nullptr), m_ttyStream(TTYStream::INVALID), m_pipe(nullptr), m_epoll(nullptr), m_ioring(nullptr) {
 
 }
 
-FileDescriptor::FileDescriptor(Process* proc, FDType type, TTY* tty, TTYStream stream) : m_proc(proc), m_type(type), m_offset(0), m_open(false), m_append(false), m_vnode(nullptr), m_tty(tty), m_ttyStream(stream) {
+FileDescriptor::FileDescriptor(Process* proc, FDType type, TTY* tty, TTYStream stream) : m_proc(proc), m_type(type), m_offset(0), m_open(false), m_append(false), m_nonBlock(false), m_vnode(nullptr), m_tty(tty), m_ttyStream(stream), m_pipe(nullptr), m_epoll(nullptr), m_ioring(nullptr) {
+
+}
+
+FileDescriptor::FileDescriptor(Process* proc, FDType type, FS::Pipe* pipe) : m_proc(proc), m_type(type), m_offset(0), m_open(false), m_append(false), m_nonBlock(false), m_vnode(nullptr), m_tty(nullptr), m_ttyStream(TTYStream::INVALID), m_pipe(pipe), m_epoll(nullptr), m_ioring(nullptr) {
+
+}
+
+FileDescriptor::FileDescriptor(Process* proc, FS::EventPoll* poll) : m_proc(proc), m_type(FDType::EventPoll), m_offset(0), m_open(false), m_append(false), m_nonBlock(false), m_vnode(nullptr), m_tty(nullptr), m_ttyStream(TTYStream::INVALID), m_pipe(nullptr), m_epoll(poll), m_ioring(nullptr) {
+
+}
+
+FileDescriptor::FileDescriptor(Process* proc, FS::IORing* ring) : m_proc(proc), m_type(FDType::IORing), m_offset(0), m_open(false), m_append(false), m_nonBlock(false), m_vnode(nullptr), m_tty(nullptr), m_ttyStream(TTYStream::INVALID), m_pipe(nullptr), m_epoll(nullptr), m_ioring(ring) {
 
 }
 
@@ -82,12 +99,35 @@ int FileDescriptor::Open(int flags) {
             return -EBADF;
         }
         break;
+    case FDType::PipeRead:
+    case FDType::PipeWrite:
+        if (m_pipe == nullptr || (flags & O_APPEND) > 0) {
+            m_mutex.Unlock();
+            return -EBADF;
+        }
+        m_pipe->Open(m_type == FDType::PipeWrite);
+        m_nonBlock = (flags & O_NONBLOCK) > 0;
+        break;
+    case FDType::EventPoll:
+        if (m_epoll == nullptr) {
+            m_mutex.Unlock();
+            return -EBADF;
+        }
+        m_epoll->Ref();
+        break;
+    case FDType::IORing:
+        if (m_ioring == nullptr) {
+            m_mutex.Unlock();
+            return -EBADF;
+        }
+        m_ioring->Ref();
+        break;
     case FDType::Invalid:
         m_mutex.Unlock();
         return -EBADF;
     }
 
-    m_open = true;
+    __atomic_store_n(&m_open, true, __ATOMIC_SEQ_CST);
     m_offset = 0;
     m_mutex.Unlock();
     return ESUCCESS;
@@ -97,16 +137,50 @@ void FileDescriptor::Close() {
     m_mutex.Lock();
     m_offset = 0;
     m_append = false;
-    m_open = false;
+    bool wasOpen = m_open;
+    FS::IORing* deadRing = nullptr;
+    // before detaching from epoll, see EventPoll::Control
+    __atomic_store_n(&m_open, false, __ATOMIC_SEQ_CST);
+
+    switch (m_type) {
+    case FDType::TTY:
+        m_ttyWatchers.RemoveDesc(this);
+        break;
+    case FDType::PipeRead:
+    case FDType::PipeWrite: {
+        bool write = m_type == FDType::PipeWrite;
+        m_pipe->GetWatchers(write)->RemoveDesc(this);
+        if (wasOpen && m_pipe->Close(write))
+            delete m_pipe;
+        m_pipe = nullptr;
+        break;
+    }
+    case FDType::EventPoll:
+        if (wasOpen && m_epoll->Unref())
+            delete m_epoll;
+        m_epoll = nullptr;
+        break;
+    case FDType::IORing:
+        if (wasOpen && m_ioring->Unref())
+            deadRing = m_ioring;
+        m_ioring = nullptr;
+        break;
+    default:
+        break;
+    }
+
     m_mutex.Unlock();
+
+    // waits for the ring's threads, which may be blocked on this descriptor's mutex
+    delete deadRing;
 }
 
 bool FileDescriptor::isOpen() const {
-    return m_open;
+    return __atomic_load_n(&m_open, __ATOMIC_SEQ_CST);
 }
 
-int FileDescriptor::Read(void* buf, size_t count, size_t* realCount) {
-    if (buf == nullptr || count == 0 || realCount == nullptr)
+int FileDescriptor::Read(FS::UIO* uio, size_t* realCount, int64_t offset) {
+    if (uio == nullptr || uio->GetResidual() == 0 || realCount == nullptr)
         return -EINVAL;
 
     m_mutex.Lock();
@@ -124,11 +198,13 @@ int FileDescriptor::Read(void* buf, size_t count, size_t* realCount) {
             m_mutex.Unlock();
             return -EBADF;
         }
-        size_t bytesRead = 0;
+        size_t start = uio->GetTransferred();
         m_vnode->Lock();
-        rc = m_vnode->Read(buf, count, 0, m_offset, &bytesRead, m_proc->GetCred());
+        rc = m_vnode->Read(uio, 0, offset < 0 ? m_offset : offset, m_proc->GetCred());
         m_vnode->Unlock();
-        m_offset += bytesRead;
+        size_t bytesRead = uio->GetTransferred() - start;
+        if (offset < 0)
+            m_offset += bytesRead;
         *realCount = bytesRead;
         break;
     }
@@ -137,15 +213,46 @@ int FileDescriptor::Read(void* buf, size_t count, size_t* realCount) {
             m_mutex.Unlock();
             return -EBADF;
         }
+        if (offset >= 0) {
+            rc = -ESPIPE;
+            break;
+        }
         // Ignore offset
+        char buf[UIO_BOUNCE_SIZE];
+        size_t start = uio->GetTransferred();
+        rc = ESUCCESS;
         m_tty->Lock(m_ttyStream);
-        m_tty->ReadString(static_cast<char*>(buf), count, m_ttyStream);
+        while (uio->GetResidual() > 0 && rc == ESUCCESS) {
+            size_t count = MIN(uio->GetResidual(), UIO_BOUNCE_SIZE);
+            m_tty->ReadString(buf, count, m_ttyStream);
+            rc = uio->CopyOut(buf, count);
+        }
         m_tty->Unlock(m_ttyStream);
-        *realCount = count;
-        rc = ESUCCESS;
+        *realCount = uio->GetTransferred() - start;
         break;
     }
-    case FDType::Directory: {
+    case FDType::PipeRead: {
+        if (offset >= 0) {
+            rc = -ESPIPE;
+            break;
+        }
+        // the pipe serialises its readers itself, and a blocked reader mustn't hold up close
+        FS::Pipe* pipe = m_pipe;
+        pipe->Ref(); // the descriptor may be closed while this is blocked
+        bool nonBlock = m_nonBlock;
+        m_mutex.Unlock();
+        size_t start = uio->GetTransferred();
+        rc = pipe->Read(uio, nonBlock);
+        *realCount = uio->GetTransferred() - start;
+        if (pipe->Unref())
+            delete pipe;
+        return rc;
+    }
+    case FDType::Directory:
+    case FDType::PipeWrite:
+    case FDType::EventPoll:
+    case FDType::IORing:
+    case FDType::Invalid: {
         rc = -EBADF;
         break;
     }
@@ -155,8 +262,8 @@ int FileDescriptor::Read(void* buf, size_t count, size_t* realCount) {
     return rc;
 }
 
-int FileDescriptor::Write(const void* buf, size_t count, size_t* realCount) {
-    if (buf == nullptr || count == 0 || realCount == nullptr)
+int FileDescriptor::Write(FS::UIO* uio, size_t* realCount, int64_t offset) {
+    if (uio == nullptr || uio->GetResidual() == 0 || realCount == nullptr)
         return -EINVAL;
 
     m_mutex.Lock();
@@ -175,20 +282,21 @@ int FileDescriptor::Write(const void* buf, size_t count, size_t* realCount) {
             return -EBADF;
         }
         m_vnode->Lock();
-        size_t bytesWritten = 0;
-        size_t offset = m_offset;
-        if (m_append) {
+        size_t start = uio->GetTransferred();
+        uint64_t writeOffset = offset < 0 ? m_offset : offset;
+        if (m_append && offset < 0) {
             FS::VAttr attr;
             rc = m_vnode->GetAttr(&attr);
             if (rc < 0) {
                 m_vnode->Unlock();
                 break;
             }
-            offset = attr.size;
+            writeOffset = attr.size;
         }
-        rc = m_vnode->Write(buf, count, 0, offset, &bytesWritten, m_proc->GetCred());
+        rc = m_vnode->Write(uio, 0, writeOffset, m_proc->GetCred());
         m_vnode->Unlock();
-        if (!m_append)
+        size_t bytesWritten = uio->GetTransferred() - start;
+        if (!m_append && offset < 0)
             m_offset += bytesWritten;
         *realCount = bytesWritten;
         break;
@@ -198,15 +306,47 @@ int FileDescriptor::Write(const void* buf, size_t count, size_t* realCount) {
             m_mutex.Unlock();
             return -EBADF;
         }
+        if (offset >= 0) {
+            rc = -ESPIPE;
+            break;
+        }
         // Ignore offset
+        char buf[UIO_BOUNCE_SIZE];
+        size_t start = uio->GetTransferred();
+        rc = ESUCCESS;
         m_tty->Lock(m_ttyStream);
-        m_tty->WriteString(static_cast<const char*>(buf), count, m_ttyStream, true);
+        while (uio->GetResidual() > 0) {
+            size_t count = MIN(uio->GetResidual(), UIO_BOUNCE_SIZE);
+            rc = uio->CopyIn(buf, count);
+            if (rc < 0)
+                break;
+            m_tty->WriteString(buf, count, m_ttyStream, uio->GetResidual() == 0);
+        }
         m_tty->Unlock(m_ttyStream);
-        *realCount = count;
-        rc = ESUCCESS;
+        *realCount = uio->GetTransferred() - start;
         break;
     }
-    case FDType::Directory: {
+    case FDType::PipeWrite: {
+        if (offset >= 0) {
+            rc = -ESPIPE;
+            break;
+        }
+        FS::Pipe* pipe = m_pipe;
+        pipe->Ref();
+        bool nonBlock = m_nonBlock;
+        m_mutex.Unlock();
+        size_t start = uio->GetTransferred();
+        rc = pipe->Write(uio, nonBlock);
+        *realCount = uio->GetTransferred() - start;
+        if (pipe->Unref())
+            delete pipe;
+        return rc;
+    }
+    case FDType::Directory:
+    case FDType::PipeRead:
+    case FDType::EventPoll:
+    case FDType::IORing:
+    case FDType::Invalid: {
         rc = -EBADF;
         break;
     }
@@ -278,7 +418,14 @@ int FileDescriptor::Seek(int64_t offset, FDOffsetStart whence, int64_t* realOffs
     case FDType::TTY:
         rc = ESUCCESS; // ignore seek on TTYs
         break;
-    case FDType::Directory: {
+    case FDType::PipeRead:
+    case FDType::PipeWrite:
+    case FDType::EventPoll:
+    case FDType::IORing:
+        rc = -ESPIPE;
+        break;
+    case FDType::Directory:
+    case FDType::Invalid: {
         rc = -EBADF;
         break;
     }
@@ -288,6 +435,39 @@ int FileDescriptor::Seek(int64_t offset, FDOffsetStart whence, int64_t* realOffs
     return rc;
 }
 
+int FileDescriptor::Allocate(uint64_t offset, uint64_t size) {
+    m_mutex.Lock();
+
+    if (!m_open) {
+        m_mutex.Unlock();
+        return -EBADF;
+    }
+
+    int rc;
+    switch (m_type) {
+    case FDType::File:
+        if (m_vnode == nullptr) {
+            rc = -EBADF;
+            break;
+        }
+        m_vnode->Lock();
+        rc = m_vnode->Allocate(offset, size, m_proc->GetCred());
+        m_vnode->Unlock();
+        break;
+    case FDType::TTY:
+    case FDType::PipeRead:
+    case FDType::PipeWrite:
+        rc = -ESPIPE;
+        break;
+    default:
+        rc = -ENODEV;
+        break;
+    }
+
+    m_mutex.Unlock();
+    return rc;
+}
+
 int FileDescriptor::GetDents(FS::Dentry* buf, size_t count, size_t* realCount) {
     if (buf == nullptr || count == 0 || realCount == 0)
         return -EINVAL;
@@ -332,6 +512,16 @@ bool FileDescriptor::Fork(FileDescriptor* other, Process* newProc) { // no speci
     m_tty = other->m_tty;
     m_ttyStream = other->m_ttyStream;
 
+    m_nonBlock = other->m_nonBlock;
+    m_pipe = other->m_pipe;
+    m_epoll = other->m_epoll;
+    if (m_open && m_pipe != nullptr)
+        m_pipe->Open(m_type == FDType::PipeWrite);
+    if (m_open && m_epoll != nullptr)
+        m_epoll->Ref();
+    if (m_type == FDType::IORing)
+        m_open = false; // the ring's threads and mappings belong to the parent, so the child gets a closed descriptor
+
     other->m_mutex.Unlock();
     m_mutex.Unlock();
 
@@ -346,3 +536,61 @@ FS::VNode* FileDescriptor::GetVNode() {
     return m_vnode;
 }
 
+FS::EventPoll* FileDescriptor::GetEventPoll() {
+    m_mutex.Lock();
+    FS::EventPoll* poll = nullptr;
+    if (m_open && m_type == FDType::EventPoll) {
+        poll = m_epoll;
+        poll->Ref();
+    }
+    m_mutex.Unlock();
+    return poll;
+}
+
+FS::IORing* FileDescriptor::GetIORing() {
+    m_mutex.Lock();
+    FS::IORing* ring = nullptr;
+    if (m_open && m_type == FDType::IORing) {
+        ring = m_ioring;
+        ring->Ref();
+    }
+    m_mutex.Unlock();
+    return ring;
+}
+
+uint32_t FileDescriptor::Poll() const {
+    switch (m_type) {
+    case FDType::TTY:
+        return m_ttyStream == TTYStream::IN ? 0 : EPOLLOUT;
+    case FDType::PipeRead:
+        return m_pipe->Poll(false);
+    case FDType::PipeWrite:
+        return m_pipe->Poll(true);
+    default:
+        return 0;
+    }
+}
+
+int FileDescriptor::GetPollWatchers(FS::PollWatchers** watchers) {
+    switch (m_type) {
+    case FDType::TTY:
+        if (m_ttyStream == TTYStream::IN)
+            return -EPERM; // no TTY backend has input, so there is nothing that could report readiness
+        *watchers = &m_ttyWatchers;
+        return ESUCCESS;
+    case FDType::PipeRead:
+    case FDType::PipeWrite:
+        *watchers = m_pipe->GetWatchers(m_type == FDType::PipeWrite);
+        return ESUCCESS;
+    case FDType::File:
+    case FDType::Directory:
+        return -EPERM;
+    case FDType::EventPoll:
+        return -EINVAL; // no nesting
+    case FDType::IORing:
+        return -EPERM;
+    default:
+        return -EBADF;
+    }
+}
+
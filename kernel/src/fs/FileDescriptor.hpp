@@ -21,6 +21,8 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <stddef.h>
 #include <stdint.h>
 
+#include "EventPoll.hpp"
+
 #include <Scheduling/Mutex.hpp>
 
 #include <tty/TTY.hpp>
@@ -30,6 +32,10 @@ enum class FDType {
     File,
     TTY,
     Directory,
+    PipeRead,
+    PipeWrite,
+    EventPoll,
+    IORing,
     Invalid
 };
 
@@ -41,6 +47,9 @@ enum class FDOffsetStart {
 
 namespace FS {
     class VNode;
+    class UIO;
+    class Pipe;
+    class IORing;
     struct Dentry;
 }
 
@@ -51,6 +60,9 @@ public:
     FileDescriptor();
     FileDescriptor(Process* proc, FDType type, FS::VNode* vnode);
     FileDescriptor(Process* proc, FDType type, TTY* tty, TTYStream stream);
+    FileDescriptor(Process* proc, FDType type, FS::Pipe* pipe); // type must be PipeRead or PipeWrite
+    FileDescriptor(Process* proc, FS::EventPoll* poll);
+    FileDescriptor(Process* proc, FS::IORing* ring);
     ~FileDescriptor();
 
     void Init(Process* proc, FDType type, FS::VNode* vnode);
@@ -60,17 +72,25 @@ public:
     void Close();
     bool isOpen() const;
 
-    int Read(void* buf, size_t count, size_t* realCount);
-    int Write(const void* buf, size_t count, size_t* realCount);
+    // offset < 0 uses and advances the descriptor's offset, otherwise it is left alone
+    int Read(FS::UIO* uio, size_t* realCount, int64_t offset = -1);
+    int Write(FS::UIO* uio, size_t* realCount, int64_t offset = -1);
 
     int Seek(int64_t offset, FDOffsetStart whence, int64_t* realOffset);
+    int Allocate(uint64_t offset, uint64_t size);
 
     int GetDents(FS::Dentry* buf, size_t count, size_t* realCount);
 
     bool Fork(FileDescriptor* other, Process* newProc); // copy from other into this
 
+    // Readiness for epoll. Poll takes no locks, so it can be called from under EventPoll's spinlocks
+    uint32_t Poll() const;
+    int GetPollWatchers(FS::PollWatchers** watchers); // -EPERM for types that are always ready, like files
+
     FDType GetType() const;
     FS::VNode* GetVNode();
+    FS::EventPoll* GetEventPoll(); // referenced, nullptr unless this is an open epoll descriptor
+    FS::IORing* GetIORing(); // referenced, nullptr unless this is an open ring descriptor
 
 private:
     Process* m_proc;
@@ -79,11 +99,17 @@ private:
     size_t m_offset;
     bool m_open;
     bool m_append;
+    bool m_nonBlock;
 
     FS::VNode* m_vnode;
 
     TTY* m_tty;
     TTYStream m_ttyStream;
+    FS::PollWatchers m_ttyWatchers; // never notified, TTY output is always ready and input can't be polled
+
+    FS::Pipe* m_pipe;
+    FS::EventPoll* m_epoll;
+    FS::IORing* m_ioring;
 
     Mutex m_mutex;
 };
@@ -0,0 +1,377 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "FDManager.hpp"
+#include "FileDescriptor.hpp"
+#include "IORing.hpp"
+#include "UIO.hpp"
+
+#include <errno.h>
+#include <spinlock.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util.h>
+
+#include <HAL/HAL.hpp>
+#include <HAL/Time.hpp>
+
+#include <Memory/PageMapper.hpp>
+#include <Memory/Pager.hpp>
+#include <Memory/PagingUtil.hpp>
+#include <Memory/PMM.hpp>
+#include <Memory/VMM.hpp>
+
+#include <Scheduling/Process.hpp>
+#include <Scheduling/Scheduler.hpp>
+#include <Scheduling/Thread.hpp>
+
+#include <SystemCalls/File.hpp>
+
+namespace FS {
+
+    static void ReleaseObject(VMM::MemoryObject* obj) {
+        spinlock_acquire(&obj->lock);
+        if (--obj->refCount > 0) {
+            spinlock_release(&obj->lock);
+            return;
+        }
+        obj->pages.forEach([](void*, uint64_t, VMM::Page* page) -> void {
+            g_PMM->FreePage(reinterpret_cast<void*>(page->physAddr));
+            kfree_vmm(page);
+        }, nullptr);
+        obj->pages.Clear();
+        kfree_vmm(obj);
+    }
+
+    IORing::IORing(Process* owner) : m_owner(owner), m_ioProcess(nullptr), m_object(nullptr), m_pages(0), m_header(nullptr), m_sqes(nullptr), m_cqes(nullptr), m_sqEntries(0), m_cqEntries(0), m_cqLock(SPINLOCK_DEFAULT_VALUE), m_inflight(0), m_cqWaiting(0), m_cqReady(0, 1), m_sqPoll(false), m_pollerWake(0, 1), m_work(nullptr), m_workHead(0), m_workTail(0), m_workLock(SPINLOCK_DEFAULT_VALUE), m_workReady(0), m_workers(0), m_threads(0), m_threadsExited(0), m_shutdown(false), m_refCount(0) {
+
+    }
+
+    IORing::~IORing() {
+        __atomic_store_n(&m_shutdown, true, __ATOMIC_SEQ_CST);
+        if (m_sqPoll)
+            m_pollerWake.Signal();
+        for (uint32_t i = 0; i < m_workers; i++)
+            m_workReady.Signal(); // each worker exits once it finds the queue empty
+        for (uint32_t i = 0; i < m_threads; i++)
+            m_threadsExited.Wait();
+
+        if (m_ioProcess != nullptr) {
+            m_ioProcess->SetVMM(nullptr); // borrowed from the owner
+            delete m_ioProcess;
+        }
+        delete[] m_work;
+        if (m_object != nullptr)
+            ReleaseObject(m_object);
+    }
+
+    void IORing::Ref() {
+        __atomic_add_fetch(&m_refCount, 1, __ATOMIC_RELAXED);
+    }
+
+    bool IORing::Unref() {
+        return __atomic_sub_fetch(&m_refCount, 1, __ATOMIC_ACQ_REL) == 0;
+    }
+
+    int IORing::Init(uint32_t entries, uint32_t flags, uint32_t workers) {
+        if (entries == 0 || entries > IORING_MAX_ENTRIES || workers > IORING_MAX_WORKERS || (flags & ~IORING_SETUP_SQPOLL) != 0)
+            return -EINVAL;
+
+        m_sqEntries = 1;
+        while (m_sqEntries < entries)
+            m_sqEntries <<= 1;
+        m_cqEntries = m_sqEntries * 2; // room for a full SQ while the last batch's completions are still unreaped
+
+        uint64_t sqOffset = ALIGN_UP(sizeof(IORingHeader), 64);
+        uint64_t cqOffset = sqOffset + m_sqEntries * sizeof(IORingSQE);
+        m_pages = DIV_ROUNDUP(cqOffset + m_cqEntries * sizeof(IORingCQE), PAGE_SIZE);
+
+        // physically contiguous, so the kernel can use the HHDM instead of mapping it again
+        void* phys = g_PMM->AllocatePages(m_pages);
+        if (phys == nullptr)
+            return -ENOMEM;
+        memset(to_HHDM(phys), 0, m_pages * PAGE_SIZE);
+
+        m_object = static_cast<VMM::MemoryObject*>(kcalloc_vmm(1, sizeof(VMM::MemoryObject)));
+        if (m_object == nullptr) {
+            g_PMM->FreePages(phys, m_pages);
+            return -ENOMEM;
+        }
+        m_object->size = m_pages;
+        m_object->refCount = 1; // held by the ring, mappings take their own
+        m_object->pager = &VMM::g_wiredPager;
+        for (uint64_t i = 0; i < m_pages; i++) {
+            uint64_t pagePhys = reinterpret_cast<uint64_t>(phys) + i * PAGE_SIZE;
+            VMM::Page* page = static_cast<VMM::Page*>(kcalloc_vmm(1, sizeof(VMM::Page)));
+            if (page == nullptr) {
+                g_PMM->FreePages(reinterpret_cast<void*>(pagePhys), m_pages - i); // the rest are freed along with the object
+                return -ENOMEM;
+            }
+            page->physAddr = pagePhys;
+            page->protection = VMM::Protection::READ_WRITE;
+            page->isWired = true;
+            m_object->pages.Insert(i * PAGE_SIZE, page);
+        }
+
+        m_header = static_cast<IORingHeader*>(to_HHDM(phys));
+        m_sqes = reinterpret_cast<IORingSQE*>(reinterpret_cast<uint8_t*>(m_header) + sqOffset);
+        m_cqes = reinterpret_cast<IORingCQE*>(reinterpret_cast<uint8_t*>(m_header) + cqOffset);
+        m_header->sqEntries = m_sqEntries;
+        m_header->sqMask = m_sqEntries - 1;
+        m_header->cqEntries = m_cqEntries;
+        m_header->cqMask = m_cqEntries - 1;
+        m_header->sqOffset = sqOffset;
+        m_header->cqOffset = cqOffset;
+
+        m_sqPoll = (flags & IORING_SETUP_SQPOLL) > 0;
+        if (!m_sqPoll && workers == 0)
+            return ESUCCESS; // everything runs in ioring_enter
+
+        if (workers > 0) {
+            m_work = new IORingSQE[m_cqEntries];
+            if (m_work == nullptr)
+                return -ENOMEM;
+        }
+
+        m_ioProcess = new Process(ProcessMode::KERNEL, m_owner->GetVMM(), m_owner->GetNice());
+        if (m_ioProcess == nullptr)
+            return -ENOMEM;
+        m_ioProcess->SetCred(m_owner->GetCred());
+
+        // spread the threads out, starting away from the CPU the owner is probably on
+        uint64_t processor = GetCurrentProcessorState()->id + 1;
+        if (m_sqPoll && !StartThread(PollerMain, processor++))
+            return -ENOMEM;
+        for (uint32_t i = 0; i < workers; i++) {
+            if (!StartThread(WorkerMain, processor++))
+                return -ENOMEM;
+            m_workers++;
+        }
+        return ESUCCESS;
+    }
+
+    void* IORing::Map(VMM::VMM* vmm) {
+        VMM::AllocFlags flags = VMM::DEFAULT_ALLOC_FLAGS;
+        flags.isPrivate = false; // user stores have to land in the pages the kernel reads
+        flags.zero = false;
+        flags.allocPhys = true;
+        return vmm->AllocateBackedPages(m_pages, m_object, 0, nullptr, flags);
+    }
+
+    int IORing::Enter(uint32_t toSubmit, uint32_t minComplete, uint32_t flags) {
+        if ((flags & ~(IORING_ENTER_GETEVENTS | IORING_ENTER_SQ_WAKEUP)) != 0)
+            return -EINVAL;
+
+        uint32_t submitted = 0;
+        if (m_sqPoll) {
+            if ((flags & IORING_ENTER_SQ_WAKEUP) > 0)
+                m_pollerWake.Signal();
+            submitted = MIN(toSubmit, m_sqEntries); // taken by the poller
+        } else if (toSubmit > 0) {
+            m_submitLock.Lock();
+            submitted = Submit(toSubmit);
+            m_submitLock.Unlock();
+        }
+
+        if ((flags & IORING_ENTER_GETEVENTS) > 0 && minComplete > 0)
+            WaitForCompletions(MIN(minComplete, m_cqEntries));
+        return submitted;
+    }
+
+    uint32_t IORing::GetSQEntries() const {
+        return m_sqEntries;
+    }
+
+    uint32_t IORing::GetCQEntries() const {
+        return m_cqEntries;
+    }
+
+    uint64_t IORing::GetSize() const {
+        return m_pages * PAGE_SIZE;
+    }
+
+    uint32_t IORing::Submit(uint32_t max) {
+        uint32_t head = m_header->sqHead;
+        uint32_t pending = __atomic_load_n(&m_header->sqTail, __ATOMIC_ACQUIRE) - head;
+        uint32_t count = MIN(MIN(pending, m_sqEntries), max); // sqTail is user controlled
+
+        uint32_t done = 0;
+        while (done < count && ReserveCompletion()) {
+            // copy first, user mode may reuse the slot as soon as sqHead moves past it
+            IORingSQE sqe;
+            memcpy(&sqe, &m_sqes[(head + done) & (m_sqEntries - 1)], sizeof(IORingSQE));
+            done++;
+            __atomic_store_n(&m_header->sqHead, head + done, __ATOMIC_RELEASE);
+            Dispatch(sqe);
+        }
+        return done;
+    }
+
+    bool IORing::ReserveCompletion() {
+        spinlock_acquire(&m_cqLock);
+        uint32_t used = m_header->cqTail - __atomic_load_n(&m_header->cqHead, __ATOMIC_ACQUIRE);
+        bool reserved = used <= m_cqEntries && used + m_inflight < m_cqEntries;
+        if (reserved)
+            m_inflight++;
+        spinlock_release(&m_cqLock);
+        return reserved;
+    }
+
+    void IORing::Dispatch(const IORingSQE& sqe) {
+        if (m_workers == 0 || (sqe.flags & IORING_SQE_ASYNC) == 0) {
+            Complete(sqe.userData, Execute(sqe));
+            return;
+        }
+        // can't overflow, there are never more than m_cqEntries in flight
+        spinlock_acquire(&m_workLock);
+        m_work[m_workTail++ & (m_cqEntries - 1)] = sqe;
+        spinlock_release(&m_workLock);
+        m_workReady.Signal();
+    }
+
+    int64_t IORing::Execute(const IORingSQE& sqe) {
+        switch (sqe.opcode) {
+        case IORING_OP_NOP:
+            return ESUCCESS;
+        case IORING_OP_READ:
+        case IORING_OP_WRITE: {
+            if (sqe.len == 0 || sqe.offset < -1)
+                return -EINVAL;
+            UIO uio(reinterpret_cast<void*>(sqe.addr), sqe.len, UIOSpace::USER);
+            return FileIO(m_owner, sqe.fd, &uio, sqe.opcode == IORING_OP_WRITE, sqe.offset);
+        }
+        case IORING_OP_OPEN:
+            return OpenFile(m_owner, reinterpret_cast<const char*>(sqe.addr), sqe.len, sqe.opFlags, 0);
+        case IORING_OP_CLOSE: {
+            // closing a ring from one of its own threads would wait on itself
+            FileDescriptorManager* manager = m_owner->GetFDManager();
+            FileDescriptor* desc = manager != nullptr ? manager->Get(sqe.fd) : nullptr;
+            if (desc != nullptr && desc->GetType() == FDType::IORing)
+                return -EINVAL;
+            return CloseFile(m_owner, sqe.fd);
+        }
+        case IORING_OP_FSYNC:
+            return SyncFile(m_owner, sqe.fd);
+        default:
+            return -EINVAL;
+        }
+    }
+
+    void IORing::Complete(uint64_t userData, int64_t result) {
+        spinlock_acquire(&m_cqLock);
+        uint32_t tail = m_header->cqTail;
+        IORingCQE* cqe = &m_cqes[tail & (m_cqEntries - 1)];
+        cqe->userData = userData;
+        cqe->result = result;
+        __atomic_store_n(&m_header->cqTail, tail + 1, __ATOMIC_RELEASE);
+        m_inflight--;
+        spinlock_release(&m_cqLock);
+
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_exchange_n(&m_cqWaiting, 0, __ATOMIC_SEQ_CST))
+            m_cqReady.Signal();
+    }
+
+    void IORing::WaitForCompletions(uint32_t minComplete) {
+        while (true) {
+            // announce before checking, so a completion posted in between is caught
+            __atomic_store_n(&m_cqWaiting, 1, __ATOMIC_SEQ_CST);
+            spinlock_acquire(&m_cqLock);
+            uint32_t ready = m_header->cqTail - __atomic_load_n(&m_header->cqHead, __ATOMIC_ACQUIRE);
+            uint32_t inflight = m_inflight;
+            spinlock_release(&m_cqLock);
+            if (ready >= minComplete || inflight == 0) { // nothing more is coming without another submission
+                __atomic_store_n(&m_cqWaiting, 0, __ATOMIC_RELAXED);
+                return;
+            }
+            m_cqReady.Wait();
+        }
+    }
+
+    bool IORing::StartThread(void (*entry)(void*), uint64_t processor) {
+        Thread* thread = new Thread({entry, this}, m_ioProcess);
+        if (thread == nullptr)
+            return false;
+        if (!thread->Init()) {
+            delete thread;
+            return false;
+        }
+        m_ioProcess->AddThread(thread);
+        m_threads++;
+        Scheduler::ScheduleThread(thread, Scheduler::GetProcessor(processor % Scheduler::GetProcessorCount()));
+        return true;
+    }
+
+    void IORing::ExitThread() {
+        // The owner's address space can be torn down as soon as m_threadsExited is signalled
+        Thread::MoveCurrentToKernelProcess();
+
+        m_threadsExited.Signal();
+        Thread::ExitCurrentThread(true, false, false);
+        PANIC("IORing: Thread::ExitCurrentThread returned!");
+    }
+
+    void IORing::PollerMain(void* data) {
+        IORing* ring = static_cast<IORing*>(data);
+        uint64_t lastWork = HAL_GetNSTicks();
+        while (!__atomic_load_n(&ring->m_shutdown, __ATOMIC_ACQUIRE)) {
+            ring->m_submitLock.Lock();
+            uint32_t count = ring->Submit(UINT32_MAX);
+            ring->m_submitLock.Unlock();
+            uint64_t now = HAL_GetNSTicks();
+            if (count > 0) {
+                lastWork = now;
+                continue;
+            }
+            if (now - lastWork < IORING_SQPOLL_IDLE_NS) {
+                Scheduler::YieldCurrentThread();
+                continue;
+            }
+
+            // Set the flag, then check once more. User mode stores sqTail before reading the flag, so between
+            // the two of us either this sees the new entries or user mode sees the flag and wakes us.
+            __atomic_or_fetch(&ring->m_header->sqFlags, IORING_SQ_NEED_WAKEUP, __ATOMIC_SEQ_CST);
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            ring->m_submitLock.Lock();
+            count = ring->Submit(UINT32_MAX);
+            ring->m_submitLock.Unlock();
+            if (count == 0 && !__atomic_load_n(&ring->m_shutdown, __ATOMIC_ACQUIRE))
+                ring->m_pollerWake.Wait();
+            __atomic_and_fetch(&ring->m_header->sqFlags, ~static_cast<uint32_t>(IORING_SQ_NEED_WAKEUP), __ATOMIC_SEQ_CST);
+            lastWork = HAL_GetNSTicks();
+        }
+        ring->ExitThread();
+    }
+
+    void IORing::WorkerMain(void* data) {
+        IORing* ring = static_cast<IORing*>(data);
+        while (true) {
+            ring->m_workReady.Wait();
+            spinlock_acquire(&ring->m_workLock);
+            if (ring->m_workHead == ring->m_workTail) {
+                spinlock_release(&ring->m_workLock);
+                break; // only happens for the signals sent on shutdown
+            }
+            IORingSQE sqe = ring->m_work[ring->m_workHead++ & (ring->m_cqEntries - 1)];
+            spinlock_release(&ring->m_workLock);
+            ring->Complete(sqe.userData, ring->Execute(sqe));
+        }
+        ring->ExitThread();
+    }
+
+}
@@ -0,0 +1,108 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _IO_RING_HPP
+#define _IO_RING_HPP
+
+#include <spinlock.h>
+#include <stdint.h>
+
+#include "IORingData.h"
+
+#include <Scheduling/Mutex.hpp>
+#include <Scheduling/Semaphore.hpp>
+
+#define IORING_SQPOLL_IDLE_NS 2'000'000 // the SQPOLL thread sleeps after this long without submissions
+
+class Process;
+
+namespace VMM {
+    class VMM;
+    struct MemoryObject;
+}
+
+namespace FS {
+
+    // Submission and completion rings shared with one process. Operations run inline in the enter call, on the SQPOLL thread,
+    // or on worker threads. The poller and workers belong to a kernel mode process that borrows the owner's address space,
+    // so they can reach user buffers directly.
+    class IORing {
+    public:
+        IORing(Process* owner);
+        ~IORing(); // stops the poller and workers, waiting for any operation they are in the middle of
+
+        void Ref();
+        bool Unref(); // returns true when the last reference is gone and the ring can be deleted
+
+        int Init(uint32_t entries, uint32_t flags, uint32_t workers);
+        void* Map(VMM::VMM* vmm); // maps the shared region read-write, nullptr on failure
+
+        int Enter(uint32_t toSubmit, uint32_t minComplete, uint32_t flags); // returns the number of submissions taken
+
+        uint32_t GetSQEntries() const;
+        uint32_t GetCQEntries() const;
+        uint64_t GetSize() const;
+
+    private:
+        uint32_t Submit(uint32_t max); // needs m_submitLock
+        bool ReserveCompletion();
+        void Dispatch(const IORingSQE& sqe);
+        int64_t Execute(const IORingSQE& sqe);
+        void Complete(uint64_t userData, int64_t result);
+        void WaitForCompletions(uint32_t minComplete);
+
+        bool StartThread(void (*entry)(void*), uint64_t processor);
+        [[noreturn]] void ExitThread();
+        static void PollerMain(void* data);
+        static void WorkerMain(void* data);
+
+        Process* m_owner;
+        Process* m_ioProcess; // kernel mode, shares m_owner's VMM. Null without a poller or workers
+
+        VMM::MemoryObject* m_object;
+        uint64_t m_pages;
+        IORingHeader* m_header; // HHDM view of the shared region
+        IORingSQE* m_sqes;
+        IORingCQE* m_cqes;
+        uint32_t m_sqEntries;
+        uint32_t m_cqEntries;
+
+        Mutex m_submitLock;
+        spinlock_t m_cqLock;
+        uint32_t m_inflight; // taken from the SQ but not completed yet, protected by m_cqLock
+        uint32_t m_cqWaiting;
+        Semaphore m_cqReady;
+
+        bool m_sqPoll;
+        Semaphore m_pollerWake;
+
+        IORingSQE* m_work; // queued IORING_SQE_ASYNC operations, m_cqEntries long so it can't fill up
+        uint32_t m_workHead;
+        uint32_t m_workTail;
+        spinlock_t m_workLock;
+        Semaphore m_workReady;
+        uint32_t m_workers;
+
+        uint32_t m_threads;
+        Semaphore m_threadsExited;
+        bool m_shutdown;
+        uint32_t m_refCount;
+    };
+
+}
+
+#endif /* _IO_RING_HPP */
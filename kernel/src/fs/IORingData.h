@@ -0,0 +1,99 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _IO_RING_DATA_H
+#define _IO_RING_DATA_H
+
+// Layout of the submission and completion rings shared between a process and the kernel.
+// This is ABI: only ever append fields. Plain C so libc can include it as is.
+//
+// User mode fills sqes[sqTail & sqMask] and then publishes it with a release store to sqTail. The kernel
+// posts completions to cqes[cqTail & cqMask], and user mode hands them back by advancing cqHead.
+// The kernel only takes a submission once it has a completion slot for it, so the CQ never overflows.
+
+#include <stdint.h>
+
+#define IORING_OP_NOP 0
+#define IORING_OP_READ 1 // fd, addr, len, offset
+#define IORING_OP_WRITE 2
+#define IORING_OP_OPEN 3 // addr = path, len = path length, opFlags = O_* flags, result is the new fd
+#define IORING_OP_CLOSE 4 // fd
+#define IORING_OP_FSYNC 5 // fd
+
+#define IORING_SQE_ASYNC 1 // run on a worker thread, if the ring has any. For operations that may block, like pipe reads
+
+// IORingParams flags
+#define IORING_SETUP_SQPOLL 1 // a kernel thread takes submissions as they're published, no enter call needed while it's awake
+
+// sqFlags
+#define IORING_SQ_NEED_WAKEUP 1 // the SQPOLL thread has gone to sleep, wake it with IORING_ENTER_SQ_WAKEUP. Check after a full fence following the sqTail store
+
+// ioring_enter flags
+#define IORING_ENTER_GETEVENTS 1 // wait for minComplete completions to be ready
+#define IORING_ENTER_SQ_WAKEUP 2
+
+#define IORING_MAX_ENTRIES 1024
+#define IORING_MAX_WORKERS 8
+
+struct IORingSQE {
+    uint8_t opcode;
+    uint8_t flags; // IORING_SQE_*
+    uint16_t reserved;
+    int32_t fd;
+    int64_t offset; // -1 to use and advance the descriptor's offset
+    uint64_t addr;
+    uint32_t len;
+    uint32_t opFlags;
+    uint64_t userData; // copied to the completion
+};
+
+struct IORingCQE {
+    uint64_t userData;
+    int64_t result; // as the equivalent system call would return
+};
+
+struct IORingHeader {
+    // written by user mode
+    uint32_t sqTail;
+    uint32_t cqHead;
+    uint8_t userPadding[56];
+
+    // written by the kernel, on its own cache line
+    uint32_t sqHead;
+    uint32_t cqTail;
+    uint32_t sqFlags;
+    uint8_t kernelPadding[52];
+
+    // fixed at setup
+    uint32_t sqEntries;
+    uint32_t sqMask;
+    uint32_t cqEntries;
+    uint32_t cqMask;
+    uint64_t sqOffset; // byte offsets of the SQE and CQE arrays from the start of the header
+    uint64_t cqOffset;
+};
+
+struct IORingParams {
+    uint32_t flags; // in, IORING_SETUP_*
+    uint32_t workers; // in, worker threads for IORING_SQE_ASYNC operations, up to IORING_MAX_WORKERS
+    uint32_t sqEntries; // out
+    uint32_t cqEntries; // out, twice sqEntries
+    uint64_t ringAddr; // out, where the header is mapped
+    uint64_t ringSize; // out
+};
+
+#endif /* _IO_RING_DATA_H */
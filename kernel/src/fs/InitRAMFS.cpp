@@ -22,8 +22,18 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
+#include <stdio.h>
 #include <util.h>
 
+#include <DataStructures/Bitmap.hpp>
+
+#include <fs/TempFS/TempFS.hpp>
+
+#include <HAL/Time.hpp>
+
+#include <Memory/PagingUtil.hpp>
+#include <Memory/PMM.hpp>
+
 #include <Scheduling/Process.hpp>
 
 uint64_t StringOctalToNum(char* str, size_t len) {
@@ -37,9 +47,52 @@ uint64_t StringOctalToNum(char* str, size_t len) {
     return n;
 }
 
+// Page aligned whole pages of a file's data are handed to TempFS in place, the rest is copied
+static int LoadFileData(FS::VNode* vnode, uint8_t* fileData, uint64_t size, RawBitmap* adopted, uint64_t moduleBase, uint64_t* adoptedBytes, const Credential& cred) {
+    uint64_t phys = from_HHDM((uint64_t)fileData);
+    uint64_t pages = 0;
+    if ((phys & (PAGE_SIZE - 1)) == 0 && vnode->GetVFS()->GetType() == FS::FSType::TempFS)
+        pages = size >> PAGE_SIZE_SHIFT;
+    if (pages > 0 && static_cast<FS::TempFSVNode*>(vnode)->AdoptPages(0, phys, pages) == ESUCCESS) {
+        for (uint64_t i = 0; i < pages; i++)
+            adopted->Set(((phys - moduleBase) >> PAGE_SIZE_SHIFT) + i, true);
+        *adoptedBytes += pages << PAGE_SIZE_SHIFT;
+    } else
+        pages = 0;
+
+    uint64_t copyStart = pages << PAGE_SIZE_SHIFT;
+    if (copyStart == size)
+        return ESUCCESS;
+    if (pages > 0) {
+        // a write at EOF would preallocate as much again as was adopted, the tail only needs its one page
+        int rc = vnode->Allocate(copyStart, size - copyStart, cred);
+        if (rc < 0)
+            return rc;
+    }
+    size_t bytes = 0;
+    return vnode->Write(fileData + copyStart, size - copyStart, 0, copyStart, &bytes, cred);
+}
+
+// Gives every module page that wasn't adopted back to the PMM
+static void ReclaimModule(uint64_t moduleBase, uint64_t modulePages, RawBitmap* adopted) {
+    uint64_t runStart = 0;
+    for (uint64_t i = 0; i <= modulePages; i++) {
+        if (i < modulePages && !adopted->Get(i))
+            continue;
+        if (i > runStart)
+            g_PMM->AddRange((void*)(moduleBase + (runStart << PAGE_SIZE_SHIFT)), i - runStart);
+        runStart = i + 1;
+    }
+}
+
 int LoadInitRAMFS(void* data, size_t size) {
     USTARItemHeader* header = (USTARItemHeader*)data;
 
+    uint64_t start = HAL_GetNSTicks();
+    uint64_t dataTime = 0;
+    uint64_t adoptedBytes = 0;
+    uint64_t copiedBytes = 0;
+
     const Credential& cred = g_KProcess->GetCred();
     FS::VNode* cwd = nullptr;
     FS::VFS* cwdFS = nullptr;
@@ -47,6 +100,16 @@ int LoadInitRAMFS(void* data, size_t size) {
     if (rc < 0)
         return rc;
 
+    // one bit per module page, set once the page belongs to a file
+    uint64_t moduleBase = ALIGN_DOWN(from_HHDM((uint64_t)data), PAGE_SIZE);
+    uint64_t modulePages = DIV_ROUNDUP(from_HHDM((uint64_t)data) + size - moduleBase, PAGE_SIZE);
+    uint64_t bitmapSize = DIV_ROUNDUP(modulePages, 8);
+    uint8_t* bitmapBuffer = new uint8_t[bitmapSize];
+    if (bitmapBuffer == nullptr)
+        return -ENOMEM;
+    memset(bitmapBuffer, 0, bitmapSize);
+    RawBitmap adopted(bitmapBuffer, bitmapSize);
+
     printf("Loading initramfs...\n");
 
     uint64_t count = 0;
@@ -79,13 +142,8 @@ int LoadInitRAMFS(void* data, size_t size) {
 
         switch (header->type) {
         case '0': { // File
-            rc = FS::VFS_CreateFile(parent, name, cwd, cred);
-            if (rc < 0)
-                break;
-
             FS::VNode* vnode = nullptr;
-            FS::VFS* vfs = nullptr;
-            rc = FS::VFS_LookupPath(header->fileName, &vnode, &vfs, cwd, cred);
+            rc = FS::VFS_CreateFile(parent, name, cwd, cred, &vnode);
             if (rc < 0)
                 break;
 
@@ -109,19 +167,19 @@ int LoadInitRAMFS(void* data, size_t size) {
                 break;
             }
 
-            uint64_t bytes = 0;
-            rc = vnode->Write((void*)((uint64_t)header + 512), itemSize, 0, 0, &bytes, cred);
+            if (itemSize > 0) {
+                uint64_t dataStart = HAL_GetNSTicks();
+                uint64_t before = adoptedBytes;
+                rc = LoadFileData(vnode, (uint8_t*)header + 512, itemSize, &adopted, moduleBase, &adoptedBytes, cred);
+                copiedBytes += itemSize - (adoptedBytes - before);
+                dataTime += HAL_GetNSTicks() - dataStart;
+            }
             vnode->Unlock();
             break;
         }
         case '5': { // Folder
-            rc = FS::VFS_CreateDir(parent, name, cwd, cred);
-            if (rc < 0)
-                break;
-
             FS::VNode* vnode = nullptr;
-            FS::VFS* vfs = nullptr;
-            rc = FS::VFS_LookupPath(header->fileName, &vnode, &vfs, cwd, cred);
+            rc = FS::VFS_CreateDir(parent, name, cwd, cred, &vnode);
             if (rc < 0)
                 break;
 
@@ -151,14 +209,25 @@ int LoadInitRAMFS(void* data, size_t size) {
         if (name != header->fileName)
             delete[] parent;
 
-        if (rc < 0)
+        if (rc < 0) {
+            delete[] bitmapBuffer;
             return rc;
+        }
 
         header = (USTARItemHeader*)((uint64_t)header + 512 + ALIGN_UP(itemSize, 512));
         count++;
     }
 
-    printf("initramfs: loaded %lu items\n", count);
+    uint64_t unpackTime = HAL_GetNSTicks() - start;
+
+    // nothing reads the module past here
+    uint64_t reclaimStart = HAL_GetNSTicks();
+    ReclaimModule(moduleBase, modulePages, &adopted);
+    uint64_t reclaimTime = HAL_GetNSTicks() - reclaimStart;
+    delete[] bitmapBuffer;
+
+    printf("initramfs: loaded %lu items, %lu KiB in place, %lu KiB copied\n", count, adoptedBytes >> 10, copiedBytes >> 10);
+    printf("initramfs: unpack %lu us (file data %lu us), reclaim %lu us\n", unpackTime / 1000, dataTime / 1000, reclaimTime / 1000);
 
     return ESUCCESS;
 }
@@ -0,0 +1,172 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "NameCache.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <spinlock.h>
+#include <string.h>
+
+namespace FS {
+
+    NameCacheBucket g_nameCache[1 << NAMECACHE_HASH_BITS];
+    uint64_t g_nameCacheGeneration = 0;
+
+    // FNV-1a
+    uint64_t NameHash(const char* name, size_t nameLen) {
+        uint64_t hash = 0xCBF29CE484222325;
+        for (size_t i = 0; i < nameLen; i++) {
+            hash ^= static_cast<uint8_t>(name[i]);
+            hash *= 0x100000001B3;
+        }
+        return hash;
+    }
+
+    static NameCacheBucket* GetBucket(VNode* parent, uint64_t nameHash) {
+        uint64_t hash = (nameHash ^ ((uint64_t)parent * 0x9E3779B97F4A7C15)) * 0xBF58476D1CE4E5B9;
+        return &g_nameCache[hash >> (64 - NAMECACHE_HASH_BITS)];
+    }
+
+    // bucket must be locked, returns the link pointing at the match so it can be unlinked
+    static NameCacheEntry** FindEntry(NameCacheBucket* bucket, VNode* parent, const char* name, size_t nameLen, uint64_t hash) {
+        for (NameCacheEntry** link = &bucket->head; *link != nullptr; link = &(*link)->next) {
+            NameCacheEntry* entry = *link;
+            if (entry->hash == hash && entry->parent == parent && entry->nameLen == nameLen && memcmp(entry->name, name, nameLen) == 0)
+                return link;
+        }
+        return nullptr;
+    }
+
+    NameCacheResult NameCache_Lookup(VNode* parent, const char* name, size_t nameLen, VNode** out) {
+        if (nameLen > NAMECACHE_NAME_MAX)
+            return NameCacheResult::MISS;
+
+        uint64_t hash = NameHash(name, nameLen);
+        NameCacheBucket* bucket = GetBucket(parent, hash);
+        spinlock_acquire(&bucket->lock);
+        NameCacheEntry** link = FindEntry(bucket, parent, name, nameLen, hash);
+        if (link == nullptr) {
+            spinlock_release(&bucket->lock);
+            return NameCacheResult::MISS;
+        }
+
+        NameCacheEntry* entry = *link;
+        if (link != &bucket->head) {
+            *link = entry->next;
+            entry->next = bucket->head;
+            bucket->head = entry;
+        }
+        VNode* vnode = entry->vnode;
+        spinlock_release(&bucket->lock);
+
+        if (vnode == nullptr)
+            return NameCacheResult::NEGATIVE;
+        *out = vnode;
+        return NameCacheResult::HIT;
+    }
+
+    uint64_t NameCache_GetGeneration() {
+        return __atomic_load_n(&g_nameCacheGeneration, __ATOMIC_ACQUIRE);
+    }
+
+    void NameCache_Enter(VNode* parent, const char* name, size_t nameLen, VNode* vnode, uint64_t generation) {
+        if (nameLen > NAMECACHE_NAME_MAX)
+            return;
+
+        NameCacheEntry* newEntry = new NameCacheEntry;
+        if (newEntry == nullptr)
+            return;
+
+        uint64_t hash = NameHash(name, nameLen);
+        NameCacheBucket* bucket = GetBucket(parent, hash);
+        NameCacheEntry* evicted = nullptr;
+        spinlock_acquire(&bucket->lock);
+
+        // checked with the lock held, as invalidations bump the generation under the bucket lock
+        if (__atomic_load_n(&g_nameCacheGeneration, __ATOMIC_ACQUIRE) != generation || FindEntry(bucket, parent, name, nameLen, hash) != nullptr) {
+            spinlock_release(&bucket->lock);
+            delete newEntry;
+            return;
+        }
+
+        *newEntry = {parent, vnode, bucket->head, hash, static_cast<uint8_t>(nameLen), {}};
+        memcpy(newEntry->name, name, nameLen);
+        bucket->head = newEntry;
+
+        if (++bucket->count > NAMECACHE_BUCKET_DEPTH) {
+            NameCacheEntry** link = &bucket->head;
+            while ((*link)->next != nullptr)
+                link = &(*link)->next;
+            evicted = *link;
+            *link = nullptr;
+            bucket->count--;
+        }
+        spinlock_release(&bucket->lock);
+
+        delete evicted;
+    }
+
+    void NameCache_Remove(VNode* parent, const char* name, size_t nameLen) {
+        uint64_t hash = NameHash(name, nameLen);
+        NameCacheBucket* bucket = GetBucket(parent, hash);
+        NameCacheEntry* entry = nullptr;
+        spinlock_acquire(&bucket->lock);
+        __atomic_add_fetch(&g_nameCacheGeneration, 1, __ATOMIC_RELEASE);
+        if (nameLen <= NAMECACHE_NAME_MAX) {
+            NameCacheEntry** link = FindEntry(bucket, parent, name, nameLen, hash);
+            if (link != nullptr) {
+                entry = *link;
+                *link = entry->next;
+                bucket->count--;
+            }
+        }
+        spinlock_release(&bucket->lock);
+
+        delete entry;
+    }
+
+    void NameCache_PurgeVNode(VNode* vnode) {
+        __atomic_add_fetch(&g_nameCacheGeneration, 1, __ATOMIC_RELEASE);
+        for (uint64_t i = 0; i < (1 << NAMECACHE_HASH_BITS); i++) {
+            NameCacheBucket* bucket = &g_nameCache[i];
+            if (__atomic_load_n(&bucket->head, __ATOMIC_RELAXED) == nullptr)
+                continue;
+
+            NameCacheEntry* freeList = nullptr;
+            spinlock_acquire(&bucket->lock);
+            NameCacheEntry** link = &bucket->head;
+            while (*link != nullptr) {
+                NameCacheEntry* entry = *link;
+                if (entry->parent == vnode || entry->vnode == vnode) {
+                    *link = entry->next;
+                    entry->next = freeList;
+                    freeList = entry;
+                    bucket->count--;
+                } else
+                    link = &entry->next;
+            }
+            spinlock_release(&bucket->lock);
+
+            while (freeList != nullptr) {
+                NameCacheEntry* next = freeList->next;
+                delete freeList;
+                freeList = next;
+            }
+        }
+    }
+
+}
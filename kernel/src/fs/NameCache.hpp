@@ -0,0 +1,66 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef _NAME_CACHE_HPP
+#define _NAME_CACHE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <spinlock.h>
+
+#define NAMECACHE_HASH_BITS 12
+#define NAMECACHE_BUCKET_DEPTH 8 // oldest entry in a full bucket is evicted
+#define NAMECACHE_NAME_MAX 47 // longer names aren't cached
+
+namespace FS {
+
+    class VNode;
+
+    enum class NameCacheResult {
+        MISS,
+        HIT,
+        NEGATIVE // name is known not to exist
+    };
+
+    struct NameCacheEntry {
+        VNode* parent;
+        VNode* vnode; // nullptr for negative entries
+        NameCacheEntry* next;
+        uint64_t hash;
+        uint8_t nameLen;
+        char name[NAMECACHE_NAME_MAX];
+    };
+
+    struct NameCacheBucket {
+        NameCacheEntry* head; // most recently used first
+        uint32_t count;
+        spinlock_t lock;
+    };
+
+    uint64_t NameHash(const char* name, size_t nameLen);
+
+    NameCacheResult NameCache_Lookup(VNode* parent, const char* name, size_t nameLen, VNode** out);
+
+    // Read before asking the file system, then passed to NameCache_Enter so a result that raced with an invalidation is dropped
+    uint64_t NameCache_GetGeneration();
+    void NameCache_Enter(VNode* parent, const char* name, size_t nameLen, VNode* vnode, uint64_t generation);
+
+    void NameCache_Remove(VNode* parent, const char* name, size_t nameLen); // on create, unlink and rename
+    void NameCache_PurgeVNode(VNode* vnode); // before a vnode is deleted, drops entries for it and its children
+
+}
+
+#endif /* _NAME_CACHE_HPP */
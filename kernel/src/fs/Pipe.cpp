@@ -0,0 +1,192 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "EventPoll.hpp"
+#include "Pipe.hpp"
+#include "UIO.hpp"
+
+#include <errno.h>
+#include <stdint.h>
+#include <util.h>
+
+#include <Memory/VMM.hpp>
+
+namespace FS {
+
+    Pipe::Pipe() : m_buffer(nullptr), m_head(0), m_tail(0), m_readers(0), m_writers(0), m_refCount(0), m_readerWaiting(0), m_writerWaiting(0), m_dataReady(0, 1), m_spaceReady(0, 1) {
+
+    }
+
+    Pipe::~Pipe() {
+        if (m_buffer != nullptr)
+            VMM::g_KVMM->FreePages(m_buffer, PIPE_BUFFER_PAGES);
+    }
+
+    bool Pipe::Init() {
+        m_buffer = static_cast<uint8_t*>(VMM::g_KVMM->AllocateAnonPages(PIPE_BUFFER_PAGES, VMM::DEFAULT_KALLOC_PHYS_FLAGS));
+        return m_buffer != nullptr;
+    }
+
+    void Pipe::Open(bool write) {
+        __atomic_add_fetch(write ? &m_writers : &m_readers, 1, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&m_refCount, 1, __ATOMIC_SEQ_CST);
+    }
+
+    bool Pipe::Close(bool write) {
+        if (__atomic_sub_fetch(write ? &m_writers : &m_readers, 1, __ATOMIC_SEQ_CST) == 0) {
+            // wake the other side so it sees end of file or -EPIPE
+            if (write) {
+                if (__atomic_exchange_n(&m_readerWaiting, 0, __ATOMIC_SEQ_CST))
+                    m_dataReady.Signal();
+                m_readWatchers.Notify(EPOLLIN | EPOLLHUP);
+            } else {
+                if (__atomic_exchange_n(&m_writerWaiting, 0, __ATOMIC_SEQ_CST))
+                    m_spaceReady.Signal();
+                m_writeWatchers.Notify(EPOLLOUT | EPOLLERR);
+            }
+        }
+        return Unref();
+    }
+
+    void Pipe::Ref() {
+        __atomic_add_fetch(&m_refCount, 1, __ATOMIC_SEQ_CST);
+    }
+
+    bool Pipe::Unref() {
+        return __atomic_sub_fetch(&m_refCount, 1, __ATOMIC_ACQ_REL) == 0;
+    }
+
+    int Pipe::Read(UIO* uio, bool nonBlock) {
+        m_readLock.Lock();
+
+        uint64_t tail = m_tail;
+        uint64_t head;
+        while ((head = __atomic_load_n(&m_head, __ATOMIC_ACQUIRE)) == tail) {
+            if (__atomic_load_n(&m_writers, __ATOMIC_ACQUIRE) == 0) {
+                m_readLock.Unlock();
+                return ESUCCESS; // end of file
+            }
+            if (nonBlock) {
+                m_readLock.Unlock();
+                return -EAGAIN;
+            }
+            // announce before re-checking, so a writer that published without seeing the flag is caught here
+            __atomic_store_n(&m_readerWaiting, 1, __ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&m_head, __ATOMIC_SEQ_CST) != tail || __atomic_load_n(&m_writers, __ATOMIC_SEQ_CST) == 0) {
+                __atomic_store_n(&m_readerWaiting, 0, __ATOMIC_RELAXED);
+                continue;
+            }
+            m_dataReady.Wait();
+        }
+
+        uint64_t count = MIN(head - tail, uio->GetResidual());
+        uint64_t done = 0;
+        int rc = ESUCCESS;
+        while (done < count) {
+            uint64_t offset = (tail + done) & (PIPE_BUFFER_SIZE - 1);
+            uint64_t chunk = MIN(count - done, PIPE_BUFFER_SIZE - offset);
+            size_t start = uio->GetTransferred();
+            rc = uio->CopyOut(&m_buffer[offset], chunk);
+            done += uio->GetTransferred() - start;
+            if (rc < 0)
+                break;
+        }
+
+        if (done > 0) {
+            __atomic_store_n(&m_tail, tail + done, __ATOMIC_RELEASE);
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            if (__atomic_exchange_n(&m_writerWaiting, 0, __ATOMIC_SEQ_CST))
+                m_spaceReady.Signal();
+            m_writeWatchers.Notify(EPOLLOUT);
+        }
+
+        m_readLock.Unlock();
+        return done > 0 ? ESUCCESS : rc;
+    }
+
+    int Pipe::Write(UIO* uio, bool nonBlock) {
+        m_writeLock.Lock();
+
+        uint64_t head = m_head;
+        uint64_t done = 0;
+        int rc = ESUCCESS;
+        while (uio->GetResidual() > 0) {
+            if (__atomic_load_n(&m_readers, __ATOMIC_ACQUIRE) == 0) {
+                rc = -EPIPE;
+                break;
+            }
+
+            uint64_t space = PIPE_BUFFER_SIZE - (head - __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE));
+            if (space == 0) {
+                if (nonBlock) {
+                    rc = -EAGAIN;
+                    break;
+                }
+                __atomic_store_n(&m_writerWaiting, 1, __ATOMIC_SEQ_CST);
+                if (__atomic_load_n(&m_tail, __ATOMIC_SEQ_CST) != head - PIPE_BUFFER_SIZE || __atomic_load_n(&m_readers, __ATOMIC_SEQ_CST) == 0) {
+                    __atomic_store_n(&m_writerWaiting, 0, __ATOMIC_RELAXED);
+                    continue;
+                }
+                m_spaceReady.Wait();
+                continue;
+            }
+
+            uint64_t offset = head & (PIPE_BUFFER_SIZE - 1);
+            uint64_t chunk = MIN(MIN(space, uio->GetResidual()), PIPE_BUFFER_SIZE - offset);
+            size_t start = uio->GetTransferred();
+            rc = uio->CopyIn(&m_buffer[offset], chunk);
+            uint64_t copied = uio->GetTransferred() - start;
+            head += copied;
+            done += copied;
+
+            // publish each chunk straight away so the reader can start while a big write is still going
+            __atomic_store_n(&m_head, head, __ATOMIC_RELEASE);
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            if (__atomic_exchange_n(&m_readerWaiting, 0, __ATOMIC_SEQ_CST))
+                m_dataReady.Signal();
+            m_readWatchers.Notify(EPOLLIN);
+
+            if (rc < 0)
+                break;
+        }
+
+        m_writeLock.Unlock();
+        return done > 0 ? ESUCCESS : rc;
+    }
+
+    uint32_t Pipe::Poll(bool write) const {
+        uint64_t used = __atomic_load_n(&m_head, __ATOMIC_ACQUIRE) - __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE);
+        uint32_t events = 0;
+        if (write) {
+            if (used < PIPE_BUFFER_SIZE)
+                events |= EPOLLOUT;
+            if (__atomic_load_n(&m_readers, __ATOMIC_ACQUIRE) == 0)
+                events |= EPOLLERR;
+        } else {
+            if (used > 0)
+                events |= EPOLLIN;
+            if (__atomic_load_n(&m_writers, __ATOMIC_ACQUIRE) == 0)
+                events |= EPOLLHUP;
+        }
+        return events;
+    }
+
+    PollWatchers* Pipe::GetWatchers(bool write) {
+        return write ? &m_writeWatchers : &m_readWatchers;
+    }
+
+}
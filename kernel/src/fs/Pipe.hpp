@@ -0,0 +1,82 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _PIPE_HPP
+#define _PIPE_HPP
+
+#include <stdint.h>
+#include <util.h>
+
+#include "EventPoll.hpp"
+
+#include <Scheduling/Mutex.hpp>
+#include <Scheduling/Semaphore.hpp>
+
+#define PIPE_BUFFER_PAGES 16
+#define PIPE_BUFFER_SIZE (PIPE_BUFFER_PAGES * PAGE_SIZE) // must be a power of 2
+
+namespace FS {
+
+    class UIO;
+
+    // The data path is a single-producer/single-consumer ring: m_head is only stored by the writer and m_tail by the reader.
+    // Extra readers or writers (after fork) queue on m_readLock/m_writeLock, so the ring itself never sees more than one of each.
+    class Pipe {
+    public:
+        Pipe();
+        ~Pipe();
+
+        bool Init();
+
+        void Open(bool write); // adds a reference to one end
+        bool Close(bool write); // returns true once both ends are fully closed and the pipe can be deleted
+
+        void Ref(); // keeps the pipe alive without opening an end, e.g. across a blocking read
+        bool Unref(); // returns true if the pipe can be deleted
+
+        // Progress is reported through uio. A read that transfers nothing without an error is end of file.
+        // Errors are only returned when nothing was transferred.
+        int Read(UIO* uio, bool nonBlock);
+        int Write(UIO* uio, bool nonBlock); // -EPIPE once there are no readers
+
+        uint32_t Poll(bool write) const; // EPOLL* events, lock-free
+        PollWatchers* GetWatchers(bool write);
+
+    private:
+        uint8_t* m_buffer;
+        uint64_t m_head; // total bytes written
+        uint64_t m_tail; // total bytes read
+
+        uint32_t m_readers;
+        uint32_t m_writers;
+        uint32_t m_refCount; // readers + writers + Ref() holders
+
+        uint32_t m_readerWaiting;
+        uint32_t m_writerWaiting;
+        Semaphore m_dataReady;
+        Semaphore m_spaceReady;
+
+        Mutex m_readLock;
+        Mutex m_writeLock;
+
+        PollWatchers m_readWatchers;
+        PollWatchers m_writeWatchers;
+    };
+
+}
+
+#endif /* _PIPE_HPP */
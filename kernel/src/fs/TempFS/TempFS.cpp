@@ -20,15 +20,20 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <errno.h>
 #include <stddef.h>
+#include <spinlock.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <util.h>
 
 #include <DataStructures/AVLTree.hpp>
 
 #include <Memory/PageMapper.hpp>
+#include <Memory/PagingUtil.hpp>
+#include <Memory/PMM.hpp>
 #include <Memory/VMM.hpp>
 
+#include "../NameCache.hpp"
 #include "../VFS.hpp"
 
 #define ROOT_DIR_MODE 0755
@@ -87,12 +92,13 @@ namespace FS {
     }
 
     
-    TempFSVNode::TempFSVNode(VFS* vfs) : VNode(vfs), m_name(nullptr), m_nameLen(0), m_memObj(nullptr), m_blocks(), m_children() {
+    TempFSVNode::TempFSVNode(VFS* vfs) : VNode(vfs), m_name(nullptr), m_nameLen(0), m_memObj(nullptr), m_defaultProt(VMM::Protection::READ_WRITE), m_extents(), m_allocatedPages(0), m_children(), m_childTable(nullptr), m_childBuckets(0), m_hashNext(nullptr), m_nameHash(0) {
 
     }
 
     TempFSVNode::~TempFSVNode() {
-
+        delete[] m_childTable;
+        delete[] m_name;
     }
 
     int TempFSVNode::Open(int flags, Credential cred) {
@@ -103,165 +109,31 @@ namespace FS {
         return ESUCCESS;
     }
 
-    int TempFSVNode::Read(void* out, size_t size, int flags, uint64_t offset, size_t* bytesRead, Credential cred) {
+    int TempFSVNode::Read(UIO* uio, int flags, uint64_t offset, Credential cred) {
         if (offset >= m_attr.size)
-            return -EINVAL;
-
-        if (offset + size > m_attr.size)
-            size = m_attr.size - offset;
-
-        size_t read = 0;
-        while (read < size) {
-            if (offset + read >= m_attr.size)
-                break;
-            uint64_t blockNum = (offset + read) >> PAGE_SIZE_SHIFT;
-            uint64_t blockOffset = (offset + read) % PAGE_SIZE;
-            AVLTree::wAVLTreeNode* node = m_blocks.FindNodeOrLower(blockNum);
-            if (node == nullptr || node->key + reinterpret_cast<Block*>(node->value)->pages <= blockNum) {
-                // we are in the range of the file, this block just doesn't exist
-                AVLTree::wAVLTreeNode* nextNode = m_blocks.FindNodeOrHigher(blockNum);
-                if (nextNode == nullptr || nextNode->key >= offset + size) {
-                    // just allocate a node from blockNum to end of requested region to read
-                    Block* block = CreateBlock(blockNum, DIV_ROUNDUP(size - read, PAGE_SIZE));
-                    if (block == nullptr) {
-                        *bytesRead = read;
-                        return -ENOMEM;
-                    }
-
-                    memcpy((void*)((uint64_t)out + read), (void*)((uint64_t)block->addr + blockOffset), size - read);
-                    read = size;
-                    break;
-                } else {
-                    // need to allocate a block to fill the gap
-                    Block* block = CreateBlock(blockNum, nextNode->key - blockNum);
-                    if (block == nullptr) {
-                        *bytesRead = read;
-                        return -ENOMEM;
-                    }
-
-                    memcpy((void*)((uint64_t)out + read), (void*)((uint64_t)block->addr + blockOffset), block->pages * PAGE_SIZE);
-                    read += block->pages * PAGE_SIZE;
-
-                    block = reinterpret_cast<Block*>(nextNode->value);
-                    uint64_t readSize = MIN(size - read, block->pages * PAGE_SIZE);
-                    memcpy((void*)((uint64_t)out + read), block->addr, readSize);
-                    read += readSize;
-
-                    if (read == size)
-                        break;
-                    else
-                        continue;
-                }
-            }
-            uint64_t actualBlockNum = node->key;
-            Block* block = reinterpret_cast<Block*>(node->value);
+            return ESUCCESS;
 
-            uint64_t readSize = MIN(size - read, (block->pages - (blockNum - actualBlockNum)) * PAGE_SIZE);
-            memcpy((void*)((uint64_t)out + read), (void*)((uint64_t)block->addr + (blockNum - actualBlockNum) * PAGE_SIZE + blockOffset), readSize);
-            read += readSize;
-        }
-        
-        
-        *bytesRead = read;
-        return ESUCCESS;
+        size_t size = MIN(uio->GetResidual(), m_attr.size - offset);
+        return Transfer(uio, offset, size, false);
     }
 
-    int TempFSVNode::Write(const void* in, size_t size, int flags, uint64_t offset, size_t* bytesWritten, Credential cred) {
-        size_t written = 0;
-        while (written < size) {
-            uint64_t blockNum = (offset + written) >> PAGE_SIZE_SHIFT;
-            uint64_t blockOffset = (offset + written) % PAGE_SIZE;
-            if (offset + written >= m_attr.blocks) {
-                Block* block = CreateBlock(blockNum, DIV_ROUNDUP(size - written, PAGE_SIZE));
-                if (block == nullptr) {
-                    *bytesWritten = written;
-                    return -ENOMEM;
-                }
-
-                memcpy((void*)((uint64_t)block->addr + blockOffset), (void*)((uint64_t)in + written), size - written);
-                m_attr.size += size - written;
-                m_attr.blocks += ALIGN_UP(size - written, PAGE_SIZE);
-                written = size;
-                break;
-            }
-
-            AVLTree::wAVLTreeNode* node = m_blocks.FindNodeOrLower(blockNum);
-            if (node == nullptr || node->key + reinterpret_cast<Block*>(node->value)->pages <= blockNum) {
-                // we are in the range of the file, this block just doesn't exist
-                AVLTree::wAVLTreeNode* nextNode = m_blocks.FindNodeOrHigher(blockNum);
-                if (nextNode == nullptr || nextNode->key >= offset + size) {
-                    // just allocate a node from blockNum to end of requested region to read
-                    Block* block = CreateBlock(blockNum, DIV_ROUNDUP(size - written, PAGE_SIZE));
-                    if (block == nullptr) {
-                        *bytesWritten = written;
-                        return -ENOMEM;
-                    }
-
-                    memcpy((void*)((uint64_t)block->addr + blockOffset), (void*)((uint64_t)in + written), size - written - blockOffset);
-                    written = size;
-                    break;
-                } else {
-                    // need to allocate a block to fill the gap
-                    Block* block = CreateBlock(blockNum, nextNode->key - blockNum);
-                    if (block == nullptr) {
-                        *bytesWritten = written;
-                        return -ENOMEM;
-                    }
-
-                    memcpy((void*)((uint64_t)block->addr + blockOffset), (void*)((uint64_t)in + written), block->pages * PAGE_SIZE - blockOffset);
-                    written += block->pages * PAGE_SIZE;
-
-                    block = reinterpret_cast<Block*>(nextNode->value);
-                    uint64_t writeSize = MIN(size - written, block->pages * PAGE_SIZE);
-                    memcpy(block->addr, (void*)((uint64_t)in + written), writeSize);
-                    written += writeSize;
-
-                    if (written == size)
-                        break;
-                    else
-                        continue;
-                }
-            }
-            uint64_t actualBlockNum = node->key;
-            Block* block = reinterpret_cast<Block*>(node->value);
-
-            uint64_t writeSize = MIN(size - written, (block->pages - (blockNum - actualBlockNum)) * PAGE_SIZE);
-            memcpy((void*)((uint64_t)block->addr + (blockNum - actualBlockNum) * PAGE_SIZE + blockOffset), (void*)((uint64_t)in + written), writeSize - blockOffset);
-            written += writeSize;
-        }
-        
-        
-        *bytesWritten = written;
-        return ESUCCESS;
+    int TempFSVNode::Write(UIO* uio, int flags, uint64_t offset, Credential cred) {
+        size_t before = uio->GetTransferred();
+        int rc = Transfer(uio, offset, uio->GetResidual(), true);
+        UpdateSize(offset + uio->GetTransferred() - before);
+        return rc;
     }
 
     int TempFSVNode::Lookup(const char* name, size_t nameLen, VNode** out, Credential cred) {
         if (name == nullptr || nameLen == 0)
             return -EINVAL;
 
-        struct SearchData {
-            const char* name;
-            size_t nameLen;
-            TempFSVNode* node;
-        } data = {name, nameLen, nullptr};
-
         m_children.lock();
-        m_children.Enumerate([](TempFSVNode* child, void* data) -> bool {
-            if (child == nullptr)
-                return false;
-
-            SearchData* d = static_cast<SearchData*>(data);
-            if (child->m_nameLen == d->nameLen && 0 == memcmp(child->m_name, d->name, d->nameLen)) {
-                d->node = child;
-                return false;
-            }
-
-            return true;
-        }, &data);
+        TempFSVNode* child = FindChild(name, nameLen, NameHash(name, nameLen));
         m_children.unlock();
 
-        if (data.node != nullptr) {
-            *out = data.node;
+        if (child != nullptr) {
+            *out = child;
             return ESUCCESS;
         }
 
@@ -283,6 +155,7 @@ namespace FS {
             newName[nameLen] = 0;
             m_name = newName;
             m_nameLen = nameLen;
+            m_nameHash = NameHash(newName, nameLen);
         }
 
         m_vfsMounted = nullptr;
@@ -294,6 +167,11 @@ namespace FS {
             TempFSVNode* fsVNode = static_cast<TempFSVNode*>(parent);
             fsVNode->m_children.lock();
             fsVNode->m_children.insert(this);
+            if (!fsVNode->InsertChild(this)) {
+                fsVNode->m_children.remove(this);
+                fsVNode->m_children.unlock();
+                return -ENOMEM;
+            }
             fsVNode->m_children.unlock();
         }
 
@@ -375,19 +253,24 @@ namespace FS {
     }
 
     int TempFSVNode::Mmap(uint64_t offset, size_t size, VMM::MemoryObject** obj, Credential cred) {
-        if (offset + size > m_attr.blocks || obj == nullptr || size == 0 || (offset & (PAGE_SIZE - 1)) > 0 || (size & (PAGE_SIZE - 1)) > 0)
+        if (offset + size > ALIGN_UP(m_attr.size, PAGE_SIZE) || obj == nullptr || size == 0 || (offset & (PAGE_SIZE - 1)) > 0 || (size & (PAGE_SIZE - 1)) > 0)
             return -EINVAL;
 
+        // The object's pages are the extents' pages, handed out by the pager as they are faulted in
+        spinlock_acquire(&m_extentLock);
         if (m_memObj == nullptr) {
-            m_blocks.lock();
-            bool empty = m_blocks.isEmpty();
-            m_blocks.unlock();
-            if (empty)
-                return -EINVAL;
-            Block* b = CreateBlock(0, 1);
-            if (b == nullptr || m_memObj == nullptr)
+            VMM::MemoryObject* newObj = static_cast<VMM::MemoryObject*>(kcalloc_vmm(1, sizeof(VMM::MemoryObject)));
+            if (newObj == nullptr) {
+                spinlock_release(&m_extentLock);
                 return -ENOMEM;
+            }
+            newObj->pager = static_cast<TempFS*>(m_vfs)->GetPager();
+            newObj->pagerData = this;
+            newObj->size = DIV_ROUNDUP(m_attr.size, PAGE_SIZE);
+            newObj->refCount = 1; // held by this vnode
+            __atomic_store_n(&m_memObj, newObj, __ATOMIC_RELEASE);
         }
+        spinlock_release(&m_extentLock);
 
         *obj = m_memObj;
         return ESUCCESS;
@@ -413,32 +296,243 @@ namespace FS {
         return ESUCCESS;
     }
 
-    void* TempFSVNode::GetAddr(uint64_t offset) {
-        AVLTree::wAVLTreeNode* node = m_blocks.FindNodeOrLower(offset);
-        if (node == nullptr || node->value == 0)
-            return nullptr;
-        Block* block = reinterpret_cast<Block*>(node->value);
-        if (offset >= node->key + block->pages * PAGE_SIZE)
-            return nullptr;
-        return (void*)((uint64_t)block->addr + (offset - node->key));
+    int TempFSVNode::Allocate(uint64_t offset, uint64_t size, Credential cred) {
+        if (size == 0)
+            return -EINVAL;
+        if (m_attr.type != VType::REG)
+            return -ENODEV;
+        uint64_t end = offset + size;
+        if (end < offset)
+            return -EFBIG;
+
+        uint64_t page = offset >> PAGE_SIZE_SHIFT;
+        uint64_t endPage = DIV_ROUNDUP(end, PAGE_SIZE);
+        spinlock_acquire(&m_extentLock);
+        while (page < endPage) {
+            uint64_t nextStart;
+            Extent* extent = FindExtent(page, &nextStart);
+            if (extent == nullptr) {
+                extent = CreateExtent(page, MIN(endPage, nextStart) - page);
+                if (extent == nullptr) {
+                    spinlock_release(&m_extentLock);
+                    return -ENOSPC;
+                }
+            }
+            page = extent->start + extent->pages;
+        }
+        spinlock_release(&m_extentLock);
+
+        UpdateSize(end);
+        return ESUCCESS;
+    }
+
+    int TempFSVNode::AdoptPages(uint64_t page, uint64_t phys, uint64_t pages) {
+        if (pages == 0 || (phys & (PAGE_SIZE - 1)) > 0)
+            return -EINVAL;
+
+        spinlock_acquire(&m_extentLock);
+        uint64_t nextStart;
+        if (FindExtent(page, &nextStart) != nullptr || page + pages > nextStart) {
+            spinlock_release(&m_extentLock);
+            return -EEXIST;
+        }
+        Extent* extent = InsertExtent(page, pages, phys);
+        spinlock_release(&m_extentLock);
+        if (extent == nullptr)
+            return -ENOMEM;
+
+        UpdateSize((page + pages) << PAGE_SIZE_SHIFT);
+        return ESUCCESS;
+    }
+
+    uint64_t TempFSVNode::GetPagePhys(uint64_t page) {
+        spinlock_acquire(&m_extentLock);
+        uint64_t nextStart;
+        Extent* extent = FindExtent(page, &nextStart);
+        if (extent == nullptr)
+            extent = CreateExtent(page, 1);
+        uint64_t phys = extent == nullptr ? 0 : extent->phys + ((page - extent->start) << PAGE_SIZE_SHIFT);
+        spinlock_release(&m_extentLock);
+        return phys;
+    }
+
+    uint64_t TempFSVNode::GetExtentCount() {
+        uint64_t count = 0;
+        spinlock_acquire(&m_extentLock);
+        m_extents.forEach([](void* data, uint64_t, Extent*) -> void {
+            (*static_cast<uint64_t*>(data))++;
+        }, &count);
+        spinlock_release(&m_extentLock);
+        return count;
     }
 
     VMM::Protection TempFSVNode::GetDefaultProt() const {
         return m_defaultProt;
     }
 
-    TempFSVNode::Block* TempFSVNode::CreateBlock(uint64_t offset, uint64_t pages) {
-        Block* block = new Block;
-        block->pages = pages;
-        block->addr = VMM::g_KVMM->AllocMemObjAnonPages(pages, this, offset, VMM::DEFAULT_KALLOC_FLAGS, &m_memObj, static_cast<TempFS*>(m_vfs)->GetPager());
-        if (block->addr == nullptr) {
-            delete block;
+    bool TempFSVNode::InsertChild(TempFSVNode* child) {
+        // keep the load factor at or below 1
+        if (m_children.getCount() > m_childBuckets) {
+            size_t newBuckets = m_childBuckets == 0 ? TEMPFS_MIN_CHILD_BUCKETS : m_childBuckets * 2;
+            TempFSVNode** newTable = new TempFSVNode*[newBuckets];
+            if (newTable != nullptr) {
+                memset(newTable, 0, sizeof(TempFSVNode*) * newBuckets);
+                for (size_t i = 0; i < m_childBuckets; i++) {
+                    TempFSVNode* node = m_childTable[i];
+                    while (node != nullptr) {
+                        TempFSVNode* next = node->m_hashNext;
+                        TempFSVNode** bucket = &newTable[node->m_nameHash & (newBuckets - 1)];
+                        node->m_hashNext = *bucket;
+                        *bucket = node;
+                        node = next;
+                    }
+                }
+                delete[] m_childTable;
+                m_childTable = newTable;
+                m_childBuckets = newBuckets;
+            }
+        }
+
+        if (m_childBuckets == 0)
+            return false; // out of memory for the first table
+        TempFSVNode** bucket = &m_childTable[child->m_nameHash & (m_childBuckets - 1)];
+        child->m_hashNext = *bucket;
+        *bucket = child;
+        return true;
+    }
+
+    TempFSVNode* TempFSVNode::FindChild(const char* name, size_t nameLen, uint64_t hash) {
+        if (m_childBuckets == 0)
             return nullptr;
+        for (TempFSVNode* child = m_childTable[hash & (m_childBuckets - 1)]; child != nullptr; child = child->m_hashNext) {
+            if (child->m_nameHash == hash && child->m_nameLen == nameLen && memcmp(child->m_name, name, nameLen) == 0)
+                return child;
+        }
+        return nullptr;
+    }
+
+    TempFSVNode::Extent* TempFSVNode::FindExtent(uint64_t page, uint64_t* nextStart) {
+        AVLTree::wAVLTreeNode* node = m_extents.FindNodeOrLower(page);
+        if (node != nullptr) {
+            Extent* extent = reinterpret_cast<Extent*>(node->value);
+            if (extent->start + extent->pages > page)
+                return extent;
+        }
+        AVLTree::wAVLTreeNode* next = m_extents.FindNodeOrHigher(page);
+        *nextStart = next == nullptr ? UINT64_MAX : next->key;
+        return nullptr;
+    }
+
+    TempFSVNode::Extent* TempFSVNode::CreateExtent(uint64_t page, uint64_t pages) {
+        // take a smaller run rather than fail when memory is fragmented
+        uint64_t count = pages;
+        void* phys = g_PMM->AllocatePages(count);
+        while (phys == nullptr && count > 1) {
+            count /= 2;
+            phys = g_PMM->AllocatePages(count);
+        }
+        if (phys == nullptr)
+            return nullptr;
+        memset(to_HHDM(phys), 0, count << PAGE_SIZE_SHIFT);
+
+        Extent* extent = InsertExtent(page, count, (uint64_t)phys);
+        if (extent == nullptr)
+            g_PMM->FreePages(phys, count);
+        return extent;
+    }
+
+    TempFSVNode::Extent* TempFSVNode::InsertExtent(uint64_t page, uint64_t count, uint64_t phys) {
+        // merge with the neighbours when both the file and physical ranges line up
+        Extent* extent = nullptr;
+        if (page > 0) {
+            AVLTree::wAVLTreeNode* prevNode = m_extents.FindNodeOrLower(page - 1);
+            if (prevNode != nullptr) {
+                Extent* prev = reinterpret_cast<Extent*>(prevNode->value);
+                if (prev->start + prev->pages == page && prev->phys + (prev->pages << PAGE_SIZE_SHIFT) == phys) {
+                    prev->pages += count;
+                    extent = prev;
+                }
+            }
         }
+        if (extent == nullptr) {
+            extent = new Extent{page, count, phys};
+            if (extent == nullptr)
+                return nullptr;
+            m_extents.Insert(page, extent);
+        }
+        m_allocatedPages += count;
+
+        AVLTree::wAVLTreeNode* nextNode = m_extents.FindNode(page + count);
+        if (nextNode != nullptr) {
+            Extent* next = reinterpret_cast<Extent*>(nextNode->value);
+            if (extent->phys + (extent->pages << PAGE_SIZE_SHIFT) == next->phys) {
+                extent->pages += next->pages;
+                m_extents.RemoveNode(nextNode);
+                delete next;
+            }
+        }
+        return extent;
+    }
+
+    // Copies between the uio and [offset, offset + size) an extent or hole at a time. The extent lock isn't held across the copy as it can fault into the pager.
+    int TempFSVNode::Transfer(UIO* uio, uint64_t offset, size_t size, bool write) {
+        uint64_t endPage = DIV_ROUNDUP(offset + size, PAGE_SIZE);
+        size_t done = 0;
+        while (done < size) {
+            uint64_t pos = offset + done;
+            uint64_t page = pos >> PAGE_SIZE_SHIFT;
+
+            spinlock_acquire(&m_extentLock);
+            uint64_t nextStart;
+            Extent* extent = FindExtent(page, &nextStart);
+            if (extent == nullptr && write) {
+                // Appending past the last extent preallocates in proportion to what is already allocated, so files grown by small writes end up in a few large extents
+                uint64_t pages = MIN(endPage, nextStart) - page;
+                if (nextStart == UINT64_MAX)
+                    pages = MAX(pages, MIN(MAX(m_allocatedPages, 1), TEMPFS_MAX_EXTENT_PAGES));
+                extent = CreateExtent(page, pages);
+                if (extent == nullptr) {
+                    spinlock_release(&m_extentLock);
+                    return -ENOSPC;
+                }
+            }
 
-        m_defaultProt = VMM::Protection::READ_WRITE;
-        m_blocks.Insert(offset, block);
-        return block;
+            uint8_t* addr = nullptr;
+            uint64_t avail;
+            if (extent != nullptr) {
+                uint64_t extentOffset = pos - (extent->start << PAGE_SIZE_SHIFT);
+                addr = static_cast<uint8_t*>(to_HHDM(reinterpret_cast<void*>(extent->phys))) + extentOffset;
+                avail = (extent->pages << PAGE_SIZE_SHIFT) - extentOffset;
+            } else
+                avail = nextStart == UINT64_MAX ? size - done : (nextStart << PAGE_SIZE_SHIFT) - pos;
+            spinlock_release(&m_extentLock);
+
+            size_t chunk = MIN(size - done, avail);
+            int rc;
+            if (addr == nullptr)
+                rc = uio->Zero(chunk); // holes read as zeroes without being allocated
+            else
+                rc = write ? uio->CopyIn(addr, chunk) : uio->CopyOut(addr, chunk);
+            if (rc < 0)
+                return rc;
+            done += chunk;
+        }
+        return ESUCCESS;
+    }
+
+    void TempFSVNode::UpdateSize(uint64_t end) {
+        if (end > m_attr.size)
+            m_attr.size = end;
+        m_attr.blocks = __atomic_load_n(&m_allocatedPages, __ATOMIC_RELAXED) << PAGE_SIZE_SHIFT;
+
+        VMM::MemoryObject* obj = __atomic_load_n(&m_memObj, __ATOMIC_ACQUIRE);
+        if (obj != nullptr) {
+            spinlock_acquire(&obj->lock);
+            uint64_t pages = DIV_ROUNDUP(m_attr.size, PAGE_SIZE);
+            if (pages > obj->size)
+                obj->size = pages;
+            spinlock_release(&obj->lock);
+        }
     }
 
-}
\ No newline at end of file
+}
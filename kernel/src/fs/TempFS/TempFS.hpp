@@ -18,6 +18,10 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #ifndef _TEMPFS_HPP
 #define _TEMPFS_HPP
 
+#define TEMPFS_MIN_CHILD_BUCKETS 16
+#define TEMPFS_MAX_EXTENT_PAGES 512 // cap on how far an appending write preallocates
+
+#include <spinlock.h>
 #include <stdint.h>
 
 #include <DataStructures/AVLTree.hpp>
@@ -59,8 +63,10 @@ namespace FS {
 
         virtual int Open(int flags, Credential cred) override;
         virtual int Close(int flags, Credential cred) override;
-        virtual int Read(void* out, size_t size, int flags, uint64_t offset, size_t* bytesRead, Credential cred) override;
-        virtual int Write(const void* in, size_t size, int flags, uint64_t offset, size_t* bytesWritten, Credential cred) override;
+        virtual int Read(UIO* uio, int flags, uint64_t offset, Credential cred) override;
+        virtual int Write(UIO* uio, int flags, uint64_t offset, Credential cred) override;
+        using VNode::Read;
+        using VNode::Write;
         virtual int Lookup(const char* name, size_t nameLen, VNode** out, Credential cred) override;
         virtual int Create(VNode* parent, const char* name, size_t nameLen, VAttr* attr, Credential cred) override; // Verifying that a child vnode with the same name doesn't already exist is up to the caller.
         virtual int GetAttr(VAttr* out) override;
@@ -76,17 +82,32 @@ namespace FS {
         virtual int Resize() override;
         virtual int Rename() override;
         virtual int GetName(char* buf, size_t size, size_t* realSize) override; // copy the null-terminated name into buf
+        virtual int Allocate(uint64_t offset, uint64_t size, Credential cred) override;
 
-        void* GetAddr(uint64_t offset);
+        int AdoptPages(uint64_t page, uint64_t phys, uint64_t pages); // use already filled physical pages as the storage for a hole, and extend the size over them
+        uint64_t GetPagePhys(uint64_t page); // physical address backing a file page, allocating it if it is in a hole. 0 if out of memory
+        uint64_t GetExtentCount();
         VMM::Protection GetDefaultProt() const;
 
     private:
-        struct Block {
-            void* addr;
-            size_t pages;
+        // A physically contiguous run of file pages, accessed through the HHDM
+        struct Extent {
+            uint64_t start; // in pages
+            uint64_t pages;
+            uint64_t phys;
         };
 
-        Block* CreateBlock(uint64_t offset, uint64_t pages); // offset and pages are page count numbers, not bytes
+        // m_children must be locked for these
+        bool InsertChild(TempFSVNode* child); // fails only if the first table can't be allocated
+        TempFSVNode* FindChild(const char* name, size_t nameLen, uint64_t hash);
+
+        // m_extentLock must be held for these
+        Extent* FindExtent(uint64_t page, uint64_t* nextStart); // nullptr in a hole, nextStart is set to the start of the next extent or UINT64_MAX
+        Extent* CreateExtent(uint64_t page, uint64_t pages); // may allocate fewer pages than asked for, but at least 1
+        Extent* InsertExtent(uint64_t page, uint64_t pages, uint64_t phys); // merges with the neighbours where possible
+
+        int Transfer(UIO* uio, uint64_t offset, size_t size, bool write);
+        void UpdateSize(uint64_t end);
 
         char* m_name;
         size_t m_nameLen;
@@ -94,8 +115,16 @@ namespace FS {
         VMM::MemoryObject* m_memObj;
         VMM::Protection m_defaultProt;
 
-        AVLTree::wAVLTree<uint64_t, Block*> m_blocks;
-        LinkedList::RearInsertLinkedList<TempFSVNode> m_children;
+        AVLTree::wAVLTree<uint64_t, Extent*> m_extents; // keyed by start page, extents are never shrunk or freed
+        uint64_t m_allocatedPages;
+        spinlock_new(m_extentLock); // the pager takes this with the memory object locked, so it can't be a mutex
+        LinkedList::RearInsertLinkedList<TempFSVNode> m_children; // creation order, for GetDents
+
+        // Children hashed by name. Chained through m_hashNext, and protected by m_children's lock.
+        TempFSVNode** m_childTable;
+        size_t m_childBuckets; // power of 2, 0 until the first child
+        TempFSVNode* m_hashNext;
+        uint64_t m_nameHash;
     };
 }
 
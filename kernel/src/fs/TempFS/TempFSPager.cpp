@@ -22,6 +22,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <stdint.h>
 #include <spinlock.h>
+#include <stdlib.h>
 #include <string.h>
 #include <util.h>
 
@@ -58,7 +59,11 @@ namespace FS {
             page = static_cast<VMM::Page*>(kcalloc_vmm(1, sizeof(VMM::Page)));
             if (page == nullptr)
                 return false;
-            page->physAddr = (uint64_t)AllocatePage();
+            page->physAddr = vnode->GetPagePhys(offset >> PAGE_SIZE_SHIFT); // the file's own storage, so writes through the mapping and the vnode agree
+            if (page->physAddr == 0) {
+                kfree_vmm(page);
+                return false;
+            }
             page->protection = vnode->GetDefaultProt();
             obj->pages.Insert(offset, page);
         }
@@ -0,0 +1,108 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "UIO.hpp"
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <util.h>
+
+#include <Memory/UserAccess.hpp>
+
+#define UIO_ZERO_CHUNK 512
+
+namespace FS {
+
+    static const uint8_t g_zeroes[UIO_ZERO_CHUNK] = {};
+
+    UIO::UIO(IOVec* iov, size_t iovCount, UIOSpace space) : m_single{nullptr, 0}, m_iov(iov), m_iovCount(iovCount), m_index(0), m_iovOffset(0), m_residual(0), m_transferred(0), m_space(space) {
+        for (size_t i = 0; i < iovCount; i++)
+            m_residual += iov[i].length;
+    }
+
+    UIO::UIO(void* buf, size_t size, UIOSpace space) : m_single{buf, size}, m_iov(&m_single), m_iovCount(1), m_index(0), m_iovOffset(0), m_residual(size), m_transferred(0), m_space(space) {
+
+    }
+
+    int UIO::CopyOut(const void* src, size_t size) {
+        return Move(const_cast<void*>(src), size, true);
+    }
+
+    int UIO::CopyIn(void* dst, size_t size) {
+        return Move(dst, size, false);
+    }
+
+    int UIO::Zero(size_t size) {
+        size = MIN(size, m_residual);
+        while (size > 0) {
+            size_t chunk = MIN(size, UIO_ZERO_CHUNK);
+            int rc = Move(const_cast<uint8_t*>(g_zeroes), chunk, true);
+            if (rc < 0)
+                return rc;
+            size -= chunk;
+        }
+        return ESUCCESS;
+    }
+
+    size_t UIO::GetResidual() const {
+        return m_residual;
+    }
+
+    size_t UIO::GetTransferred() const {
+        return m_transferred;
+    }
+
+    int UIO::Move(void* kBuf, size_t size, bool out) {
+        uint8_t* k = static_cast<uint8_t*>(kBuf);
+        size = MIN(size, m_residual);
+        while (size > 0) {
+            IOVec* iov = &m_iov[m_index];
+            size_t chunk = MIN(size, iov->length - m_iovOffset);
+            if (chunk > 0) {
+                uint8_t* buf = static_cast<uint8_t*>(iov->base) + m_iovOffset;
+                if (m_space == UIOSpace::KERNEL) {
+                    if (out)
+                        memcpy(buf, k, chunk);
+                    else
+                        memcpy(k, buf, chunk);
+                } else {
+                    size_t copied;
+                    int rc = out ? CopyToUser(buf, k, chunk, &copied) : CopyFromUser(k, buf, chunk, &copied);
+                    if (rc < 0) {
+                        // count what made it before the fault, so callers can return a short count
+                        m_iovOffset += copied;
+                        m_residual -= copied;
+                        m_transferred += copied;
+                        return rc;
+                    }
+                }
+                k += chunk;
+                size -= chunk;
+                m_iovOffset += chunk;
+                m_residual -= chunk;
+                m_transferred += chunk;
+            }
+            if (m_iovOffset == iov->length) {
+                m_index++;
+                m_iovOffset = 0;
+            }
+        }
+        return ESUCCESS;
+    }
+
+}
@@ -0,0 +1,68 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef _UIO_HPP
+#define _UIO_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define UIO_MAX_IOV 1024
+#define UIO_BOUNCE_SIZE 256 // for backends that need a kernel buffer, like TTYs
+
+namespace FS {
+
+    // Same layout as the POSIX struct iovec
+    struct IOVec {
+        void* base;
+        size_t length;
+    };
+
+    enum class UIOSpace {
+        KERNEL,
+        USER
+    };
+
+    // Describes the caller's side of a read or write as a list of buffers, so file systems can copy straight to or from them.
+    class UIO {
+    public:
+        UIO(IOVec* iov, size_t iovCount, UIOSpace space);
+        UIO(void* buf, size_t size, UIOSpace space); // single buffer
+
+        // Both advance by up to size bytes, stopping at the end of the buffers. Return -EFAULT on a bad user buffer.
+        int CopyOut(const void* src, size_t size); // src -> buffers, for reads
+        int CopyIn(void* dst, size_t size); // buffers -> dst, for writes
+        int Zero(size_t size); // zero fill the buffers, for reading holes
+
+        size_t GetResidual() const; // bytes left to transfer
+        size_t GetTransferred() const;
+
+    private:
+        int Move(void* kBuf, size_t size, bool out);
+
+        IOVec m_single;
+        IOVec* m_iov;
+        size_t m_iovCount;
+        size_t m_index;
+        size_t m_iovOffset;
+        size_t m_residual;
+        size_t m_transferred;
+        UIOSpace m_space;
+    };
+
+}
+
+#endif /* _UIO_HPP */
@@ -15,6 +15,7 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include "NameCache.hpp"
 #include "VFS.hpp"
 
 #include "TempFS/TempFS.hpp"
@@ -89,6 +90,20 @@ namespace FS {
         m_lock.Unlock();
     }
 
+    int VNode::Read(void* out, size_t size, int flags, uint64_t offset, size_t* bytesRead, Credential cred) {
+        UIO uio(out, size, UIOSpace::KERNEL);
+        int rc = Read(&uio, flags, offset, cred);
+        *bytesRead = uio.GetTransferred();
+        return rc;
+    }
+
+    int VNode::Write(const void* in, size_t size, int flags, uint64_t offset, size_t* bytesWritten, Credential cred) {
+        UIO uio(const_cast<void*>(in), size, UIOSpace::KERNEL);
+        int rc = Write(&uio, flags, offset, cred);
+        *bytesWritten = uio.GetTransferred();
+        return rc;
+    }
+
     // Increment refCount of a VNode, and delete it if refCount is 0.
     void RefVNode(VNode* node) {
         node->GetRefCount()++;
@@ -98,8 +113,30 @@ namespace FS {
     void UnrefVNode(VNode* node) {
         int& refCount = node->GetRefCount();
         refCount--;
-        if (refCount == 0)
+        if (refCount == 0) {
+            NameCache_PurgeVNode(node);
             delete node;
+        }
+    }
+
+    // Lookup through the name cache
+    static int LookupChild(VNode* dir, const char* name, size_t nameLen, VNode** out, Credential cred) {
+        switch (NameCache_Lookup(dir, name, nameLen, out)) {
+        case NameCacheResult::HIT:
+            return ESUCCESS;
+        case NameCacheResult::NEGATIVE:
+            return -ENOENT;
+        case NameCacheResult::MISS:
+            break;
+        }
+
+        uint64_t generation = NameCache_GetGeneration();
+        int rc = dir->Lookup(name, nameLen, out, cred);
+        if (rc == ESUCCESS)
+            NameCache_Enter(dir, name, nameLen, *out, generation);
+        else if (rc == -ENOENT)
+            NameCache_Enter(dir, name, nameLen, nullptr, generation);
+        return rc;
     }
 
     int VFS_Init() {
@@ -173,7 +210,7 @@ namespace FS {
                 if (currentVNode->GetType() != VType::DIR)
                     return -ENOTDIR;
                 VNode* next = nullptr;
-                int rc = currentVNode->Lookup(currentPath, len, &next, cred);
+                int rc = LookupChild(currentVNode, currentPath, len, &next, cred);
                 if (rc < 0)
                     return rc;
                 currentVNode = next;
@@ -196,7 +233,7 @@ namespace FS {
                 if (currentVNode->GetType() != VType::DIR)
                     return -ENOTDIR;
                 VNode* nextVNode = nullptr;
-                int rc = currentVNode->Lookup(currentPath, len, &nextVNode, cred);
+                int rc = LookupChild(currentVNode, currentPath, len, &nextVNode, cred);
                 if (rc < 0)
                     return rc;
                 currentVNode = nextVNode;
@@ -219,7 +256,7 @@ namespace FS {
         return ESUCCESS;
     }
 
-    int VFS_CreateDir(const char* path, const char* name, VNode* cwd, Credential cred) {
+    int VFS_CreateDir(const char* path, const char* name, VNode* cwd, Credential cred, VNode** out) {
         if (path == nullptr || name == nullptr)
             return -EINVAL;
 
@@ -251,10 +288,14 @@ namespace FS {
             return rc;
         }
 
+        NameCache_Remove(parent, name, nameLen); // drop any negative entry
+
+        if (out != nullptr)
+            *out = vnode;
         return ESUCCESS;
     }
 
-    int VFS_CreateFile(const char* path, const char* name, VNode* cwd, Credential cred) {
+    int VFS_CreateFile(const char* path, const char* name, VNode* cwd, Credential cred, VNode** out) {
         if (path == nullptr || name == nullptr)
             return -EINVAL;
 
@@ -286,6 +327,10 @@ namespace FS {
             return rc;
         }
 
+        NameCache_Remove(parent, name, nameLen); // drop any negative entry
+
+        if (out != nullptr)
+            *out = vnode;
         return ESUCCESS;
     }
 
@@ -18,6 +18,8 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #ifndef _VFS_HPP
 #define _VFS_HPP
 
+#include "UIO.hpp"
+
 #include <stdint.h>
 
 #include <Scheduling/Mutex.hpp>
@@ -114,8 +116,8 @@ namespace FS {
 
         virtual int Open(int flags, Credential cred) = 0;
         virtual int Close(int flags, Credential cred) = 0;
-        virtual int Read(void* out, size_t size, int flags, uint64_t offset, size_t* bytesRead, Credential cred) = 0;
-        virtual int Write(const void* in, size_t size, int flags, uint64_t offset, size_t* bytesWritten, Credential cred) = 0;
+        virtual int Read(UIO* uio, int flags, uint64_t offset, Credential cred) = 0; // up to uio's residual, the amount moved is uio's transferred count
+        virtual int Write(UIO* uio, int flags, uint64_t offset, Credential cred) = 0;
         virtual int Lookup(const char* name, size_t nameLen, VNode** out, Credential cred) = 0;
         virtual int Create(VNode* parent, const char* name, size_t nameLen, VAttr* attr, Credential cred) = 0;
         virtual int GetAttr(VAttr* out) = 0;
@@ -131,6 +133,7 @@ namespace FS {
         virtual int Resize() = 0;
         virtual int Rename() = 0;
         virtual int GetName(char* buf, size_t size, size_t* realSize) = 0;
+        virtual int Allocate(uint64_t offset, uint64_t size, Credential cred) = 0; // back [offset, offset + size) with storage, extending the size to cover it
 
         virtual VFS* GetVFS();
         virtual VFS* GetMountedVFS();
@@ -141,6 +144,10 @@ namespace FS {
         virtual void Lock();
         virtual void Unlock();
 
+        // Wrappers around the UIO versions for kernel buffers
+        int Read(void* out, size_t size, int flags, uint64_t offset, size_t* bytesRead, Credential cred);
+        int Write(const void* in, size_t size, int flags, uint64_t offset, size_t* bytesWritten, Credential cred);
+
     protected:
         VAttr m_attr;
         Mutex m_lock;
@@ -157,8 +164,8 @@ namespace FS {
     int VFS_MountRoot(FSType type, int flags, void* backing, Credential cred); // flags and backing are currently unusued
     int VFS_LookupPath(const char* path, VNode** vnode, VFS** vfs, VNode* cwd, Credential cred);
 
-    int VFS_CreateDir(const char* path, const char* name, VNode* cwd, Credential cred);
-    int VFS_CreateFile(const char* path, const char* name, VNode* cwd, Credential cred);
+    int VFS_CreateDir(const char* path, const char* name, VNode* cwd, Credential cred, VNode** out = nullptr); // out gets the new vnode, without an extra reference
+    int VFS_CreateFile(const char* path, const char* name, VNode* cwd, Credential cred, VNode** out = nullptr);
     int VFS_Open(const char* path, VNode** out, VNode* cwd, Credential cred);
     int VFS_Close(VNode* vnode, Credential cred);
 
@@ -26,8 +26,11 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <DataStructures/LinkedList.hpp>
 
+#include <Exec/VDSO.hpp>
+
 #include <fs/TempFS/TempFS.hpp>
 
+#include <fs/Benchmark.hpp>
 #include <fs/InitRAMFS.hpp>
 #include <fs/VFS.hpp>
 
@@ -35,8 +38,11 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <HAL/HAL.hpp>
 
+#include <Memory/Benchmark.hpp>
+#include <Memory/PagingUtil.hpp>
 #include <Memory/VMM.hpp>
 
+#include <Scheduling/Benchmark.hpp>
 #include <Scheduling/Process.hpp>
 #include <Scheduling/Scheduler.hpp>
 #include <Scheduling/Thread.hpp>
@@ -108,7 +114,7 @@ void StartKernel() {
     }
 
     KernelStage2Params* params = new KernelStage2Params;
-    params->initramfs = g_kernelParams.initramfs;
+    params->initramfs = g_kernelParams.initramfs == nullptr ? nullptr : to_HHDM((void*)((uint64_t)g_kernelParams.initramfs - g_kernelParams.HHDMStart)); // the bootloader's HHDM offset may differ from ours
     params->initramfsSize = g_kernelParams.initramfsSize;
 
     if (!KProcess.CreateMainThread({Kernel_Stage2, params}))
@@ -134,6 +140,18 @@ void Kernel_Stage2(void* data) {
 
     HAL_Stage2();
 
+    VDSO_Init();
+
+#if _FROSTYOS_ENABLE_SCHED_BENCHMARKS
+    Scheduler::RunYieldBenchmark(100'000);
+#endif
+
+#if _FROSTYOS_ENABLE_VM_BENCHMARKS
+    VMM::RunPageFaultBenchmark(4096, 1, false);
+    VMM::RunPageFaultBenchmark(4096, Scheduler::GetProcessorCount(), false);
+    VMM::RunPageFaultBenchmark(4096, Scheduler::GetProcessorCount(), true);
+#endif
+
     if (FS::VFS_Init() < 0)
         PANIC("VFS Init failed!");
 
@@ -142,6 +160,12 @@ void Kernel_Stage2(void* data) {
 
     printf("VFS root mounted!\n");
 
+#if _FROSTYOS_ENABLE_FS_BENCHMARKS
+    FS::RunTempFSBenchmark("tempfs-bench-small", 100, 100'000, KCred);
+    FS::RunTempFSBenchmark("tempfs-bench-page", PAGE_SIZE, 4096, KCred);
+    FS::RunIORingBenchmark(100'000, KCred);
+#endif
+
     if (params->initramfs != nullptr && params->initramfsSize > 0)
         LoadInitRAMFS(params->initramfs, params->initramfsSize);
     else
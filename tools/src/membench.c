@@ -0,0 +1,218 @@
+/*
+Copyright (©) 2026  Frosty515
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Microbenchmark for the kernel library's mem* and str* routines, which this is linked against.
+// Usage: membench [nt threshold in bytes]
+
+#define _POSIX_C_SOURCE 199309L // clock_gettime
+
+#include <cpuid.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <util.h> // the kernel one, found after the host headers
+
+#define MIN_SIZE 1
+#define MAX_SIZE (16 << 20)
+#define BYTES_PER_TEST (256 << 20) // each size moves about this much
+#define MOVE_OFFSET 64 // memmove copies between overlapping buffers this far apart
+
+// What the kernel library had before, for comparison
+static void* baseline_memcpy(void* dst, const void* src, size_t n) {
+    void* ret = dst;
+    __asm__ volatile("rep movsb" : "+D"(dst), "+S"(src), "+c"(n) : : "memory");
+    return ret;
+}
+
+static void* baseline_memset(void* dst, int value, size_t n) {
+    void* ret = dst;
+    __asm__ volatile("rep stosb" : "+D"(dst), "+c"(n) : "a"(value) : "memory");
+    return ret;
+}
+
+static void* baseline_memmove(void* dst, const void* src, size_t n) {
+    if (dst < src)
+        return baseline_memcpy(dst, src, n);
+    volatile uint8_t* d = dst;
+    const uint8_t* s = src;
+    for (size_t i = n; i > 0; i--)
+        d[i - 1] = s[i - 1];
+    return dst;
+}
+
+static int baseline_memcmp(const void* s1, const void* s2, size_t n) {
+    const volatile uint8_t* a = s1;
+    const uint8_t* b = s2;
+    for (size_t i = 0; i < n; i++) {
+        if (a[i] != b[i])
+            return a[i] > b[i] ? 1 : -1;
+    }
+    return 0;
+}
+
+static size_t baseline_strlen(const char* str) {
+    const volatile char* s = str;
+    size_t len = 0;
+    while (s[len] != 0)
+        len++;
+    return len;
+}
+
+enum Op {
+    OP_MEMCPY,
+    OP_MEMSET,
+    OP_MEMMOVE,
+    OP_MEMCMP,
+    OP_STRLEN,
+    OP_COUNT
+};
+
+static const char* g_opNames[OP_COUNT] = {"memcpy", "memset", "memmove", "memcmp", "strlen"};
+
+static uint8_t* g_dst;
+static uint8_t* g_src;
+static volatile size_t g_sink;
+
+static void RunOp(enum Op op, bool baseline, size_t n) {
+    switch (op) {
+    case OP_MEMCPY:
+        g_sink += (size_t)(baseline ? baseline_memcpy : memcpy)(g_dst, g_src, n);
+        break;
+    case OP_MEMSET:
+        g_sink += (size_t)(baseline ? baseline_memset : memset)(g_dst, (int)n, n);
+        break;
+    case OP_MEMMOVE:
+        g_sink += (size_t)(baseline ? baseline_memmove : memmove)(g_dst + MOVE_OFFSET, g_dst, n);
+        break;
+    case OP_MEMCMP:
+        g_sink += (baseline ? baseline_memcmp : memcmp)(g_dst, g_src, n);
+        break;
+    case OP_STRLEN:
+        g_sink += (baseline ? baseline_strlen : strlen)((const char*)g_src);
+        break;
+    default:
+        break;
+    }
+}
+
+static void Prepare(enum Op op, size_t n) {
+    switch (op) {
+    case OP_MEMCMP:
+        memset(g_src, 0x5A, n);
+        memset(g_dst, 0x5A, n); // equal, so the whole buffer is compared
+        break;
+    case OP_STRLEN:
+        memset(g_src, 'a', n);
+        g_src[n - 1] = 0;
+        break;
+    default:
+        break;
+    }
+}
+
+// returns ns per call
+static double Measure(enum Op op, bool baseline, size_t n) {
+    size_t iterations = BYTES_PER_TEST / n;
+    if (iterations < 16)
+        iterations = 16;
+    if (iterations > 10000000)
+        iterations = 10000000;
+
+    Prepare(op, n);
+    RunOp(op, baseline, n); // warm up
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < iterations; i++)
+        RunOp(op, baseline, n);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double ns = (double)(end.tv_sec - start.tv_sec) * 1e9 + (double)(end.tv_nsec - start.tv_nsec);
+    return ns / (double)iterations;
+}
+
+struct Variant {
+    const char* name;
+    uint32_t features;
+    size_t ntThreshold;
+};
+
+int main(int argc, char** argv) {
+    size_t ntThreshold = X86_64_MEM_NT_THRESHOLD;
+    if (argc > 1)
+        ntThreshold = strtoull(argv[1], NULL, 0);
+
+    // same bits x86_64_Processor::FillCPUInfo looks at
+    uint32_t eax, ebx, ecx, edx;
+    uint32_t cpuFeatures = 0;
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        if (ebx & (1 << 9))
+            cpuFeatures |= X86_64_MEM_ERMS;
+        if (edx & (1 << 4))
+            cpuFeatures |= X86_64_MEM_FSRM;
+    }
+    printf("CPU: ERMS %s, FSRM %s, non-temporal threshold %zu bytes\n", (cpuFeatures & X86_64_MEM_ERMS) ? "yes" : "no", (cpuFeatures & X86_64_MEM_FSRM) ? "yes" : "no", ntThreshold);
+
+    // baseline first, then the generic paths, then what the kernel would select
+    struct Variant variants[] = {
+        {"baseline", 0, SIZE_MAX},
+        {"generic", 0, SIZE_MAX},
+        {"generic+nt", 0, ntThreshold},
+        {"selected", cpuFeatures, ntThreshold},
+    };
+    size_t variantCount = sizeof(variants) / sizeof(variants[0]);
+
+    g_dst = aligned_alloc(4096, MAX_SIZE + 4096);
+    g_src = aligned_alloc(4096, MAX_SIZE + 4096);
+    if (g_dst == NULL || g_src == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    memset(g_dst, 0, MAX_SIZE + 4096);
+    memset(g_src, 0, MAX_SIZE + 4096);
+
+    for (int op = 0; op < OP_COUNT; op++) {
+        printf("\n%-10s", g_opNames[op]);
+        for (size_t v = 0; v < variantCount; v++)
+            printf(" %18s", variants[v].name);
+        printf("\n");
+        for (size_t n = MIN_SIZE; n <= MAX_SIZE; n *= 2) {
+            // powers of two and a size in between, so the tails get exercised
+            size_t sizes[2] = {n, n + n / 2};
+            for (int s = 0; s < 2; s++) {
+                if (sizes[s] > MAX_SIZE || (s == 1 && sizes[1] == sizes[0]))
+                    continue;
+                printf("%-10zu", sizes[s]);
+                for (size_t v = 0; v < variantCount; v++) {
+                    x86_64_SetMemFeatures(variants[v].features, variants[v].ntThreshold);
+                    double ns = Measure(op, v == 0, sizes[s]);
+                    printf(" %9.1fns %5.1fG/s", ns, (double)sizes[s] / ns);
+                }
+                printf("\n");
+            }
+        }
+    }
+
+    x86_64_SetMemFeatures(0, SIZE_MAX);
+    free(g_dst);
+    free(g_src);
+    return 0;
+}